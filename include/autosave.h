@@ -0,0 +1,115 @@
+#ifndef autosave_h
+#define autosave_h
+
+/*
+*  Background autosave of the active project.
+*
+*  The UI thread only takes a Document snapshot, which is O(1), and hands it to a worker thread.
+*  The worker serializes the snapshot and writes it next to the project as a sidecar file.  Until
+*  it has written and synced the whole file it writes to "<sidecar>.tmp", then renames that over
+*  the sidecar, so a crash mid-save never leaves a damaged sidecar behind.  The sidecar is an
+*  ordinary binary project and opens through File > Load.
+*
+*  A save starts once the project has unsaved edits the sidecar doesn't have yet, and either
+*  the user has left it alone for a moment or the last save is a while ago.  A snapshot taken
+*  while the worker is still busy replaces the one waiting, latest wins.  A save that fails leaves
+*  its edits unsaved, and is tried again on the same terms.
+*/
+
+#include "graph_document.h"
+#include <condition_variable>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace casa {
+namespace doc {
+
+struct AutosaveSettings {
+    double idle_seconds = 3.0;        // Save once the user has done nothing for this long...
+    double min_gap_seconds = 15.0;    // ...and the last save started at least this long ago,
+    double interval_seconds = 120.0;  // or anyway once the last save is this old.
+};
+
+struct AutosaveStatus {
+    bool saving = false;
+    bool ok = true;                   // Whether the last finished save worked
+    uint64_t saves = 0;               // Finished saves, good or not
+    uint64_t version = 0;             // Document version of the last good save
+    double latency_ms = 0.0;          // From taking the snapshot to the rename
+    uint64_t bytes = 0;               // Written by the last good save
+    double finished_at = 0.0;         // Seconds on the Autosaver's clock, see Now()
+    std::string path;                 // Sidecar of the last save
+    std::string error;                // Why the last save failed
+};
+
+class Autosaver {
+public:
+    Autosaver(void);
+    ~Autosaver(void);
+
+    Autosaver(const Autosaver&) = delete;
+    Autosaver& operator=(const Autosaver&) = delete;
+
+    // Once per frame, after the document is up to date.  "unsaved" says whether the project
+    // has edits that aren't in its file, "user_active" whether the user is doing something
+    // right now.  Never waits for the worker.
+    void Update(const Document& document, const std::string& sidecar, bool unsaved, bool user_active);
+
+    // Save the current version now, unless the sidecar already has it.
+    void SaveNow(const Document& document, const std::string& sidecar);
+
+    // Start over for a new project: its first edit is unsaved whatever the version says.
+    void Reset(void);
+
+    AutosaveStatus Status(void) const;
+    void SetSettings(const AutosaveSettings& settings) { m_Settings = settings; }
+    const AutosaveSettings& Settings(void) const { return m_Settings; }
+
+    // Seconds since some fixed point, the clock "finished_at" is measured on.
+    static double Now(void);
+
+    // Where a project's autosave goes: "<project>.autosave", or a file in the temp directory
+    // for a project that was never saved.
+    static std::string SidecarPath(const std::string& project_path);
+
+private:
+    struct Job {
+        Snapshot snapshot;
+        std::string path;
+        double taken_at = 0.0;
+    };
+
+    void Submit(const Document& document, const std::string& sidecar);
+    // Whether the last save failed with no later one waiting, once.
+    bool TakeFailure(void);
+    void WorkerLoop(void);
+    void Save(const Job& job);
+
+    // UI thread
+    AutosaveSettings m_Settings;
+    uint64_t m_SubmittedVersion = 0;
+    bool m_Submitted = false;
+    double m_LastSubmit = 0.0;
+    double m_LastActive = 0.0;
+
+    // Hand over, latest wins
+    mutable std::mutex m_Lock;
+    std::condition_variable m_Wake;
+    std::unique_ptr<Job> m_Pending;
+    bool m_Stop = false;
+    bool m_Failed = false;
+    AutosaveStatus m_Status;
+    std::future<void> m_Worker;
+};
+
+// A one line status bar along the bottom of the main viewport.  "project" (if not empty) follows
+// the autosave's, eg. how the project last saved.
+void DrawAutosaveStatusBar(const Autosaver& autosaver, const char* project = nullptr);
+
+} // end namespace doc
+} // end namespace casa
+
+#endif /* autosave_h */
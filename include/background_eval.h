@@ -0,0 +1,150 @@
+#ifndef background_eval_h
+#define background_eval_h
+
+/*
+*  Graph evaluation on a dedicated worker thread.
+*
+*  Every frame, Update() compares the active context against what the worker last saw and, if
+*  anything changed, submits an immutable snapshot: the captured graph with copies of its
+*  Properties when the topology changed, or just copies of the edited Properties otherwise.
+*  The worker owns its own Engine and never touches plano or the live Properties.
+*
+*  Results come back through two ResultSet buffers.  The worker fills the one the UI is not
+*  looking at and publishes it with an atomic pointer swap, so the UI thread never waits on
+*  evaluation.  Submitting a newer snapshot interrupts the run in progress; the worker folds
+*  the new edits in and carries on, so results are only ever published for the latest snapshot.
+*
+*  A long run also stops every kProgressMs to publish which nodes it hasn't reached yet, and
+*  carries on with just those.  TrackEdits draws its progress bars from that (see
+*  SetProgressSource()), the same bars a sliced Engine on the UI thread gets.
+*/
+
+#include "graph_eval.h"
+#include "plano_bridge.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace casa {
+namespace eval {
+
+// Everything the UI needs from one finished evaluation.
+struct ResultSet {
+    uint64_t generation = 0;        // Snapshot the values belong to, 0 before the first result
+    uint64_t topology = 0;
+    ValueStore values;
+    std::shared_ptr<const std::unordered_map<uintptr_t, Slot>> output_slot;  // Shared by all results of one plan
+    EngineStats stats;
+
+    // Slot of an output pin in "values", or kNoSlot if the pin is unknown.
+    Slot FindOutput(uintptr_t pin_id) const;
+};
+
+class BackgroundEvaluator {
+public:
+    // "cache" may be nullptr, and must outlive the evaluator.
+    BackgroundEvaluator(unsigned workers, OutputCache* cache);
+    ~BackgroundEvaluator(void);
+
+    BackgroundEvaluator(const BackgroundEvaluator&) = delete;
+    BackgroundEvaluator& operator=(const BackgroundEvaluator&) = delete;
+
+    // Submit a snapshot if the graph changed, and pick up the latest published results.
+    // Call once per frame after plano::api::Frame(), on the UI thread.
+    void Update(void);
+
+    // Latest results, valid until the next Update().  Generation 0 and empty until the first ones arrive.
+    const ResultSet& Results(void) const { return *m_Held; }
+
+    // The graph as last captured on the UI thread, pointing at the live Properties.
+    const casa::bridge::GraphView& Graph(void) const { return m_Graph; }
+    uint64_t Captures(void) const { return m_Captures; }
+
+    // Threads the worker's engine uses, including the worker itself.  Applied before its next run.
+    void SetWorkerCount(unsigned workers) { m_RequestedWorkers.store(workers, std::memory_order_relaxed); }
+    unsigned WorkerCount(void) const { return m_RequestedWorkers.load(std::memory_order_relaxed); }
+    OutputCache* Cache(void) const { return m_Cache; }
+
+    uint64_t Submitted(void) const { return m_Submitted.load(std::memory_order_relaxed); }
+    uint64_t Interruptions(void) const { return m_Interruptions.load(std::memory_order_relaxed); }
+
+    // The run in flight as of this frame's Update(), "in_flight" is false between runs.
+    bool InFlight(void) const { return m_HeldProgress.in_flight; }
+    float Progress(void) const { return m_HeldProgress.progress; }
+
+private:
+    // What the UI hands over.  Either a whole graph (full) or a list of edited nodes.
+    struct Snapshot {
+        bool full = false;
+        uint64_t topology = 0;
+        casa::bridge::GraphView graph;          // full only; properties point into "properties"
+        std::vector<Properties> properties;     // full: one per node.  Otherwise one per edited node.
+        std::vector<uint32_t> edited;           // Otherwise: node index of each entry in "properties"
+    };
+
+    // Where the run in flight is.
+    struct RunProgress {
+        uint64_t serial = 0;                    // Bumped on every publish
+        uint64_t topology = 0;
+        bool in_flight = false;
+        float progress = 1.0f;
+        std::vector<uint8_t> pending;           // By node index, the nodes it hasn't reached yet
+    };
+
+    void Submit(std::unique_ptr<Snapshot> snapshot);
+    void WorkerLoop(void);
+    void Apply(std::unique_ptr<Snapshot> snapshot);
+    void Publish(void);
+    void PublishProgress(bool in_flight);
+    static bool NewerSnapshot(void* user);
+    static bool NewerSnapshotOrProgressDue(void* user);
+    static bool PendingNode(void* user, const Properties* p, float* progress);
+
+    // UI thread
+    casa::bridge::GraphView m_Graph;
+    std::unordered_map<const Properties*, uint32_t> m_NodeOfProperties;
+    uint64_t m_Topology = 0;
+    uint64_t m_Captures = 0;
+    std::vector<const Properties*> m_Edits;
+    const ResultSet* m_Held = nullptr;
+    RunProgress m_HeldProgress;
+
+    // Hand over, latest wins
+    std::mutex m_Lock;
+    std::condition_variable m_Wake;
+    std::unique_ptr<Snapshot> m_Pending;
+    std::atomic<bool> m_Stop{false};
+    std::atomic<uint64_t> m_Submitted{0};   // Generation of the newest snapshot
+    std::atomic<uint64_t> m_Interruptions{0};
+    std::atomic<unsigned> m_RequestedWorkers{1};
+    std::mutex m_ProgressLock;
+    RunProgress m_Progress;
+
+    // Double buffered results
+    ResultSet m_Buffers[2];
+    std::atomic<const ResultSet*> m_Front;
+    std::atomic<const ResultSet*> m_Reading;    // Buffer the UI holds, the worker must not write it
+
+    // Worker thread
+    OutputCache* m_Cache = nullptr;
+    Engine m_Engine;
+    std::unique_ptr<Snapshot> m_Current;        // Last full snapshot, owns the Properties the engine's graph points at
+    std::shared_ptr<const std::unordered_map<uintptr_t, Slot>> m_OutputSlot;
+    uint64_t m_Applied = 0;                     // Generation of the last snapshot folded into m_Engine
+    std::chrono::steady_clock::time_point m_RunStarted;     // Of the current stretch of m_Engine.Run()
+    std::future<void> m_Worker;
+};
+
+// Evaluator window for the background evaluator.
+void DrawStatsWindow(BackgroundEvaluator& evaluator, bool* open);
+
+} // end namespace eval
+} // end namespace casa
+
+#endif /* background_eval_h */
@@ -0,0 +1,179 @@
+#ifndef batch_eval_h
+#define batch_eval_h
+
+/*
+*  Batched evaluation of one graph under many property variants, eg. a sweep over floor heights.
+*
+*  Every variant is a lane.  The BatchEngine stores each value slot as Lanes() values side by side
+*  and walks the plan once for all of them, so a node type with a BatchEvaluateFn computes every
+*  variant in one call, typically with the kernels in simd_kernels.h.  The math nodes
+*  (node_defs/math_nodes.h) register theirs next to their EvaluateFn, eg. "Scale Offset":
+*
+*      static void EvaluateBatch(casa::eval::BatchIO& io) {
+*          casa::simd::MulAddF(io.OutputFloat(0), io.InputFloat(0), io.PropFloat("scale", 1.0f),
+*                              io.PropFloat("offset", 0.0f), io.Lanes());
+*      }
+*
+*  The editor runs sweeps from its Sweep window (see DrawSweepWindow()).
+*
+*  Node types without one still work: their EvaluateFn runs once per lane, with the lane's values
+*  gathered into a scratch ValueStore and a copy of the Properties when the lane overrides them.
+*  Results are the same as evaluating each variant on its own Engine.
+*/
+
+#include "graph_eval.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace casa {
+namespace eval {
+
+// Replace one property of one node (index into the GraphView) for one variant.
+// "bank" says which map of the Properties the key is in: pbool, pint, pfloat or pstring.
+struct PropertyOverride {
+    uint32_t node = 0;
+    std::string key;
+    ValueBank bank = ValueBank::Float;
+    bool b = false;
+    int32_t i = 0;
+    float f = 0.0f;
+    std::string s;
+};
+
+struct Variant {
+    std::vector<PropertyOverride> overrides;
+};
+
+class BatchEngine;
+
+// What a BatchEvaluateFn gets to see.  Every pointer holds Lanes() values, one per variant,
+// and stays valid until the callback returns.
+class BatchIO {
+public:
+    uint32_t Lanes(void) const { return m_Lanes; }
+    const Properties& Props(void) const { return *m_Properties; }   // Without overrides
+    int InputCount(void) const { return (int)m_InputCount; }
+    int OutputCount(void) const { return (int)m_OutputCount; }
+
+    // Inputs linked to another kind of output are converted like NodeIO does.
+    const float* InputFloat(int index);
+    const int32_t* InputInt(int index);
+
+    // Outputs are written in place and must be the pin's own kind.
+    float* OutputFloat(int index);
+    int32_t* OutputInt(int index);
+
+    // A property per lane: the node's value (or "fallback" if it has none) with the lanes' overrides applied.
+    const float* PropFloat(const char* key, float fallback);
+    const int32_t* PropInt(const char* key, int32_t fallback);
+
+private:
+    friend class BatchEngine;
+    float* ScratchFloat(void);
+    int32_t* ScratchInt(void);
+
+    BatchEngine* m_Engine = nullptr;
+    const Properties* m_Properties = nullptr;
+    const Slot* m_InputSlots = nullptr;
+    const Slot* m_OutputSlots = nullptr;
+    uint32_t m_InputCount = 0;
+    uint32_t m_OutputCount = 0;
+    uint32_t m_Node = 0;
+    uint32_t m_Lanes = 0;
+    uint32_t m_FloatScratchUsed = 0;
+    uint32_t m_IntScratchUsed = 0;
+};
+
+typedef void (*BatchEvaluateFn)(BatchIO& io);
+
+// Looked up by node type like RegisterEvaluator().  A type still needs its EvaluateFn for Engine.
+void RegisterBatchEvaluator(const std::string& type, BatchEvaluateFn evaluate);
+BatchEvaluateFn FindBatchEvaluator(const std::string& type);
+
+struct BatchStats {
+    uint32_t lanes = 0;
+    uint32_t batched_steps = 0;      // Steps run through their BatchEvaluateFn
+    uint32_t fallback_steps = 0;     // Steps run lane by lane
+    double last_run_ms = 0.0;
+};
+
+class BatchEngine {
+public:
+    // The graph and its Properties must stay alive until the next Compile().
+    void Compile(const casa::bridge::GraphView& graph);
+
+    // Evaluate the whole graph once per variant.  Overrides naming a node outside the graph are ignored.
+    void Run(const std::vector<Variant>& variants);
+
+    uint32_t Lanes(void) const { return m_Lanes; }
+    const ExecutionPlan& Plan(void) const { return m_Plan; }
+    const BatchStats& Stats(void) const { return m_Stats; }
+    Slot FindOutput(uintptr_t pin_id) const;
+
+    // Lanes() values of a slot in its own bank, or nullptr for another bank.
+    const float* Floats(Slot slot) const;
+    const int32_t* Ints(Slot slot) const;
+
+    // One lane, converting like ValueStore.
+    bool GetBool(Slot slot, uint32_t lane) const;
+    int32_t GetInt(Slot slot, uint32_t lane) const;
+    float GetFloat(Slot slot, uint32_t lane) const;
+    const std::string& GetString(Slot slot, uint32_t lane) const;
+
+private:
+    friend class BatchIO;
+    struct LaneOverride {
+        uint32_t lane;
+        const PropertyOverride* value;
+    };
+
+    size_t At(Slot slot) const { return (size_t)SlotIndex(slot) * m_Stride; }
+    void RunLanes(const PlanStep& step);
+
+    casa::bridge::GraphView m_Graph;
+    ExecutionPlan m_Plan;
+    std::vector<BatchEvaluateFn> m_Batch;              // Per plan step, nullptr to run it lane by lane
+    uint32_t m_Lanes = 0;
+    uint32_t m_Stride = 0;                             // Lanes rounded up to a multiple of 8, the AVX2 width
+
+    // Slot index * m_Stride + lane, per bank.
+    std::vector<uint8_t> m_Bools;
+    std::vector<int32_t> m_Ints;
+    std::vector<float> m_Floats;
+    std::vector<std::string> m_Strings;
+
+    std::vector<std::vector<LaneOverride>> m_Overrides;    // Per node
+    std::vector<std::vector<float>> m_FloatScratch;        // Handed out by BatchIO, reused every step
+    std::vector<std::vector<int32_t>> m_IntScratch;
+    ValueStore m_LaneValues;                               // One lane at a time, for steps without a batch kernel
+    Properties m_LaneProperties;
+    casa::mem::Arena m_LaneArena;
+    BatchStats m_Stats;
+};
+
+// The editor's sweep window: one float property of one node stepped over a range, every value a
+// lane of one Run(), and one output of another node read back per lane.  Nodes are kept by id, so
+// the panel outlives edits to the graph; a node that is gone just leaves nothing to run.
+struct SweepPanel {
+    uintptr_t vary_node = 0;
+    std::string key;                 // In vary_node's pfloat
+    float from = 0.0f;
+    float to = 1.0f;
+    int steps = 64;
+    uintptr_t watch_node = 0;
+    int watch_output = 0;
+
+    std::vector<float> values;       // The watched output per lane, as of the last run
+    std::string error;               // Why the last run has no values
+    BatchEngine engine;
+};
+
+// "graph" must point at the live Properties, eg. BackgroundEvaluator::Graph().  The Vary and
+// Watch buttons take the node selected in the editor.
+void DrawSweepWindow(SweepPanel& panel, const casa::bridge::GraphView& graph, bool* open);
+
+} // end namespace eval
+} // end namespace casa
+
+#endif /* batch_eval_h */
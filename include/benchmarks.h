@@ -0,0 +1,16 @@
+#ifndef benchmarks_h
+#define benchmarks_h
+
+/*
+*  Headless benchmarks.  These never open a window, so they can run on build machines:
+*
+*      casa --benchmark list
+*      casa --benchmark <name>
+*
+*  Results go to stdout as plain text tables.
+*/
+
+// Returns the process exit code: 0 on success, 1 for an unknown benchmark or a failed check.
+int run_benchmark(const char* name);
+
+#endif /* benchmarks_h */
@@ -0,0 +1,82 @@
+#ifndef casa_hash_h
+#define casa_hash_h
+
+/*
+*  Small hashing helpers shared by the evaluator and the file code.
+*  FNV-1a is not a great hash, but it is fast, stable between runs and platforms,
+*  and that is what we need for topology stamps and cache keys.
+*/
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+namespace casa {
+namespace hash {
+
+static const uint64_t kFnvOffset = 14695981039346656037ull;
+static const uint64_t kFnvPrime = 1099511628211ull;
+
+inline uint64_t Bytes(uint64_t h, const void* data, size_t size)
+{
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++) {
+        h ^= p[i];
+        h *= kFnvPrime;
+    }
+    return h;
+}
+
+// FNV-1a over eight bytes at a time, the tail padded with zeros.  A different hash than Bytes(),
+// but several times faster on large buffers, eg. for checksums of whole file blocks.
+inline uint64_t Words(uint64_t h, const void* data, size_t size)
+{
+    const unsigned char* p = (const unsigned char*)data;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t w;
+        memcpy(&w, p + i, 8);
+        h ^= w;
+        h *= kFnvPrime;
+    }
+    if (i < size) {
+        uint64_t w = 0;
+        memcpy(&w, p + i, size - i);
+        h ^= w;
+        h *= kFnvPrime;
+    }
+    return h;
+}
+
+template<typename T>
+inline uint64_t Value(uint64_t h, const T& v)
+{
+    return Bytes(h, &v, sizeof(T));
+}
+
+inline uint64_t String(uint64_t h, const std::string& s)
+{
+    h = Value(h, (uint64_t)s.size()); // length prefix so "ab"+"c" != "a"+"bc"
+    return Bytes(h, s.data(), s.size());
+}
+
+// splitmix64 finalizer.  Used where hashes get summed, so nearby inputs don't cancel out.
+inline uint64_t Mix(uint64_t x)
+{
+    x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27; x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+// Mix two 64 bit hashes together (order matters).
+inline uint64_t Combine(uint64_t a, uint64_t b)
+{
+    return Value(a, b);
+}
+
+} // end namespace hash
+} // end namespace casa
+
+#endif /* casa_hash_h */
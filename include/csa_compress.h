@@ -0,0 +1,133 @@
+#ifndef csa_compress_h
+#define csa_compress_h
+
+/*
+*  The compressed container for binary projects.
+*
+*  A compressed project is an ordinary .csa cut into blocks of block_size bytes, each compressed
+*  on its own with lz_block.h, so saving and loading run a block per core:
+*
+*      CompressedHeader | block | block | ... | BlockEntry[] | CompressedTrailer
+*
+*  The block table and the trailer come last so a save can stream blocks out as they are done.
+*  A block that doesn't get smaller is stored as it is (stored_size == raw_size).  Every entry
+*  has a checksum of the block's raw bytes, so a damaged file is refused instead of being read
+*  as a slightly different project.
+*
+*  load_project_file tells the formats apart by their first bytes: kCompressedMagic here,
+*  kMagic for an uncompressed .csa, anything else is a text project.
+*/
+
+#include "csa_format.h"
+#include "output_sink.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace casa {
+
+class WorkStealingPool;
+
+namespace csa {
+
+const char kCompressedMagic[4] = { 'C', 'S', 'A', 'Z' };
+const uint32_t kCompressedVersion = 1;
+const uint32_t kDefaultBlockSize = 1024 * 1024;
+
+enum class Codec : uint32_t { LZ = 1 };
+
+struct CompressedHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t block_size;    // Raw bytes per block, the last one may have less
+    uint32_t codec;         // Codec
+};
+
+struct BlockEntry {
+    uint64_t offset;        // From the start of the file
+    uint32_t stored_size;
+    uint32_t raw_size;
+    uint64_t checksum;      // casa::hash::Words() of the raw bytes
+};
+
+struct CompressedTrailer {
+    uint64_t raw_size;      // Of the whole .csa
+    uint64_t table_offset;  // Of the BlockEntry table
+    uint32_t block_count;
+    char magic[4];          // kCompressedMagic again, to spot a file cut short
+};
+
+static_assert(sizeof(CompressedHeader) % 8 == 0 && sizeof(BlockEntry) % 8 == 0 && sizeof(CompressedTrailer) % 8 == 0,
+    "the compressed container keeps its tables 8 byte aligned");
+
+// Whether "data" starts like a compressed project.
+bool IsCompressedProject(const char* data, size_t size);
+
+// Compresses everything written to it into a container on "next".  Blocks are collected until
+// there is one for every worker, then compressed together.  Call Finish() once at the end,
+// which writes the table and the trailer and flushes "next".
+class CompressingSink : public io::Sink {
+public:
+    // "threads" 0 uses every core.
+    explicit CompressingSink(io::Sink& next, unsigned threads = 0, uint32_t block_size = kDefaultBlockSize);
+    ~CompressingSink(void);
+
+    CompressingSink(const CompressingSink&) = delete;
+    CompressingSink& operator=(const CompressingSink&) = delete;
+
+    bool Write(const void* data, size_t size) override;
+    bool Finish(void);
+
+    uint64_t RawSize(void) const { return m_RawSize; }
+    uint64_t StoredSize(void) const { return m_Offset; }
+
+private:
+    struct Block {
+        std::vector<char> raw;
+        size_t used = 0;
+        std::vector<char> stored;
+        size_t stored_size = 0;
+        uint64_t checksum = 0;
+    };
+
+    bool CompressBatch(void);
+    static void CompressTask(void* user, uint32_t item, unsigned worker);
+
+    io::Sink& m_Next;
+    uint32_t m_BlockSize;
+    std::unique_ptr<WorkStealingPool> m_Pool;
+    std::vector<Block> m_Batch;       // One per worker
+    size_t m_Filled = 0;              // Blocks in m_Batch that are full
+    std::vector<BlockEntry> m_Table;
+    uint64_t m_Offset = 0;            // Bytes passed on to m_Next
+    uint64_t m_RawSize = 0;
+    bool m_Started = false;
+    bool m_Finished = false;
+    bool m_Failed = false;
+};
+
+// A compressed project, decompressed into memory that is 8 byte aligned like a mapping, so a
+// Reader can open Data() directly.
+class DecompressedProject {
+public:
+    // "threads" 0 uses every core.
+    bool Open(const char* data, size_t size, std::string* error = nullptr, unsigned threads = 0);
+    void Close(void);
+
+    const char* Data(void) const { return (const char*)m_Words.get(); }
+    size_t Size(void) const { return m_Size; }
+
+private:
+    std::unique_ptr<uint64_t[]> m_Words;
+    size_t m_Size = 0;
+};
+
+// The FileHeader of a binary project, compressed or not, without reading the rest of it.
+bool ReadProjectHeader(const char* data, size_t size, FileHeader& out);
+
+} // end namespace csa
+} // end namespace casa
+
+#endif /* csa_compress_h */
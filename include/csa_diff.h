@@ -0,0 +1,194 @@
+#ifndef csa_diff_h
+#define csa_diff_h
+
+/*
+*  Structural diff and three-way merge of binary projects (csa_format.h).
+*
+*  Nodes and links are matched by id, which plano never hands out twice, so both take a few hash
+*  lookups per node: O(n) time and memory however much was edited.  Each node is hashed the way
+*  the file stores it, with its pins and properties, in parts: what it is (type and pins), where
+*  it is, how it looks, its state, and its properties.  Only nodes whose hashes differ are looked
+*  at any closer.  The property hash doesn't depend on the order a file lists them in, which can
+*  differ between two saves of the same project.
+*
+*  A merge takes each part of a node from whichever side changed it.  Where both sides changed a
+*  part differently the properties are merged key by key, and whatever still conflicts comes from
+*  the side MergeOptions prefers and is reported.  A node or link removed on one side and changed
+*  on the other is kept.
+*
+*  Forks count ids on from the same base, so what both sides added is different objects under the
+*  same ids.  Ids "theirs" handed out after the base are moved past the ones "ours" handed out.
+*  Links that would feed an input twice, or end at a pin the merged project doesn't have, are
+*  dropped and reported.
+*/
+
+#include "csa_compress.h"
+#include "csa_format.h"
+#include "csa_journal.h"
+#include "mapped_file.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace casa {
+namespace csa {
+
+// A project as it is on disk: a binary project, compressed or not, with the journal that
+// continues it folded in.  Text projects have to be saved once in the binary format first.
+class ProjectSnapshot {
+public:
+    // A node of the file's tables, an instance's copy of one, or a journal record.
+    struct NodeRef {
+        const NodeEntry* entry = nullptr;
+        const PinEntry* pins = nullptr;               // entry->input_count inputs, then the outputs
+        const PropertyEntry* properties = nullptr;
+        uint64_t id = 0;
+        uint64_t id_shift = 0;                        // An instance's, for the pins
+        float offset[2] = {};                         // An instance's, for the position
+        const OverrideEntry* overrides = nullptr;     // An instance's values for its template's properties
+        uint32_t override_count = 0;
+        uint32_t local = 0;                           // Which of the template's nodes
+        const JournalRecord* record = nullptr;        // Where the strings are, nullptr for the file's
+    };
+
+    // On failure "error" (if given) says why.
+    bool Open(const char* path, std::string* error = nullptr);
+
+    size_t NodeCount(void) const { return m_Nodes.size(); }
+    const NodeRef& Node(size_t i) const { return m_Nodes[i]; }
+    size_t LinkCount(void) const { return m_Links.size(); }
+    const LinkEntry& Link(size_t i) const { return m_Links[i]; }
+    // Above every id the project uses.
+    uint64_t NextId(void) const { return m_NextId; }
+    const FileHeader& Header(void) const { return m_Reader.Header(); }
+
+    std::string_view String(const NodeRef& node, StrRef s) const;
+    uint64_t PinId(const NodeRef& node, uint32_t pin) const;
+    float X(const NodeRef& node) const { return node.entry->position[0] + node.offset[0]; }
+    float Y(const NodeRef& node) const { return node.entry->position[1] + node.offset[1]; }
+
+    // Calls "visit(key, entry, text)" for every property of "node", an instance's own values in
+    // place of its template's.  "text" is the value of a String.
+    template<typename Visit>
+    void ForEachProperty(const NodeRef& node, Visit visit) const;
+    void ReadProperties(const NodeRef& node, ::Properties& out) const;
+
+    // Every id from "from" on, of nodes, pins and links, reads "by" higher from now on.  Once,
+    // before anything has read the ids.
+    void ShiftIds(uint64_t from, uint64_t by);
+    uint64_t Shifted(uint64_t id) const { return id >= m_ShiftFrom ? id + m_ShiftBy : id; }
+
+private:
+    io::MappedFile m_File;
+    DecompressedProject m_Decompressed;
+    Reader m_Reader;
+    JournalReader m_Journal;
+    std::vector<NodeRef> m_Nodes;
+    std::vector<LinkEntry> m_Links;
+    uint64_t m_NextId = 1;
+    uint64_t m_ShiftFrom = UINT64_MAX;
+    uint64_t m_ShiftBy = 0;
+};
+
+// The parts of a node that are hashed and merged apart.
+enum NodePart : uint32_t {
+    kPartKind = 1,          // Type, node type and pins
+    kPartPosition = 2,
+    kPartLook = 4,          // Color and size
+    kPartState = 8,         // State and saved state
+    kPartProperties = 16,
+};
+const uint32_t kNodeParts = 5;
+
+enum class Change : uint32_t { Added, Removed, Modified };
+
+struct NodeDiff {
+    uint64_t id = 0;
+    Change change = Change::Modified;
+    uint32_t parts = 0;                         // NodePart bits, for Modified
+    std::vector<std::string> properties;        // Keys added, removed or changed, for Modified
+};
+
+struct LinkDiff {
+    uint64_t id = 0;
+    Change change = Change::Modified;
+};
+
+struct ProjectDiff {
+    std::vector<NodeDiff> nodes;                // In "other"'s order, then the removed in the base's
+    std::vector<LinkDiff> links;
+    size_t same_nodes = 0;
+    size_t same_links = 0;
+};
+
+// What changed from "base" to "other".  Hashes on "threads" threads, 0 uses every core.
+void DiffProjects(const ProjectSnapshot& base, const ProjectSnapshot& other, ProjectDiff& out, unsigned threads = 0);
+
+struct MergeOptions {
+    bool prefer_theirs = false;                 // Which side wins a conflict
+    bool compress = false;                      // Write the merged project as save_project_file() would
+    bool dedupe = false;
+    unsigned threads = 0;                       // For the hashing, 0 uses every core
+};
+
+struct MergeConflict {
+    enum class Kind : uint32_t {
+        Parts,              // Both sides changed "parts" of node "id" differently
+        Property,           // Both sides changed "property" of node "id" differently
+        LinkChanged,        // Both sides changed link "id" differently
+        RemovedChanged,     // One side removed node or link "id", the other changed it, it was kept
+        DroppedLink,        // Link "id" fed an input that already had a link, or lost a pin
+    };
+    Kind kind = Kind::Parts;
+    uint64_t id = 0;
+    uint32_t parts = 0;
+    std::string property;
+};
+
+struct MergeResult {
+    size_t nodes = 0;                           // In the merged project
+    size_t links = 0;
+    size_t from_ours = 0;                       // Nodes the merge took changes to from each side
+    size_t from_theirs = 0;
+    std::vector<MergeConflict> conflicts;
+};
+
+// Merge what "ours" and "theirs" changed since "base" and write the result to "path".  Shifts
+// "theirs"' new ids (see ShiftIds()).  Returns false, with "error" saying why, if the merged
+// project can't be written; conflicts don't fail a merge.
+bool MergeProjects(const ProjectSnapshot& base, const ProjectSnapshot& ours, ProjectSnapshot& theirs,
+    const MergeOptions& options, const char* path, MergeResult& result, std::string* error = nullptr);
+
+template<typename Visit>
+void ProjectSnapshot::ForEachProperty(const NodeRef& node, Visit visit) const
+{
+    for (uint32_t p = 0; p < node.entry->property_count; p++) {
+        const PropertyEntry* e = &node.properties[p];
+        std::string_view key = String(node, e->key);
+        for (uint32_t o = 0; o < node.override_count; o++) {
+            const PropertyEntry& own = m_Reader.Property(node.overrides[o].property);
+            if (node.overrides[o].node == node.local && own.kind == e->kind && String(node, own.key) == key) {
+                e = &own;
+                break;
+            }
+        }
+        visit(key, *e, e->kind == (uint32_t)PropertyKind::String ? String(node, e->value.s) : std::string_view());
+    }
+}
+
+} // end namespace csa
+} // end namespace casa
+
+// The command line, results go to stdout, returns the process exit code:
+//
+//     casa --diff <base> <other>
+//     casa --merge <base> <ours> <theirs> <out> [--theirs] [--compress] [--dedupe]
+//
+// A diff exits with 0 when the projects are the same and 1 when they differ, like diff(1); a
+// merge with 0 when it had no conflicts and 1 when it had some.  Both exit with 2 on errors.
+int run_diff_command(const char* base, const char* other);
+int run_merge_command(int argc, char** argv);
+
+#endif /* csa_diff_h */
@@ -0,0 +1,416 @@
+#ifndef csa_format_h
+#define csa_format_h
+
+/*
+*  The binary .csa project format.
+*
+*  A file is a FileHeader followed by fixed size tables and one string table:
+*
+*      FileHeader | NodeEntry[] | PinEntry[] | PropertyEntry[] | LinkEntry[] | TileEntry[] |
+*      node indices | TemplateEntry[] | template node indices | template link indices |
+*      InstanceEntry[] | OverrideEntry[] | string bytes
+*
+*  The header gives every section's offset and count.  Entries refer to strings by offset and
+*  length into the string table, and each node to its run of pins (inputs first) and properties
+*  by index, so nothing needs fixing up after a load: the Reader maps the file and hands out
+*  pointers and string_views straight into the mapping.  Every table starts 8 byte aligned, and
+*  all numbers are little endian.
+*
+*  Files written by the text serializer in plano start with text, never with kMagic, so both
+*  kinds keep loading through load_project_file (see IsBinaryProject).
+*
+*  Later versions may only append fields to FileHeader and add sections; header_size says how
+*  much of the header a file has, and fields past it read as zero.  A Reader refuses files with
+*  a newer version.
+*
+*  Version 2 added journal_stamp: edits saved since the file was written live in an append only
+*  journal next to it, see csa_journal.h.
+*
+*  Version 3 added a spatial index: the canvas is cut into square tiles of tile_size, and every
+*  tile with nodes on it has a TileEntry naming its run in the node index table, so the nodes
+*  around a spot can be found without looking at the rest.  view is the part of the canvas the
+*  editor showed when the file was saved.  A progressive load (see progressive_load.h) builds the
+*  nodes around it first.
+*
+*  Version 4 stores repeated subgraphs once.  A template names a connected group of nodes in the
+*  tables, and the links between them; an instance stands for a copy of it whose ids are all the
+*  template's plus one shift and whose positions are all the template's plus one offset, with its
+*  own values for whichever properties differ (OverrideEntry).  The project as loaded is the
+*  tables' nodes followed by every instance's copies, in instance order, and its links the same
+*  way; the spatial index and everything else that counts nodes counts them in that order.  The
+*  tables alone are still a valid project, just without the copies, so a file without instances
+*  is what version 3 wrote.
+*/
+
+#include "plano_api.h"
+#include "mapped_file.h"
+#include "output_sink.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace casa {
+namespace csa {
+
+const char kMagic[4] = { 'C', 'S', 'A', 'B' };
+const uint32_t kVersion = 4;
+const float kTileSize = 1024.0f;    // Canvas units per tile side in the files we write
+
+// The on disk structs are plain data, written and mapped as they are.
+struct StrRef {
+    uint32_t offset;        // Into the string table
+    uint32_t size;
+};
+
+struct Section {
+    uint64_t offset;        // From the start of the file
+    uint64_t count;         // Entries, or bytes for the string table
+};
+
+struct FileHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t flags;         // None defined yet
+    uint64_t file_size;
+    uint64_t next_id;       // First id plano may hand out after loading
+    Section nodes;
+    Section pins;
+    Section properties;
+    Section links;
+    Section strings;
+    uint64_t journal_stamp;   // Version 2: names the journal that continues this file, 0 for none
+    Section tiles;            // Version 3: TileEntry[], sorted by y, then x
+    Section tile_nodes;       // Version 3: uint32_t node indices, every tile's run in file order
+    float view[4];            // Version 3: canvas rect shown when saved: min x, min y, max x, max y
+    float tile_size;          // Version 3
+    uint32_t reserved;
+    Section templates;        // Version 4: TemplateEntry[]
+    Section template_nodes;   // Version 4: uint32_t node indices, every template's run
+    Section template_links;   // Version 4: uint32_t link indices, every template's run
+    Section instances;        // Version 4: InstanceEntry[]
+    Section overrides;        // Version 4: OverrideEntry[], every instance's run
+    uint64_t instance_nodes;  // Version 4: nodes the instances add to the tables'
+    uint64_t instance_links;  // Version 4: links they add
+};
+
+const uint32_t kHeaderSizeV1 = offsetof(FileHeader, journal_stamp);
+
+struct NodeEntry {
+    uint64_t id;
+    StrRef type;            // NodeDescription::Type
+    StrRef state;
+    StrRef saved_state;
+    float color[4];
+    float position[2];      // Canvas position
+    float size[2];
+    uint32_t node_type;     // plano::types::NodeType
+    uint32_t first_pin;     // Index into the pin table: input_count inputs, then output_count outputs
+    uint32_t input_count;
+    uint32_t output_count;
+    uint32_t first_property;
+    uint32_t property_count;
+};
+
+struct PinEntry {
+    uint64_t id;
+    StrRef name;
+    uint32_t type;          // plano::types::PinType
+    uint32_t kind;          // plano::types::PinKind
+};
+
+enum class PropertyKind : uint32_t { Bool = 1, Int = 2, Float = 3, String = 4 };
+
+struct PropertyEntry {
+    StrRef key;
+    uint32_t kind;          // PropertyKind
+    uint32_t reserved;
+    union {
+        uint32_t b;
+        int32_t i;
+        float f;
+        StrRef s;
+    } value;
+};
+
+struct LinkEntry {
+    uint64_t id;
+    uint64_t start_pin;
+    uint64_t end_pin;
+    float color[4];
+};
+
+// The nodes whose position lies in [x, x + 1) * tile_size by [y, y + 1) * tile_size.
+struct TileEntry {
+    int32_t x;
+    int32_t y;
+    uint32_t first;         // Into the node index table
+    uint32_t count;
+};
+
+// A subgraph stored once, in the order its instances copy it.  The nodes are connected, and the
+// links are all of theirs.
+struct TemplateEntry {
+    uint32_t first_node;    // Into the template node table, which indexes the node table
+    uint32_t node_count;
+    uint32_t first_link;    // Into the template link table, which indexes the link table
+    uint32_t link_count;
+};
+
+struct InstanceEntry {
+    uint64_t id_shift;      // Added to every node, pin and link id of the template, modulo 2^64
+    float offset[2];        // Added to every node position
+    uint32_t template_index;
+    uint32_t first_node;    // Where its copies come in the project's node order
+    uint32_t first_link;    // And its links in the project's link order
+    uint32_t first_override;
+    uint32_t override_count;
+    uint32_t reserved;
+};
+
+// A property value an instance has instead of its template's.
+struct OverrideEntry {
+    uint32_t node;          // Which of the template's nodes, counted from 0
+    uint32_t property;      // Into the property table: the key, its kind and this copy's value
+};
+
+static_assert(sizeof(FileHeader) % 8 == 0 && sizeof(NodeEntry) % 8 == 0 && sizeof(PinEntry) % 8 == 0 &&
+    sizeof(PropertyEntry) % 8 == 0 && sizeof(LinkEntry) % 8 == 0 && sizeof(TileEntry) % 8 == 0 &&
+    sizeof(TemplateEntry) % 8 == 0 && sizeof(InstanceEntry) % 8 == 0 && sizeof(OverrideEntry) % 8 == 0,
+    "tables must stay 8 byte aligned");
+
+// True when "data" starts like a binary project.
+bool IsBinaryProject(const char* data, size_t size);
+
+// What SetDedupe() made of the last Write().
+struct DedupeStats {
+    uint64_t nodes = 0;             // In the project
+    uint64_t stored_nodes = 0;      // In the node table
+    uint64_t links = 0;
+    uint64_t stored_links = 0;
+    uint64_t templates = 0;
+    uint64_t instances = 0;
+    uint64_t overrides = 0;
+    double Ratio(void) const { return stored_nodes ? (double)nodes / (double)stored_nodes : 1.0; }
+};
+
+// Streams a project into a Sink without building it in memory first.
+//
+// The tables come out one after another, so the project is walked once to measure it and then
+// once per table: "fill" is called six times and must add the same nodes, pins, properties and
+// links in the same order each time.  Between calls only the interned strings and the spatial
+// index are kept, the index at 12 bytes a node; nothing else grows with the project.
+//
+// With SetDedupe() the first walk also hashes every node, and the Writer looks for connected
+// subgraphs that repeat: same node types, pins, property keys, links, relative layout and
+// pattern of ids, found by a structural hash and then compared byte for byte.  Every copy after
+// the first becomes an instance, and a seventh walk measures the tables without them.  That
+// takes a hundred bytes or so a node, plus its strings, until the tables are written.
+class Writer {
+public:
+    typedef std::function<bool(Writer&)> Fill;
+
+    // Returns false if "fill" did, if it added something different on a later call, or if the
+    // sink failed.  Small pieces go to the sink one by one, so it should buffer.
+    bool Write(io::Sink& sink, const Fill& fill);
+    bool WriteFile(const char* path, const Fill& fill);
+
+    // Bytes written by the last Write().
+    uint64_t Size(void) const { return m_Written; }
+
+    // For "fill".  Pins and properties added after AddNode() belong to that node, add inputs
+    // before outputs.  The NodeEntry may be filled in until the next AddNode().
+    StrRef Intern(std::string_view s);   // Stored once however often it is added
+    StrRef Append(std::string_view s);   // Stored every time, for values that rarely repeat
+    NodeEntry& AddNode(void);
+    void AddPin(uint64_t id, std::string_view name, plano::types::PinType type, plano::types::PinKind kind);
+    void AddProperties(const Properties& p);
+    // One property copied from another file, without building a Properties: "value" gives the
+    // kind and the value, "text" the value of a String.  Either one AddProperties() or a run of
+    // AddProperty() per node.
+    void AddProperty(std::string_view key, const PropertyEntry& value, std::string_view text = std::string_view());
+    void AddLink(const LinkEntry& link);
+    void SetNextId(uint64_t id) { m_NextId = id; }
+    void SetView(float min_x, float min_y, float max_x, float max_y);
+
+    // Kept across Write() calls, unlike everything "fill" adds.
+    void SetJournalStamp(uint64_t stamp) { m_JournalStamp = stamp; }
+    void SetDedupe(bool dedupe) { m_Dedupe = dedupe; }
+    const DedupeStats& Dedupe(void) const { return m_DedupeStats; }
+
+private:
+    enum class Pass { Measure, Nodes, Pins, Properties, Links, Strings };
+
+    // What the first walk keeps for FindRepeats().
+    struct LinkKey {
+        uint64_t start_pin;
+        uint64_t end_pin;
+        uint64_t id;
+        uint64_t hash;                    // Of the color
+        float color[4];
+    };
+
+    struct Counts {
+        uint64_t nodes = 0;
+        uint64_t pins = 0;
+        uint64_t properties = 0;
+        uint64_t links = 0;
+        uint64_t strings = 0;             // Bytes
+        bool operator==(const Counts&) const = default;
+    };
+
+    bool RunPass(Pass pass, const Fill& fill);
+    void FinishNode(void);
+    void PutProperty(std::string_view key, PropertyKind kind, const PropertyEntry& value, std::string_view text);
+    void RecordString(std::string_view s);
+    static void Record(std::string& out, const void* data, size_t size);
+    static void RecordText(std::string& out, std::string_view s);
+    bool SameNode(uint32_t a, uint32_t b) const;
+    bool SameValue(uint32_t a, uint32_t b) const;
+    bool FindRepeats(void);
+    void BuildSpatialIndex(void);
+    void Put(const void* data, size_t size);
+    void Pad(void);
+
+    Pass m_Pass = Pass::Measure;
+    Counts m_Counts;
+    NodeEntry m_Node = {};
+    bool m_HasNode = false;
+    uint64_t m_NextId = 1;
+    float m_View[4] = {};
+    uint64_t m_JournalStamp = 0;
+    std::vector<float> m_Positions;       // x, y of every node, collected while measuring
+    std::vector<TileEntry> m_Tiles;
+    std::vector<uint32_t> m_TileNodes;
+
+    // Dedupe.  "fill" adds nodes, properties and links in the same order every time, so their
+    // place in that order says which node of which instance they belong to.
+    bool m_Dedupe = false;
+    bool m_Collect = false;               // The first walk, which hashes
+    bool m_Skipping = false;              // The node being added is an instance's
+    bool m_InProperties = false;
+    uint32_t m_SkipInstance = 0;          // Which instance, and which of its nodes, while m_Skipping
+    uint32_t m_SkipLocal = 0;
+    uint32_t m_AddedNodes = 0;            // In this walk, instances' included
+    uint32_t m_AddedLinks = 0;
+    uint32_t m_AddedProperties = 0;
+    std::vector<uint64_t> m_NodeIds;
+    std::vector<uint64_t> m_NodeHashes;
+    std::vector<uint32_t> m_NodeProperties;   // Where each node's properties start in m_ValueHashes
+    std::vector<uint64_t> m_ValueHashes;
+    // The bytes the hashes are taken over, for comparing exactly: where each node's and each
+    // property value's record starts, and the records one after another.
+    std::vector<uint64_t> m_NodeRecords;
+    std::string m_NodeBytes;
+    std::vector<uint64_t> m_ValueRecords;
+    std::string m_ValueBytes;
+    std::vector<std::pair<uint64_t, uint32_t>> m_PinNodes;
+    std::vector<LinkKey> m_LinkKeys;
+    std::vector<uint32_t> m_Order;        // Every node's place in the project, tables first
+    std::vector<uint8_t> m_SkipLink;
+    std::vector<uint8_t> m_Override;      // Per property: an instance's value differs from its template's
+    std::vector<TemplateEntry> m_Templates;
+    std::vector<uint32_t> m_TemplateNodes;
+    std::vector<uint32_t> m_TemplateLinks;
+    std::vector<InstanceEntry> m_Instances;
+    std::vector<std::pair<uint32_t, OverrideEntry>> m_Found;     // Instance and override, in the order they come up
+    std::vector<OverrideEntry> m_Overrides;
+    DedupeStats m_DedupeStats;
+    io::Sink* m_Sink = nullptr;
+    uint64_t m_Written = 0;
+    bool m_Failed = false;
+    struct StringHash {
+        typedef void is_transparent;
+        size_t operator()(std::string_view s) const { return std::hash<std::string_view>()(s); }
+    };
+    std::unordered_map<std::string, StrRef, StringHash, std::equal_to<>> m_Interned;  // Names and keys, which repeat a lot
+};
+
+// A mapped binary project.  Everything it hands out points into the mapping and is valid until
+// Close() or the Reader goes away.
+class Reader {
+public:
+    // Map and validate a file.  On failure "error" (if given) says why.
+    bool Open(const char* path, std::string* error = nullptr);
+    // Validate a project already in memory, eg. a buffer.  "data" must stay valid and be 8 byte aligned.
+    bool Open(const char* data, size_t size, std::string* error = nullptr);
+    void Close(void);
+
+    const FileHeader& Header(void) const { return m_Header; }
+
+    // The tables, ie. the project without the copies its instances stand for.
+    size_t NodeCount(void) const { return (size_t)m_Header.nodes.count; }
+    size_t LinkCount(void) const { return (size_t)m_Header.links.count; }
+    const NodeEntry& Node(size_t i) const { return m_Nodes[i]; }
+    const LinkEntry& Link(size_t i) const { return m_Links[i]; }
+    const PinEntry* Pins(const NodeEntry& node) const { return m_Pins + node.first_pin; }
+    const PropertyEntry* Properties(const NodeEntry& node) const { return m_PropertyTable + node.first_property; }
+    const PropertyEntry& Property(size_t i) const { return m_PropertyTable[i]; }   // eg. an OverrideEntry's
+
+    // The project as loaded: the tables' nodes, then the copies of every instance (see the format
+    // notes).  A NodeRef is a node of the tables, and what to change to make the copy.
+    struct NodeRef {
+        const NodeEntry* entry = nullptr;
+        uint64_t id = 0;                  // entry->id + id_shift
+        uint64_t id_shift = 0;            // Also for the pins
+        float offset[2] = {};
+        const InstanceEntry* instance = nullptr;   // nullptr for the tables' own
+        uint32_t local = 0;               // Which of the instance's template's nodes
+    };
+    size_t ProjectNodeCount(void) const { return NodeCount() + (size_t)m_Header.instance_nodes; }
+    size_t ProjectLinkCount(void) const { return LinkCount() + (size_t)m_Header.instance_links; }
+    NodeRef ProjectNode(size_t i) const;
+    LinkEntry ProjectLink(size_t i) const;
+    // The node's properties, with the instance's values where it has its own.
+    void ReadProperties(const NodeRef& node, ::Properties& out) const;
+
+    size_t TemplateCount(void) const { return (size_t)m_Header.templates.count; }
+    size_t InstanceCount(void) const { return (size_t)m_Header.instances.count; }
+    const TemplateEntry& Template(size_t i) const { return m_Templates[i]; }
+    const InstanceEntry& Instance(size_t i) const { return m_Instances[i]; }
+    const uint32_t* TemplateNodes(const TemplateEntry& t) const { return m_TemplateNodes + t.first_node; }
+    const uint32_t* TemplateLinks(const TemplateEntry& t) const { return m_TemplateLinks + t.first_link; }
+    const OverrideEntry* Overrides(const InstanceEntry& i) const { return m_Overrides + i.first_override; }
+
+    // The spatial index.  Files before version 3, and empty projects, have no tiles.  It indexes
+    // the project's nodes, not the tables'.
+    size_t TileCount(void) const { return (size_t)m_Header.tiles.count; }
+    const TileEntry& Tile(size_t i) const { return m_Tiles[i]; }
+    const uint32_t* TileNodes(const TileEntry& tile) const { return m_TileNodes + tile.first; }
+
+    // Out of range references read as "".
+    std::string_view String(StrRef s) const;
+
+    // Fill "out" with a node's properties.
+    void ReadProperties(const NodeEntry& node, ::Properties& out) const;
+
+private:
+    bool Validate(std::string* error);
+    void ReadProperty(const PropertyEntry& e, ::Properties& out) const;
+
+    casa::io::MappedFile m_File;
+    const char* m_Data = nullptr;
+    size_t m_Size = 0;
+    FileHeader m_Header = {};         // A copy, older files have less of it
+    const NodeEntry* m_Nodes = nullptr;
+    const PinEntry* m_Pins = nullptr;
+    const PropertyEntry* m_PropertyTable = nullptr;
+    const LinkEntry* m_Links = nullptr;
+    const TileEntry* m_Tiles = nullptr;
+    const uint32_t* m_TileNodes = nullptr;
+    const TemplateEntry* m_Templates = nullptr;
+    const uint32_t* m_TemplateNodes = nullptr;
+    const uint32_t* m_TemplateLinks = nullptr;
+    const InstanceEntry* m_Instances = nullptr;
+    const OverrideEntry* m_Overrides = nullptr;
+    const char* m_Strings = nullptr;
+};
+
+} // end namespace csa
+} // end namespace casa
+
+#endif /* csa_format_h */
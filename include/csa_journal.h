@@ -0,0 +1,175 @@
+#ifndef csa_journal_h
+#define csa_journal_h
+
+/*
+*  The append only journal that continues a binary project (csa_format.h).
+*
+*  A full save rewrites the whole .csa.  After that, saving only appends what changed since the
+*  previous save to "<project>.<stamp>.csaj" as one batch, so the I/O grows with the edit and not
+*  with the project.  The project file names its journal by the stamp in its header, and the
+*  journal repeats the stamp, so a journal left over from an older version of the project is
+*  never replayed onto a newer one.
+*
+*      JournalHeader | batch | batch | ...
+*      batch:  BatchHeader | record | record | ...
+*      record: RecordHeader | body, padded to 8 bytes
+*
+*  A SetNode body is the node's NodeEntry, its PinEntry and PropertyEntry tables and a string
+*  table of its own, laid out like the tables of a .csa; first_pin and first_property are 0 and
+*  every StrRef points into the record's strings.  A SetLink body is a LinkEntry.  The erase
+*  records have no body.
+*
+*  Each batch carries a checksum of its records.  A batch that is cut short or doesn't match,
+*  eg. after a crash in the middle of a save, ends the journal: it and anything after it are
+*  ignored when reading and cut off when the journal is continued.
+*/
+
+#include "csa_format.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace casa {
+namespace csa {
+
+const char kJournalMagic[4] = { 'C', 'S', 'A', 'J' };
+const uint32_t kJournalVersion = 1;
+
+struct JournalHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t stamp;         // FileHeader::journal_stamp of the project it continues
+};
+
+struct BatchHeader {
+    uint64_t seq;           // 1 for the first batch, then counting up
+    uint64_t size;          // Bytes of records that follow
+    uint64_t next_id;       // First id plano may hand out once the batch is applied
+    uint64_t checksum;      // casa::hash::Bytes() of the records
+    uint32_t records;
+    uint32_t reserved;
+};
+
+enum class RecordKind : uint32_t { SetNode = 1, EraseNode = 2, SetLink = 3, EraseLink = 4 };
+
+struct RecordHeader {
+    uint32_t kind;          // RecordKind
+    uint32_t size;          // Of the body, a multiple of 8
+    uint64_t id;            // Of the node or link
+};
+
+static_assert(sizeof(JournalHeader) % 8 == 0 && sizeof(BatchHeader) % 8 == 0 && sizeof(RecordHeader) % 8 == 0,
+    "journal records must stay 8 byte aligned");
+
+// A random stamp for a new journal, never 0.
+uint64_t NewJournalStamp(void);
+
+// Where the journal with "stamp" of the project at "project_path" lives.
+std::string JournalPath(const std::string& project_path, uint64_t stamp);
+
+// One batch, built in memory.  Only holds what changed.
+class JournalBatch {
+public:
+    // Pins, properties and strings added after SetNode() belong to that node, add inputs before outputs.
+    NodeEntry& SetNode(uint64_t id);
+    StrRef String(std::string_view s);
+    void AddPin(uint64_t id, std::string_view name, plano::types::PinType type, plano::types::PinKind kind);
+    void AddProperties(const Properties& p);
+
+    void EraseNode(uint64_t id);
+    void SetLink(const LinkEntry& link);
+    void EraseLink(uint64_t id);
+    void SetNextId(uint64_t id) { m_NextId = id; }
+
+    bool Empty(void) const { return m_Records == 0 && !m_HasNode; }
+    void Clear(void);
+
+private:
+    friend class JournalWriter;
+    void FinishNode(void);
+    void PutRecord(RecordKind kind, uint64_t id, const void* body, size_t size);
+
+    std::vector<char> m_Bytes;        // Finished records
+    uint32_t m_Records = 0;
+    uint64_t m_NextId = 1;
+
+    bool m_HasNode = false;
+    uint64_t m_NodeId = 0;
+    NodeEntry m_Node = {};
+    std::vector<PinEntry> m_Pins;
+    std::vector<PropertyEntry> m_Properties;
+    std::string m_Strings;
+};
+
+class JournalWriter {
+public:
+    ~JournalWriter(void) { Close(); }
+
+    // Continue the journal at "path" if it belongs to "stamp", after its last good batch.
+    // Anything else at "path" is replaced by an empty journal.
+    bool Open(const std::string& path, uint64_t stamp);
+    void Close(void);
+
+    // Append "batch" as the next batch and wait until it is on disk.  Returns false if the
+    // journal can't be written, it must not be appended to after that.
+    bool Append(JournalBatch& batch);
+
+    bool IsOpen(void) const { return m_File.IsOpen(); }
+    const std::string& Path(void) const { return m_Path; }
+    uint64_t Stamp(void) const { return m_Stamp; }
+    uint64_t Size(void) const { return m_Size; }
+    uint64_t LastSeq(void) const { return m_Seq; }
+
+private:
+    io::FileSink m_File;
+    std::string m_Path;
+    uint64_t m_Stamp = 0;
+    uint64_t m_Size = 0;
+    uint64_t m_Seq = 0;
+};
+
+// One record of a mapped journal.  Pointers point into the mapping.
+struct JournalRecord {
+    RecordKind kind = RecordKind::EraseNode;
+    uint64_t id = 0;
+    const NodeEntry* node = nullptr;             // SetNode
+    const PinEntry* pins = nullptr;              // SetNode: node->input_count inputs, then outputs
+    const PropertyEntry* properties = nullptr;   // SetNode
+    const char* strings = nullptr;               // SetNode
+    uint32_t strings_size = 0;
+    const LinkEntry* link = nullptr;             // SetLink
+};
+
+// The good batches of a journal, in order.
+class JournalReader {
+public:
+    // Returns false if there is no journal at "path" or it belongs to another stamp.  A journal
+    // whose tail is damaged opens fine, with the batches before the damage.
+    bool Open(const std::string& path, uint64_t stamp, std::string* error = nullptr);
+    void Close(void);
+
+    size_t RecordCount(void) const { return m_Records.size(); }
+    const JournalRecord& Record(size_t i) const { return m_Records[i]; }
+    uint64_t LastSeq(void) const { return m_Seq; }
+    uint64_t NextId(void) const { return m_NextId; }
+    uint64_t GoodSize(void) const { return m_GoodSize; }     // Bytes up to the end of the last good batch
+
+    // Out of range references read as "".
+    std::string_view String(const JournalRecord& record, StrRef s) const;
+    void ReadProperties(const JournalRecord& record, ::Properties& out) const;
+
+private:
+    bool ReadBatch(const char* at, uint64_t remaining, uint64_t& used);
+
+    io::MappedFile m_File;
+    std::vector<JournalRecord> m_Records;
+    uint64_t m_Seq = 0;
+    uint64_t m_NextId = 0;
+    uint64_t m_GoodSize = 0;
+};
+
+} // end namespace csa
+} // end namespace casa
+
+#endif /* csa_journal_h */
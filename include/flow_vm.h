@@ -0,0 +1,127 @@
+#ifndef flow_vm_h
+#define flow_vm_h
+
+/*
+*  Bytecode for the imperative part of a graph: the PinType::Flow links between the
+*  blueprint_demo nodes (InputAction Fire, Branch, DoN, SetTimer, PrintString).
+*
+*  CompileFlow() turns the Flow subgraph into a flat, register based program.  Every value the
+*  program touches (DoN counters, Branch conditions, timer arguments, strings to print) lives in a
+*  preallocated register, so running it never touches a node's Properties.  Data inputs that are
+*  linked to regular outputs are refreshed from the dataflow values with Machine::RefreshInputs().
+*/
+
+#include "graph_eval.h"
+#include "plano_bridge.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace casa {
+namespace flow {
+
+enum class Op : uint8_t {
+    Halt,       // Return from a Call, or stop when the call stack is empty
+    Jump,       // pc = a
+    Call,       // push pc+1, pc = a.  Used when one Flow output fans out to several inputs.
+    Branch,     // pc = ints[a] ? b : c
+    DoN,        // if (ints[a] < ints[b]) { ints[a]++; pc++ } else Halt.  a is the node's counter.
+    DoNReset,   // ints[a] = 0
+    SetTimer,   // arm timers[a] with time floats[b], looping ints[c]
+    Print,      // hand strings[a] to the print callback
+};
+
+struct Instruction {
+    Op op = Op::Halt;
+    int32_t a = 0;
+    int32_t b = 0;
+    int32_t c = 0;
+};
+
+enum class Bank : uint8_t { Int, Float, String };
+
+// A data input pin of a Flow node, and the register it was given.
+struct DataInput {
+    uintptr_t node_id = 0;
+    uint32_t input = 0;             // Index into the node's inputs
+    Bank bank = Bank::Int;
+    uint32_t reg = 0;
+    uintptr_t source_pin = 0;       // Output pin feeding it, 0 when unconnected
+};
+
+// Where execution starts when an event node fires.
+struct Entry {
+    uintptr_t node_id = 0;
+    uint32_t output = 0;            // Index into the event node's outputs (eg. 0 = Pressed, 1 = Released)
+    uint32_t pc = 0;
+};
+
+struct Program {
+    std::vector<Instruction> code;
+    std::vector<Entry> entries;
+    std::vector<DataInput> inputs;
+    uint32_t int_registers = 0;
+    uint32_t float_registers = 0;
+    uint32_t string_registers = 0;
+    uint32_t timers = 0;
+
+    // Register of a node's data input, or -1 if the compiler did not need one.
+    int FindInputRegister(uintptr_t node_id, uint32_t input) const;
+};
+
+void CompileFlow(const casa::bridge::GraphView& graph, Program& program);
+
+struct Timer {
+    float time = 0.0f;
+    bool looping = false;
+    uint32_t armed = 0;             // How many times SetTimer ran
+};
+
+class Machine {
+public:
+    typedef void (*PrintFn)(void* user, const std::string& text);
+
+    // Allocate the register file for "program" and zero it.  The program must outlive the machine's use of it.
+    void Load(const Program& program);
+
+    // Resolve the program's linked data inputs to value slots, eg. ExecutionPlan::output_slot.
+    // Call again whenever the plan the values come from is recompiled.
+    void Bind(const std::unordered_map<uintptr_t, casa::eval::Slot>& output_slot);
+
+    // Copy the bound output values into their registers, eg. from Engine::Values() or a
+    // BackgroundEvaluator's ResultSet.
+    void RefreshInputs(const casa::eval::ValueStore& values);
+
+    // Run from an entry point until it halts.  Returns false if it was stopped by the
+    // instruction budget (eg. a Flow cycle with nothing to break it) or call stack overflow.
+    bool Fire(uint32_t entry, uint64_t max_instructions = 1ull << 24);
+
+    void SetPrint(PrintFn print, void* user) { m_Print = print; m_PrintUser = user; }
+
+    int32_t& Int(uint32_t reg) { return m_Ints[reg]; }
+    float& Float(uint32_t reg) { return m_Floats[reg]; }
+    std::string& String(uint32_t reg) { return m_Strings[reg]; }
+    const std::vector<Timer>& Timers(void) const { return m_Timers; }
+    uint64_t InstructionsExecuted(void) const { return m_Executed; }
+
+private:
+    const Program* m_Program = nullptr;
+    std::vector<int32_t> m_Ints;
+    std::vector<float> m_Floats;
+    std::vector<std::string> m_Strings;
+    std::vector<Timer> m_Timers;
+    std::vector<uint32_t> m_CallStack;
+    std::vector<casa::eval::Slot> m_Bound;  // Parallel to Program::inputs, kNoSlot when unbound
+    PrintFn m_Print = nullptr;
+    void* m_PrintUser = nullptr;
+    uint64_t m_Executed = 0;
+};
+
+// Lists the program's entry points with a "Fire" button each.  Inputs are refreshed from "values" before firing.
+void DrawFlowWindow(const Program& program, Machine& machine, const casa::eval::ValueStore& values, bool* open);
+
+} // end namespace flow
+} // end namespace casa
+
+#endif /* flow_vm_h */
@@ -0,0 +1,108 @@
+#ifndef frame_arena_h
+#define frame_arena_h
+
+/*
+*  Bump allocation for short lived temporaries, and a count of global heap allocations.
+*
+*  An Arena hands out memory by bumping a pointer through a chunk and frees everything at once on
+*  Reset().  When a frame needed more than one chunk, Reset() replaces them with a single chunk of
+*  the combined size, so after a few frames a steady workload never touches the heap again.
+*
+*  The UI thread has one arena, FrameArena(), which main() resets right after SDL_GL_SwapWindow
+*  through EndFrame().  Draw callbacks use it for labels and scratch buffers that only have to last
+*  until the frame is presented.  Evaluate callbacks run on other threads and get a per worker
+*  arena from NodeIO::Arena() instead, reset at the start of every run.
+*
+*  Arena memory is never destructed: only put trivially destructible data in it.
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace casa {
+namespace mem {
+
+class Arena {
+public:
+    explicit Arena(size_t chunk_size = 64 * 1024);
+
+    void* Allocate(size_t bytes, size_t align = alignof(std::max_align_t));
+
+    template<typename T>
+    T* Allocate(size_t count)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "arena memory is never destructed");
+        return (T*)Allocate(sizeof(T) * count, alignof(T));
+    }
+
+    // printf into the arena, eg. an ImGui label.
+    const char* Format(const char* fmt, ...);
+
+    // Free everything allocated since the last Reset().
+    void Reset(void);
+
+    size_t Used(void) const { return m_Used + m_Offset; }
+    size_t Capacity(void) const { return m_Capacity; }
+    size_t PeakUsed(void) const { return m_Peak; }
+
+private:
+    void Grow(size_t bytes, size_t align);
+
+    std::vector<std::unique_ptr<char[]>> m_Chunks;
+    std::vector<size_t> m_ChunkSizes;
+    size_t m_Offset = 0;        // Into the last chunk
+    size_t m_Used = 0;          // Bytes in the chunks before the last one
+    size_t m_Capacity = 0;
+    size_t m_Peak = 0;
+    size_t m_ChunkSize;
+};
+
+// For standard containers, eg. std::vector<float, ArenaAllocator<float>> v{ ArenaAllocator<float>(arena) };
+// deallocate() is a no-op, memory comes back on Reset().
+template<typename T>
+class ArenaAllocator {
+public:
+    typedef T value_type;
+
+    explicit ArenaAllocator(Arena& arena) : m_Arena(&arena) {}
+    template<typename U> ArenaAllocator(const ArenaAllocator<U>& other) : m_Arena(other.m_Arena) {}
+
+    T* allocate(size_t n) { return (T*)m_Arena->Allocate(sizeof(T) * n, alignof(T)); }
+    void deallocate(T*, size_t) {}
+
+    template<typename U> bool operator==(const ArenaAllocator<U>& other) const { return m_Arena == other.m_Arena; }
+    template<typename U> bool operator!=(const ArenaAllocator<U>& other) const { return m_Arena != other.m_Arena; }
+
+private:
+    template<typename U> friend class ArenaAllocator;
+    Arena* m_Arena;
+};
+
+// The UI thread's arena.
+Arena& FrameArena(void);
+
+// Global operator new calls since startup, from any thread, and the bytes they asked for.
+uint64_t HeapAllocations(void);
+uint64_t HeapBytesAllocated(void);
+
+struct FrameMemoryStats {
+    uint64_t frames = 0;
+    uint64_t heap_allocations = 0;      // During the last frame
+    uint64_t peak_heap_allocations = 0;
+    size_t arena_used = 0;              // By the last frame
+    size_t arena_capacity = 0;
+};
+
+// Call once per frame after presenting it: resets FrameArena() and takes the frame's counts.
+void EndFrame(void);
+const FrameMemoryStats& FrameStats(void);
+
+void DrawMemoryWindow(bool* open);
+
+} // end namespace mem
+} // end namespace casa
+
+#endif /* frame_arena_h */
@@ -0,0 +1,129 @@
+#ifndef graph_document_h
+#define graph_document_h
+
+/*
+*  casa's own copy of the active graph, as a persistent document.
+*
+*  plano's vectors of nodes and links can only be read on the UI thread and change under anyone
+*  who holds on to them.  The Document mirrors their contents (node types, pins, Properties and
+*  links) in PersistentMaps keyed by id, so Take() hands out a consistent Snapshot in O(1) that
+*  stays valid and unchanged however the graph is edited afterwards.  Autosave, the evaluator
+*  and undo can each keep the version they are working on for as long as they need it.
+*
+*  An edit copies one NodeData and the trie path above it, O(log n), and shares the rest with
+*  every Snapshot still alive.
+*
+*  Keeping up with plano works like the undo history: property edits arrive through
+*  MarkPropertiesDirty() and are folded in by Update(), nodes and links that came or went are
+*  found by SyncTopology() whenever the evaluator captured a new topology.  Node positions only
+*  change when the user drags the selection, so SyncLayout() just watches the selected nodes.
+*  That keeps a Snapshot a complete project, which WriteSnapshot() saves like a live context.
+*/
+
+#include "plano_api.h"
+#include "plano_bridge.h"
+#include "persistent_map.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace casa {
+namespace doc {
+
+struct PinData {
+    uintptr_t id = 0;
+    plano::types::PinType type = plano::types::PinType::Flow;
+    std::string name;
+};
+
+struct NodeData {
+    uintptr_t id = 0;
+    std::string type;                 // The registered NodeDescription::Type
+    std::vector<PinData> inputs;
+    std::vector<PinData> outputs;
+    Properties properties;
+    ImVec2 position;                  // Canvas position
+    ImVec2 size;
+    ImVec4 color;
+    uint32_t node_type = 0;           // plano::types::NodeType
+    std::string state;
+    std::string saved_state;
+};
+
+struct LinkData {
+    uintptr_t id = 0;
+    uintptr_t start_pin = 0;          // Always an output pin
+    uintptr_t end_pin = 0;            // Always an input pin
+    ImVec4 color = ImVec4(1.0f, 1.0f, 1.0f, 1.0f);
+};
+
+// One version of the document.  Copies are O(1) and never see later edits.
+struct Snapshot {
+    PersistentMap<NodeData> nodes;
+    PersistentMap<LinkData> links;
+    uint64_t version = 0;             // Goes up with every edit to the Document it was taken from
+};
+
+class Document {
+public:
+    Document(void);
+    ~Document(void);
+
+    Document(const Document&) = delete;
+    Document& operator=(const Document&) = delete;
+
+    const Snapshot& Current(void) const { return m_Current; }
+    Snapshot Take(void) const { return m_Current; }
+    uint64_t Version(void) const { return m_Current.version; }
+
+    // Direct edits.  SetProperties() does nothing for an unknown node.
+    void SetNode(NodeData node);
+    bool EraseNode(uintptr_t id);
+    void SetProperties(uintptr_t id, const Properties& p);
+    void SetLink(const LinkData& link);
+    bool EraseLink(uintptr_t id);
+
+    // Fold in the property edits reported since the last call.  Once per frame, after the graph was drawn.
+    void Update(void);
+
+    // Add and remove whatever nodes and links "graph" has that the document doesn't, or the other
+    // way round.  Nodes that are already there keep their properties, Update() looks after those.
+    void SyncTopology(const casa::bridge::GraphView& graph);
+
+    // Pick up where the selected nodes were moved to.  Once per frame, costs in the size of the
+    // selection.  Waits while "interacting", so a drag becomes one edit when it ends.
+    void SyncLayout(bool interacting);
+
+    // Empty the document, eg. when a project is loaded and ids start over.
+    void Clear(void);
+
+private:
+    static void OnEdit(void* user, const Properties* p);
+    void Edited(void) { m_Current.version++; }
+
+    Snapshot m_Current;
+    std::unordered_map<uintptr_t, Properties> m_Pending;  // Edited Properties as they were when reported
+    casa::bridge::ContextIndex m_Index;                    // Rebuilt by SyncTopology()
+    std::vector<uintptr_t> m_Selected;
+    std::unordered_set<uintptr_t> m_Watched;               // Selected at some point since the last SyncLayout() that wasn't waiting
+};
+
+// Build a NodeData from a captured node.
+NodeData MakeNodeData(const casa::bridge::GraphView& graph, const casa::bridge::NodeView& node);
+
+// Copy what "layout" says into "node".  Pin names only where the pin counts agree.
+void ApplyLayout(const casa::bridge::NodeLayout& layout, NodeData& node);
+
+// A csa::Writer fill function for "snapshot".  Safe on any thread, the snapshot never changes.
+bool WriteSnapshot(const Snapshot& snapshot, casa::csa::Writer& out);
+
+// Add what changed from "before" to "after" to a journal batch.  Costs in the number of changes
+// when both snapshots come from one Document.
+void WriteChanges(const Snapshot& before, const Snapshot& after, casa::csa::JournalBatch& out);
+
+} // end namespace doc
+} // end namespace casa
+
+#endif /* graph_document_h */
@@ -0,0 +1,291 @@
+#ifndef graph_eval_h
+#define graph_eval_h
+
+/*
+*  Dataflow evaluation of the active plano graph.
+*
+*  Nodes opt in by registering an Evaluate callback for their NodeDescription::Type.
+*  The engine snapshots the context's nodes and links once, compiles them into a flat,
+*  topologically ordered ExecutionPlan and then runs that plan every frame without walking
+*  plano's node/link structures again.  The plan is only rebuilt when the topology changes.
+*
+*  Runs are incremental: a node whose properties were edited (see TrackEdits) marks itself and
+*  everything downstream of it dirty, and only dirty steps are re-evaluated.
+*
+*  With a time slice set, a run stops once the slice is used up and carries on from the same
+*  step on the next Update(), so a big graph never holds up a frame for longer than the slice.
+*
+*  With more than one worker, large runs go through a work stealing pool: a node becomes ready
+*  once all its dirty upstream nodes are done.  Evaluate callbacks may therefore run on any
+*  thread, and must only read their Properties and inputs and write their own outputs.
+*
+*  Values live in a ValueStore, one contiguous array per kind of pin (see value_store.h).
+*
+*  Evaluate callbacks must also be pure: with an OutputCache attached, a node whose Type,
+*  Properties and upstream values were seen before gets its outputs from the cache instead.
+*/
+
+#include "plano_api.h"
+#include "plano_bridge.h"
+#include "frame_arena.h"
+#include "value_store.h"
+#include "work_stealing_pool.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+namespace casa {
+namespace eval {
+
+// What an Evaluate callback gets to see: the node's properties, its input values
+// (already resolved through the links) and its output values to fill in.
+// Reads and writes convert between kinds, so a Float input linked to an Int output still works.
+// Flow and Delegate pins are read and written as Bool, the "fired" flag.
+class NodeIO {
+public:
+    const Properties& Props(void) const { return *m_Properties; }
+    int InputCount(void) const { return (int)m_InputCount; }
+    int OutputCount(void) const { return (int)m_OutputCount; }
+
+    bool InputBool(int index) const { return m_Store->GetBool(m_InputSlots[index]); }
+    int32_t InputInt(int index) const { return m_Store->GetInt(m_InputSlots[index]); }
+    float InputFloat(int index) const { return m_Store->GetFloat(m_InputSlots[index]); }
+    const std::string& InputString(int index) const { return m_Store->GetString(m_InputSlots[index]); }
+
+    void SetBool(int index, bool v) { m_Store->SetBool(m_OutputSlots[index], v); }
+    void SetInt(int index, int32_t v) { m_Store->SetInt(m_OutputSlots[index], v); }
+    void SetFloat(int index, float v) { m_Store->SetFloat(m_OutputSlots[index], v); }
+    void SetString(int index, const std::string& v) { m_Store->SetString(m_OutputSlots[index], v); }
+
+    // Raw access, for evaluators that know their pin kinds at compile time (see typed_node.h).
+    ValueStore& Store(void) { return *m_Store; }
+    Slot InputSlot(int index) const { return m_InputSlots[index]; }
+    Slot OutputSlot(int index) const { return m_OutputSlots[index]; }
+
+    // Scratch memory for the callback's temporaries, owned by the worker running it and reset
+    // at the start of every run (see frame_arena.h).
+    casa::mem::Arena& Arena(void) { return *m_Arena; }
+
+private:
+    friend class Engine;
+    friend class BatchEngine;
+    const Properties* m_Properties = nullptr;
+    casa::mem::Arena* m_Arena = nullptr;
+    ValueStore* m_Store = nullptr;
+    const Slot* m_InputSlots = nullptr;
+    const Slot* m_OutputSlots = nullptr;
+    uint32_t m_InputCount = 0;
+    uint32_t m_OutputCount = 0;
+};
+
+typedef void (*EvaluateFn)(NodeIO& io);
+
+class OutputCache;
+
+// Evaluators are looked up by node type, so one registration covers every context.
+void RegisterEvaluator(const std::string& type, EvaluateFn evaluate);
+EvaluateFn FindEvaluator(const std::string& type);
+
+// Order independent hash of every key and value in a Properties block.
+uint64_t PropertiesHash(const Properties& p);
+
+// Tell the evaluator a node's properties changed.  The engine picks these up on its next Update().
+void MarkPropertiesDirty(const Properties* p);
+
+// Also hand every MarkPropertiesDirty() call to "listener", eg. so the undo history knows which
+// nodes to look at.  UI thread only, like the calls themselves.
+typedef void (*EditListenerFn)(void* user, const Properties* p);
+void AddEditListener(EditListenerFn listener, void* user);
+void RemoveEditListener(EditListenerFn listener, void* user);
+
+// Move the edits reported since the last call into "out" (appended).  Engine::CollectEdits() uses this.
+void TakePendingEdits(std::vector<const Properties*>& out);
+
+// Progress bar for a node that a sliced run (see Engine::SetTimeSlice) has not reached yet.
+void DrawEvaluationProgress(const Properties* p);
+
+// Where DrawEvaluationProgress() asks about nodes when no Engine on the UI thread has a run in
+// flight, eg. the BackgroundEvaluator.  Returns true, with the run's progress, while "p"'s node
+// is still pending.  One at a time, nullptr to remove; UI thread only.
+typedef bool (*ProgressSourceFn)(void* user, const Properties* p, float* progress);
+void SetProgressSource(ProgressSourceFn source, void* user);
+
+// Wraps a node's DrawAndEdit callback so edits made through its widgets mark the node dirty.
+// Use it in ConstructDefinition:  node.DrawAndEditProperties = casa::eval::TrackEdits<DrawAndEdit>;
+// It also draws a progress bar while a sliced run still has the node pending.
+template<void (*DrawAndEdit)(Properties&)>
+void TrackEdits(Properties& p)
+{
+    DrawEvaluationProgress(&p);
+    uint64_t before = PropertiesHash(p);
+    DrawAndEdit(p);
+    if (PropertiesHash(p) != before)
+        MarkPropertiesDirty(&p);
+}
+
+// One node's worth of work in the plan.
+struct PlanStep {
+    EvaluateFn evaluate = nullptr;
+    Properties* properties = nullptr;
+    uint64_t type_hash = 0;     // Hash of the node's Type, the start of its cache key
+    uint32_t node = 0;          // Index into the GraphView the plan was compiled from
+    uint32_t first_input = 0;   // Index into ExecutionPlan::input_slots
+    uint32_t input_count = 0;
+    uint32_t first_output = 0;  // Index into ExecutionPlan::output_slots
+    uint32_t output_count = 0;
+};
+
+struct ExecutionPlan {
+    uint64_t topology = 0;
+    std::vector<PlanStep> steps;                          // Topological order, only nodes with an evaluator
+    std::vector<uint32_t> order;                          // Topological order of every node not on a cycle
+    std::vector<Slot> input_slots;                        // Per input pin: value slot it reads, kNoSlot when unconnected
+    std::vector<Slot> output_slots;                       // Per output pin: value slot it writes
+    std::unordered_map<uintptr_t, Slot> output_slot;      // Output pin id -> value slot
+    std::unordered_map<const Properties*, uint32_t> node_of_properties;
+    std::vector<uint32_t> downstream_offsets;             // CSR node -> downstream nodes, node_count+1 entries
+    std::vector<uint32_t> downstream;
+    std::vector<int32_t> step_of_node;                    // Node -> index into steps, -1 if it has no evaluator
+    uint32_t bank_size[kBankCount] = { 1, 1, 1, 1, 1 };  // Slots per ValueBank, default entries included
+    uint32_t node_count = 0;
+    uint32_t cyclic_nodes = 0;                            // Nodes left out of the plan because they sit on a cycle
+};
+
+// Turns a captured graph into a plan.  Pure function of the GraphView, touches nothing else.
+void CompilePlan(const casa::bridge::GraphView& graph, ExecutionPlan& plan);
+
+struct EngineStats {
+    uint64_t compiles = 0;
+    uint32_t nodes = 0;
+    uint32_t steps = 0;
+    uint32_t cyclic_nodes = 0;
+    uint32_t last_run_steps = 0;                          // Steps evaluated by the last run
+    uint32_t last_skipped_steps = 0;                      // Steps skipped because they were clean
+    bool last_run_parallel = false;
+    uint32_t last_run_frames = 0;                         // Update() calls the last finished run was spread over
+    bool in_flight = false;                               // A sliced run is part way through the plan
+    float progress = 1.0f;                                // Of the run in flight
+    uint64_t total_run_steps = 0;
+    uint64_t total_skipped_steps = 0;
+    double last_compile_ms = 0.0;
+    double last_run_ms = 0.0;                             // Summed over all of its slices
+};
+
+class Engine {
+public:
+    typedef bool (*InterruptFn)(void* user);
+
+    ~Engine(void);
+
+    // Recompile when the topology changed, pick up property edits, then run the dirty steps.
+    // Call once per frame after plano::api::Frame().
+    void Update(void);
+
+    // Recompile the plan if the active context's topology changed.  Returns true when it did.
+    // A fresh plan starts out fully dirty.
+    bool Sync(void);
+
+    // Compile an already captured graph (Sync() does this for the active context).
+    void Compile(casa::bridge::GraphView graph, uint64_t topology);
+
+    // Number of threads used by Run(), including the calling thread.  1 runs everything serially.
+    void SetWorkerCount(unsigned workers);
+    unsigned WorkerCount(void) const { return m_Pool ? m_Pool->WorkerCount() : 1; }
+
+    // Runs with fewer dirty steps than this stay serial, the pool's overhead isn't worth it.
+    void SetParallelThreshold(uint32_t steps) { m_ParallelThreshold = steps; }
+
+    // Stop a run once it has taken "ms" and resume it on the next call, eg. 4 ms to leave a
+    // 60 fps frame enough room for drawing.  0 runs to completion every time.  Sliced runs are serial.
+    void SetTimeSlice(double ms) { m_TimeSliceMs = ms; }
+    double TimeSlice(void) const { return m_TimeSliceMs; }
+
+    // Checked after every step.  Once it returns true the run stops where it is, exactly as if its
+    // time slice ran out, and the next Run() resumes it.  Parallel runs stop handing out nodes.
+    void SetInterrupt(InterruptFn interrupt, void* user) { m_Interrupt = interrupt; m_InterruptUser = user; }
+
+    // Memoize node outputs in "cache" (may be nullptr).  The cache is not owned, and is meant to
+    // outlive plans and contexts so a reloaded project finds its old results.
+    void SetCache(OutputCache* cache);
+    OutputCache* Cache(void) const { return m_Cache; }
+
+    // Drain the edits reported through MarkPropertiesDirty() into the dirty set.
+    void CollectEdits(void);
+
+    // Mark a node and its whole downstream cone dirty.
+    void MarkDirty(uint32_t node);
+    void MarkAllDirty(void);
+
+    // Run the dirty steps of the current plan, in plan order, and clear the dirty set.
+    // With a time slice this may stop part way and pick up from there next time.
+    void Run(void);
+
+    // True while a sliced run has not evaluated "node" yet.
+    bool InFlight(uint32_t node) const;
+
+    // Forget the plan and all values (eg. when the context is destroyed).
+    void Reset(void);
+
+    const EngineStats& Stats(void) const { return m_Stats; }
+    const ExecutionPlan& Plan(void) const { return m_Plan; }
+    const casa::bridge::GraphView& Graph(void) const { return m_Graph; }
+
+    // Slot of an output pin, or kNoSlot if the pin is unknown.  Read it from Values().
+    Slot FindOutput(uintptr_t pin_id) const;
+    const ValueStore& Values(void) const { return m_Values; }
+
+private:
+    bool Interrupted(void) const { return m_Interrupt != nullptr && m_Interrupt(m_InterruptUser); }
+    void RunStep(const PlanStep& step, unsigned worker);
+    uint64_t& SlotHash(Slot slot) { return m_SlotHash[(uint32_t)SlotBank(slot)][SlotIndex(slot)]; }
+    void StartRun(void);
+    void FinishRun(void);
+    uint32_t RunSerial(std::chrono::steady_clock::time_point start);
+    uint32_t RunParallel(void);
+    static void RunNodeTask(void* user, uint32_t node, unsigned worker);
+
+    casa::bridge::GraphView m_Graph;
+    ExecutionPlan m_Plan;
+    ValueStore m_Values;
+    std::vector<uint64_t> m_SlotHash[kBankCount];   // Per value slot: content hash of the value, for cache keys
+    OutputCache* m_Cache = nullptr;
+    std::vector<uint8_t> m_Dirty;   // Per node
+    std::vector<uint32_t> m_Stack;  // Scratch for MarkDirty
+    std::vector<const Properties*> m_Edits;  // Scratch for CollectEdits
+    std::vector<std::unique_ptr<casa::mem::Arena>> m_Arenas;  // Per worker, for NodeIO::Arena()
+    bool m_AnyDirty = false;
+    EngineStats m_Stats;
+
+    // Continuation of a run: the next index into m_Plan.order and what has been done so far.
+    double m_TimeSliceMs = 0.0;
+    bool m_InFlight = false;
+    bool m_Rewound = false;         // Edits landed behind the cursor, so it went back to the start
+    uint32_t m_Cursor = 0;
+    uint32_t m_RunSteps = 0;        // Dirty steps when the run started (or was rewound), plus those already done
+    uint32_t m_RunDone = 0;
+    uint32_t m_RunFrames = 0;
+    double m_RunMs = 0.0;
+    InterruptFn m_Interrupt = nullptr;
+    void* m_InterruptUser = nullptr;
+
+    std::unique_ptr<WorkStealingPool> m_Pool;
+    std::unique_ptr<std::atomic<uint32_t>[]> m_Pending;  // Per node: dirty upstream nodes not finished yet
+    std::vector<uint32_t> m_Ready;
+    std::atomic<uint32_t> m_ParallelRan{0};
+    uint32_t m_ParallelThreshold = 64;
+};
+
+// Small ImGui window with the engine counters.
+void DrawStatsWindow(Engine& engine, bool* open);
+
+// The counters part of it, for engines whose stats arrive as a copy (see BackgroundEvaluator).
+void DrawEngineStats(const EngineStats& st, OutputCache* cache);
+
+} // end namespace eval
+} // end namespace casa
+
+#endif /* graph_eval_h */
@@ -0,0 +1,66 @@
+#ifndef graph_generator_h
+#define graph_generator_h
+
+/*
+*  Synthetic projects for benchmarks and stress tests.
+*
+*  A graph is made of every registered node type (see casa_nodes.h), linked the way people wire
+*  graphs by hand: each input is fed by at most one output of the same pin type, from a node
+*  made a little earlier, so links stay short and the graph has no cycles.  Nodes sit on a grid
+*  in the order they were made.  Everything comes from one seed through a generator of our own,
+*  so a seed gives the same project on every platform and standard library.
+*/
+
+#include "plano_api.h"
+#include "plano_bridge.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace casa {
+namespace gen {
+
+// splitmix64: tiny, fast and the same everywhere, which the <random> distributions are not.
+class Random {
+public:
+    explicit Random(uint64_t seed) : m_State(seed) {}
+
+    uint64_t Next(void)
+    {
+        uint64_t z = (m_State += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+    // In [0, n), n > 0.
+    uint32_t Below(uint32_t n) { return (uint32_t)(((Next() >> 32) * n) >> 32); }
+    // In [0, 1).
+    float Unit(void) { return (float)(Next() >> 40) * (1.0f / 16777216.0f); }
+
+private:
+    uint64_t m_State;
+};
+
+struct GraphOptions {
+    uint64_t seed = 1;
+    size_t nodes = 1000;
+    float input_fill = 0.75f;       // Share of the inputs that get a link, where a match is in reach
+    uint32_t reach = 64;            // How many of the nodes made before it a node links back to
+    uint32_t columns = 0;           // Of the layout grid, 0 for a square
+    float spacing[2] = { 320.0f, 220.0f };
+};
+
+// Lay out "options.nodes" nodes of the given types and link them.  The first nodes take each type
+// once, so every type shows up in a graph at least as large as "types".  "nodes" point into "types".
+void GenerateGraph(const std::vector<plano::api::NodeDescription>& types, const GraphOptions& options,
+    std::vector<casa::bridge::NewNode>& nodes, std::vector<casa::bridge::NewLink>& links);
+
+// Replace the active context's nodes and links with a graph of every registered node type.
+// Numeric and bool Properties are varied from their defaults, the way a project that was
+// worked on has them.  Leaves the project clean.  Returns false when there is no active context.
+bool GenerateIntoActiveContext(const GraphOptions& options);
+
+} // end namespace gen
+} // end namespace casa
+
+#endif /* graph_generator_h */
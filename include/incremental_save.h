@@ -0,0 +1,113 @@
+#ifndef incremental_save_h
+#define incremental_save_h
+
+/*
+*  Saving a project by appending what changed to its journal (csa_journal.h).
+*
+*  Once a project was loaded from or fully saved to a .csa, Save() diffs the Document against
+*  the snapshot of the last save and appends only the difference, so one edit costs one small
+*  write and an fsync however big the project is.
+*
+*  When the journal grows past a threshold, a worker thread compacts it: it writes the snapshot
+*  of the latest save as a new .csa naming a new journal, while saves keep going to the old one.
+*  Update() then finishes the switch on the UI thread, in an order where a crash at any point
+*  leaves a project file whose own journal has every saved edit:
+*
+*      1. create the new journal with whatever was saved while the worker was busy
+*      2. rename the new .csa over the old one, which now names the new journal
+*      3. delete the old journal
+*/
+
+#include "graph_document.h"
+#include "csa_journal.h"
+#include <condition_variable>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace casa {
+namespace doc {
+
+struct IncrementalSaveStatus {
+    uint64_t saves = 0;               // Saves that appended to a journal
+    uint64_t last_bytes = 0;          // Appended by the last one
+    double last_ms = 0.0;             // Time the last one took, fsync included
+    uint64_t journal_bytes = 0;
+    uint64_t compactions = 0;
+    bool compacting = false;
+    std::string error;                // Why the last save or compaction failed, empty if it didn't
+};
+
+class IncrementalSaver {
+public:
+    IncrementalSaver(void);
+    ~IncrementalSaver(void);
+
+    IncrementalSaver(const IncrementalSaver&) = delete;
+    IncrementalSaver& operator=(const IncrementalSaver&) = delete;
+
+    // Save onto the project at "path" from now on.  "stamp" is the journal its header names and
+    // "base" what the file and journal hold together, eg. the Document right after loading it.
+    bool Begin(const std::string& path, uint64_t stamp, const Snapshot& base);
+
+    // Stop, eg. when another project is loaded.  A compaction in progress is dropped.
+    void Reset(void);
+
+    bool Ready(void) const { return m_Journal != nullptr; }
+    const std::string& Path(void) const { return m_Path; }
+
+    // Append the changes since the last save.  Returns false if they couldn't be written, the
+    // project then needs a full save.
+    bool Save(const Document& document);
+
+    // Once per frame: finishes a compaction the worker is done with.
+    void Update(void);
+
+    void SetCompactThreshold(uint64_t bytes) { m_Threshold = bytes; }
+    // Whether compaction writes the compressed container (csa_compress.h).
+    void SetCompress(bool compress) { m_Compress = compress; }
+    // Whether it stores repeated subgraphs once (csa_format.h).
+    void SetDedupe(bool dedupe) { m_Dedupe = dedupe; }
+    const IncrementalSaveStatus& Status(void) const { return m_Status; }
+
+private:
+    struct Compaction {
+        uint64_t generation = 0;      // Of the Begin() it was started under
+        Snapshot snapshot;
+        std::string temp;             // Where the worker writes the new .csa
+        uint64_t stamp = 0;           // Of the new journal
+        bool compress = false;
+        bool dedupe = false;
+        bool done = false;
+        bool ok = false;
+    };
+
+    void StartCompaction(void);
+    void FinishCompaction(std::unique_ptr<Compaction> job);
+    void WorkerLoop(void);
+
+    // UI thread
+    std::string m_Path;
+    std::unique_ptr<casa::csa::JournalWriter> m_Journal;
+    Snapshot m_Saved;                 // What the file and journal hold
+    uint64_t m_Generation = 0;
+    uint64_t m_Threshold = 16 * 1024 * 1024;
+    uint64_t m_CompactAt = 0;         // Journal size that starts the next compaction
+    bool m_Compress = false;
+    bool m_Dedupe = false;
+    IncrementalSaveStatus m_Status;
+
+    // Hand over
+    std::mutex m_Lock;
+    std::condition_variable m_Wake;
+    std::unique_ptr<Compaction> m_Job;  // Being written, or written and waiting for Update()
+    bool m_Stop = false;
+    std::future<void> m_Worker;
+};
+
+} // end namespace doc
+} // end namespace casa
+
+#endif /* incremental_save_h */
@@ -0,0 +1,40 @@
+#ifndef lz_block_h
+#define lz_block_h
+
+/*
+*  A small LZ77 block codec in the style of LZ4, for project files.
+*
+*  Projects repeat the same type names, pin names and property keys over and over, which a
+*  64KB window and a greedy single probe hash match finder pick up well enough while staying
+*  in the GB/s range on both ends.  Blocks are independent, so the container (csa_compress.h)
+*  can compress and decompress them on as many threads as it likes.
+*
+*  A block is a run of sequences:
+*
+*      token | [literal length bytes] | literals | offset (2 bytes, LE) | [match length bytes]
+*
+*  The token's high nibble is the literal length and its low nibble the match length minus 4;
+*  a nibble of 15 continues in bytes of 255 until one is smaller, which is added too.  The last
+*  sequence has literals only and ends the block.
+*/
+
+#include <cstddef>
+
+namespace casa {
+namespace lz {
+
+// The most Compress() can write for "size" bytes of input.
+size_t CompressBound(size_t size);
+
+// Compress "size" bytes into "out", which holds "capacity" bytes.  Returns the compressed size,
+// or 0 if it doesn't fit.
+size_t Compress(const char* data, size_t size, char* out, size_t capacity);
+
+// Decompress a block into exactly "raw_size" bytes at "out".  Returns false for a block that
+// is damaged or doesn't come out at raw_size; it never reads or writes out of bounds.
+bool Decompress(const char* data, size_t size, char* out, size_t raw_size);
+
+} // end namespace lz
+} // end namespace casa
+
+#endif /* lz_block_h */
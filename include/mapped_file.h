@@ -0,0 +1,46 @@
+#ifndef mapped_file_h
+#define mapped_file_h
+
+/*
+*  A read only memory mapping of a whole file.
+*
+*  The pages are only read from disk when they are touched, and nothing is copied into the
+*  process: Data() points straight at the page cache.  The mapping lives until Close() or the
+*  destructor, so anything pointing into it must be done with by then.
+*/
+
+#include <cstddef>
+
+namespace casa {
+namespace io {
+
+class MappedFile {
+public:
+    MappedFile(void) {}
+    ~MappedFile(void) { Close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Returns false if the file can't be opened or mapped.  An empty file maps fine, with Data() == nullptr.
+    bool Open(const char* path);
+    void Close(void);
+
+    bool IsOpen(void) const { return m_Open; }
+    const char* Data(void) const { return m_Data; }
+    size_t Size(void) const { return m_Size; }
+
+private:
+    const char* m_Data = nullptr;
+    size_t m_Size = 0;
+    bool m_Open = false;
+#if defined(_WIN32)
+    void* m_File = nullptr;
+    void* m_Mapping = nullptr;
+#endif
+};
+
+} // end namespace io
+} // end namespace casa
+
+#endif /* mapped_file_h */
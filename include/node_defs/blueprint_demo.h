@@ -3,6 +3,9 @@
 
 #include <plano_api.h>
 #include <internal/imgui_stdlib.h> // For 3-arg text box
+#include "graph_eval.h"
+#include "property_block.h"
+#include "typed_node.h"
 using plano::types::PinType;
 namespace node_defs
 {
@@ -38,50 +41,37 @@ namespace InputActionFire
 
 } // end namespace InputActionFire
 
-namespace OutputAction
+struct OutputAction : casa::eval::Node<OutputAction, casa::eval::Inputs<float, bool>, casa::eval::Outputs<casa::eval::Delegate>>
 {
-    void Initialize(Properties& Properties)
-    {
-        return;
-    }
+    static constexpr const char* kType = "OutputAction";
+    static constexpr std::array<const char*, 2> kInputNames = { "Sample", "Condition" };
+    static constexpr std::array<const char*, 1> kOutputNames = { "Event" };
 
-    void DrawAndEdit(Properties& Properties)
-    {
-        return;
-    }
-
-
-    plano::api::NodeDescription ConstructDefinition(void)
+    static void Evaluate(const Properties&, float /* sample */, bool condition, casa::eval::Delegate& event)
     {
-        plano::api::NodeDescription node;
-        node.Type = "OutputAction";
-
-        node.Inputs.push_back(plano::api::PinDescription("Sample",PinType::Float));
-        node.Inputs.push_back(plano::api::PinDescription("Condition",PinType::Bool));
-
-        node.Outputs.push_back(plano::api::PinDescription("Event",PinType::Delegate));
-
-        node.InitializeDefaultProperties = Initialize;
-        node.DrawAndEditProperties = DrawAndEdit;
-        return node;
+        // The event fires when the condition holds.
+        event.fired = condition;
     }
-} // end namespace OutputAction
+}; // end struct OutputAction
 
 namespace Branch
 {
-    void Initialize(Properties& p)
+    struct PropertyBlock
     {
-        p.pint["buttonvalue"] ;
-    }
+        int button_value = 0;
+
+        static constexpr std::array<casa::props::Field<PropertyBlock>, 1> kSchema = {{
+            { "buttonValue", &PropertyBlock::button_value },
+        }};
+    };
 
-    void DrawAndEdit(Properties& p)
+    void DrawAndEdit(PropertyBlock& p)
     {
-        auto input = p.pstring["button"];
         if (ImGui::SmallButton("More")) {
-            p.pint["buttonValue"]++;
+            p.button_value++;
         }
         ImGui::SameLine();
-        ImGui::Text("%i",p.pint["buttonValue"]);
+        ImGui::Text("%i",p.button_value);
         
     }
 
@@ -97,8 +87,8 @@ namespace Branch
         node.Outputs.push_back(plano::api::PinDescription("True",PinType::Flow));
         node.Outputs.push_back(plano::api::PinDescription("False",PinType::Flow));
 
-        node.InitializeDefaultProperties = Initialize;
-        node.DrawAndEditProperties = DrawAndEdit;
+        node.InitializeDefaultProperties = casa::props::InitializeBlock<PropertyBlock>;
+        node.DrawAndEditProperties = casa::props::DrawBlock<PropertyBlock, DrawAndEdit>;
         return node;
     }
 } // end namespace Branch
@@ -1,4 +1,9 @@
 #ifndef PLANO_NODES_H
 #define PLANO_NODES_H
+#include "plano_api.h"
+#include <vector>
 void RegiserNodesToActiveContext(void);
-#endif
\ No newline at end of file
+// The descriptions of every node type RegiserNodesToActiveContext() registers, in the same order,
+// for code that builds projects without going through plano's menus (see graph_generator.h).
+std::vector<plano::api::NodeDescription> RegisteredNodeDescriptions(void);
+#endif
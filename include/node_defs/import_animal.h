@@ -3,39 +3,47 @@
 
 #include <plano_api.h>
 #include <internal/imgui_stdlib.h> // For 3-arg text box
+#include "graph_eval.h"
+#include "property_block.h"
+#include "typed_node.h"
 
 namespace node_defs
 {
 namespace import_animal
 {
-void Initialize(Properties& p)
+struct PropertyBlock
 {
-    p.pstring["input"] = "enter text here";
-}
+    std::string input = "enter text here";
+
+    static constexpr std::array<casa::props::Field<PropertyBlock>, 1> kSchema = {{
+        { "input", &PropertyBlock::input },
+    }};
+};
 
-void DrawAndEdit(Properties& p)
+void DrawAndEdit(PropertyBlock& p)
 {
     ax::NodeEditor::EnableShortcuts(ImGui::GetIO().WantTextInput);
     
     // The input widgets require some guidance on their widths, or else they're very large. (note matching pop at the end).
     ImGui::PushItemWidth(200);
-    ImGui::InputTextWithHint("File Address", "enter text here", &p.pstring["input"]);
+    ImGui::InputTextWithHint("File Address", "enter text here", &p.input);
     ImGui::PopItemWidth();
 }
 
-
-plano::api::NodeDescription ConstructDefinition(void)
+struct Definition : casa::eval::Node<Definition, casa::eval::Inputs<>, casa::eval::Outputs<std::string>>
 {
-    plano::api::NodeDescription node;
-    node.Type = "Import Animal";
-
-    plano::api::PinDescription out1("Animal", plano::types::PinType::String);    
-    node.Outputs.push_back(out1);
-
-    node.InitializeDefaultProperties = Initialize;
-    node.DrawAndEditProperties = DrawAndEdit;
-    return node;
-}
+    static constexpr const char* kType = "Import Animal";
+    static constexpr std::array<const char*, 0> kInputNames = {};
+    static constexpr std::array<const char*, 1> kOutputNames = { "Animal" };
+    typedef import_animal::PropertyBlock Block;
+    static void DrawAndEdit(Block& p) { import_animal::DrawAndEdit(p); }
+
+    static void Evaluate(const Block& p, std::string& animal)
+    {
+        // The "Animal" output is just the file address typed into the node.
+        animal = p.input;
+    }
+};
 
 
 } // end namespace import_animal
@@ -0,0 +1,131 @@
+#ifndef MATH_NODES_H
+#define MATH_NODES_H
+
+#include <plano_api.h>
+#include "graph_eval.h"
+#include "batch_eval.h"
+#include "property_block.h"
+#include "simd_kernels.h"
+#include "typed_node.h"
+#include <algorithm>
+
+// Float arithmetic.  Each node has a batch kernel next to its Evaluate, so a sweep (see
+// batch_eval.h) runs all of its variants through it in one call.  The kernels round like the
+// plain expressions, so a lane always matches the variant evaluated on its own.
+namespace node_defs
+{
+namespace math_nodes
+{
+
+namespace Constant
+{
+struct PropertyBlock
+{
+    float value = 0.0f;
+
+    static constexpr std::array<casa::props::Field<PropertyBlock>, 1> kSchema = {{
+        { "value", &PropertyBlock::value },
+    }};
+};
+
+struct Definition : casa::eval::Node<Definition, casa::eval::Inputs<>, casa::eval::Outputs<float>>
+{
+    static constexpr const char* kType = "Constant";
+    static constexpr std::array<const char*, 0> kInputNames = {};
+    static constexpr std::array<const char*, 1> kOutputNames = { "Value" };
+    typedef Constant::PropertyBlock Block;
+    static void DrawAndEdit(Block& p)
+    {
+        ImGui::PushItemWidth(120);
+        ImGui::DragFloat("value", &p.value, 0.01f);
+        ImGui::PopItemWidth();
+    }
+
+    static void Evaluate(const Block& p, float& value) { value = p.value; }
+
+    static void EvaluateBatch(casa::eval::BatchIO& io)
+    {
+        const float* value = io.PropFloat("value", 0.0f);
+        std::copy(value, value + io.Lanes(), io.OutputFloat(0));
+    }
+};
+} // end namespace Constant
+
+namespace ScaleOffset
+{
+struct PropertyBlock
+{
+    float scale = 1.0f;
+    float offset = 0.0f;
+
+    static constexpr std::array<casa::props::Field<PropertyBlock>, 2> kSchema = {{
+        { "scale", &PropertyBlock::scale },
+        { "offset", &PropertyBlock::offset },
+    }};
+};
+
+struct Definition : casa::eval::Node<Definition, casa::eval::Inputs<float>, casa::eval::Outputs<float>>
+{
+    static constexpr const char* kType = "Scale Offset";
+    static constexpr std::array<const char*, 1> kInputNames = { "In" };
+    static constexpr std::array<const char*, 1> kOutputNames = { "Out" };
+    typedef ScaleOffset::PropertyBlock Block;
+    static void DrawAndEdit(Block& p)
+    {
+        ImGui::PushItemWidth(120);
+        ImGui::DragFloat("scale", &p.scale, 0.01f);
+        ImGui::DragFloat("offset", &p.offset, 0.01f);
+        ImGui::PopItemWidth();
+    }
+
+    static void Evaluate(const Block& p, float in, float& out)
+    {
+        float scaled = in * p.scale;
+        out = scaled + p.offset;
+    }
+
+    static void EvaluateBatch(casa::eval::BatchIO& io)
+    {
+        casa::simd::MulAddF(io.OutputFloat(0), io.InputFloat(0), io.PropFloat("scale", 1.0f),
+                            io.PropFloat("offset", 0.0f), io.Lanes());
+    }
+};
+} // end namespace ScaleOffset
+
+namespace Add
+{
+struct Definition : casa::eval::Node<Definition, casa::eval::Inputs<float, float>, casa::eval::Outputs<float>>
+{
+    static constexpr const char* kType = "Add";
+    static constexpr std::array<const char*, 2> kInputNames = { "A", "B" };
+    static constexpr std::array<const char*, 1> kOutputNames = { "Sum" };
+
+    static void Evaluate(const Properties&, float a, float b, float& sum) { sum = a + b; }
+
+    static void EvaluateBatch(casa::eval::BatchIO& io)
+    {
+        casa::simd::AddF(io.OutputFloat(0), io.InputFloat(0), io.InputFloat(1), io.Lanes());
+    }
+};
+} // end namespace Add
+
+namespace Multiply
+{
+struct Definition : casa::eval::Node<Definition, casa::eval::Inputs<float, float>, casa::eval::Outputs<float>>
+{
+    static constexpr const char* kType = "Multiply";
+    static constexpr std::array<const char*, 2> kInputNames = { "A", "B" };
+    static constexpr std::array<const char*, 1> kOutputNames = { "Product" };
+
+    static void Evaluate(const Properties&, float a, float b, float& product) { product = a * b; }
+
+    static void EvaluateBatch(casa::eval::BatchIO& io)
+    {
+        casa::simd::MulF(io.OutputFloat(0), io.InputFloat(0), io.InputFloat(1), io.Lanes());
+    }
+};
+} // end namespace Multiply
+
+} // end namespace math_nodes
+} // end namespace node_defs
+#endif //MATH_NODES_H
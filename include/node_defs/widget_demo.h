@@ -5,6 +5,10 @@
 #include <internal/imgui_stdlib.h> // For 3-arg text box
 
 #include "imgui_internal.h" // needed for columns hack for tree widget...
+#include "graph_eval.h"
+#include "property_block.h"
+#include "typed_node.h"
+#include "frame_arena.h"
 using plano::types::PinType;
 namespace node_defs
 {
@@ -13,18 +17,40 @@ namespace widget_demo
 namespace BasicWidgets
 {
 
-void Initialize(Properties& p)
+struct PropertyBlock
 {
-    return;
-}
+    int button = 0;
+    bool check = false;
+    int radio = 0;
+    bool color_button_0 = false;
+    bool color_button_1 = false;
+    bool color_button_2 = false;
+    int spinner = 0;
+    float in_float = 0.0f;
+    float drag_float = 0.0f;
+    float drag_small_float = 0.0f;
 
-void DrawAndEdit(Properties& p)
+    static constexpr std::array<casa::props::Field<PropertyBlock>, 10> kSchema = {{
+        { "Button", &PropertyBlock::button },
+        { "Check", &PropertyBlock::check },
+        { "Radio", &PropertyBlock::radio },
+        { "button-0", &PropertyBlock::color_button_0 },
+        { "button-1", &PropertyBlock::color_button_1 },
+        { "button-2", &PropertyBlock::color_button_2 },
+        { "spinner", &PropertyBlock::spinner },
+        { "infloat", &PropertyBlock::in_float },
+        { "infloat2", &PropertyBlock::drag_float },
+        { "infloat3", &PropertyBlock::drag_small_float },
+    }};
+};
+
+void DrawAndEdit(PropertyBlock& p)
 {
     // Button toggles label
     if (ImGui::Button("Push Me"))
-        p.pint["Button"]++;
+        p.button++;
     ImGui::SameLine();
-    if (p.pint["Button"] & 1)
+    if (p.button & 1)
     {
         ImGui::Text("Thanks for clicking me!");
     } else {
@@ -32,14 +58,15 @@ void DrawAndEdit(Properties& p)
     }
     
     // Checkbox
-    ImGui::Checkbox("Checkbox", &p.pbool["Check"]);
+    ImGui::Checkbox("Checkbox", &p.check);
     
     // Radio buttons
-    ImGui::RadioButton("radio a", &p.pint["Radio"], 0); ImGui::SameLine();
-    ImGui::RadioButton("radio b", &p.pint["Radio"], 1); ImGui::SameLine();
-    ImGui::RadioButton("radio c", &p.pint["Radio"], 2);
+    ImGui::RadioButton("radio a", &p.radio, 0); ImGui::SameLine();
+    ImGui::RadioButton("radio b", &p.radio, 1); ImGui::SameLine();
+    ImGui::RadioButton("radio c", &p.radio, 2);
     
     // Color buttons, demonstrate using PushID() to add unique identifier in the ID stack, and changing style.
+    bool* color_buttons[3] = { &p.color_button_0, &p.color_button_1, &p.color_button_2 };
     for (int i = 0; i < 3; i++)
     {
         
@@ -47,7 +74,7 @@ void DrawAndEdit(Properties& p)
         ImGui::PushStyleColor(ImGuiCol_Button, (ImVec4)ImColor::HSV(i / 7.0f, 0.6f, 0.6f));
         ImGui::PushStyleColor(ImGuiCol_ButtonHovered, (ImVec4)ImColor::HSV(i / 7.0f, 0.7f, 0.7f));
         ImGui::PushStyleColor(ImGuiCol_ButtonActive, (ImVec4)ImColor::HSV(i / 7.0f, 0.8f, 0.8f));
-        bool& c = p.pbool["button-" + std::to_string(i)];
+        bool& c = *color_buttons[i];
         if(ImGui::Button("Click"))
             c =! c;
         ImGui::SameLine();
@@ -64,12 +91,12 @@ void DrawAndEdit(Properties& p)
     // Arrow buttons with Repeater
     float spacing = ImGui::GetStyle().ItemInnerSpacing.x;
     ImGui::PushButtonRepeat(true);
-    if (ImGui::ArrowButton("##left", ImGuiDir_Left)) { p.pint["spinner"]--; }
+    if (ImGui::ArrowButton("##left", ImGuiDir_Left)) { p.spinner--; }
     ImGui::SameLine(0.0f, spacing);
-    if (ImGui::ArrowButton("##right", ImGuiDir_Right)) { p.pint["spinner"]++; }
+    if (ImGui::ArrowButton("##right", ImGuiDir_Right)) { p.spinner++; }
     ImGui::PopButtonRepeat();
     ImGui::SameLine();
-    ImGui::Text("%d", p.pint["spinner"]);
+    ImGui::Text("%d", p.spinner);
     
     // The input widgets also require you to manually disable the editor shortcuts so the view doesn't fly around.
     // (note that this is a per-frame setting, so it disables it for all text boxes.  I left it here so you could find it!)
@@ -79,33 +106,42 @@ void DrawAndEdit(Properties& p)
     
     //ImGui::InputTextWithHint("input text (w/ hint)", "enter text here", &p.pstring["input"], p.pstring["input"].capacity()+1);
     
-    ImGui::InputFloat("input float", &p.pfloat["infloat"], 0.01f, 1.0f, "%.3f");
+    ImGui::InputFloat("input float", &p.in_float, 0.01f, 1.0f, "%.3f");
     
-    ImGui::DragFloat("drag float", &p.pfloat["infloat2"], 0.005f);
-    ImGui::DragFloat("drag small float", &p.pfloat["infloat3"], 0.0001f, 0.0f, 0.0f, "%.06f ns");
+    ImGui::DragFloat("drag float", &p.drag_float, 0.005f);
+    ImGui::DragFloat("drag small float", &p.drag_small_float, 0.0001f, 0.0f, 0.0f, "%.06f ns");
     ImGui::PopItemWidth();
     
     
 }
-plano::api::NodeDescription ConstructDefinition(void)
+
+// Flow passes straight through.
+struct Definition : casa::eval::Node<Definition, casa::eval::Inputs<casa::eval::Flow>, casa::eval::Outputs<casa::eval::Flow>>
 {
-    plano::api::NodeDescription node;
-    node.Type = "BasicWidgets";
-    node.Color = ImColor(128, 195, 248);
-    node.Inputs.push_back(plano::api::PinDescription("Enter",PinType::Flow));
-    node.Outputs.push_back(plano::api::PinDescription("Exit",PinType::Flow));
-    node.InitializeDefaultProperties = Initialize;
-    node.DrawAndEditProperties = DrawAndEdit;
-    return node;
-}
+    static constexpr const char* kType = "BasicWidgets";
+    static constexpr std::array<const char*, 1> kInputNames = { "Enter" };
+    static constexpr std::array<const char*, 1> kOutputNames = { "Exit" };
+    typedef BasicWidgets::PropertyBlock Block;
+    static ImColor Color(void) { return ImColor(128, 195, 248); }
+    static void DrawAndEdit(Block& p) { BasicWidgets::DrawAndEdit(p); }
+
+    static void Evaluate(const Block&, casa::eval::Flow enter, casa::eval::Flow& exit)
+    {
+        exit.fired = enter.fired;
+    }
+};
 } // basic widgets
 namespace TreeDemo {
-void Initialize(Properties& p)
+struct PropertyBlock
 {
-    return;
-}
+    bool check = false;
 
-void DrawAndEdit(Properties& p)
+    static constexpr std::array<casa::props::Field<PropertyBlock>, 1> kSchema = {{
+        { "check", &PropertyBlock::check },
+    }};
+};
+
+void DrawAndEdit(PropertyBlock& p)
 {
     // Tree widgets "stretch to fill whatever space is available" in their parent.
     // There is a shortcoming with the node: they cannot
@@ -134,8 +170,8 @@ void DrawAndEdit(Properties& p)
     {
         ImGui::Text("Hello There");
         if (ImGui::TreeNode("Open Tree")) {
-            ImGui::Text("Checked: %s", p.pbool["check"] ? "true" : "false");
-            ImGui::Checkbox("Option 1", &p.pbool["check"]);
+            ImGui::Text("Checked: %s", p.check ? "true" : "false");
+            ImGui::Checkbox("Option 1", &p.check);
             ImGui::TreePop();
         }
     }
@@ -155,8 +191,8 @@ plano::api::NodeDescription ConstructDefinition(void)
     node.Color = ImColor(255, 128, 64);
     node.Inputs.push_back(plano::api::PinDescription("Enter",PinType::Flow));
     node.Outputs.push_back(plano::api::PinDescription("Exit",PinType::Flow));
-    node.InitializeDefaultProperties = Initialize;
-    node.DrawAndEditProperties = DrawAndEdit;
+    node.InitializeDefaultProperties = casa::props::InitializeBlock<PropertyBlock>;
+    node.DrawAndEditProperties = casa::props::DrawBlock<PropertyBlock, DrawAndEdit>;
     return node;
 } // construct defintion
 
@@ -185,11 +221,10 @@ void DrawAndEdit(Properties& p)
     ImGui::SameLine();
     ImGui::Text("Progress Bar");
     
-    // Progress bar with custom text
+    // Progress bar with custom text, the label only has to last until the frame is presented.
     float progress_saturated = (progress < 0.0f) ? 0.0f : (progress > 1.0f) ? 1.0f : progress;
-    char buf[32];
-    snprintf(buf, 32 ,"%d/%d", (int)(progress_saturated * 1753), 1753);
-    ImGui::ProgressBar(progress, bar_size, buf);
+    const char* label = casa::mem::FrameArena().Format("%d/%d", (int)(progress_saturated * 1753), 1753);
+    ImGui::ProgressBar(progress, bar_size, label);
     
 }
 
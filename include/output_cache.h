@@ -0,0 +1,64 @@
+#ifndef output_cache_h
+#define output_cache_h
+
+/*
+*  Content addressed cache of node outputs.
+*
+*  The key is a hash of what went into the node: its Type, its Properties and the hashes of the
+*  upstream outputs it reads.  Nothing in the key refers to node ids or pointers, so results
+*  survive undo, reloading the same project, and are shared between identical sibling branches.
+*  Entries are evicted least-recently-used once the byte budget is exceeded.
+*/
+
+#include "graph_eval.h"
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace casa {
+namespace eval {
+
+struct CacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    size_t entries = 0;
+    size_t bytes = 0;
+    size_t budget = 0;
+};
+
+class OutputCache {
+public:
+    explicit OutputCache(size_t budget_bytes);
+
+    // Copies the cached outputs for "key" into the "output_count" slots of "store".  Returns false on a miss.
+    bool Lookup(uint64_t key, ValueStore& store, const Slot* slots, uint32_t output_count);
+
+    // Stores a copy of the values in those slots, evicting old entries to stay under budget.
+    void Insert(uint64_t key, const ValueStore& store, const Slot* slots, uint32_t output_count);
+
+    void SetBudget(size_t budget_bytes);
+    void Clear(void);
+    CacheStats Stats(void) const;
+
+private:
+    struct Entry {
+        uint64_t key;
+        size_t bytes;
+        std::vector<PinValue> outputs;  // Boxed, entries outlive the plan whose slots they came from
+    };
+
+    void EvictToBudget(void);
+
+    mutable std::mutex m_Lock;  // Lookups come from every evaluation worker
+    std::list<Entry> m_Lru;     // Front is most recently used
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> m_Index;
+    CacheStats m_Stats;
+};
+
+} // end namespace eval
+} // end namespace casa
+
+#endif /* output_cache_h */
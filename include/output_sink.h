@@ -0,0 +1,102 @@
+#ifndef output_sink_h
+#define output_sink_h
+
+/*
+*  Places to write a stream of bytes to.
+*
+*  Serializers write into a Sink as they go instead of building the whole output in memory
+*  first, so saving a project never holds more than one chunk of it.  Sinks that talk to the OS
+*  (FdSink) pass every Write() straight on, put a BufferedSink in front of them when the writer
+*  produces lots of small pieces.  FileSink is both in one.
+*
+*  Errors stick: once a Write() failed, every later Write() and Flush() fails too, so a writer
+*  can check once at the end.
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace casa {
+namespace io {
+
+class Sink {
+public:
+    virtual ~Sink(void) {}
+    virtual bool Write(const void* data, size_t size) = 0;
+    virtual bool Flush(void) { return true; }
+};
+
+// An open file descriptor, which stays open.  A file handle's descriptor (_open) on Windows.
+class FdSink : public Sink {
+public:
+    explicit FdSink(int fd) : m_Fd(fd) {}
+    bool Write(const void* data, size_t size) override;
+
+private:
+    int m_Fd;
+    bool m_Failed = false;
+};
+
+// A fixed region of memory.  Writing past "capacity" fails and writes nothing.
+class MemorySink : public Sink {
+public:
+    MemorySink(void* data, size_t capacity) : m_Data((uint8_t*)data), m_Capacity(capacity) {}
+    bool Write(const void* data, size_t size) override;
+    size_t Size(void) const { return m_Size; }
+
+private:
+    uint8_t* m_Data;
+    size_t m_Capacity;
+    size_t m_Size = 0;
+    bool m_Failed = false;
+};
+
+// Collects writes into chunks of "chunk_size" bytes before passing them on to "next".
+class BufferedSink : public Sink {
+public:
+    explicit BufferedSink(Sink& next, size_t chunk_size = 64 * 1024);
+    ~BufferedSink(void) { Flush(); }
+
+    bool Write(const void* data, size_t size) override;
+    bool Flush(void) override;
+
+private:
+    Sink& m_Next;
+    std::vector<uint8_t> m_Chunk;
+    size_t m_Used = 0;
+    bool m_Failed = false;
+};
+
+// A file opened for writing (created or truncated), buffered.
+class FileSink : public Sink {
+public:
+    explicit FileSink(size_t chunk_size = 64 * 1024) : m_Chunk(chunk_size) {}
+    ~FileSink(void) { Close(); }
+
+    FileSink(const FileSink&) = delete;
+    FileSink& operator=(const FileSink&) = delete;
+
+    bool Open(const char* path);
+    // Open an existing file, cut it to "size" bytes and carry on writing after them.
+    bool Continue(const char* path, uint64_t size);
+    bool Write(const void* data, size_t size) override;
+    bool Flush(void) override;
+    // Flushes, then waits until the OS has the file on disk, eg. before renaming it over another.
+    bool Sync(void);
+    // Flushes, then closes.  Returns false if anything written since Open() didn't make it.
+    bool Close(void);
+
+    bool IsOpen(void) const { return m_Fd >= 0; }
+
+private:
+    int m_Fd = -1;
+    std::vector<uint8_t> m_Chunk;
+    size_t m_Used = 0;
+    bool m_Failed = false;
+};
+
+} // end namespace io
+} // end namespace casa
+
+#endif /* output_sink_h */
@@ -0,0 +1,337 @@
+#ifndef persistent_map_h
+#define persistent_map_h
+
+/*
+*  An immutable, structurally shared map from 64 bit keys to values: a hash array mapped trie.
+*
+*  Every trie node covers 5 bits of the key and holds only the children that exist, located
+*  through a 32 bit bitmap.  Keys are used as they are, low bits first, so the sequential ids
+*  plano hands out fill the trie evenly: a million nodes sit 4 levels deep.
+*
+*  Nodes are never changed once another map can see them.  Set() and Erase() copy the path from
+*  the root down to the key, at most 32 slots per level, and share everything else with the map
+*  they were called on.  Copying a map copies one pointer, so a copy taken before an edit is an
+*  O(1) snapshot that keeps seeing the old values.  Set() skips the copy for trie nodes this map
+*  made since it was last copied, so filling a map nobody has copied yet costs no more than a plain
+*  trie.  Each trie node carries the token of the map that made it, and copying a map gives both
+*  maps new tokens: a node another map can see is never edited again.  Reference counts can't
+*  tell that safely, the last other owner may be letting go on another thread right then.  Values
+*  are held through shared_ptr<const Value> for the same reason as the nodes, and can be shared
+*  between maps.
+*
+*  A map may be read from any thread while its owner keeps editing its own copy.  Copies are made
+*  on the owner's thread, copying changes the source's token.
+*/
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace casa {
+namespace doc {
+
+template<typename Value>
+class PersistentMap {
+public:
+    typedef std::shared_ptr<const Value> ValuePtr;
+
+    PersistentMap(void) : m_Owner(NewOwner()) {}
+    // Neither map may edit the nodes they now share, both take a new token.
+    PersistentMap(const PersistentMap& other) : m_Root(other.m_Root), m_Size(other.m_Size), m_Owner(NewOwner())
+    {
+        other.m_Owner = NewOwner();
+    }
+    PersistentMap(PersistentMap&& other) noexcept : m_Root(std::move(other.m_Root)), m_Size(other.m_Size), m_Owner(other.m_Owner)
+    {
+        other.m_Size = 0;
+        other.m_Owner = NewOwner();
+    }
+    PersistentMap& operator=(const PersistentMap& other)
+    {
+        if (this != &other) {
+            m_Root = other.m_Root;
+            m_Size = other.m_Size;
+            m_Owner = NewOwner();
+            other.m_Owner = NewOwner();
+        }
+        return *this;
+    }
+    PersistentMap& operator=(PersistentMap&& other) noexcept
+    {
+        if (this != &other) {
+            m_Root = std::move(other.m_Root);
+            m_Size = other.m_Size;
+            m_Owner = other.m_Owner;
+            other.m_Size = 0;
+            other.m_Owner = NewOwner();
+        }
+        return *this;
+    }
+
+    size_t Size(void) const { return m_Size; }
+    bool Empty(void) const { return m_Size == 0; }
+
+    const Value* Find(uint64_t key) const
+    {
+        const ValuePtr* found = FindSlot(key);
+        return found ? found->get() : nullptr;
+    }
+
+    ValuePtr FindShared(uint64_t key) const
+    {
+        const ValuePtr* found = FindSlot(key);
+        return found ? *found : ValuePtr();
+    }
+
+    void Set(uint64_t key, ValuePtr value)
+    {
+        bool added = false;
+        Insert(m_Root, 0, key, std::move(value), m_Owner, added);
+        if (added)
+            m_Size++;
+    }
+
+    void Set(uint64_t key, Value value) { Set(key, std::make_shared<const Value>(std::move(value))); }
+
+    // Returns false if the key was not there.
+    bool Erase(uint64_t key)
+    {
+        bool removed = false;
+        std::shared_ptr<const Node> root = Remove(m_Root, 0, key, m_Owner, removed);
+        if (!removed)
+            return false;
+        m_Root = std::move(root);
+        m_Size--;
+        return true;
+    }
+
+    void Clear(void)
+    {
+        m_Root.reset();
+        m_Size = 0;
+    }
+
+    // fn(uint64_t key, const Value& value) for every entry, in no particular order.
+    template<typename Fn>
+    void ForEach(Fn&& fn) const
+    {
+        if (m_Root)
+            Visit(*m_Root, fn);
+    }
+
+    // True when both maps are the same version, eg. nothing was edited since one was copied from the other.
+    bool SameAs(const PersistentMap& other) const { return m_Root == other.m_Root; }
+
+    // fn(uint64_t key, const Value* before, const Value* after) for every key whose value differs
+    // between "before" and this map, with nullptr for a side that doesn't have the key.  Values
+    // count as different when they are different objects.  Subtrees the two maps share are
+    // skipped, so between versions of one map this costs in the number of edits, not the size.
+    template<typename Fn>
+    void Diff(const PersistentMap& before, Fn&& fn) const { DiffNodes(before.m_Root.get(), m_Root.get(), fn); }
+
+private:
+    static const unsigned kBits = 5;
+    static const uint32_t kMask = 31;
+
+    struct Node;
+
+    // A leaf when "child" is null, otherwise a subtree and "key"/"value" are unused.
+    struct Slot {
+        uint64_t key = 0;
+        ValuePtr value;
+        std::shared_ptr<const Node> child;
+    };
+
+    struct Node {
+        uint64_t owner = 0;         // Token of the map that may still edit it in place
+        uint32_t bitmap = 0;
+        std::vector<Slot> slots;    // One per set bit, in bit order
+    };
+
+    static unsigned SlotIndex(uint32_t bitmap, uint32_t bit) { return (unsigned)std::popcount(bitmap & (bit - 1)); }
+
+    const ValuePtr* FindSlot(uint64_t key) const
+    {
+        const Node* node = m_Root.get();
+        for (unsigned shift = 0; node != nullptr; shift += kBits) {
+            uint32_t bit = 1u << ((key >> shift) & kMask);
+            if (!(node->bitmap & bit))
+                return nullptr;
+            const Slot& slot = node->slots[SlotIndex(node->bitmap, bit)];
+            if (!slot.child)
+                return slot.key == key ? &slot.value : nullptr;
+            node = slot.child.get();
+        }
+        return nullptr;
+    }
+
+    static uint64_t NewOwner(void)
+    {
+        static std::atomic<uint64_t> next{ 1 };
+        return next.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Edits "ref" in place when "owner" made it, eg. while filling a fresh map, and copies it otherwise.
+    static void Insert(std::shared_ptr<const Node>& ref, unsigned shift, uint64_t key, ValuePtr value, uint64_t owner, bool& added)
+    {
+        Node* node;
+        if (ref && ref->owner == owner) {
+            node = const_cast<Node*>(ref.get());
+        } else {
+            auto copy = ref ? std::make_shared<Node>(*ref) : std::make_shared<Node>();
+            copy->owner = owner;
+            node = copy.get();
+            ref = std::move(copy);
+        }
+        uint32_t bit = 1u << ((key >> shift) & kMask);
+        unsigned at = SlotIndex(node->bitmap, bit);
+        if (!(node->bitmap & bit)) {
+            Slot leaf;
+            leaf.key = key;
+            leaf.value = std::move(value);
+            node->slots.insert(node->slots.begin() + at, std::move(leaf));
+            node->bitmap |= bit;
+            added = true;
+            return;
+        }
+
+        Slot& slot = node->slots[at];
+        if (slot.child) {
+            Insert(slot.child, shift + kBits, key, std::move(value), owner, added);
+        } else if (slot.key == key) {
+            slot.value = std::move(value);
+        } else {
+            // Two keys share this prefix, push the old leaf down a level next to the new one.
+            bool ignored = false;
+            std::shared_ptr<const Node> child;
+            Insert(child, shift + kBits, slot.key, std::move(slot.value), owner, ignored);
+            Insert(child, shift + kBits, key, std::move(value), owner, added);
+            slot.child = std::move(child);
+            slot.key = 0;
+        }
+    }
+
+    // Returns the replacement for "node": itself when the key is not there, null once it is empty.
+    static std::shared_ptr<const Node> Remove(const std::shared_ptr<const Node>& node, unsigned shift, uint64_t key, uint64_t owner, bool& removed)
+    {
+        if (!node)
+            return node;
+        uint32_t bit = 1u << ((key >> shift) & kMask);
+        if (!(node->bitmap & bit))
+            return node;
+        unsigned at = SlotIndex(node->bitmap, bit);
+        const Slot& slot = node->slots[at];
+
+        std::shared_ptr<const Node> child;
+        if (slot.child) {
+            child = Remove(slot.child, shift + kBits, key, owner, removed);
+            if (!removed)
+                return node;
+        } else if (slot.key == key) {
+            removed = true;
+        } else {
+            return node;
+        }
+
+        auto copy = std::make_shared<Node>(*node);
+        copy->owner = owner;
+        if (child && !(child->slots.size() == 1 && !child->slots[0].child)) {
+            copy->slots[at].child = std::move(child);
+        } else if (child) {
+            copy->slots[at] = child->slots[0]; // a lone leaf moves up into its parent
+        } else {
+            copy->slots.erase(copy->slots.begin() + at);
+            copy->bitmap &= ~bit;
+            if (copy->slots.empty())
+                return nullptr;
+        }
+        return copy;
+    }
+
+    template<typename Fn>
+    static void Visit(const Node& node, Fn&& fn)
+    {
+        for (const Slot& slot : node.slots) {
+            if (slot.child)
+                Visit(*slot.child, fn);
+            else
+                fn(slot.key, *slot.value);
+        }
+    }
+
+    template<typename Fn>
+    static void VisitSlot(const Slot& slot, Fn&& fn)
+    {
+        if (slot.child)
+            Visit(*slot.child, fn);
+        else
+            fn(slot.key, *slot.value);
+    }
+
+    template<typename Fn>
+    static void DiffNodes(const Node* a, const Node* b, Fn& fn)
+    {
+        if (a == b)
+            return;
+        if (a == nullptr || b == nullptr) {
+            const Node* only = a ? a : b;
+            Visit(*only, [&](uint64_t key, const Value& value) { a ? fn(key, &value, nullptr) : fn(key, nullptr, &value); });
+            return;
+        }
+        for (uint32_t bit = 1; bit != 0; bit <<= 1) {
+            const Slot* sa = (a->bitmap & bit) ? &a->slots[SlotIndex(a->bitmap, bit)] : nullptr;
+            const Slot* sb = (b->bitmap & bit) ? &b->slots[SlotIndex(b->bitmap, bit)] : nullptr;
+            if (sa && sb)
+                DiffSlots(*sa, *sb, fn);
+            else if (sa)
+                VisitSlot(*sa, [&](uint64_t key, const Value& value) { fn(key, &value, nullptr); });
+            else if (sb)
+                VisitSlot(*sb, [&](uint64_t key, const Value& value) { fn(key, nullptr, &value); });
+        }
+    }
+
+    template<typename Fn>
+    static void DiffSlots(const Slot& a, const Slot& b, Fn& fn)
+    {
+        if (a.child && b.child) {
+            DiffNodes(a.child.get(), b.child.get(), fn);
+        } else if (!a.child && !b.child) {
+            if (a.key == b.key) {
+                if (a.value != b.value)
+                    fn(a.key, a.value.get(), b.value.get());
+            } else {
+                fn(a.key, a.value.get(), nullptr);
+                fn(b.key, nullptr, b.value.get());
+            }
+        } else {
+            // A leaf on one side, a subtree on the other: the leaf's key may or may not be in it.
+            const Slot& leaf = a.child ? b : a;
+            const Slot& tree = a.child ? a : b;
+            bool found = false;
+            Visit(*tree.child, [&](uint64_t key, const Value& value) {
+                if (key == leaf.key) {
+                    found = true;
+                    if (&value != leaf.value.get())
+                        a.child ? fn(key, &value, leaf.value.get()) : fn(key, leaf.value.get(), &value);
+                } else {
+                    a.child ? fn(key, &value, nullptr) : fn(key, nullptr, &value);
+                }
+            });
+            if (!found)
+                a.child ? fn(leaf.key, nullptr, leaf.value.get()) : fn(leaf.key, leaf.value.get(), nullptr);
+        }
+    }
+
+    std::shared_ptr<const Node> m_Root;
+    size_t m_Size = 0;
+    mutable uint64_t m_Owner;       // Copying a map from a const one still ends the source's ownership
+};
+
+} // end namespace doc
+} // end namespace casa
+
+#endif /* persistent_map_h */
@@ -0,0 +1,252 @@
+#ifndef plano_bridge_h
+#define plano_bridge_h
+
+/*
+*  The only place casa reaches past plano_api.h into plano's internal node and link storage.
+*  Everything else in casa (evaluator, file code) talks to these flat views instead, so when
+*  plano's internals change there is one file to fix.
+*/
+
+#include "plano_api.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace plano {
+namespace types {
+struct Node;
+struct Link;
+} // end namespace types
+} // end namespace plano
+
+namespace casa {
+namespace csa {
+class Writer;
+class Reader;
+class JournalBatch;
+class JournalReader;
+} // end namespace csa
+
+namespace bridge {
+
+struct PinView {
+    uintptr_t id = 0;
+    plano::types::PinType type = plano::types::PinType::Flow;
+};
+
+struct NodeView {
+    uintptr_t id = 0;
+    std::string type;                     // The registered NodeDescription::Type
+    Properties* properties = nullptr;     // Points into the live context. Only valid until the topology changes.
+    uint32_t first_input = 0;             // Index into GraphView::pins
+    uint32_t input_count = 0;
+    uint32_t first_output = 0;            // Index into GraphView::pins
+    uint32_t output_count = 0;
+};
+
+struct LinkView {
+    uintptr_t start_pin = 0;              // Always an output pin
+    uintptr_t end_pin = 0;                // Always an input pin
+    uintptr_t id = 0;
+};
+
+struct GraphView {
+    std::vector<NodeView> nodes;
+    std::vector<PinView> pins;
+    std::vector<LinkView> links;
+};
+
+// Copies the node/pin/link layout of the active context into "out".
+// Returns false (and leaves "out" empty) when there is no active context.
+bool CaptureActiveContext(GraphView& out);
+
+// Cheap fingerprint of the active context's topology: nodes, pins and links, but not properties.
+// Changes whenever a node or link is added or removed, or the context is swapped out.
+// Returns 0 when there is no active context.
+uint64_t TopologyStamp(void);
+
+// Direct edits of the active context's storage, for undo and redo.
+//
+// Records hold a complete copy of a plano node or link, ids, pins and editor position included,
+// so putting one back gives exactly the object that was taken out.  Every call costs in the size
+// of the record, never in the size of the graph: lookups go through a ContextIndex that the edits
+// keep up to date, and removal swaps the last node into the hole instead of shifting the rest.
+struct NodeRecord {
+    uintptr_t id = 0;
+    std::shared_ptr<plano::types::Node> node;
+    ImVec2 position;
+};
+
+struct LinkRecord {
+    uintptr_t id = 0;
+    std::shared_ptr<plano::types::Link> link;
+};
+
+// Where every node and link id sits in plano's vectors.
+struct ContextIndex {
+    std::unordered_map<uintptr_t, uint32_t> nodes;
+    std::unordered_map<uintptr_t, uint32_t> links;
+};
+
+// Rebuild "index" for the active context.  Walks the whole graph, so only after plano itself changed it.
+void IndexActiveContext(ContextIndex& index);
+
+bool CopyNode(uintptr_t id, const ContextIndex& index, NodeRecord& out);
+bool InsertNode(const NodeRecord& record, ContextIndex& index);
+bool RemoveNode(uintptr_t id, ContextIndex& index);
+
+bool CopyLink(uintptr_t id, const ContextIndex& index, LinkRecord& out);
+bool InsertLink(const LinkRecord& record, ContextIndex& index);
+bool RemoveLink(uintptr_t id, ContextIndex& index);
+
+// The live node's Properties, or nullptr if the id is unknown or the index is out of date.
+Properties* FindProperties(uintptr_t id, const ContextIndex& index);
+
+// The id of the live node that owns "p", or 0.  Constant time: works out the slot from the address.
+uintptr_t NodeOfProperties(const Properties* p);
+
+// The Properties stored in a record.  Copies of a record share their node, so the non-const
+// overload first gives the record a node of its own.
+Properties& RecordProperties(NodeRecord& record);
+const Properties& RecordProperties(const NodeRecord& record);
+
+// Roughly how much memory a record holds on to.
+size_t RecordBytes(const NodeRecord& record);
+size_t RecordBytes(const LinkRecord& record);
+
+// Flag the active project as having unsaved changes.
+void MarkActiveContextDirty(void);
+
+// Everything a project file keeps about a node apart from ids, pin types and Properties.
+struct NodeLayout {
+    ImVec2 position;                      // Canvas position
+    ImVec2 size;
+    ImVec4 color;
+    uint32_t node_type = 0;               // plano::types::NodeType
+    std::string state;
+    std::string saved_state;
+    std::vector<std::string> input_names;
+    std::vector<std::string> output_names;
+};
+
+// Copies of what a project file needs beyond a GraphView, for keeping casa::doc::Document complete.
+bool CaptureNodeLayout(uintptr_t id, const ContextIndex& index, NodeLayout& out);
+bool CaptureLinkColor(uintptr_t id, const ContextIndex& index, ImVec4& out);
+
+// Where the editor shows a node.  Only needs the id, but the node must exist.
+bool NodePosition(uintptr_t id, ImVec2& out);
+
+// The ids of the nodes selected in the active context's editor, the only ones a drag can move.
+void SelectedNodes(std::vector<uintptr_t>& out);
+
+// Binary project files (see csa_format.h).  Writing adds every node and link of the active
+// context to "out", and the part of the canvas the editor shows, it is the Writer's fill function.  Reading replaces the active context's
+// nodes and links with the file's, building plano's nodes straight from the mapped tables on
+// "threads" threads (see ReadGraph()), and leaves the project clean.  Both return false when
+// there is no active context.
+bool WriteActiveContext(casa::csa::Writer& out);
+bool ReadIntoActiveContext(const casa::csa::Reader& in, unsigned threads = 0);
+
+// Which of a project's nodes and links to build: indices into the file's project, as the Reader's
+// ProjectNode() and ProjectLink() count it, and into the records of the journal that continues it.
+struct GraphPart {
+    std::vector<uint32_t> nodes;              // Project nodes
+    std::vector<uint32_t> links;              // Project links
+    std::vector<uint32_t> journal_nodes;      // SetNode records
+    std::vector<uint32_t> journal_links;      // SetLink records
+};
+
+// A node of a registered type, as plano's menu would add it.
+struct NewNode {
+    const plano::api::NodeDescription* description = nullptr;
+    ImVec2 position;
+};
+
+// A link from output "output" of new node "from" to input "input" of new node "to", by index
+// into the nodes BuildGraph() is given.
+struct NewLink {
+    uint32_t from = 0;
+    uint32_t output = 0;
+    uint32_t to = 0;
+    uint32_t input = 0;
+};
+
+// plano's nodes and links for a whole project, built off to the side of any context so the
+// building can run on as many threads as there are, or away from the UI thread altogether.
+class LoadedGraph {
+public:
+    LoadedGraph(void);
+    ~LoadedGraph(void);
+
+    LoadedGraph(const LoadedGraph&) = delete;
+    LoadedGraph& operator=(const LoadedGraph&) = delete;
+
+    size_t NodeCount(void) const;
+    size_t LinkCount(void) const;
+    uintptr_t NodeId(size_t i) const;
+    uintptr_t LinkId(size_t i) const;
+
+private:
+    friend bool ReadGraph(const casa::csa::Reader& in, LoadedGraph& out, unsigned threads);
+    friend bool ReadGraphPart(const casa::csa::Reader& in, const casa::csa::JournalReader* journal,
+        const GraphPart& part, LoadedGraph& out, unsigned threads);
+    friend bool InstallIntoActiveContext(LoadedGraph& graph);
+    friend bool AppendToActiveContext(LoadedGraph& graph, size_t reserve);
+    friend bool BuildGraph(const std::vector<NewNode>& nodes, const std::vector<NewLink>& links, LoadedGraph& out);
+    struct Storage;
+    std::unique_ptr<Storage> m_Storage;
+};
+
+// Build "out" from a binary project, the copies its instances stand for included.  Runs of nodes
+// and links are built on "threads" threads (0 uses every core) straight into their final slots,
+// so the order, and with it every id and index, is the file's whatever the thread count.
+// Touches no plano context.
+bool ReadGraph(const casa::csa::Reader& in, LoadedGraph& out, unsigned threads = 0);
+
+// Move a graph into the active context in place of its nodes and links, and place its nodes in
+// the editor.  Leaves the project clean and "graph" empty.  ReadIntoActiveContext() is
+// ReadGraph() followed by this.
+bool InstallIntoActiveContext(LoadedGraph& graph);
+
+// Build new nodes into "out" the way plano adds them: ids counted up from 1, each node's own
+// before its inputs' and outputs', the links' after every node's, and the description's default
+// Properties.  Touches no plano context, install the result with InstallIntoActiveContext().
+// Returns false, with "out" empty, for a node without a description or a link to a pin the
+// nodes don't have.
+bool BuildGraph(const std::vector<NewNode>& nodes, const std::vector<NewLink>& links, LoadedGraph& out);
+
+// Build part of a project into "out", in the order "part" lists it, the file's nodes before the
+// journal's.  "journal" may be null if "part" names none of its records.  Runs on "threads"
+// threads like ReadGraph() and touches no plano context.
+bool ReadGraphPart(const casa::csa::Reader& in, const casa::csa::JournalReader* journal, const GraphPart& part,
+    LoadedGraph& out, unsigned threads = 0);
+
+// Move a graph into the active context after the nodes and links it already has, and place its
+// nodes in the editor.  "reserve" makes room for that many nodes in all, so that later appends
+// leave the nodes where they are.  Links whose pins aren't in the context, or that would give an
+// input a second link, are dropped: the graph may have been edited since the part was built.
+// Leaves the dirty flag alone and "graph" empty.
+bool AppendToActiveContext(LoadedGraph& graph, size_t reserve = 0);
+
+// A link of which only one end is loaded so far, drawn as a short stub off that node's side.
+struct LinkStub {
+    uintptr_t node = 0;                   // The loaded end's node
+    bool output = false;                  // Whether the loaded end is one of its outputs
+    uint32_t pin = 0;                     // Which of its inputs or outputs
+    uint32_t pin_count = 0;               // Out of how many
+};
+
+// Draw "stubs" over the active context's editor, after plano drew the frame.
+void DrawLinkStubs(const std::vector<LinkStub>& stubs);
+
+// Apply a journal's records to the active context, after ReadIntoActiveContext() read the file
+// the journal continues.  Leaves the project clean.
+bool ReplayIntoActiveContext(const casa::csa::JournalReader& in);
+
+} // end namespace bridge
+} // end namespace casa
+
+#endif /* plano_bridge_h */
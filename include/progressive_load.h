@@ -0,0 +1,132 @@
+#ifndef progressive_load_h
+#define progressive_load_h
+
+/*
+*  Progressive loading of large binary projects.
+*
+*  Files from version 3 on carry a spatial index and the view they were saved with (see
+*  csa_format.h).  Begin() builds only the nodes in the tiles on and around that view, and the
+*  links between them, and installs them right away, so the editor can be used after a small
+*  part of the full load.  A worker builds the rest in slices, which Update() appends to the
+*  context within a time budget per frame.  Until the last slice, which brings every remaining
+*  link, a link from a loaded node to one that isn't is drawn as a stub off that node's side.
+*
+*  The journal that continues the file is folded in while the project is split: the last record
+*  for an id wins, which is what replaying the records in order comes to, so every node and link
+*  is built once, from the file or from the journal.
+*
+*  While Streaming() the context doesn't hold the whole project.  Call Finish() before anything
+*  saves it; the undo history should Adopt() what streams in rather than record it, and the
+*  autosave and the incremental saver should wait for the end.
+*/
+
+#include "csa_compress.h"
+#include "csa_format.h"
+#include "csa_journal.h"
+#include "mapped_file.h"
+#include "plano_bridge.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace casa {
+namespace doc {
+
+// How a progressive load splits a project.
+struct LoadPlan {
+    casa::bridge::GraphPart first;                  // Built before the first frame
+    casa::bridge::GraphPart rest;                   // Streams in after it
+    std::vector<casa::bridge::LinkStub> stubs;      // Links from "first" into "rest"
+    size_t node_count = 0;                          // Of the whole project, journal included
+};
+
+// Split a project around its saved view, widened by "margin" times the view's size on every
+// side.  A file saved without a view is split around its fullest tile.  Returns false if the
+// file has no spatial index.
+bool PlanLoad(const casa::csa::Reader& in, const casa::csa::JournalReader* journal, float margin, LoadPlan& out);
+
+struct ProgressiveLoadStatus {
+    bool streaming = false;
+    size_t loaded_nodes = 0;
+    size_t node_count = 0;
+    size_t stubs = 0;
+    // Kept once the load is done, until the next Begin() or Cancel().
+    double first_frame_ms = 0.0;    // From Begin() until the first frame of the project was on screen
+    double full_ms = 0.0;           // From Begin() until the last slice was in, 0 while streaming
+};
+
+class ProgressiveLoader {
+public:
+    ProgressiveLoader(void);
+    ~ProgressiveLoader(void);
+
+    ProgressiveLoader(const ProgressiveLoader&) = delete;
+    ProgressiveLoader& operator=(const ProgressiveLoader&) = delete;
+
+    // Smaller projects load whole in less time than a couple of frames, Begin() leaves them be.
+    void SetMinNodes(size_t nodes) { m_MinNodes = nodes; }
+    // Time Update() may spend appending slices, it appends at least one a frame regardless.
+    void SetFrameBudget(double ms) { m_BudgetMs = ms; }
+
+    // Open the binary project at "path" and install the part around its saved view into the
+    // active context, which should be empty.  "journal_stamp" as for load_project_file().
+    // Returns false, with nothing loaded, if the project is too small, has no spatial index or
+    // isn't binary: load it with load_project_file() instead.
+    bool Begin(const std::string& path, uint64_t* journal_stamp = nullptr);
+
+    // Once per frame, before plano draws.  Returns true if it changed the context's topology.
+    bool Update(void);
+    // Once per frame, once it is on screen.
+    void FrameDone(void);
+    // After plano drew the frame.
+    void DrawStubs(void) const;
+
+    // Wait for the worker and install everything that is left, eg. before a save.
+    void Finish(void);
+    // Drop whatever isn't installed yet, eg. before the context goes away, and reset Status().
+    void Cancel(void);
+
+    bool Streaming(void) const { return m_Load != nullptr; }
+    const ProgressiveLoadStatus& Status(void) const { return m_Status; }
+
+private:
+    // A load in progress.  The worker reads "source", "journal" and "plan" and fills "ready";
+    // everything else is the UI thread's.
+    struct Load {
+        std::string path;
+        casa::io::MappedFile file;
+        casa::csa::DecompressedProject decompressed;
+        casa::csa::Reader source;
+        casa::csa::JournalReader journal;
+        bool has_journal = false;
+        LoadPlan plan;
+        const void* context = nullptr;      // The plano context it goes into
+        std::mutex lock;
+        std::deque<std::unique_ptr<casa::bridge::LoadedGraph>> ready;
+        bool done = false;                  // The worker added its last slice
+        bool cancel = false;
+        std::future<void> worker;
+    };
+
+    static void Build(Load* load, unsigned threads);
+    bool Install(bool all);
+    void Complete(void);
+
+    std::unique_ptr<Load> m_Load;
+    ProgressiveLoadStatus m_Status;
+    std::chrono::steady_clock::time_point m_Started;
+    bool m_FramePending = false;            // Begin() was called, its first frame isn't on screen yet
+    size_t m_MinNodes = 200000;
+    double m_BudgetMs = 4.0;
+};
+
+} // end namespace doc
+} // end namespace casa
+
+#endif /* progressive_load_h */
@@ -0,0 +1,162 @@
+#ifndef property_block_h
+#define property_block_h
+
+/*
+*  Fixed layout property blocks.
+*
+*  plano keeps a node's properties in four string keyed maps, so every p.pint["..."] in a draw
+*  callback hashes a string every frame, and a mistyped key silently inserts a new entry.  Instead,
+*  a node can declare its properties as a plain struct with a schema that names each member:
+*
+*      struct PropertyBlock {
+*          int button_value = 0;
+*          static constexpr std::array<casa::props::Field<PropertyBlock>, 1> kSchema = {{
+*              { "buttonValue", &PropertyBlock::button_value },
+*          }};
+*      };
+*
+*      void DrawAndEdit(PropertyBlock& p) { if (ImGui::SmallButton("More")) p.button_value++; }
+*
+*      node.InitializeDefaultProperties = casa::props::InitializeBlock<PropertyBlock>;
+*      node.DrawAndEditProperties = casa::props::DrawBlock<PropertyBlock, DrawAndEdit>;
+*
+*  Defaults are the member initializers.  Every node gets its own block, read from the maps the
+*  first time it is drawn.  The maps remain as a compatibility shim: edits are written back to them
+*  as soon as they happen, so saving, the evaluator and code that still uses the maps all see the
+*  same values under the same keys.
+*
+*  Blocks belong to the UI thread.  A deleted node's Properties address can be reused, so the
+*  blocks are dropped whenever the topology changes or a project is loaded (see ResetBlocks).
+*/
+
+#include "plano_api.h"
+#include "graph_eval.h"
+#include "casa_hash.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+namespace casa {
+namespace props {
+
+enum class FieldKind { Bool, Int, Float, String };
+
+// One schema entry: the key in the Properties maps and the member it is stored in.
+template<typename Block>
+struct Field {
+    const char* name;
+    FieldKind kind;
+    bool Block::* b = nullptr;
+    int Block::* i = nullptr;
+    float Block::* f = nullptr;
+    std::string Block::* s = nullptr;
+
+    constexpr Field(const char* n, bool Block::* m) : name(n), kind(FieldKind::Bool), b(m) {}
+    constexpr Field(const char* n, int Block::* m) : name(n), kind(FieldKind::Int), i(m) {}
+    constexpr Field(const char* n, float Block::* m) : name(n), kind(FieldKind::Float), f(m) {}
+    constexpr Field(const char* n, std::string Block::* m) : name(n), kind(FieldKind::String), s(m) {}
+};
+
+// Copy the block's fields out of the maps.  Missing keys keep the value already in the block.
+template<typename Block>
+void Import(const Properties& p, Block& block)
+{
+    for (const auto& field : Block::kSchema) {
+        switch (field.kind) {
+        case FieldKind::Bool: { auto it = p.pbool.find(field.name); if (it != p.pbool.end()) block.*field.b = it->second; break; }
+        case FieldKind::Int: { auto it = p.pint.find(field.name); if (it != p.pint.end()) block.*field.i = it->second; break; }
+        case FieldKind::Float: { auto it = p.pfloat.find(field.name); if (it != p.pfloat.end()) block.*field.f = it->second; break; }
+        case FieldKind::String: { auto it = p.pstring.find(field.name); if (it != p.pstring.end()) block.*field.s = it->second; break; }
+        }
+    }
+}
+
+// Write every field into the maps, under its schema key.
+template<typename Block>
+void Export(const Block& block, Properties& p)
+{
+    for (const auto& field : Block::kSchema) {
+        switch (field.kind) {
+        case FieldKind::Bool: p.pbool[field.name] = block.*field.b; break;
+        case FieldKind::Int: p.pint[field.name] = block.*field.i; break;
+        case FieldKind::Float: p.pfloat[field.name] = block.*field.f; break;
+        case FieldKind::String: p.pstring[field.name] = block.*field.s; break;
+        }
+    }
+}
+
+template<typename Block>
+uint64_t BlockHash(const Block& block)
+{
+    uint64_t h = casa::hash::kFnvOffset;
+    for (const auto& field : Block::kSchema) {
+        switch (field.kind) {
+        case FieldKind::Bool: h = casa::hash::Value(h, block.*field.b); break;
+        case FieldKind::Int: h = casa::hash::Value(h, block.*field.i); break;
+        case FieldKind::Float: h = casa::hash::Value(h, block.*field.f); break;
+        case FieldKind::String: h = casa::hash::String(h, block.*field.s); break;
+        }
+    }
+    return h;
+}
+
+// ResetBlocks() clears every table handed out by BlockTable(), ForgetBlocks() drops one node's
+// block from all of them, eg. after undo rewrote its maps behind the block's back.
+void RegisterBlockTable(void (*clear)(void), void (*forget)(const Properties*));
+void ResetBlocks(void);
+void ForgetBlocks(const Properties* p);
+
+template<typename Block>
+std::unordered_map<const Properties*, Block>& BlockTable(void)
+{
+    static std::unordered_map<const Properties*, Block> table;
+    static bool registered = false;
+    if (!registered) {
+        RegisterBlockTable([]() { BlockTable<Block>().clear(); },
+                           [](const Properties* p) { BlockTable<Block>().erase(p); });
+        registered = true;
+    }
+    return table;
+}
+
+// The node's block, read from its maps on first use.
+template<typename Block>
+Block& BlockOf(Properties& p)
+{
+    auto& table = BlockTable<Block>();
+    auto it = table.find(&p);
+    if (it == table.end()) {
+        it = table.emplace(&p, Block()).first;
+        Import(p, it->second);
+    }
+    return it->second;
+}
+
+// InitializeDefaultProperties callback: a fresh block with its defaults, written to the maps.
+template<typename Block>
+void InitializeBlock(Properties& p)
+{
+    Block& block = BlockTable<Block>()[&p];
+    block = Block();
+    Export(block, p);
+}
+
+// DrawAndEditProperties callback.  Like casa::eval::TrackEdits, but the draw function edits the
+// block; a change is written back to the maps and marks the node dirty.
+template<typename Block, void (*Draw)(Block&)>
+void DrawBlock(Properties& p)
+{
+    casa::eval::DrawEvaluationProgress(&p);
+    Block& block = BlockOf<Block>(p);
+    uint64_t before = BlockHash(block);
+    Draw(block);
+    if (BlockHash(block) != before) {
+        Export(block, p);
+        casa::eval::MarkPropertiesDirty(&p);
+    }
+}
+
+} // end namespace props
+} // end namespace casa
+
+#endif /* property_block_h */
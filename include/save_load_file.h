@@ -6,9 +6,17 @@
 */
 
 #include "plano_api.h"
+#include "csa_format.h"
+#include <cstdint>
 #include <string>
 #include <fstream>
 
+namespace casa {
+namespace doc {
+class ProgressiveLoader;
+} // end namespace doc
+} // end namespace casa
+
 // Load & Save States
 struct plano_state_flags {
     bool waiting_on_os_save_dialog = false;   // true when an asyncronous, native file browser is visible to the user. Dialog is geared towards saving a project file.
@@ -20,18 +28,35 @@ struct plano_state_flags {
     bool waiting_on_quit = false;             // true when a quit is requested by the menu.  Tracking it this way allows us to handle edge cases like when a user goes to quit then indecisively cancels a save challange.
     bool done = false;
     plano::types::ContextData* context_a = nullptr;
+    uint64_t project_generation = 0;          // bumped every time a project is loaded or created, so per-project state (eg. the undo history) knows to start over.
     std::string last_save_file_address = "";
+    bool compress_saves = false;              // full saves write the compressed container (see csa_compress.h).
+    bool dedupe_saves = false;                // full saves store repeated subgraphs once (see csa_format.h).
+    casa::csa::DedupeStats last_dedupe;       // what storing them once saved in the last full save that did, for the status bar.
+    uint64_t journal_stamp = 0;               // names the journal of the project at last_save_file_address (see csa_journal.h), 0 if it has none.
+    bool progressive_load = true;             // large binary projects open around their saved view and stream in the rest (see progressive_load.h).
+    casa::doc::ProgressiveLoader* loader = nullptr;   // does the streaming, finished before every save and cancelled before the context goes.
+    std::string file_error = "";              // why the last save or load failed, shown in a popup until the user dismisses it.
 };
 
 // Load project function
 // This is "stateful": meaning you must first create a nodos context, and set the context
 // Loading will then affect the currently set context.
-void load_project_file(const char* file_address);
+// Binary .csa projects, compressed or not, and the older text projects load.  A binary project's journal is
+// replayed after it, "journal_stamp" gets the stamp that names the journal, 0 for a text project.
+// Returns false, with "error" (if given) saying why, if the file can't be read or is damaged.
+bool load_project_file(const char* file_address, uint64_t* journal_stamp = nullptr, std::string* error = nullptr);
 
 // Save project function
 // This is "stateful": meaning you must first create a nodos context, and set the context
 // Saving will then affect the currently set context.
-int save_project_file(const char* file_address);
+// Projects are always saved in the binary format (see csa_format.h), in compressed blocks if
+// "compress" is set (see csa_compress.h), under a new journal stamp that goes to "journal_stamp";
+// the old journal is deleted.  "dedupe" stores repeated subgraphs once, "dedupe_stats" (if given)
+// gets how much that saved.  Returns 0 on success.  On failure returns -1, "error" (if given) says
+// why, and the project on disk and "journal_stamp" are left as they were.
+int save_project_file(const char* file_address, uint64_t* journal_stamp = nullptr, bool compress = false, bool dedupe = false,
+    std::string* error = nullptr, casa::csa::DedupeStats* dedupe_stats = nullptr);
 
 void handle_load_save_dialogs(plano_state_flags& pstate, const plano::types::ContextCallbacks& cbk);
 void handle_menu_state(plano_state_flags& pstate);
@@ -0,0 +1,43 @@
+#ifndef simd_kernels_h
+#define simd_kernels_h
+
+/*
+*  Element-wise kernels over lanes of float and int32 values, for batched evaluation.
+*
+*  Each kernel has a scalar, an SSE and an AVX2 version.  The best one the CPU supports is picked
+*  the first time a kernel runs; x86 builds compile all three, anything else only has scalar.
+*  "out" may alias an input.  Kernels don't use FMA, so every level gives bit-identical results to
+*  the plain scalar expression.
+*/
+
+#include <cstdint>
+
+namespace casa {
+namespace simd {
+
+enum class Level { Scalar, SSE, AVX2 };
+
+Level Detect(void);         // Best level this CPU and build support
+Level Active(void);
+void SetLevel(Level level); // Clamped to Detect(), eg. to benchmark the fallbacks
+const char* LevelName(Level level);
+
+void AddF(float* out, const float* a, const float* b, uint32_t n);
+void SubF(float* out, const float* a, const float* b, uint32_t n);
+void MulF(float* out, const float* a, const float* b, uint32_t n);
+void MinF(float* out, const float* a, const float* b, uint32_t n);
+void MaxF(float* out, const float* a, const float* b, uint32_t n);
+void MulAddF(float* out, const float* a, const float* b, const float* c, uint32_t n);  // a * b + c, rounded twice
+void FillF(float* out, float v, uint32_t n);
+
+void AddI(int32_t* out, const int32_t* a, const int32_t* b, uint32_t n);
+void SubI(int32_t* out, const int32_t* a, const int32_t* b, uint32_t n);
+void MulI(int32_t* out, const int32_t* a, const int32_t* b, uint32_t n);
+void FillI(int32_t* out, int32_t v, uint32_t n);
+
+void IntToFloat(float* out, const int32_t* a, uint32_t n);
+
+} // end namespace simd
+} // end namespace casa
+
+#endif /* simd_kernels_h */
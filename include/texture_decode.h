@@ -0,0 +1,100 @@
+#ifndef texture_decode_h
+#define texture_decode_h
+
+/*
+*  Image decoding off the UI thread.
+*
+*  plano wants a texture back from ContextCallbacks::LoadTexture right away, and a project with
+*  many image nodes asks for all of them while it opens.  The app hands out a texture showing a
+*  placeholder and queues the file here.  Worker threads decode it to RGBA8, and once per frame
+*  the UI thread takes what is done, no more bytes than it means to upload in one frame, and puts
+*  the pixels into the texture it handed out.  A file that doesn't decode comes back with an
+*  error and no pixels; the app shows its error image for it.
+*
+*  Nothing here touches OpenGL, and the decoder itself is passed in.
+*/
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace casa {
+namespace gfx {
+
+struct DecodedImage {
+    uint64_t handle = 0;                    // What Request() was given
+    int width = 0;
+    int height = 0;
+    std::vector<unsigned char> pixels;      // RGBA8, rows top down; empty if decoding failed
+    std::string error;                      // Why it failed
+
+    bool Ok(void) const { return !pixels.empty(); }
+    size_t Bytes(void) const { return pixels.size(); }
+};
+
+// Decodes the file at "path" into "out"'s width, height and pixels, or says why not in "out.error".
+// Called on several workers at once.
+typedef bool (*DecodeFn)(const char* path, DecodedImage& out);
+
+class TextureDecoder {
+public:
+    // "threads" 0 uses every core but the UI thread's.
+    explicit TextureDecoder(DecodeFn decode, unsigned threads = 0);
+    // Waits for the images being decoded, drops the rest.
+    ~TextureDecoder(void);
+
+    TextureDecoder(const TextureDecoder&) = delete;
+    TextureDecoder& operator=(const TextureDecoder&) = delete;
+
+    // Decode "path" for "handle".  Requesting a handle again replaces the request before.
+    void Request(uint64_t handle, const std::string& path);
+
+    // The texture is gone, its image is never handed out.  The handle may be requested again.
+    void Cancel(uint64_t handle);
+
+    // Moves the decoded images to "out", in the order they finished, while their pixels add up to
+    // no more than "budget" bytes.  Always takes one when there is one, however large, so a big
+    // image can't hold up the queue.  Failed images cost nothing.  Returns how many it took.
+    size_t TakeDecoded(size_t budget, std::vector<DecodedImage>& out);
+
+    // Requested and not taken yet.
+    size_t Pending(void) const;
+
+private:
+    struct Job {
+        uint64_t handle;
+        uint64_t ticket;
+        std::string path;
+    };
+    struct Finished {
+        uint64_t ticket;
+        DecodedImage image;
+    };
+
+    void WorkerLoop(void);
+    bool Current(uint64_t handle, uint64_t ticket) const;
+
+    DecodeFn m_Decode;
+
+    mutable std::mutex m_Lock;
+    std::condition_variable m_Wake;
+    std::deque<Job> m_Queue;
+    std::deque<Finished> m_Done;
+    // The live request of each handle.  A job or an image whose ticket is not its handle's any
+    // more was cancelled, or replaced by a later request.
+    std::unordered_map<uint64_t, uint64_t> m_Tickets;
+    uint64_t m_NextTicket = 1;
+    bool m_Stop = false;
+    std::vector<std::future<void>> m_Workers;
+};
+
+} // end namespace gfx
+} // end namespace casa
+
+#endif /* texture_decode_h */
@@ -0,0 +1,160 @@
+#ifndef typed_node_h
+#define typed_node_h
+
+/*
+*  Compile time typed node definitions.
+*
+*  Instead of pushing PinDescriptions by hand and reading values through NodeIO, a node can
+*  declare its pins as C++ types and get both its NodeDescription and its evaluator generated:
+*
+*      struct OutputAction : casa::eval::Node<OutputAction, Inputs<float, bool>, Outputs<Delegate>> {
+*          static constexpr const char* kType = "OutputAction";
+*          static constexpr std::array<const char*, 2> kInputNames = { "Sample", "Condition" };
+*          static constexpr std::array<const char*, 1> kOutputNames = { "Event" };
+*          static void Evaluate(const Properties& p, float sample, bool condition, Delegate& event);
+*      };
+*
+*      RegisterNode(OutputAction::ConstructDefinition(), OutputAction::EvaluateIO);
+*
+*  Optional members picked up by ConstructDefinition(): Initialize(Properties&), DrawAndEdit(Properties&)
+*  (wrapped in TrackEdits) and Color().  A node with a property block (see property_block.h) names it
+*  "Block" instead, and its DrawAndEdit takes a Block&; the block's defaults replace Initialize.  Its
+*  Evaluate takes a const Block& in place of the Properties, filled from the maps without touching
+*  them or the UI thread's block table, so it is safe on any thread and sees snapshot copies too.
+*
+*  The generated EvaluateIO reads inputs straight out of their ValueStore bank and writes outputs
+*  straight into theirs: an output's slot always lives in its own pin type's bank, and an input only
+*  falls back to a converting read when it is linked to an output of another kind.
+*/
+
+#include "graph_eval.h"
+#include "property_block.h"
+#include <array>
+#include <cstddef>
+#include <string>
+#include <tuple>
+#include <utility>
+
+namespace casa {
+namespace eval {
+
+// Pin kinds without a C++ type of their own.  Flow and Delegate carry the "fired" flag.
+struct Flow { bool fired = false; };
+struct Delegate { bool fired = false; };
+struct Object {};
+struct Function {};
+
+template<typename... T> struct Inputs {};
+template<typename... T> struct Outputs {};
+
+// How a C++ type maps onto a pin: its PinType, how Evaluate receives it as an input, and how it
+// moves in and out of the ValueStore.
+template<typename T> struct PinTraits;
+
+template<> struct PinTraits<bool> {
+    static constexpr plano::types::PinType kType = plano::types::PinType::Bool;
+    typedef bool Arg;
+    static bool Read(ValueStore& s, Slot slot) { return SlotBank(slot) == ValueBank::Bool ? s.BoolData()[SlotIndex(slot)] != 0 : s.GetBool(slot); }
+    static void Write(ValueStore& s, Slot slot, bool v) { s.BoolData()[SlotIndex(slot)] = v; }
+};
+
+template<> struct PinTraits<int32_t> {
+    static constexpr plano::types::PinType kType = plano::types::PinType::Int;
+    typedef int32_t Arg;
+    static int32_t Read(ValueStore& s, Slot slot) { return SlotBank(slot) == ValueBank::Int ? s.IntData()[SlotIndex(slot)] : s.GetInt(slot); }
+    static void Write(ValueStore& s, Slot slot, int32_t v) { s.IntData()[SlotIndex(slot)] = v; }
+};
+
+template<> struct PinTraits<float> {
+    static constexpr plano::types::PinType kType = plano::types::PinType::Float;
+    typedef float Arg;
+    static float Read(ValueStore& s, Slot slot) { return SlotBank(slot) == ValueBank::Float ? s.FloatData()[SlotIndex(slot)] : s.GetFloat(slot); }
+    static void Write(ValueStore& s, Slot slot, float v) { s.FloatData()[SlotIndex(slot)] = v; }
+};
+
+template<> struct PinTraits<std::string> {
+    static constexpr plano::types::PinType kType = plano::types::PinType::String;
+    typedef const std::string& Arg;
+    static const std::string& Read(ValueStore& s, Slot slot) { return s.GetString(slot); }
+    static void Write(ValueStore& s, Slot slot, std::string& v) { s.StringData()[SlotIndex(slot)].swap(v); }
+};
+
+template<typename Tag, plano::types::PinType Type> struct FiredPinTraits {
+    static constexpr plano::types::PinType kType = Type;
+    typedef Tag Arg;
+    static Tag Read(ValueStore& s, Slot slot) { Tag t; t.fired = PinTraits<bool>::Read(s, slot); return t; }
+    static void Write(ValueStore& s, Slot slot, const Tag& v) { s.BoolData()[SlotIndex(slot)] = v.fired; }
+};
+template<> struct PinTraits<Flow> : FiredPinTraits<Flow, plano::types::PinType::Flow> {};
+template<> struct PinTraits<Delegate> : FiredPinTraits<Delegate, plano::types::PinType::Delegate> {};
+
+template<typename Tag, plano::types::PinType Type> struct EmptyPinTraits {
+    static constexpr plano::types::PinType kType = Type;
+    typedef Tag Arg;
+    static Tag Read(ValueStore&, Slot) { return Tag(); }
+    static void Write(ValueStore&, Slot, const Tag&) {}
+};
+template<> struct PinTraits<Object> : EmptyPinTraits<Object, plano::types::PinType::Object> {};
+template<> struct PinTraits<Function> : EmptyPinTraits<Function, plano::types::PinType::Function> {};
+
+template<typename Derived, typename In, typename Out> struct Node;
+
+template<typename Derived, typename... In, typename... Out>
+struct Node<Derived, Inputs<In...>, Outputs<Out...>> {
+    static plano::api::NodeDescription ConstructDefinition(void)
+    {
+        static_assert(Derived::kInputNames.size() == sizeof...(In), "one name per input");
+        static_assert(Derived::kOutputNames.size() == sizeof...(Out), "one name per output");
+
+        plano::api::NodeDescription node;
+        node.Type = Derived::kType;
+        size_t i = 0, o = 0;
+        (node.Inputs.push_back(plano::api::PinDescription(Derived::kInputNames[i++], PinTraits<In>::kType)), ...);
+        (node.Outputs.push_back(plano::api::PinDescription(Derived::kOutputNames[o++], PinTraits<Out>::kType)), ...);
+        if constexpr (requires { Derived::Color(); })
+            node.Color = Derived::Color();
+        if constexpr (requires { typename Derived::Block; }) {
+            node.InitializeDefaultProperties = casa::props::InitializeBlock<typename Derived::Block>;
+            node.DrawAndEditProperties = casa::props::DrawBlock<typename Derived::Block, Derived::DrawAndEdit>;
+        } else {
+            if constexpr (requires(Properties& p) { Derived::Initialize(p); })
+                node.InitializeDefaultProperties = Derived::Initialize;
+            else
+                node.InitializeDefaultProperties = NoProperties;
+            if constexpr (requires(Properties& p) { Derived::DrawAndEdit(p); })
+                node.DrawAndEditProperties = TrackEdits<Derived::DrawAndEdit>;
+            else
+                node.DrawAndEditProperties = NoProperties;
+        }
+        return node;
+    }
+
+    // The EvaluateFn to register: unpacks the pins and calls Derived::Evaluate.
+    static void EvaluateIO(NodeIO& io)
+    {
+        Invoke(io, std::index_sequence_for<In...>(), std::index_sequence_for<Out...>());
+    }
+
+private:
+    static void NoProperties(Properties&) {}
+
+    template<size_t... I, size_t... O>
+    static void Invoke(NodeIO& io, std::index_sequence<I...>, std::index_sequence<O...>)
+    {
+        ValueStore& store = io.Store();
+        std::tuple<Out...> outputs;
+        if constexpr (requires { typename Derived::Block; }) {
+            typename Derived::Block block;
+            casa::props::Import(io.Props(), block);
+            Derived::Evaluate(block, PinTraits<In>::Read(store, io.InputSlot((int)I))..., std::get<O>(outputs)...);
+        } else {
+            Derived::Evaluate(io.Props(), PinTraits<In>::Read(store, io.InputSlot((int)I))..., std::get<O>(outputs)...);
+        }
+        (PinTraits<Out>::Write(store, io.OutputSlot((int)O), std::get<O>(outputs)), ...);
+    }
+};
+
+} // end namespace eval
+} // end namespace casa
+
+#endif /* typed_node_h */
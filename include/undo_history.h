@@ -0,0 +1,116 @@
+#ifndef undo_history_h
+#define undo_history_h
+
+/*
+*  Undo and redo for the active plano graph, kept as a journal of small typed deltas.
+*
+*  An entry holds only what one user action changed: the nodes and links it added or removed, as
+*  complete records so they come back with the same ids, pins and properties, and for property
+*  edits the old and new value of each key that changed.  Undo and Redo touch exactly those nodes,
+*  links and keys, however big the graph is.
+*
+*  Changes are found against a shadow copy of the graph.  Property edits already go through
+*  MarkPropertiesDirty() (see TrackEdits and DrawBlock), so Update() only compares the nodes that
+*  reported one.  plano has no events for nodes and links coming and going: call SyncTopology()
+*  whenever the evaluator captured a new topology, it walks the ids once.
+*
+*  Edits made while a widget stays active, eg. dragging a slider, coalesce into a single entry.
+*  The journal is capped in bytes and drops its oldest entries first.  Moves are not journaled,
+*  but Update() keeps the shadows of the selected nodes, the only ones a drag moves, where they
+*  are: a deleted node comes back where it was deleted.
+*/
+
+#include "plano_api.h"
+#include "plano_bridge.h"
+#include "value_store.h"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace casa {
+namespace undo {
+
+// One key of one node's Properties, before and after.  A key that did not exist on one side has
+// had_before or had_after false, undo/redo erase it again.
+struct PropertyChange {
+    uintptr_t node = 0;
+    casa::eval::ValueBank bank = casa::eval::ValueBank::None;
+    std::string key;
+    bool had_before = false;
+    bool had_after = false;
+    casa::eval::PinValue before;
+    casa::eval::PinValue after;
+};
+
+struct Entry {
+    std::vector<casa::bridge::NodeRecord> added_nodes;
+    std::vector<casa::bridge::NodeRecord> removed_nodes;
+    std::vector<casa::bridge::LinkRecord> added_links;
+    std::vector<casa::bridge::LinkRecord> removed_links;
+    std::vector<PropertyChange> properties;
+    size_t bytes = 0;
+    bool open = false;  // Still taking edits from the active widget
+
+    bool Empty(void) const;
+};
+
+class History {
+public:
+    explicit History(size_t budget_bytes = 64 * 1024 * 1024);
+    ~History(void);
+
+    History(const History&) = delete;
+    History& operator=(const History&) = delete;
+
+    // Once per frame after the graph was drawn.  "interacting" is ImGui::IsAnyItemActive(): while
+    // it stays true, property edits keep merging into the same entry.
+    void Update(bool interacting);
+
+    // Record the nodes and links that came or went since the last call.
+    void SyncTopology(void);
+    // Take them as they are instead, without an entry, eg. while a project streams in.
+    void Adopt(void);
+
+    // Forget every entry and shadow the active context afresh, eg. after a load.
+    void Clear(void);
+
+    bool CanUndo(void) const { return !m_Undo.empty(); }
+    bool CanRedo(void) const { return !m_Redo.empty(); }
+    bool Undo(void);
+    bool Redo(void);
+
+    void SetBudget(size_t bytes);
+    size_t Budget(void) const { return m_Budget; }
+    size_t Bytes(void) const { return m_Bytes; }
+    size_t UndoCount(void) const { return m_Undo.size(); }
+    size_t RedoCount(void) const { return m_Redo.size(); }
+
+private:
+    static void OnEdit(void* user, const Properties* p);
+    void Sync(bool record);
+    bool DiffProperties(uintptr_t node, std::vector<PropertyChange>& out);
+    void SyncPositions(void);
+    void Record(Entry&& entry);
+    void Apply(const Entry& entry, bool forward);
+    void Trim(void);
+
+    const plano::types::ContextData* m_Context = nullptr;
+    casa::bridge::ContextIndex m_Index;
+    // The graph as the journal last saw it.  Records are shared with entries until either side changes.
+    std::unordered_map<uintptr_t, casa::bridge::NodeRecord> m_Nodes;
+    std::unordered_map<uintptr_t, casa::bridge::LinkRecord> m_Links;
+    std::vector<uintptr_t> m_Touched;  // Nodes reported through MarkPropertiesDirty since the last Update
+    std::vector<uintptr_t> m_Selected;
+    std::deque<Entry> m_Undo;
+    std::vector<Entry> m_Redo;
+    size_t m_Bytes = 0;
+    size_t m_Budget;
+};
+
+} // end namespace undo
+} // end namespace casa
+
+#endif /* undo_history_h */
@@ -0,0 +1,96 @@
+#ifndef value_store_h
+#define value_store_h
+
+/*
+*  Pin values, stored struct-of-arrays.
+*
+*  Every output pin of a compiled graph gets a Slot: the bank its PinType stores into, and a
+*  dense index into that bank's array.  All the Float pins of a graph therefore sit next to each
+*  other in one std::vector<float>, all the Int pins in one std::vector<int32_t>, and so on,
+*  which keeps evaluation cache friendly and lets a whole bank be scanned in one loop.
+*
+*  Index 0 of every bank is a default value that is never written.  Unconnected inputs read
+*  kNoSlot, which always reads as false / 0 / "".
+*/
+
+#include "plano_api.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace casa {
+namespace eval {
+
+// Flow and Delegate pins store a "fired" flag in the Bool bank.  Object and Function pins
+// don't carry a value yet and get no storage.
+enum class ValueBank : uint32_t { None, Bool, Int, Float, String };
+const uint32_t kBankCount = 5;
+
+ValueBank BankOf(plano::types::PinType type);
+
+// Bank in the top 4 bits, index into the bank below.
+typedef uint32_t Slot;
+const Slot kNoSlot = 0;
+
+inline Slot MakeSlot(ValueBank bank, uint32_t index) { return ((uint32_t)bank << 28) | index; }
+inline ValueBank SlotBank(Slot slot) { return (ValueBank)(slot >> 28); }
+inline uint32_t SlotIndex(Slot slot) { return slot & 0x0fffffff; }
+
+// Hand out the next slot of the pin type's bank.  "bank_size" holds kBankCount counters,
+// each starting at 1 for the default entry.
+Slot AllocateSlot(uint32_t* bank_size, plano::types::PinType type);
+
+// One pin's value boxed up, for where values leave the store (eg. the output cache).
+struct PinValue {
+    bool b = false;
+    int i = 0;
+    float f = 0.0f;
+    std::string s;
+};
+
+class ValueStore {
+public:
+    // Size every bank (see AllocateSlot) and set all values to their defaults.
+    void Reset(const uint32_t* bank_size);
+    void Clear(void);
+
+    // Reads convert when the slot holds another kind, eg. an Int output linked into a Float input.
+    bool GetBool(Slot slot) const;
+    int32_t GetInt(Slot slot) const;
+    float GetFloat(Slot slot) const;
+    const std::string& GetString(Slot slot) const;
+
+    // Writes convert into the slot's kind.  Writes to kNoSlot or the None bank are dropped.
+    void SetBool(Slot slot, bool v);
+    void SetInt(Slot slot, int32_t v);
+    void SetFloat(Slot slot, float v);
+    void SetString(Slot slot, const std::string& v);
+
+    void Load(Slot slot, PinValue& out) const;
+    void Store(Slot slot, const PinValue& v);
+
+    uint32_t Count(ValueBank bank) const;
+
+    // Whole banks, default entry included, eg. to scan every Float pin of the graph.
+    const std::vector<uint8_t>& Bools(void) const { return m_Bools; }
+    const std::vector<int32_t>& Ints(void) const { return m_Ints; }
+    const std::vector<float>& Floats(void) const { return m_Floats; }
+    const std::vector<std::string>& Strings(void) const { return m_Strings; }
+
+    // Bank storage by slot index, for code that knows a slot's bank at compile time.
+    uint8_t* BoolData(void) { return m_Bools.data(); }
+    int32_t* IntData(void) { return m_Ints.data(); }
+    float* FloatData(void) { return m_Floats.data(); }
+    std::string* StringData(void) { return m_Strings.data(); }
+
+private:
+    std::vector<uint8_t> m_Bools;   // Not vector<bool>, parallel workers write neighbouring entries
+    std::vector<int32_t> m_Ints;
+    std::vector<float> m_Floats;
+    std::vector<std::string> m_Strings;
+};
+
+} // end namespace eval
+} // end namespace casa
+
+#endif /* value_store_h */
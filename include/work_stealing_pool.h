@@ -0,0 +1,71 @@
+#ifndef work_stealing_pool_h
+#define work_stealing_pool_h
+
+/*
+*  A small work stealing thread pool.
+*
+*  Work items are plain uint32_t's (node indices, chunk numbers...) handed to one task function
+*  per Run().  Each worker owns a deque: it pops its own work from the back (LIFO, cache warm)
+*  and steals from the front of other workers' deques when it runs dry.  The thread calling
+*  Run() is worker 0, so a pool of 1 worker runs everything inline on the caller.
+*/
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace casa {
+
+class WorkStealingPool {
+public:
+    // "item" is the work item, "worker" the index of the worker running it (0..WorkerCount()-1).
+    typedef void (*TaskFn)(void* user, uint32_t item, unsigned worker);
+
+    explicit WorkStealingPool(unsigned worker_count);
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    unsigned WorkerCount(void) const { return (unsigned)m_Queues.size(); }
+
+    // Run "task" over the seed items, plus everything the tasks Push() while running.
+    // Blocks until all of it is done.  Not reentrant: call from one thread at a time.
+    void Run(const uint32_t* items, size_t count, TaskFn task, void* user);
+
+    // Queue more work from inside a task.  "worker" is the worker the calling task runs on.
+    void Push(unsigned worker, uint32_t item);
+
+private:
+    struct WorkerQueue {
+        std::mutex lock;
+        std::deque<uint32_t> items;
+    };
+
+    void ThreadMain(unsigned worker);
+    void WorkLoop(unsigned worker);
+    bool PopLocal(unsigned worker, uint32_t& item);
+    bool Steal(unsigned worker, uint32_t& item);
+
+    std::vector<std::unique_ptr<WorkerQueue>> m_Queues;
+    std::vector<std::thread> m_Threads;
+
+    std::mutex m_WakeLock;
+    std::condition_variable m_Wake;
+    uint64_t m_Generation = 0;
+    bool m_Stop = false;
+
+    std::atomic<int64_t> m_Outstanding{0};  // Items pushed but not finished yet
+    std::atomic<unsigned> m_Active{0};      // Background workers still inside the current Run()
+    TaskFn m_Task = nullptr;
+    void* m_User = nullptr;
+};
+
+} // end namespace casa
+
+#endif /* work_stealing_pool_h */
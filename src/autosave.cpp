@@ -0,0 +1,193 @@
+#include "autosave.h"
+#include "csa_format.h"
+#include "output_sink.h"
+#include <chrono>
+#include <filesystem>
+#include <system_error>
+
+namespace casa {
+namespace doc {
+
+Autosaver::Autosaver(void)
+{
+    m_LastActive = Now();
+    m_LastSubmit = m_LastActive;
+    m_Worker = std::async(std::launch::async, &Autosaver::WorkerLoop, this);
+}
+
+// A save in progress is finished first, so the sidecar is never left half renamed.
+Autosaver::~Autosaver(void)
+{
+    {
+        std::lock_guard<std::mutex> lk(m_Lock);
+        m_Stop = true;
+    }
+    m_Wake.notify_one();
+    m_Worker.wait();
+}
+
+double Autosaver::Now(void)
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+std::string Autosaver::SidecarPath(const std::string& project_path)
+{
+    if (!project_path.empty())
+        return project_path + ".autosave";
+    std::error_code ec;
+    std::filesystem::path dir = std::filesystem::temp_directory_path(ec);
+    return ((ec ? std::filesystem::path(".") : dir) / "untitled.csa.autosave").string();
+}
+
+// UI thread
+void Autosaver::Update(const Document& document, const std::string& sidecar, bool unsaved, bool user_active)
+{
+    double now = Now();
+    if (user_active)
+        m_LastActive = now;
+    if (TakeFailure())
+        m_Submitted = false; // tried again once the gap since the failed save has passed
+    if (!unsaved || (m_Submitted && document.Version() == m_SubmittedVersion))
+        return;
+    bool idle = now - m_LastActive >= m_Settings.idle_seconds && now - m_LastSubmit >= m_Settings.min_gap_seconds;
+    bool overdue = now - m_LastSubmit >= m_Settings.interval_seconds;
+    if (idle || overdue)
+        Submit(document, sidecar);
+}
+
+void Autosaver::SaveNow(const Document& document, const std::string& sidecar)
+{
+    if (TakeFailure())
+        m_Submitted = false;
+    if (!m_Submitted || document.Version() != m_SubmittedVersion)
+        Submit(document, sidecar);
+}
+
+void Autosaver::Reset(void)
+{
+    m_Submitted = false;
+    m_LastSubmit = Now();
+}
+
+void Autosaver::Submit(const Document& document, const std::string& sidecar)
+{
+    auto job = std::make_unique<Job>();
+    job->snapshot = document.Take();
+    job->path = sidecar;
+    job->taken_at = Now();
+    m_SubmittedVersion = job->snapshot.version;
+    m_Submitted = true;
+    m_LastSubmit = job->taken_at;
+    {
+        std::lock_guard<std::mutex> lk(m_Lock);
+        m_Pending = std::move(job);
+        m_Status.saving = true;
+    }
+    m_Wake.notify_one();
+}
+
+bool Autosaver::TakeFailure(void)
+{
+    std::lock_guard<std::mutex> lk(m_Lock);
+    bool failed = m_Failed;
+    m_Failed = false;
+    return failed;
+}
+
+AutosaveStatus Autosaver::Status(void) const
+{
+    std::lock_guard<std::mutex> lk(m_Lock);
+    return m_Status;
+}
+
+// Worker thread
+void Autosaver::WorkerLoop(void)
+{
+    for (;;) {
+        std::unique_ptr<Job> job;
+        {
+            std::unique_lock<std::mutex> lk(m_Lock);
+            m_Wake.wait(lk, [&] { return m_Stop || m_Pending; });
+            if (m_Stop)
+                return; // a snapshot still waiting is dropped, the editor is going away
+            job = std::move(m_Pending);
+        }
+        Save(*job);
+    }
+}
+
+void Autosaver::Save(const Job& job)
+{
+    std::string temp = job.path + ".tmp";
+    std::string error;
+    casa::csa::Writer writer;
+    {
+        casa::io::FileSink file;
+        if (!file.Open(temp.c_str())) {
+            error = "can't create " + temp;
+        } else {
+            bool written = writer.Write(file, [&job](casa::csa::Writer& out) { return WriteSnapshot(job.snapshot, out); });
+            written = file.Sync() && written;
+            if (!file.Close() || !written)
+                error = "can't write " + temp;
+        }
+    }
+    if (error.empty()) {
+        // Replaces the old sidecar in one step, on Windows too.
+        std::error_code ec;
+        std::filesystem::rename(temp, job.path, ec);
+        if (ec)
+            error = "can't rename " + temp + ": " + ec.message();
+    }
+    if (!error.empty()) {
+        std::error_code ignored;
+        std::filesystem::remove(temp, ignored);
+    }
+
+    double finished = Now();
+    std::lock_guard<std::mutex> lk(m_Lock);
+    m_Status.saving = m_Pending != nullptr;
+    m_Status.saves++;
+    m_Status.ok = error.empty();
+    m_Status.error = error;
+    m_Status.finished_at = finished;
+    m_Status.path = job.path;
+    // The version it was given is unsaved again, unless a later snapshot is already waiting.
+    m_Failed = !m_Status.ok && m_Pending == nullptr;
+    if (m_Status.ok) {
+        m_Status.version = job.snapshot.version;
+        m_Status.latency_ms = (finished - job.taken_at) * 1000.0;
+        m_Status.bytes = writer.Size();
+    }
+}
+
+// Status bar
+void DrawAutosaveStatusBar(const Autosaver& autosaver, const char* project)
+{
+    AutosaveStatus st = autosaver.Status();
+    ImGuiViewport* viewport = ImGui::GetMainViewport();
+    float height = ImGui::GetFrameHeight();
+    ImGui::SetNextWindowPos(ImVec2(viewport->WorkPos.x, viewport->WorkPos.y + viewport->WorkSize.y - height));
+    ImGui::SetNextWindowSize(ImVec2(viewport->WorkSize.x, height));
+    ImGuiWindowFlags flags = ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoSavedSettings;
+    if (ImGui::Begin("##autosave_status", nullptr, flags)) {
+        if (st.saves == 0) {
+            ImGui::TextDisabled("%s", st.saving ? "autosaving..." : "not autosaved yet");
+        } else if (!st.ok) {
+            ImGui::Text("autosave failed: %s", st.error.c_str());
+        } else {
+            ImGui::Text("autosaved %.0f s ago: %.2f MB in %.1f ms%s", autosaver.Now() - st.finished_at,
+                st.bytes / (1024.0 * 1024.0), st.latency_ms, st.saving ? ", saving again..." : "");
+        }
+        if (project != nullptr && project[0] != '\0') {
+            ImGui::SameLine();
+            ImGui::TextDisabled("|  %s", project);
+        }
+    }
+    ImGui::End();
+}
+
+} // end namespace doc
+} // end namespace casa
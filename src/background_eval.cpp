@@ -0,0 +1,268 @@
+#include "background_eval.h"
+#include "output_cache.h"
+#include <chrono>
+#include <thread>
+
+namespace casa {
+namespace eval {
+
+// How long the worker runs before it stops to publish progress.
+static const double kProgressMs = 50.0;
+
+Slot ResultSet::FindOutput(uintptr_t pin_id) const
+{
+    if (!output_slot)
+        return kNoSlot;
+    auto it = output_slot->find(pin_id);
+    return it == output_slot->end() ? kNoSlot : it->second;
+}
+
+BackgroundEvaluator::BackgroundEvaluator(unsigned workers, OutputCache* cache)
+    : m_Front(&m_Buffers[0]), m_Reading(&m_Buffers[0]), m_Cache(cache)
+{
+    m_Held = &m_Buffers[0];
+    m_RequestedWorkers.store(workers, std::memory_order_relaxed);
+    SetProgressSource(PendingNode, this);
+    m_Worker = std::async(std::launch::async, &BackgroundEvaluator::WorkerLoop, this);
+}
+
+BackgroundEvaluator::~BackgroundEvaluator(void)
+{
+    {
+        std::lock_guard<std::mutex> lk(m_Lock);
+        m_Stop = true;
+    }
+    m_Wake.notify_one();
+    m_Worker.wait();
+    SetProgressSource(nullptr, nullptr);
+}
+
+// UI thread
+void BackgroundEvaluator::Update(void)
+{
+    m_Edits.clear();
+    TakePendingEdits(m_Edits);
+
+    uint64_t stamp = casa::bridge::TopologyStamp();
+    if (stamp != m_Topology) {
+        m_Topology = stamp;
+        m_Graph = casa::bridge::GraphView();
+        if (stamp != 0)
+            casa::bridge::CaptureActiveContext(m_Graph);
+        m_Captures++;
+        m_NodeOfProperties.clear();
+        for (uint32_t n = 0; n < (uint32_t)m_Graph.nodes.size(); n++)
+            m_NodeOfProperties[m_Graph.nodes[n].properties] = n;
+
+        // Copy every node's properties, the pending edits are in there already.
+        auto snapshot = std::make_unique<Snapshot>();
+        snapshot->full = true;
+        snapshot->topology = stamp;
+        snapshot->graph = m_Graph;
+        snapshot->properties.reserve(m_Graph.nodes.size());
+        for (const auto& node : m_Graph.nodes)
+            snapshot->properties.push_back(*node.properties);
+        for (size_t n = 0; n < snapshot->graph.nodes.size(); n++)
+            snapshot->graph.nodes[n].properties = &snapshot->properties[n];
+        Submit(std::move(snapshot));
+    } else if (!m_Edits.empty()) {
+        auto snapshot = std::make_unique<Snapshot>();
+        for (const Properties* p : m_Edits) {
+            auto it = m_NodeOfProperties.find(p);
+            if (it == m_NodeOfProperties.end())
+                continue;
+            snapshot->edited.push_back(it->second);
+            snapshot->properties.push_back(*p);
+        }
+        if (!snapshot->edited.empty())
+            Submit(std::move(snapshot));
+    }
+
+    // Claim the front buffer.  The worker may swap between our load and our claim, so check again.
+    const ResultSet* front = m_Front.load();
+    for (;;) {
+        m_Reading.store(front);
+        const ResultSet* again = m_Front.load();
+        if (again == front)
+            break;
+        front = again;
+    }
+    m_Held = front;
+
+    std::lock_guard<std::mutex> lk(m_ProgressLock);
+    if (m_Progress.serial != m_HeldProgress.serial)
+        m_HeldProgress = m_Progress;
+}
+
+bool BackgroundEvaluator::PendingNode(void* user, const Properties* p, float* progress)
+{
+    const BackgroundEvaluator& e = *(const BackgroundEvaluator*)user;
+    const RunProgress& run = e.m_HeldProgress;
+    if (!run.in_flight || run.topology != e.m_Topology)
+        return false;
+    auto it = e.m_NodeOfProperties.find(p);
+    if (it == e.m_NodeOfProperties.end() || it->second >= run.pending.size() || !run.pending[it->second])
+        return false;
+    *progress = run.progress;
+    return true;
+}
+
+void BackgroundEvaluator::Submit(std::unique_ptr<Snapshot> snapshot)
+{
+    {
+        std::lock_guard<std::mutex> lk(m_Lock);
+        if (m_Pending && !snapshot->full) {
+            // The worker has not picked up the last one yet, fold the edits into it.
+            for (size_t i = 0; i < snapshot->edited.size(); i++) {
+                if (m_Pending->full) {
+                    m_Pending->properties[snapshot->edited[i]] = std::move(snapshot->properties[i]);
+                } else {
+                    m_Pending->edited.push_back(snapshot->edited[i]);
+                    m_Pending->properties.push_back(std::move(snapshot->properties[i]));
+                }
+            }
+        } else {
+            m_Pending = std::move(snapshot);
+        }
+        m_Submitted.fetch_add(1);
+    }
+    m_Wake.notify_one();
+}
+
+// Worker thread
+bool BackgroundEvaluator::NewerSnapshot(void* user)
+{
+    BackgroundEvaluator& e = *(BackgroundEvaluator*)user;
+    return e.m_Submitted.load(std::memory_order_relaxed) != e.m_Applied || e.m_Stop.load(std::memory_order_relaxed);
+}
+
+// Also called on the engine's pool threads, which only read m_RunStarted.
+bool BackgroundEvaluator::NewerSnapshotOrProgressDue(void* user)
+{
+    BackgroundEvaluator& e = *(BackgroundEvaluator*)user;
+    using namespace std::chrono;
+    return NewerSnapshot(user) || duration<double, std::milli>(steady_clock::now() - e.m_RunStarted).count() >= kProgressMs;
+}
+
+void BackgroundEvaluator::WorkerLoop(void)
+{
+    m_Engine.SetCache(m_Cache);
+    m_Engine.SetInterrupt(NewerSnapshotOrProgressDue, this);
+    for (;;) {
+        std::unique_ptr<Snapshot> snapshot;
+        {
+            // An interrupted run is still in flight, and gets resumed even if nothing new came in.
+            std::unique_lock<std::mutex> lk(m_Lock);
+            m_Wake.wait(lk, [&] { return m_Stop || m_Pending || m_Engine.Stats().in_flight; });
+            if (m_Stop)
+                return;
+            snapshot = std::move(m_Pending);
+            if (snapshot)
+                m_Applied = m_Submitted.load();
+        }
+        if (snapshot)
+            Apply(std::move(snapshot));
+
+        m_Engine.SetWorkerCount(m_RequestedWorkers.load(std::memory_order_relaxed));
+        m_RunStarted = std::chrono::steady_clock::now();
+        m_Engine.Run();
+        if (m_Engine.Stats().in_flight) {
+            if (NewerSnapshot(this))
+                m_Interruptions.fetch_add(1, std::memory_order_relaxed);
+            else
+                PublishProgress(true);
+            continue;
+        }
+        PublishProgress(false);
+        Publish();
+    }
+}
+
+void BackgroundEvaluator::Apply(std::unique_ptr<Snapshot> snapshot)
+{
+    if (snapshot->full) {
+        m_Current = std::move(snapshot);
+        if (m_Current->topology == 0) {
+            m_Engine.Reset();
+            m_OutputSlot.reset();
+            return;
+        }
+        m_Engine.Compile(m_Current->graph, m_Current->topology);
+        m_OutputSlot = std::make_shared<const std::unordered_map<uintptr_t, Slot>>(m_Engine.Plan().output_slot);
+        return;
+    }
+
+    // Edits only: overwrite our copies and mark their cones.  A run in flight picks them up from the start.
+    if (!m_Current)
+        return;
+    for (size_t i = 0; i < snapshot->edited.size(); i++) {
+        uint32_t node = snapshot->edited[i];
+        if (node >= m_Current->properties.size())
+            continue;
+        m_Current->properties[node] = std::move(snapshot->properties[i]);
+        m_Engine.MarkDirty(node);
+    }
+}
+
+void BackgroundEvaluator::PublishProgress(bool in_flight)
+{
+    std::lock_guard<std::mutex> lk(m_ProgressLock);
+    if (!in_flight && !m_Progress.in_flight)
+        return;
+    m_Progress.serial++;
+    m_Progress.topology = m_Current ? m_Current->topology : 0;
+    m_Progress.in_flight = in_flight;
+    m_Progress.progress = m_Engine.Stats().progress;
+    m_Progress.pending.clear();
+    if (in_flight) {
+        m_Progress.pending.resize(m_Engine.Plan().node_count);
+        for (uint32_t n = 0; n < (uint32_t)m_Progress.pending.size(); n++)
+            m_Progress.pending[n] = m_Engine.InFlight(n);
+    }
+}
+
+void BackgroundEvaluator::Publish(void)
+{
+    const ResultSet* front = m_Front.load();
+    ResultSet* back = front == &m_Buffers[0] ? &m_Buffers[1] : &m_Buffers[0];
+
+    // The UI lets go of the old front buffer on its next Update().  If a newer snapshot shows
+    // up meanwhile these results are stale anyway.
+    while (m_Reading.load() == back) {
+        if (NewerSnapshot(this))
+            return;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    back->generation = m_Applied;
+    back->topology = m_Current ? m_Current->topology : 0;
+    back->values = m_Engine.Values();
+    back->output_slot = m_OutputSlot;
+    back->stats = m_Engine.Stats();
+    m_Front.store(back);
+}
+
+void DrawStatsWindow(BackgroundEvaluator& evaluator, bool* open)
+{
+    if (!ImGui::Begin("Evaluator", open)) {
+        ImGui::End();
+        return;
+    }
+    const ResultSet& results = evaluator.Results();
+    ImGui::Text("background: showing snapshot %llu of %llu", (unsigned long long)results.generation,
+        (unsigned long long)evaluator.Submitted());
+    ImGui::Text("interrupted runs %llu", (unsigned long long)evaluator.Interruptions());
+    if (evaluator.InFlight())
+        ImGui::ProgressBar(evaluator.Progress(), ImVec2(-1.0f, 0.0f), "evaluating");
+    DrawEngineStats(results.stats, evaluator.Cache());
+
+    int workers = (int)evaluator.WorkerCount();
+    ImGui::PushItemWidth(120);
+    if (ImGui::DragInt("workers", &workers, 0.1f, 1, 64))
+        evaluator.SetWorkerCount((unsigned)workers);
+    ImGui::PopItemWidth();
+    ImGui::End();
+}
+
+} // end namespace eval
+} // end namespace casa
@@ -0,0 +1,440 @@
+#include "batch_eval.h"
+#include "simd_kernels.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+
+namespace casa {
+namespace eval {
+
+// Batch evaluator registry
+static std::unordered_map<std::string, BatchEvaluateFn>& batch_registry()
+{
+    static std::unordered_map<std::string, BatchEvaluateFn> registry;
+    return registry;
+}
+
+void RegisterBatchEvaluator(const std::string& type, BatchEvaluateFn evaluate)
+{
+    batch_registry()[type] = evaluate;
+}
+
+BatchEvaluateFn FindBatchEvaluator(const std::string& type)
+{
+    auto& registry = batch_registry();
+    auto it = registry.find(type);
+    return it == registry.end() ? nullptr : it->second;
+}
+
+static const std::string empty_string;
+
+static void apply_override(Properties& p, const PropertyOverride& o)
+{
+    switch (o.bank) {
+    case ValueBank::Bool: p.pbool[o.key] = o.b; break;
+    case ValueBank::Int: p.pint[o.key] = o.i; break;
+    case ValueBank::Float: p.pfloat[o.key] = o.f; break;
+    case ValueBank::String: p.pstring[o.key] = o.s; break;
+    default: break;
+    }
+}
+
+// BatchIO
+float* BatchIO::ScratchFloat(void)
+{
+    auto& scratch = m_Engine->m_FloatScratch;
+    if (m_FloatScratchUsed == scratch.size())
+        scratch.emplace_back(m_Engine->m_Stride);
+    return scratch[m_FloatScratchUsed++].data();
+}
+
+int32_t* BatchIO::ScratchInt(void)
+{
+    auto& scratch = m_Engine->m_IntScratch;
+    if (m_IntScratchUsed == scratch.size())
+        scratch.emplace_back(m_Engine->m_Stride);
+    return scratch[m_IntScratchUsed++].data();
+}
+
+const float* BatchIO::InputFloat(int index)
+{
+    Slot slot = m_InputSlots[index];
+    const BatchEngine& e = *m_Engine;
+    if (SlotBank(slot) == ValueBank::Float)
+        return &e.m_Floats[e.At(slot)];
+
+    float* out = ScratchFloat();
+    switch (SlotBank(slot)) {
+    case ValueBank::Int:
+        casa::simd::IntToFloat(out, &e.m_Ints[e.At(slot)], m_Lanes);
+        break;
+    case ValueBank::Bool:
+        for (uint32_t l = 0; l < m_Lanes; l++)
+            out[l] = e.m_Bools[e.At(slot) + l] ? 1.0f : 0.0f;
+        break;
+    default:
+        casa::simd::FillF(out, 0.0f, m_Lanes);
+        break;
+    }
+    return out;
+}
+
+const int32_t* BatchIO::InputInt(int index)
+{
+    Slot slot = m_InputSlots[index];
+    const BatchEngine& e = *m_Engine;
+    if (SlotBank(slot) == ValueBank::Int)
+        return &e.m_Ints[e.At(slot)];
+
+    int32_t* out = ScratchInt();
+    switch (SlotBank(slot)) {
+    case ValueBank::Float:
+        for (uint32_t l = 0; l < m_Lanes; l++)
+            out[l] = (int32_t)e.m_Floats[e.At(slot) + l];
+        break;
+    case ValueBank::Bool:
+        for (uint32_t l = 0; l < m_Lanes; l++)
+            out[l] = e.m_Bools[e.At(slot) + l];
+        break;
+    default:
+        casa::simd::FillI(out, 0, m_Lanes);
+        break;
+    }
+    return out;
+}
+
+float* BatchIO::OutputFloat(int index)
+{
+    Slot slot = m_OutputSlots[index];
+    if (SlotBank(slot) == ValueBank::Float)
+        return &m_Engine->m_Floats[m_Engine->At(slot)];
+    return ScratchFloat(); // wrong kind, the writes are dropped
+}
+
+int32_t* BatchIO::OutputInt(int index)
+{
+    Slot slot = m_OutputSlots[index];
+    if (SlotBank(slot) == ValueBank::Int)
+        return &m_Engine->m_Ints[m_Engine->At(slot)];
+    return ScratchInt();
+}
+
+const float* BatchIO::PropFloat(const char* key, float fallback)
+{
+    auto it = m_Properties->pfloat.find(key);
+    float* out = ScratchFloat();
+    casa::simd::FillF(out, it == m_Properties->pfloat.end() ? fallback : it->second, m_Lanes);
+    for (const auto& o : m_Engine->m_Overrides[m_Node])
+        if (o.value->bank == ValueBank::Float && o.value->key == key)
+            out[o.lane] = o.value->f;
+    return out;
+}
+
+const int32_t* BatchIO::PropInt(const char* key, int32_t fallback)
+{
+    auto it = m_Properties->pint.find(key);
+    int32_t* out = ScratchInt();
+    casa::simd::FillI(out, it == m_Properties->pint.end() ? fallback : it->second, m_Lanes);
+    for (const auto& o : m_Engine->m_Overrides[m_Node])
+        if (o.value->bank == ValueBank::Int && o.value->key == key)
+            out[o.lane] = o.value->i;
+    return out;
+}
+
+// BatchEngine
+void BatchEngine::Compile(const casa::bridge::GraphView& graph)
+{
+    m_Graph = graph;
+    CompilePlan(m_Graph, m_Plan);
+    m_Batch.resize(m_Plan.steps.size());
+    for (size_t s = 0; s < m_Plan.steps.size(); s++)
+        m_Batch[s] = FindBatchEvaluator(m_Graph.nodes[m_Plan.steps[s].node].type);
+    m_Overrides.assign(m_Plan.node_count, std::vector<LaneOverride>());
+    m_LaneValues.Reset(m_Plan.bank_size);
+    m_Lanes = 0;
+    m_Stride = 0;
+}
+
+Slot BatchEngine::FindOutput(uintptr_t pin_id) const
+{
+    auto it = m_Plan.output_slot.find(pin_id);
+    return it == m_Plan.output_slot.end() ? kNoSlot : it->second;
+}
+
+const float* BatchEngine::Floats(Slot slot) const
+{
+    return SlotBank(slot) == ValueBank::Float ? &m_Floats[At(slot)] : nullptr;
+}
+
+const int32_t* BatchEngine::Ints(Slot slot) const
+{
+    return SlotBank(slot) == ValueBank::Int ? &m_Ints[At(slot)] : nullptr;
+}
+
+bool BatchEngine::GetBool(Slot slot, uint32_t lane) const
+{
+    switch (SlotBank(slot)) {
+    case ValueBank::Bool: return m_Bools[At(slot) + lane] != 0;
+    case ValueBank::Int: return m_Ints[At(slot) + lane] != 0;
+    case ValueBank::Float: return m_Floats[At(slot) + lane] != 0.0f;
+    default: return false;
+    }
+}
+
+int32_t BatchEngine::GetInt(Slot slot, uint32_t lane) const
+{
+    switch (SlotBank(slot)) {
+    case ValueBank::Bool: return m_Bools[At(slot) + lane];
+    case ValueBank::Int: return m_Ints[At(slot) + lane];
+    case ValueBank::Float: return (int32_t)m_Floats[At(slot) + lane];
+    default: return 0;
+    }
+}
+
+float BatchEngine::GetFloat(Slot slot, uint32_t lane) const
+{
+    switch (SlotBank(slot)) {
+    case ValueBank::Bool: return m_Bools[At(slot) + lane] ? 1.0f : 0.0f;
+    case ValueBank::Int: return (float)m_Ints[At(slot) + lane];
+    case ValueBank::Float: return m_Floats[At(slot) + lane];
+    default: return 0.0f;
+    }
+}
+
+const std::string& BatchEngine::GetString(Slot slot, uint32_t lane) const
+{
+    if (SlotBank(slot) != ValueBank::String)
+        return empty_string;
+    return m_Strings[At(slot) + lane];
+}
+
+void BatchEngine::Run(const std::vector<Variant>& variants)
+{
+    auto start = std::chrono::steady_clock::now();
+    m_Lanes = (uint32_t)variants.size();
+    m_Stride = (m_Lanes + 7) & ~7u;
+    m_FloatScratch.clear();
+    m_IntScratch.clear();
+
+    const uint32_t* size = m_Plan.bank_size;
+    m_Bools.assign((size_t)size[(uint32_t)ValueBank::Bool] * m_Stride, 0);
+    m_Ints.assign((size_t)size[(uint32_t)ValueBank::Int] * m_Stride, 0);
+    m_Floats.assign((size_t)size[(uint32_t)ValueBank::Float] * m_Stride, 0.0f);
+    m_Strings.assign((size_t)size[(uint32_t)ValueBank::String] * m_Stride, std::string());
+
+    for (auto& list : m_Overrides)
+        list.clear();
+    for (uint32_t lane = 0; lane < m_Lanes; lane++)
+        for (const auto& o : variants[lane].overrides)
+            if (o.node < m_Plan.node_count)
+                m_Overrides[o.node].push_back(LaneOverride{ lane, &o });
+
+    m_Stats = BatchStats();
+    m_Stats.lanes = m_Lanes;
+    if (m_Lanes > 0) {
+        for (size_t s = 0; s < m_Plan.steps.size(); s++) {
+            const PlanStep& step = m_Plan.steps[s];
+            if (m_Batch[s] == nullptr) {
+                RunLanes(step);
+                m_Stats.fallback_steps++;
+                continue;
+            }
+            BatchIO io;
+            io.m_Engine = this;
+            io.m_Properties = step.properties;
+            io.m_InputSlots = m_Plan.input_slots.data() + step.first_input;
+            io.m_OutputSlots = m_Plan.output_slots.data() + step.first_output;
+            io.m_InputCount = step.input_count;
+            io.m_OutputCount = step.output_count;
+            io.m_Node = step.node;
+            io.m_Lanes = m_Lanes;
+            m_Batch[s](io);
+            m_Stats.batched_steps++;
+        }
+    }
+    m_Stats.last_run_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Gather one lane into m_LaneValues, run the scalar evaluator on it, scatter the outputs back.
+void BatchEngine::RunLanes(const PlanStep& step)
+{
+    const Slot* inputs = m_Plan.input_slots.data() + step.first_input;
+    const Slot* outputs = m_Plan.output_slots.data() + step.first_output;
+    const std::vector<LaneOverride>& overrides = m_Overrides[step.node];
+    size_t next_override = 0;
+
+    NodeIO io;
+    io.m_Store = &m_LaneValues;
+    io.m_Arena = &m_LaneArena;
+    io.m_InputSlots = inputs;
+    io.m_OutputSlots = outputs;
+    io.m_InputCount = step.input_count;
+    io.m_OutputCount = step.output_count;
+
+    for (uint32_t lane = 0; lane < m_Lanes; lane++) {
+        for (uint32_t i = 0; i < step.input_count; i++) {
+            Slot slot = inputs[i];
+            size_t at = At(slot) + lane;
+            switch (SlotBank(slot)) {
+            case ValueBank::Bool: m_LaneValues.BoolData()[SlotIndex(slot)] = m_Bools[at]; break;
+            case ValueBank::Int: m_LaneValues.IntData()[SlotIndex(slot)] = m_Ints[at]; break;
+            case ValueBank::Float: m_LaneValues.FloatData()[SlotIndex(slot)] = m_Floats[at]; break;
+            case ValueBank::String: m_LaneValues.StringData()[SlotIndex(slot)] = m_Strings[at]; break;
+            default: break;
+            }
+        }
+        // Outputs start from their defaults, as they would on a fresh Engine.
+        for (uint32_t o = 0; o < step.output_count; o++)
+            m_LaneValues.Store(outputs[o], PinValue());
+
+        io.m_Properties = step.properties;
+        if (next_override < overrides.size() && overrides[next_override].lane == lane) {
+            m_LaneProperties = *step.properties;
+            for (; next_override < overrides.size() && overrides[next_override].lane == lane; next_override++)
+                apply_override(m_LaneProperties, *overrides[next_override].value);
+            io.m_Properties = &m_LaneProperties;
+        }
+        m_LaneArena.Reset(); // temporaries only live for one call
+        step.evaluate(io);
+
+        for (uint32_t o = 0; o < step.output_count; o++) {
+            Slot slot = outputs[o];
+            size_t at = At(slot) + lane;
+            switch (SlotBank(slot)) {
+            case ValueBank::Bool: m_Bools[at] = m_LaneValues.BoolData()[SlotIndex(slot)]; break;
+            case ValueBank::Int: m_Ints[at] = m_LaneValues.IntData()[SlotIndex(slot)]; break;
+            case ValueBank::Float: m_Floats[at] = m_LaneValues.FloatData()[SlotIndex(slot)]; break;
+            case ValueBank::String: m_Strings[at].swap(m_LaneValues.StringData()[SlotIndex(slot)]); break;
+            default: break;
+            }
+        }
+    }
+}
+
+// Sweep window
+static const uint32_t kNoNode = ~0u;
+
+static uint32_t find_node(const casa::bridge::GraphView& graph, uintptr_t id)
+{
+    for (uint32_t n = 0; n < (uint32_t)graph.nodes.size(); n++)
+        if (graph.nodes[n].id == id)
+            return n;
+    return kNoNode;
+}
+
+static uintptr_t first_selected_node(void)
+{
+    std::vector<uintptr_t> selected;
+    casa::bridge::SelectedNodes(selected);
+    return selected.empty() ? 0 : selected.front();
+}
+
+static bool run_sweep(SweepPanel& panel, const casa::bridge::GraphView& graph)
+{
+    panel.values.clear();
+    uint32_t vary = find_node(graph, panel.vary_node);
+    uint32_t watch = find_node(graph, panel.watch_node);
+    if (vary == kNoNode || watch == kNoNode) {
+        panel.error = "the node to vary or to watch is gone";
+        return false;
+    }
+    const casa::bridge::NodeView& watched = graph.nodes[watch];
+    if (panel.watch_output < 0 || (uint32_t)panel.watch_output >= watched.output_count) {
+        panel.error = "the watched node has no such output";
+        return false;
+    }
+
+    std::vector<Variant> variants((size_t)panel.steps);
+    for (int lane = 0; lane < panel.steps; lane++) {
+        float t = panel.steps > 1 ? (float)lane / (float)(panel.steps - 1) : 0.0f;
+        PropertyOverride o;
+        o.node = vary;
+        o.key = panel.key;
+        o.bank = ValueBank::Float;
+        o.f = panel.from + (panel.to - panel.from) * t;
+        variants[lane].overrides.push_back(std::move(o));
+    }
+    panel.engine.Compile(graph);
+    panel.engine.Run(variants);
+
+    Slot slot = panel.engine.FindOutput(graph.pins[watched.first_output + panel.watch_output].id);
+    if (slot == kNoSlot) {
+        panel.error = "the watched output is not evaluated";
+        return false;
+    }
+    panel.values.resize(variants.size());
+    for (uint32_t lane = 0; lane < (uint32_t)variants.size(); lane++)
+        panel.values[lane] = panel.engine.GetFloat(slot, lane);
+    panel.error.clear();
+    return true;
+}
+
+void DrawSweepWindow(SweepPanel& panel, const casa::bridge::GraphView& graph, bool* open)
+{
+    if (!ImGui::Begin("Sweep", open)) {
+        ImGui::End();
+        return;
+    }
+
+    uint32_t vary = find_node(graph, panel.vary_node);
+    if (ImGui::SmallButton("Vary Selected")) {
+        panel.vary_node = first_selected_node();
+        panel.key.clear();
+        vary = find_node(graph, panel.vary_node);
+    }
+    ImGui::SameLine();
+    if (vary == kNoNode) {
+        ImGui::TextDisabled("select the node whose property to vary");
+    } else {
+        const casa::bridge::NodeView& node = graph.nodes[vary];
+        ImGui::Text("node %llu, %s", (unsigned long long)node.id, node.type.c_str());
+        const auto& floats = node.properties->pfloat;
+        if (panel.key.empty() && !floats.empty())
+            panel.key = floats.begin()->first;
+        if (ImGui::BeginCombo("property", panel.key.c_str())) {
+            for (const auto& entry : floats)
+                if (ImGui::Selectable(entry.first.c_str(), entry.first == panel.key))
+                    panel.key = entry.first;
+            ImGui::EndCombo();
+        }
+    }
+    ImGui::DragFloat("from", &panel.from, 0.01f);
+    ImGui::DragFloat("to", &panel.to, 0.01f);
+    ImGui::DragInt("steps", &panel.steps, 1.0f, 2, 4096);
+    panel.steps = std::clamp(panel.steps, 2, 4096);
+
+    uint32_t watch = find_node(graph, panel.watch_node);
+    if (ImGui::SmallButton("Watch Selected")) {
+        panel.watch_node = first_selected_node();
+        panel.watch_output = 0;
+        watch = find_node(graph, panel.watch_node);
+    }
+    ImGui::SameLine();
+    if (watch == kNoNode) {
+        ImGui::TextDisabled("select the node whose output to watch");
+    } else {
+        const casa::bridge::NodeView& node = graph.nodes[watch];
+        ImGui::Text("node %llu, %s", (unsigned long long)node.id, node.type.c_str());
+        ImGui::DragInt("output", &panel.watch_output, 0.1f, 0, node.output_count > 0 ? (int)node.output_count - 1 : 0);
+    }
+
+    bool ready = vary != kNoNode && watch != kNoNode && !panel.key.empty();
+    if (ImGui::Button("Run") && ready)
+        run_sweep(panel, graph);
+
+    if (!panel.error.empty()) {
+        ImGui::TextDisabled("%s", panel.error.c_str());
+    } else if (!panel.values.empty()) {
+        const BatchStats& stats = panel.engine.Stats();
+        ImGui::Text("%u lanes in %.3f ms: %u steps batched, %u lane by lane", stats.lanes, stats.last_run_ms,
+            stats.batched_steps, stats.fallback_steps);
+        auto range = std::minmax_element(panel.values.begin(), panel.values.end());
+        ImGui::Text("output from %g to %g", *range.first, *range.second);
+        ImGui::PlotLines("##sweep", panel.values.data(), (int)panel.values.size(), 0, nullptr, FLT_MAX, FLT_MAX,
+            ImVec2(-1.0f, 120.0f));
+    }
+    ImGui::End();
+}
+
+} // end namespace eval
+} // end namespace casa
@@ -0,0 +1,1551 @@
+#include "benchmarks.h"
+#include "graph_eval.h"
+#include "batch_eval.h"
+#include "casa_hash.h"
+#include "csa_format.h"
+#include "csa_compress.h"
+#include "csa_diff.h"
+#include "flow_vm.h"
+#include "frame_arena.h"
+#include "graph_document.h"
+#include "graph_generator.h"
+#include "incremental_save.h"
+#include "mapped_file.h"
+#include "output_sink.h"
+#include "plano_bridge.h"
+#include "progressive_load.h"
+#include "save_load_file.h"
+#include "node_defs/casa_nodes.h"
+#include "node_defs/math_nodes.h"
+#include "simd_kernels.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using casa::bridge::GraphView;
+using casa::bridge::NodeView;
+using casa::bridge::PinView;
+using plano::types::PinType;
+
+// Helpers
+static double now_ms(void)
+{
+    using namespace std::chrono;
+    return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Pin ids only have to be unique, so hand them out from a counter.
+static uint32_t add_typed_node(GraphView& g, Properties* props, const char* type,
+    std::initializer_list<PinType> inputs, std::initializer_list<PinType> outputs, uintptr_t& next_id)
+{
+    NodeView n;
+    n.id = next_id++;
+    n.type = type;
+    n.properties = props;
+    n.first_input = (uint32_t)g.pins.size();
+    n.input_count = (uint32_t)inputs.size();
+    for (PinType t : inputs)
+        g.pins.push_back(PinView{ next_id++, t });
+    n.first_output = (uint32_t)g.pins.size();
+    n.output_count = (uint32_t)outputs.size();
+    for (PinType t : outputs)
+        g.pins.push_back(PinView{ next_id++, t });
+    g.nodes.push_back(n);
+    return (uint32_t)g.nodes.size() - 1;
+}
+
+static void link_pins(GraphView& g, uint32_t from_node, uint32_t output, uint32_t to_node, uint32_t input)
+{
+    g.links.push_back(casa::bridge::LinkView{ g.pins[g.nodes[from_node].first_output + output].id, g.pins[g.nodes[to_node].first_input + input].id });
+}
+
+// One root feeding "branches" independent chains of "depth" nodes, eg. one chain per facade.
+static void make_fanout_graph(GraphView& g, std::vector<Properties>& props, uint32_t branches, uint32_t depth)
+{
+    g = GraphView();
+    props.assign(1 + (size_t)branches * depth, Properties());
+    uintptr_t next_id = 1;
+    add_typed_node(g, &props[0], "bench.Work", { PinType::Float }, { PinType::Float }, next_id);
+    for (uint32_t b = 0; b < branches; b++) {
+        uint32_t upstream = 0;
+        for (uint32_t d = 0; d < depth; d++) {
+            uint32_t n = add_typed_node(g, &props[g.nodes.size()], "bench.Work", { PinType::Float }, { PinType::Float }, next_id);
+            link_pins(g, upstream, 0, n, 0);
+            upstream = n;
+        }
+    }
+}
+
+// A few microseconds of floating point work, standing in for real geometry nodes.
+static void bench_work_evaluate(casa::eval::NodeIO& io)
+{
+    float x = io.InputFloat(0) + 1.0f;
+    for (int i = 0; i < 2000; i++)
+        x = std::sqrt(x * x + 0.5f) * 0.999f;
+    io.SetFloat(0, x);
+}
+
+// Benchmarks
+static int bench_eval_scaling(void)
+{
+    casa::eval::RegisterEvaluator("bench.Work", bench_work_evaluate);
+
+    const uint32_t branches = 256, depth = 16;
+    GraphView graph;
+    std::vector<Properties> props;
+    make_fanout_graph(graph, props, branches, depth);
+    printf("eval_scaling: %u branches x %u nodes (%zu nodes)\n", branches, depth, graph.nodes.size());
+
+    // Serial reference.
+    std::vector<float> reference;
+    {
+        casa::eval::Engine engine;
+        engine.Compile(graph, 1);
+        engine.Run();
+        reference = engine.Values().Floats();
+    }
+
+    const unsigned worker_counts[] = { 1, 2, 4, 8, 16, 32 };
+    const int repeats = 5;
+    double base_ms = 0.0;
+    bool identical = true;
+    printf("%8s %12s %10s %10s\n", "workers", "ms/run", "speedup", "result");
+    for (unsigned workers : worker_counts) {
+        casa::eval::Engine engine;
+        engine.SetWorkerCount(workers);
+        engine.SetParallelThreshold(1);
+        engine.Compile(graph, 1);
+
+        double best = 1e30;
+        for (int r = 0; r < repeats; r++) {
+            engine.MarkAllDirty();
+            double start = now_ms();
+            engine.Run();
+            double t = now_ms() - start;
+            if (t < best)
+                best = t;
+        }
+        if (workers == 1)
+            base_ms = best;
+
+        bool same = engine.Values().Floats() == reference;
+        identical = identical && same;
+        printf("%8u %12.3f %9.2fx %10s\n", workers, best, base_ms / best, same ? "identical" : "DIFFERENT");
+    }
+    return identical ? 0 : 1;
+}
+
+// InputAction Fire -> DoN -> Branch(True) -> back into DoN, so one Fire loops N times.
+static int bench_flow_vm(void)
+{
+    GraphView g;
+    Properties props;
+    uintptr_t next_id = 1;
+    uint32_t fire = add_typed_node(g, &props, "InputAction Fire", {}, { PinType::Flow, PinType::Flow }, next_id);
+    uint32_t don = add_typed_node(g, &props, "DoN", { PinType::Flow, PinType::Int, PinType::Flow }, { PinType::Flow, PinType::Int }, next_id);
+    uint32_t branch = add_typed_node(g, &props, "Branch", { PinType::Flow, PinType::Delegate }, { PinType::Flow, PinType::Flow }, next_id);
+    uint32_t print = add_typed_node(g, &props, "PrintString", { PinType::Flow, PinType::String }, { PinType::Flow }, next_id);
+    link_pins(g, fire, 0, don, 0);
+    link_pins(g, don, 0, branch, 0);
+    link_pins(g, branch, 0, don, 0);
+    link_pins(g, branch, 1, print, 0);
+
+    casa::flow::Program program;
+    casa::flow::CompileFlow(g, program);
+    casa::flow::Machine machine;
+    machine.Load(program);
+    int n_reg = program.FindInputRegister(g.nodes[don].id, 1);
+    int cond_reg = program.FindInputRegister(g.nodes[branch].id, 1);
+    if (program.entries.empty() || n_reg < 0 || cond_reg < 0) {
+        printf("flow_vm: compile failed\n");
+        return 1;
+    }
+
+    const int32_t loops = 50 * 1000 * 1000;
+    machine.Int((uint32_t)n_reg) = loops;
+    machine.Int((uint32_t)cond_reg) = 1;
+    double start = now_ms();
+    bool ok = machine.Fire(0, ~0ull);
+    double ms = now_ms() - start;
+
+    uint64_t executed = machine.InstructionsExecuted();
+    printf("flow_vm: %zu instructions of code, %d loop iterations\n", program.code.size(), loops);
+    printf("%llu instructions in %.1f ms: %.1f M instructions/s\n", (unsigned long long)executed, ms, executed / (ms * 1000.0));
+    return ok ? 0 : 1;
+}
+
+// Baseline for value_store: every pin's value boxed in a hash map keyed by pin id.
+struct MapValue {
+    PinType type;
+    casa::eval::PinValue value;
+};
+
+// 100k output pins of mixed kinds, each read by the next pin of the same kind like a chain of nodes.
+static int bench_value_store(void)
+{
+    using namespace casa::eval;
+    const uint32_t pin_count = 100 * 1000;
+    const PinType kinds[] = { PinType::Float, PinType::Float, PinType::Int, PinType::Float, PinType::Bool, PinType::Float, PinType::Int, PinType::String };
+
+    std::vector<PinType> types(pin_count);
+    std::vector<uintptr_t> ids(pin_count);
+    std::vector<Slot> slots(pin_count);
+    uint32_t bank_size[kBankCount] = { 1, 1, 1, 1, 1 };
+    for (uint32_t p = 0; p < pin_count; p++) {
+        types[p] = kinds[p % 8];
+        ids[p] = 0x10000 + (uintptr_t)p * 3;
+        slots[p] = AllocateSlot(bank_size, types[p]);
+    }
+    std::vector<uint32_t> upstream(pin_count); // previous pin of the same kind, or itself for the first one
+    uint32_t last_of_kind[8];
+    for (uint32_t p = 0; p < pin_count; p++) {
+        uint32_t k = p % 8;
+        upstream[p] = p < 8 ? p : last_of_kind[k];
+        last_of_kind[k] = p;
+    }
+
+    ValueStore store;
+    store.Reset(bank_size);
+    std::unordered_map<uintptr_t, MapValue> map;
+    map.reserve(pin_count);
+    for (uint32_t p = 0; p < pin_count; p++)
+        map[ids[p]].type = types[p];
+
+    const int repeats = 5;
+    double soa_ms[3] = { 1e30, 1e30, 1e30 }, map_ms[3] = { 1e30, 1e30, 1e30 };
+    double soa_sum = 0.0, map_sum = 0.0;
+    for (int r = 0; r < repeats; r++) {
+        // 1. write every pin
+        double start = now_ms();
+        for (uint32_t p = 0; p < pin_count; p++) {
+            switch (types[p]) {
+            case PinType::Float: store.SetFloat(slots[p], (float)p * 0.5f); break;
+            case PinType::Int: store.SetInt(slots[p], (int32_t)p); break;
+            case PinType::Bool: store.SetBool(slots[p], p & 1); break;
+            default: store.SetString(slots[p], "s"); break;
+            }
+        }
+        soa_ms[0] = std::min(soa_ms[0], now_ms() - start);
+        start = now_ms();
+        for (uint32_t p = 0; p < pin_count; p++) {
+            PinValue& v = map[ids[p]].value;
+            switch (types[p]) {
+            case PinType::Float: v.f = (float)p * 0.5f; break;
+            case PinType::Int: v.i = (int32_t)p; break;
+            case PinType::Bool: v.b = p & 1; break;
+            default: v.s = "s"; break;
+            }
+        }
+        map_ms[0] = std::min(map_ms[0], now_ms() - start);
+
+        // 2. evaluate-like: read the upstream pin, write our own
+        start = now_ms();
+        for (uint32_t p = 0; p < pin_count; p++) {
+            if (types[p] == PinType::Float)
+                store.SetFloat(slots[p], store.GetFloat(slots[upstream[p]]) * 0.5f + 1.0f);
+            else if (types[p] == PinType::Int)
+                store.SetInt(slots[p], store.GetInt(slots[upstream[p]]) + 1);
+        }
+        soa_ms[1] = std::min(soa_ms[1], now_ms() - start);
+        start = now_ms();
+        for (uint32_t p = 0; p < pin_count; p++) {
+            if (types[p] == PinType::Float)
+                map[ids[p]].value.f = map[ids[upstream[p]]].value.f * 0.5f + 1.0f;
+            else if (types[p] == PinType::Int)
+                map[ids[p]].value.i = map[ids[upstream[p]]].value.i + 1;
+        }
+        map_ms[1] = std::min(map_ms[1], now_ms() - start);
+
+        // 3. scan every Float pin in the graph
+        start = now_ms();
+        const std::vector<float>& floats = store.Floats();
+        float sum = 0.0f;
+        for (size_t i = 1; i < floats.size(); i++)
+            sum += floats[i];
+        soa_ms[2] = std::min(soa_ms[2], now_ms() - start);
+        soa_sum = sum;
+        start = now_ms();
+        sum = 0.0f;
+        for (uint32_t p = 0; p < pin_count; p++) {
+            const MapValue& mv = map[ids[p]];
+            if (mv.type == PinType::Float)
+                sum += mv.value.f;
+        }
+        map_ms[2] = std::min(map_ms[2], now_ms() - start);
+        map_sum = sum;
+    }
+
+    printf("value_store: %u pins (%u float, %u int, %u bool, %u string)\n", pin_count,
+        bank_size[(uint32_t)ValueBank::Float] - 1, bank_size[(uint32_t)ValueBank::Int] - 1,
+        bank_size[(uint32_t)ValueBank::Bool] - 1, bank_size[(uint32_t)ValueBank::String] - 1);
+    const char* names[3] = { "write all", "read upstream + write", "scan floats" };
+    printf("%-24s %12s %12s %10s\n", "", "soa ms", "map ms", "speedup");
+    for (int i = 0; i < 3; i++)
+        printf("%-24s %12.3f %12.3f %9.1fx\n", names[i], soa_ms[i], map_ms[i], map_ms[i] / soa_ms[i]);
+
+    // Both stores summed the float pins in a different order, so allow for rounding.
+    bool same = std::fabs(soa_sum - map_sum) <= 1e-4 * std::fabs(map_sum);
+    printf("float sum %s (%g / %g)\n", same ? "matches" : "DIFFERS", soa_sum, map_sum);
+    return same ? 0 : 1;
+}
+
+// One graph of the app's "Scale Offset" nodes evaluated under 256 variants of their "scale"
+// properties: one Engine run per variant against a single BatchEngine run at each SIMD level, and
+// lane by lane without the node's batch kernel.
+static int bench_batch_sweep(void)
+{
+    using namespace casa::eval;
+    typedef node_defs::math_nodes::ScaleOffset::Definition ScaleOffset;
+    RegisterEvaluator(ScaleOffset::kType, ScaleOffset::EvaluateIO);
+
+    const uint32_t chains = 8, depth = 32, variant_count = 256;
+    GraphView graph;
+    std::vector<Properties> props(1 + (size_t)chains * depth);
+    uintptr_t next_id = 1;
+    add_typed_node(graph, &props[0], ScaleOffset::kType, { PinType::Float }, { PinType::Float }, next_id);
+    props[0].pfloat["offset"] = 1.0f;
+    std::vector<uint32_t> heads;
+    for (uint32_t c = 0; c < chains; c++) {
+        uint32_t upstream = 0;
+        for (uint32_t d = 0; d < depth; d++) {
+            uint32_t n = add_typed_node(graph, &props[graph.nodes.size()], ScaleOffset::kType, { PinType::Float }, { PinType::Float }, next_id);
+            props[n].pfloat["scale"] = 0.99f;
+            props[n].pfloat["offset"] = 0.25f * (float)(c + 1);
+            link_pins(graph, upstream, 0, n, 0);
+            if (d == 0)
+                heads.push_back(n);
+            upstream = n;
+        }
+    }
+
+    // Every variant sets the root's offset and every chain head's scale.
+    std::vector<Variant> variants(variant_count);
+    for (uint32_t v = 0; v < variant_count; v++) {
+        PropertyOverride o;
+        o.key = "offset";
+        o.f = 1.0f + 0.01f * (float)v;
+        variants[v].overrides.push_back(o);
+        for (uint32_t c = 0; c < chains; c++) {
+            o.node = heads[c];
+            o.key = "scale";
+            o.f = 0.5f + 0.003f * (float)(v + c);
+            variants[v].overrides.push_back(o);
+        }
+    }
+    printf("batch_sweep: %zu nodes, %u variants, best SIMD level %s\n", graph.nodes.size(), variant_count,
+        casa::simd::LevelName(casa::simd::Detect()));
+
+    const int repeats = 5;
+    Engine engine;
+    engine.Compile(graph, 1);
+    std::vector<std::vector<float>> reference(variant_count);
+    double separate_ms = 1e30;
+    for (int r = 0; r < repeats; r++) {
+        double start = now_ms();
+        for (uint32_t v = 0; v < variant_count; v++) {
+            for (const auto& o : variants[v].overrides) {
+                props[o.node].pfloat[o.key] = o.f;
+                engine.MarkDirty(o.node);
+            }
+            engine.Run();
+            reference[v] = engine.Values().Floats();
+        }
+        separate_ms = std::min(separate_ms, now_ms() - start);
+    }
+    // The per-variant runs left the last variant's values behind, put the graph back.
+    for (uint32_t c = 0; c < chains; c++)
+        props[heads[c]].pfloat["scale"] = 0.99f;
+    props[0].pfloat["offset"] = 1.0f;
+
+    printf("%-24s %12s %10s %10s\n", "", "ms/sweep", "speedup", "result");
+    printf("%-24s %12.3f %9.2fx %10s\n", "separate runs", separate_ms, 1.0, "reference");
+
+    struct Mode {
+        const char* name;
+        casa::simd::Level level;
+        bool batched;
+    };
+    const Mode modes[] = {
+        { "batch AVX2", casa::simd::Level::AVX2, true },
+        { "batch SSE4.1", casa::simd::Level::SSE, true },
+        { "batch scalar", casa::simd::Level::Scalar, true },
+        { "lane by lane", casa::simd::Level::Scalar, false },
+    };
+    bool identical = true;
+    for (const Mode& mode : modes) {
+        if ((int)mode.level > (int)casa::simd::Detect())
+            continue;
+        casa::simd::SetLevel(mode.level);
+        RegisterBatchEvaluator(ScaleOffset::kType, mode.batched ? ScaleOffset::EvaluateBatch : nullptr);
+        BatchEngine batch;
+        batch.Compile(graph);
+
+        double best = 1e30;
+        for (int r = 0; r < repeats; r++) {
+            double start = now_ms();
+            batch.Run(variants);
+            best = std::min(best, now_ms() - start);
+        }
+
+        bool same = true;
+        for (uint32_t v = 0; v < variant_count && same; v++)
+            for (Slot slot : batch.Plan().output_slots)
+                same = same && batch.Floats(slot)[v] == reference[v][SlotIndex(slot)];
+        identical = identical && same;
+        printf("%-24s %12.3f %9.2fx %10s\n", mode.name, best, separate_ms / best, same ? "identical" : "DIFFERENT");
+    }
+    casa::simd::SetLevel(casa::simd::Detect());
+    RegisterBatchEvaluator(ScaleOffset::kType, ScaleOffset::EvaluateBatch);
+    return identical ? 0 : 1;
+}
+
+// 1000 frames of a 200 node graph's per-frame temporaries, the way a status line or a plot would
+// build them: a label too long for std::string's inline buffer and a 64 sample scratch buffer per
+// node.  Heap allocated against the frame arena, counting global heap allocations per frame.
+static int bench_frame_allocs(void)
+{
+    const int frames = 1000, nodes = 200, samples = 64;
+    size_t sink = 0;
+
+    uint64_t heap_start = casa::mem::HeapAllocations();
+    double start = now_ms();
+    for (int f = 0; f < frames; f++) {
+        for (int n = 0; n < nodes; n++) {
+            std::string label = "node " + std::to_string(n) + " evaluating, frame " + std::to_string(f);
+            std::vector<float> scratch(samples);
+            for (int i = 0; i < samples; i++)
+                scratch[i] = (float)(i + n + f);
+            sink += label.size() + (size_t)scratch[samples - 1];
+        }
+    }
+    double heap_ms = now_ms() - start;
+    uint64_t heap_allocs = casa::mem::HeapAllocations() - heap_start;
+
+    casa::mem::Arena arena;
+    uint64_t arena_start = casa::mem::HeapAllocations();
+    uint64_t steady_allocs = 0;
+    start = now_ms();
+    for (int f = 0; f < frames; f++) {
+        if (f == 1)
+            steady_allocs = casa::mem::HeapAllocations(); // the first frame sizes the arena
+        for (int n = 0; n < nodes; n++) {
+            const char* label = arena.Format("node %d evaluating, frame %d", n, f);
+            float* scratch = arena.Allocate<float>(samples);
+            for (int i = 0; i < samples; i++)
+                scratch[i] = (float)(i + n + f);
+            sink += strlen(label) + (size_t)scratch[samples - 1];
+        }
+        arena.Reset();
+    }
+    double arena_ms = now_ms() - start;
+    uint64_t arena_allocs = casa::mem::HeapAllocations() - arena_start;
+    steady_allocs = casa::mem::HeapAllocations() - steady_allocs;
+
+    printf("frame_allocs: %d frames x %d nodes, label + %d floats per node (checksum %zu)\n", frames, nodes, samples, sink);
+    printf("%-12s %16s %14s %12s\n", "", "allocs/frame", "total allocs", "ms/frame");
+    printf("%-12s %16.1f %14llu %12.4f\n", "heap", (double)heap_allocs / frames, (unsigned long long)heap_allocs, heap_ms / frames);
+    printf("%-12s %16.1f %14llu %12.4f\n", "frame arena", (double)arena_allocs / frames, (unsigned long long)arena_allocs, arena_ms / frames);
+    printf("arena: %zu bytes in use at peak, %llu heap allocations after the first frame\n", arena.PeakUsed(), (unsigned long long)steady_allocs);
+    return steady_allocs == 0 ? 0 : 1;
+}
+
+// Snapshots of the persistent document against copying a flat id -> node map, 1k to 1M nodes.
+// An old snapshot is held through every edit, so "bytes/edit" is what structural sharing costs.
+static int bench_doc_snapshot(void)
+{
+    const uint32_t sizes[] = { 1000, 10000, 100000, 1000000 };
+    const int snapshots = 100000, edits = 20000, kept = 64;
+    bool ok = true;
+    size_t sink = 0;
+
+    printf("doc_snapshot: %d snapshots, %d edits with the last %d snapshots held\n", snapshots, edits, kept);
+    printf("%10s %10s %13s %13s %10s %11s %14s %14s\n", "nodes", "build ms", "snapshot ns", "allocs/snap",
+        "edit us", "bytes/edit", "flat copy ms", "flat copy MB");
+    for (uint32_t n : sizes) {
+        casa::doc::Document doc;
+        uintptr_t next_id = 1;
+        double start = now_ms();
+        for (uint32_t i = 0; i < n; i++) {
+            casa::doc::NodeData node;
+            node.id = next_id++;
+            node.type = "bench.Work";
+            node.inputs.push_back(casa::doc::PinData{ next_id++, PinType::Float, "in" });
+            node.outputs.push_back(casa::doc::PinData{ next_id++, PinType::Float, "out" });
+            node.properties.pfloat["value"] = (float)i;
+            if (i > 0) // chain each node to the one before, link ids come from their own range
+                doc.SetLink(casa::doc::LinkData{ ((uintptr_t)1 << 40) + i, node.id - 1, node.inputs[0].id });
+            doc.SetNode(std::move(node));
+        }
+        double build_ms = now_ms() - start;
+
+        uint64_t allocs = casa::mem::HeapAllocations();
+        start = now_ms();
+        for (int s = 0; s < snapshots; s++) {
+            casa::doc::Snapshot snap = doc.Take();
+            sink += snap.nodes.Size();
+        }
+        double snapshot_ns = (now_ms() - start) * 1e6 / snapshots;
+        double allocs_per_snapshot = (double)(casa::mem::HeapAllocations() - allocs) / snapshots;
+
+        // Edit random nodes, taking a snapshot before each one.  Node ids are 1, 4, 7, ...
+        casa::doc::Snapshot first = doc.Take();
+        std::vector<casa::doc::Snapshot> ring(kept);
+        uint32_t rng = 12345;
+        uint64_t bytes = casa::mem::HeapBytesAllocated();
+        start = now_ms();
+        for (int e = 0; e < edits; e++) {
+            ring[e % kept] = doc.Take();
+            rng = rng * 1664525u + 1013904223u;
+            uintptr_t id = 1 + (uintptr_t)(rng % n) * 3;
+            Properties p = doc.Current().nodes.Find(id)->properties;
+            p.pfloat["value"] += 1.0f;
+            doc.SetProperties(id, p);
+        }
+        double edit_us = (now_ms() - start) * 1e3 / edits;
+        double bytes_per_edit = (double)(casa::mem::HeapBytesAllocated() - bytes) / edits;
+
+        // The first snapshot must still see the values from before the edits.
+        first.nodes.ForEach([&](uint64_t id, const casa::doc::NodeData& node) {
+            if (node.properties.pfloat.at("value") != (float)((id - 1) / 3))
+                ok = false;
+        });
+
+        std::unordered_map<uintptr_t, std::shared_ptr<const casa::doc::NodeData>> flat;
+        flat.reserve(n);
+        doc.Current().nodes.ForEach([&](uint64_t id, const casa::doc::NodeData&) { flat[id] = doc.Current().nodes.FindShared(id); });
+        const int copies = n >= 100000 ? 3 : 20;
+        bytes = casa::mem::HeapBytesAllocated();
+        start = now_ms();
+        for (int c = 0; c < copies; c++) {
+            auto copy = flat;
+            sink += copy.size();
+        }
+        double copy_ms = (now_ms() - start) / copies;
+        double copy_mb = (double)(casa::mem::HeapBytesAllocated() - bytes) / copies / (1024.0 * 1024.0);
+
+        printf("%10u %10.1f %13.1f %13.2f %10.2f %11.0f %14.3f %14.2f\n", n, build_ms, snapshot_ns, allocs_per_snapshot,
+            edit_us, bytes_per_edit, copy_ms, copy_mb);
+    }
+    printf("old snapshots unchanged: %s (checksum %zu)\n", ok ? "yes" : "NO", sink);
+    return ok ? 0 : 1;
+}
+
+// A large project held the way plano holds it, a Properties map per node.  Nodes have an input
+// and an output pin and are chained into one long line.
+static void make_bench_project(std::vector<Properties>& props, uint32_t n)
+{
+    props.assign(n, Properties());
+    for (uint32_t i = 0; i < n; i++) {
+        props[i].pfloat["value"] = (float)i;
+        props[i].pstring["label"] = "node " + std::to_string(i);
+    }
+}
+
+// Every benchmark project's node: id "id", an "in" pin with the id after it and an "out" pin
+// with the one after that.
+static casa::csa::NodeEntry& add_bench_node(casa::csa::Writer& writer, uint64_t id, const char* type, float x, float y)
+{
+    casa::csa::NodeEntry& node = writer.AddNode();
+    node.id = id;
+    node.type = writer.Intern(type);
+    node.position[0] = x;
+    node.position[1] = y;
+    node.color[3] = 1.0f;
+    writer.AddPin(id + 1, "in", PinType::Float, plano::types::PinKind::Input);
+    writer.AddPin(id + 2, "out", PinType::Float, plano::types::PinKind::Output);
+    return node;
+}
+
+// A link from the "out" pin of node "from" to the "in" pin of node "to", both added by add_bench_node().
+static void add_bench_link(casa::csa::Writer& writer, uint64_t id, uint64_t from, uint64_t to)
+{
+    casa::csa::LinkEntry link = {};
+    link.id = id;
+    link.start_pin = from + 2;
+    link.end_pin = to + 1;
+    link.color[3] = 1.0f;
+    writer.AddLink(link);
+}
+
+// One side of a fork of make_bench_project(): nodes at "remove_at" modulo "remove_every" are
+// gone, with their links, and "added" nodes come after the rest, each linked to the one before.
+struct BenchFork {
+    uint32_t remove_every = 0;
+    uint32_t remove_at = 0;
+    uint32_t added = 0;
+    float added_value = 0.0f;
+};
+
+// A Writer fill function for it, or for a fork of it.  Node i has id 3i+1.
+static bool fill_bench_project(const std::vector<Properties>& props, casa::csa::Writer& writer,
+    const BenchFork& fork = BenchFork())
+{
+    uint32_t n = (uint32_t)props.size();
+    auto removed = [&fork](uint32_t i) { return fork.remove_every != 0 && i % fork.remove_every == fork.remove_at; };
+    for (uint32_t i = 0; i < n; i++) {
+        if (removed(i))
+            continue;
+        add_bench_node(writer, (uint64_t)i * 3 + 1, "bench.Work", (float)(i % 1000) * 200.0f, (float)(i / 1000) * 120.0f);
+        writer.AddProperties(props[i]);
+    }
+    // Ids after the base's, which hands out its last at 2^40 + n.
+    uint64_t first_added = ((uint64_t)1 << 41);
+    Properties added;
+    added.pfloat["value"] = fork.added_value;
+    for (uint32_t a = 0; a < fork.added; a++) {
+        add_bench_node(writer, first_added + (uint64_t)a * 3, "bench.Work", (float)a * 200.0f, -240.0f);
+        writer.AddProperties(added);
+    }
+    for (uint32_t i = 1; i < n; i++)
+        if (!removed(i) && !removed(i - 1))
+            add_bench_link(writer, ((uint64_t)1 << 40) + i, (uint64_t)(i - 1) * 3 + 1, (uint64_t)i * 3 + 1);
+    uint64_t next_id = first_added + (uint64_t)fork.added * 3;
+    for (uint32_t a = 1; a < fork.added; a++)
+        add_bench_link(writer, next_id + a, first_added + (uint64_t)(a - 1) * 3, first_added + (uint64_t)a * 3);
+    writer.SetNextId(fork.added ? next_id + fork.added : (uint64_t)n * 3 + 1);
+    return true;
+}
+
+static int bench_csa_load(void)
+{
+    const uint32_t n = 500000;
+    const int runs = 5;
+    std::string path = (std::filesystem::temp_directory_path() / "casa_bench_load.csa").string();
+
+    double start = now_ms();
+    {
+        std::vector<Properties> props;
+        make_bench_project(props, n);
+        casa::csa::Writer writer;
+        if (!writer.WriteFile(path.c_str(), [&props](casa::csa::Writer& w) { return fill_bench_project(props, w); })) {
+            printf("csa_load: can't write %s\n", path.c_str());
+            return 1;
+        }
+    }
+    double write_ms = now_ms() - start;
+    size_t file_size = (size_t)std::filesystem::file_size(path);
+
+    // What loading used to cost before parsing even started: three copies of the file.
+    double copy_ms = 1e30;
+    size_t sink = 0;
+    for (int r = 0; r < runs; r++) {
+        start = now_ms();
+        std::ifstream inf(path, std::ios::binary);
+        std::stringstream ssbuf;
+        ssbuf << inf.rdbuf();
+        std::string sbuf = ssbuf.str();
+        sink += sbuf.size();
+        copy_ms = std::min(copy_ms, now_ms() - start);
+    }
+
+    // Map, validate and visit every node, pin, property and link through the tables.
+    double open_ms = 1e30, walk_ms = 1e30, materialize_ms = 1e30;
+    bool ok = true;
+    for (int r = 0; r < runs; r++) {
+        start = now_ms();
+        casa::csa::Reader reader;
+        std::string error;
+        if (!reader.Open(path.c_str(), &error)) {
+            printf("csa_load: %s\n", error.c_str());
+            ok = false;
+            break;
+        }
+        open_ms = std::min(open_ms, now_ms() - start);
+
+        start = now_ms();
+        for (size_t i = 0; i < reader.NodeCount(); i++) {
+            const casa::csa::NodeEntry& node = reader.Node(i);
+            sink += reader.String(node.type).size() + node.input_count + node.output_count;
+            const casa::csa::PinEntry* pins = reader.Pins(node);
+            for (uint32_t p = 0; p < node.input_count + node.output_count; p++)
+                sink += reader.String(pins[p].name).size();
+            const casa::csa::PropertyEntry* props = reader.Properties(node);
+            for (uint32_t p = 0; p < node.property_count; p++)
+                sink += reader.String(props[p].key).size();
+        }
+        for (size_t l = 0; l < reader.LinkCount(); l++)
+            sink += (size_t)reader.Link(l).end_pin;
+        walk_ms = std::min(walk_ms, now_ms() - start);
+
+        // Filling Properties maps, the part of ReadIntoActiveContext() that copies strings out.
+        start = now_ms();
+        std::vector<Properties> props(reader.NodeCount());
+        for (size_t i = 0; i < reader.NodeCount(); i++)
+            reader.ReadProperties(reader.Node(i), props[i]);
+        materialize_ms = std::min(materialize_ms, now_ms() - start);
+        if (props[n - 1].pfloat["value"] != (float)(n - 1) || props[n - 1].pstring["label"] != "node " + std::to_string(n - 1))
+            ok = false;
+    }
+    std::filesystem::remove(path);
+
+    printf("csa_load: %u nodes, %u links, %.1f MB, best of %d\n", n, n - 1, file_size / (1024.0 * 1024.0), runs);
+    printf("%-40s %10.2f ms\n", "build and write", write_ms);
+    printf("%-40s %10.2f ms\n", "ifstream > stringstream > string", copy_ms);
+    printf("%-40s %10.2f ms\n", "mmap + validate", open_ms);
+    printf("%-40s %10.2f ms\n", "walk every table entry in place", walk_ms);
+    printf("%-40s %10.2f ms\n", "open + walk", open_ms + walk_ms);
+    printf("%-40s %10.2f ms\n", "materialize all Properties", materialize_ms);
+    printf("round trip: %s (checksum %zu)\n", ok ? "yes" : "NO", sink);
+    return ok ? 0 : 1;
+}
+
+// Runs "save" in a child process, so each way of saving gets its own peak RSS.  Reports the
+// time it took and how far the peak rose above what the project itself already used.
+struct SaveMeasure {
+    double ms = 0.0;
+    double peak_mb = -1.0;                // Below zero when it can't be measured here
+    bool ok = false;
+};
+
+#if !defined(_WIN32)
+static double peak_rss_mb(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+    return usage.ru_maxrss / (1024.0 * 1024.0);   // bytes
+#else
+    return usage.ru_maxrss / 1024.0;              // kilobytes
+#endif
+}
+#endif
+
+// "prepare", if given, runs first in the same process, outside the time and before the peak's baseline.
+static SaveMeasure measure_save(const std::function<bool(void)>& save, const std::function<bool(void)>& prepare = nullptr)
+{
+    SaveMeasure result;
+#if !defined(_WIN32)
+    int fds[2];
+    if (pipe(fds) == 0) {
+        fflush(stdout);
+        pid_t child = fork();
+        if (child == 0) {
+            close(fds[0]);
+            if (prepare && !prepare()) {
+                ssize_t written = write(fds[1], &result, sizeof(result));
+                _exit(written == (ssize_t)sizeof(result) ? 0 : 1);
+            }
+            double before = peak_rss_mb();
+            double start = now_ms();
+            result.ok = save();
+            result.ms = now_ms() - start;
+            result.peak_mb = peak_rss_mb() - before;
+            ssize_t written = write(fds[1], &result, sizeof(result));
+            _exit(written == (ssize_t)sizeof(result) ? 0 : 1);
+        }
+        close(fds[1]);
+        bool got = child > 0 && read(fds[0], &result, sizeof(result)) == (ssize_t)sizeof(result);
+        close(fds[0]);
+        if (child > 0)
+            waitpid(child, nullptr, 0);
+        if (got)
+            return result;
+        result = SaveMeasure();
+    }
+#endif
+    if (prepare && !prepare())
+        return result;
+    double start = now_ms();
+    result.ok = save();
+    result.ms = now_ms() - start;
+    return result;
+}
+
+// Grows to hold everything, the way SaveNodesAndLinksToBuffer() hands over a project.
+class GrowingSink : public casa::io::Sink {
+public:
+    bool Write(const void* data, size_t size) override
+    {
+        m_Data.insert(m_Data.end(), (const char*)data, (const char*)data + size);
+        return true;
+    }
+    std::vector<char> m_Data;
+};
+
+static int bench_csa_save(void)
+{
+    const uint32_t sizes[] = { 100000, 500000, 1000000 };
+    std::string path = (std::filesystem::temp_directory_path() / "casa_bench_save.csa").string();
+    bool ok = true;
+
+    printf("csa_save: wall time and peak RSS above the loaded project, one process per run\n");
+    printf("%10s %10s  %-34s %10s %12s\n", "nodes", "file MB", "save", "ms", "peak +MB");
+    for (uint32_t n : sizes) {
+        std::vector<Properties> props;
+        make_bench_project(props, n);
+        auto fill = [&props](casa::csa::Writer& w) { return fill_bench_project(props, w); };
+        size_t file_size = 0;
+
+        struct Variant {
+            const char* name;
+            std::function<bool(void)> save;
+        };
+        const Variant variants[] = {
+            // What save_project_file did: the whole project in a buffer, copied into a string, then streamed out.
+            { "buffer > string > ofstream (before)", [&]() {
+                casa::csa::Writer writer;
+                GrowingSink buffer;
+                if (!writer.Write(buffer, fill))
+                    return false;
+                std::string sbuf(buffer.m_Data.data(), buffer.m_Data.size());
+                std::ofstream ofs(path, std::ios::binary);
+                ofs << sbuf;
+                return (bool)ofs;
+            } },
+            { "FileSink, 64KB chunks", [&]() {
+                casa::csa::Writer writer;
+                return writer.WriteFile(path.c_str(), fill);
+            } },
+#if !defined(_WIN32)
+            { "FdSink behind a 64KB BufferedSink", [&]() {
+                int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                if (fd < 0)
+                    return false;
+                casa::io::FdSink file(fd);
+                casa::io::BufferedSink buffered(file);
+                casa::csa::Writer writer;
+                bool written = writer.Write(buffered, fill) && buffered.Flush();
+                return close(fd) == 0 && written;
+            } },
+#endif
+            { "MemorySink, caller's region", [&]() {
+                std::vector<char> region(file_size);
+                casa::io::MemorySink memory(region.data(), region.size());
+                casa::csa::Writer writer;
+                return writer.Write(memory, fill) && memory.Size() == file_size;
+            } },
+        };
+        for (const auto& variant : variants) {
+            SaveMeasure m = measure_save(variant.save);
+            if (file_size == 0 && m.ok)
+                file_size = (size_t)std::filesystem::file_size(path);
+            ok = ok && m.ok;
+            if (m.peak_mb < 0.0)
+                printf("%10u %10.1f  %-34s %10.1f %12s\n", n, file_size / (1024.0 * 1024.0), variant.name, m.ms, "n/a");
+            else
+                printf("%10u %10.1f  %-34s %10.1f %12.1f\n", n, file_size / (1024.0 * 1024.0), variant.name, m.ms, m.peak_mb);
+        }
+
+        // The streamed file must be a project that reads back.
+        casa::csa::Reader reader;
+        if (!reader.Open(path.c_str()) || reader.NodeCount() != n || reader.LinkCount() != n - 1)
+            ok = false;
+    }
+    std::filesystem::remove(path);
+    printf("all saves succeeded and read back: %s\n", ok ? "yes" : "NO");
+    return ok ? 0 : 1;
+}
+
+// One property edit saved by appending it to the project's journal, against rewriting the
+// whole project.  Both wait until the data is on disk.
+static int bench_journal_save(void)
+{
+    const uint32_t sizes[] = { 10000, 100000, 500000 };
+    const int saves = 20;
+    std::string path = (std::filesystem::temp_directory_path() / "casa_bench_journal.csa").string();
+    bool ok = true;
+
+    printf("journal_save: %d saves of one property edit each, fsync included\n", saves);
+    printf("%10s %10s %14s %16s %16s\n", "nodes", "file MB", "rewrite ms", "journal p50 ms", "journal B/save");
+    for (uint32_t n : sizes) {
+        casa::doc::Document doc;
+        uintptr_t next_id = 1;
+        for (uint32_t i = 0; i < n; i++) {
+            casa::doc::NodeData node;
+            node.id = next_id++;
+            node.type = "bench.Work";
+            node.inputs.push_back(casa::doc::PinData{ next_id++, PinType::Float, "in" });
+            node.outputs.push_back(casa::doc::PinData{ next_id++, PinType::Float, "out" });
+            node.properties.pfloat["value"] = (float)i;
+            node.properties.pstring["label"] = "node " + std::to_string(i);
+            if (i > 0)
+                doc.SetLink(casa::doc::LinkData{ ((uintptr_t)1 << 40) + i, node.id - 1, node.inputs[0].id });
+            doc.SetNode(std::move(node));
+        }
+
+        uint64_t stamp = casa::csa::NewJournalStamp();
+        auto rewrite = [&]() {
+            casa::doc::Snapshot snapshot = doc.Take();
+            casa::csa::Writer writer;
+            writer.SetJournalStamp(stamp);
+            casa::io::FileSink file;
+            if (!file.Open(path.c_str()))
+                return false;
+            bool written = writer.Write(file, [&snapshot](casa::csa::Writer& w) { return casa::doc::WriteSnapshot(snapshot, w); });
+            written = file.Sync() && written;
+            return file.Close() && written;
+        };
+        if (!rewrite()) {
+            printf("journal_save: can't write %s\n", path.c_str());
+            return 1;
+        }
+        double file_mb = std::filesystem::file_size(path) / (1024.0 * 1024.0);
+
+        // Rewrites, best of a few; the journal saves below build on the last one.
+        auto edit = [&doc](int e) {
+            uintptr_t id = 1 + (uintptr_t)(e * 7919 % 1000) * 3;
+            Properties p = doc.Current().nodes.Find(id)->properties;
+            p.pfloat["value"] += 1.0f;
+            doc.SetProperties(id, p);
+        };
+        double rewrite_ms = 1e30;
+        for (int r = 0; r < 3; r++) {
+            edit(r);
+            double start = now_ms();
+            ok = rewrite() && ok;
+            rewrite_ms = std::min(rewrite_ms, now_ms() - start);
+        }
+
+        casa::doc::IncrementalSaver saver;
+        std::filesystem::remove(casa::csa::JournalPath(path, stamp));
+        if (!saver.Begin(path, stamp, doc.Take())) {
+            printf("journal_save: %s\n", saver.Status().error.c_str());
+            return 1;
+        }
+        std::vector<double> times;
+        uint64_t bytes = 0;
+        for (int e = 0; e < saves; e++) {
+            edit(e);
+            double start = now_ms();
+            ok = saver.Save(doc) && ok;
+            times.push_back(now_ms() - start);
+            bytes += saver.Status().last_bytes;
+        }
+        std::sort(times.begin(), times.end());
+
+        // The journal must hold every save, and replay onto the file.
+        casa::csa::JournalReader journal;
+        if (!journal.Open(casa::csa::JournalPath(path, stamp), stamp) || journal.LastSeq() != (uint64_t)saves)
+            ok = false;
+        journal.Close();
+        printf("%10u %10.1f %14.2f %16.3f %16.0f\n", n, file_mb, rewrite_ms, times[times.size() / 2], (double)bytes / saves);
+        saver.Reset();
+        std::filesystem::remove(casa::csa::JournalPath(path, stamp));
+    }
+    std::filesystem::remove(path);
+    printf("every save landed in the journal: %s\n", ok ? "yes" : "NO");
+    return ok ? 0 : 1;
+}
+
+// Building plano's nodes and links from a binary project on 1..N threads.  The graph is thrown
+// away outside the timing, and every thread count must produce the same ids in the same order.
+static int bench_csa_parse(void)
+{
+    const uint32_t sizes[] = { 100000, 500000, 1000000 };
+    const int runs = 3;
+    std::string path = (std::filesystem::temp_directory_path() / "casa_bench_parse.csa").string();
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<unsigned> thread_counts = { 1, 2, 4, 8 };
+    if (std::find(thread_counts.begin(), thread_counts.end(), cores) == thread_counts.end())
+        thread_counts.push_back(cores);
+    bool ok = true;
+
+    printf("csa_parse: ReadGraph() on %u cores, best of %d\n", cores, runs);
+    printf("%10s %8s %12s %14s %10s\n", "nodes", "threads", "ms", "nodes/s", "speedup");
+    for (uint32_t n : sizes) {
+        {
+            std::vector<Properties> props;
+            make_bench_project(props, n);
+            casa::csa::Writer writer;
+            if (!writer.WriteFile(path.c_str(), [&props](casa::csa::Writer& w) { return fill_bench_project(props, w); })) {
+                printf("csa_parse: can't write %s\n", path.c_str());
+                return 1;
+            }
+        }
+        casa::csa::Reader reader;
+        if (!reader.Open(path.c_str())) {
+            printf("csa_parse: can't open %s\n", path.c_str());
+            return 1;
+        }
+
+        double single_ms = 0.0;
+        uint64_t expected = 0;
+        for (unsigned threads : thread_counts) {
+            double best = 1e30;
+            for (int r = 0; r < runs; r++) {
+                auto graph = std::make_unique<casa::bridge::LoadedGraph>();
+                double start = now_ms();
+                ok = casa::bridge::ReadGraph(reader, *graph, threads) && ok;
+                best = std::min(best, now_ms() - start);
+
+                uint64_t h = casa::hash::kFnvOffset;
+                for (size_t i = 0; i < graph->NodeCount(); i++)
+                    h = casa::hash::Value(h, graph->NodeId(i));
+                for (size_t i = 0; i < graph->LinkCount(); i++)
+                    h = casa::hash::Value(h, graph->LinkId(i));
+                if (expected == 0)
+                    expected = h;
+                ok = ok && h == expected && graph->NodeCount() == n && graph->LinkCount() == n - 1;
+            }
+            if (threads == 1)
+                single_ms = best;
+            printf("%10u %8u %12.1f %14.0f %9.2fx\n", n, threads, best, n / (best / 1000.0), single_ms / best);
+        }
+    }
+    std::filesystem::remove(path);
+    printf("same ids in the same order on every thread count: %s\n", ok ? "yes" : "NO");
+    return ok ? 0 : 1;
+}
+
+// Saving and loading a project through the compressed container with 1..N threads, against the
+// plain .csa.  Loading includes the Reader's validation of the decompressed project.
+static int bench_csa_compress(void)
+{
+    const uint32_t n = 500000;
+    const int runs = 3;
+    std::string plain_path = (std::filesystem::temp_directory_path() / "casa_bench_plain.csa").string();
+    std::string packed_path = (std::filesystem::temp_directory_path() / "casa_bench_packed.csa").string();
+    std::vector<Properties> props;
+    make_bench_project(props, n);
+    auto fill = [&props](casa::csa::Writer& w) { return fill_bench_project(props, w); };
+    bool ok = true;
+
+    auto save = [&](const std::string& path, unsigned threads) {
+        casa::csa::Writer writer;
+        casa::io::FileSink file;
+        if (!file.Open(path.c_str()))
+            return false;
+        bool written;
+        if (threads == 0) {
+            written = writer.Write(file, fill);
+        } else {
+            casa::csa::CompressingSink blocks(file, threads);
+            written = writer.Write(blocks, fill) && blocks.Finish();
+        }
+        return file.Close() && written;
+    };
+    auto best_of = [&](const std::function<bool(void)>& fn) {
+        double best = 1e30;
+        for (int r = 0; r < runs; r++) {
+            double start = now_ms();
+            ok = fn() && ok;
+            best = std::min(best, now_ms() - start);
+        }
+        return best;
+    };
+
+    double plain_save = best_of([&]() { return save(plain_path, 0); });
+    double plain_mb = std::filesystem::file_size(plain_path) / (1024.0 * 1024.0);
+    double plain_load = best_of([&]() {
+        casa::csa::Reader reader;
+        return reader.Open(plain_path.c_str()) && reader.NodeCount() == n;
+    });
+    casa::io::MappedFile plain;
+    ok = plain.Open(plain_path.c_str()) && ok;
+
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<unsigned> thread_counts = { 1, 2, 4, 8 };
+    if (std::find(thread_counts.begin(), thread_counts.end(), cores) == thread_counts.end())
+        thread_counts.push_back(cores);
+
+    printf("csa_compress: %u nodes, %u cores, best of %d, saves include the write to disk\n", n, cores, runs);
+    printf("%-22s %8s %10s %10s %12s %12s\n", "", "threads", "file MB", "ratio", "save ms", "load ms");
+    printf("%-22s %8s %10.1f %10.2f %12.1f %12.1f\n", "plain .csa", "-", plain_mb, 1.0, plain_save, plain_load);
+    for (unsigned threads : thread_counts) {
+        double save_ms = best_of([&]() { return save(packed_path, threads); });
+        double packed_mb = std::filesystem::file_size(packed_path) / (1024.0 * 1024.0);
+        double load_ms = best_of([&]() {
+            casa::io::MappedFile file;
+            casa::csa::DecompressedProject project;
+            casa::csa::Reader reader;
+            return file.Open(packed_path.c_str()) && project.Open(file.Data(), file.Size(), nullptr, threads) &&
+                reader.Open(project.Data(), project.Size()) && reader.NodeCount() == n;
+        });
+        printf("%-22s %8u %10.1f %10.2f %12.1f %12.1f\n", "compressed, 1MB blocks", threads, packed_mb, plain_mb / packed_mb, save_ms, load_ms);
+    }
+
+    // The container must give back the plain file byte for byte.
+    casa::io::MappedFile packed;
+    casa::csa::DecompressedProject project;
+    if (!packed.Open(packed_path.c_str()) || !project.Open(packed.Data(), packed.Size()) ||
+        project.Size() != plain.Size() || memcmp(project.Data(), plain.Data(), plain.Size()) != 0)
+        ok = false;
+    packed.Close();
+    plain.Close();
+    std::filesystem::remove(plain_path);
+    std::filesystem::remove(packed_path);
+    printf("decompresses to the plain file: %s\n", ok ? "yes" : "NO");
+    return ok ? 0 : 1;
+}
+
+// Opening a project around its saved view, against building all of it.  "first" is what a
+// progressive load does before the first frame: splitting the project through its spatial
+// index and building the part around the view.  The rest is built afterwards, on the worker.
+static int bench_progressive_load(void)
+{
+    const uint32_t sizes[] = { 100000, 500000, 1000000 };
+    const int runs = 3;
+    std::string path = (std::filesystem::temp_directory_path() / "casa_bench_progressive.csa").string();
+    bool ok = true;
+
+    printf("progressive_load: the part around a 1920x1080 view against the whole project, best of %d\n", runs);
+    printf("%10s %12s %8s %10s %10s %10s %10s\n", "nodes", "first nodes", "stubs", "first ms", "rest ms", "whole ms", "speedup");
+    for (uint32_t n : sizes) {
+        {
+            std::vector<Properties> props;
+            make_bench_project(props, n);
+            casa::csa::Writer writer;
+            auto fill = [&props](casa::csa::Writer& w) {
+                w.SetView(0.0f, 0.0f, 1920.0f, 1080.0f);
+                return fill_bench_project(props, w);
+            };
+            if (!writer.WriteFile(path.c_str(), fill)) {
+                printf("progressive_load: can't write %s\n", path.c_str());
+                return 1;
+            }
+        }
+        casa::csa::Reader reader;
+        if (!reader.Open(path.c_str())) {
+            printf("progressive_load: can't open %s\n", path.c_str());
+            return 1;
+        }
+
+        double first_ms = 1e30, rest_ms = 1e30, whole_ms = 1e30;
+        size_t first_nodes = 0, stubs = 0;
+        for (int r = 0; r < runs; r++) {
+            double start = now_ms();
+            casa::doc::LoadPlan plan;
+            ok = casa::doc::PlanLoad(reader, nullptr, 0.5f, plan) && ok;
+            auto first = std::make_unique<casa::bridge::LoadedGraph>();
+            ok = casa::bridge::ReadGraphPart(reader, nullptr, plan.first, *first) && ok;
+            first_ms = std::min(first_ms, now_ms() - start);
+
+            start = now_ms();
+            auto rest = std::make_unique<casa::bridge::LoadedGraph>();
+            ok = casa::bridge::ReadGraphPart(reader, nullptr, plan.rest, *rest) && ok;
+            rest_ms = std::min(rest_ms, now_ms() - start);
+            ok = ok && first->NodeCount() + rest->NodeCount() == n && first->LinkCount() + rest->LinkCount() == n - 1;
+            first_nodes = first->NodeCount();
+            stubs = plan.stubs.size();
+            first.reset();
+            rest.reset();
+
+            start = now_ms();
+            auto whole = std::make_unique<casa::bridge::LoadedGraph>();
+            ok = casa::bridge::ReadGraph(reader, *whole) && ok;
+            whole_ms = std::min(whole_ms, now_ms() - start);
+        }
+        printf("%10u %12zu %8zu %10.2f %10.1f %10.1f %9.0fx\n", n, first_nodes, stubs, first_ms, rest_ms, whole_ms, whole_ms / first_ms);
+    }
+    std::filesystem::remove(path);
+    printf("the split covers every node and link once: %s\n", ok ? "yes" : "NO");
+    return ok ? 0 : 1;
+}
+
+// A style library: "copies" pastes of a 24 node facade subgraph, each with its own label, and
+// three unique nodes next to each.  Every paste takes the next run of ids, like plano's.
+static bool fill_facade_project(uint32_t copies, casa::csa::Writer& writer)
+{
+    const uint32_t facade = 24;
+    uint64_t id = 1;
+    auto node = [&writer, &id](const char* type, float x, float y) {
+        casa::csa::NodeEntry& entry = add_bench_node(writer, id, type, x, y);
+        entry.size[0] = 140.0f;
+        entry.size[1] = 60.0f;
+        id += 3;
+    };
+    auto link = [&writer, &id](uint64_t from, uint64_t to) {
+        add_bench_link(writer, id, from, to);
+        id++;
+    };
+    Properties p;
+    p.pint["floors"] = 12;
+    p.pfloat["spacing"] = 3.5f;
+    for (uint32_t c = 0; c < copies; c++) {
+        float x = (float)(c % 100) * 4000.0f;
+        float y = (float)(c / 100) * 600.0f;
+        uint64_t first = id;
+        for (uint32_t k = 0; k < facade; k++) {
+            node(k % 4 == 0 ? "facade.Window" : "facade.Wall", x + (float)(k % 8) * 160.0f, y + (float)(k / 8) * 90.0f);
+            p.pstring["label"] = k == 0 ? "facade " + std::to_string(c) : "panel";
+            writer.AddProperties(p);
+        }
+        for (uint32_t k = 1; k < facade; k++)
+            link(first + (k - 1) * 3, first + k * 3);
+        for (uint32_t k = 0; k < facade / 8; k++) { // and a few notes of its own, linked to nothing
+            node("bench.Work", x + (float)k * 200.0f, y - 200.0f);
+            p.pstring["label"] = "note " + std::to_string(c) + "." + std::to_string(k);
+            writer.AddProperties(p);
+        }
+    }
+    writer.SetNextId(id);
+    return true;
+}
+
+static int bench_csa_dedupe(void)
+{
+    const uint32_t copies[] = { 1000, 10000, 37000 };
+    const int runs = 3;
+    std::string path = (std::filesystem::temp_directory_path() / "casa_bench_dedupe.csa").string();
+    bool ok = true;
+
+    printf("csa_dedupe: pasted facade subgraphs stored in full against once, best of %d\n", runs);
+    printf("%10s %7s %9s %9s %9s %9s %9s %9s %9s\n", "nodes", "dedupe", "ratio", "MB", "save ms", "open ms", "build ms",
+        "templates", "instances");
+    for (uint32_t n : copies) {
+        size_t nodes[2] = {};
+        std::vector<std::string> built[2];
+        for (int dedupe = 0; dedupe < 2; dedupe++) {
+            double save_ms = 1e30, open_ms = 1e30, build_ms = 1e30;
+            casa::csa::DedupeStats stats;
+            for (int r = 0; r < runs; r++) {
+                casa::csa::Writer writer;
+                writer.SetDedupe(dedupe != 0);
+                double start = now_ms();
+                if (!writer.WriteFile(path.c_str(), [n](casa::csa::Writer& w) { return fill_facade_project(n, w); })) {
+                    printf("csa_dedupe: can't write %s\n", path.c_str());
+                    return 1;
+                }
+                save_ms = std::min(save_ms, now_ms() - start);
+                stats = writer.Dedupe();
+
+                start = now_ms();
+                casa::csa::Reader reader;
+                ok = reader.Open(path.c_str()) && ok;
+                open_ms = std::min(open_ms, now_ms() - start);
+                start = now_ms();
+                casa::bridge::LoadedGraph graph;
+                ok = casa::bridge::ReadGraph(reader, graph) && ok;
+                build_ms = std::min(build_ms, now_ms() - start);
+                nodes[dedupe] = graph.NodeCount();
+                if (r == 0) {
+                    // What the two files hold must be the same project.
+                    for (size_t i = 0; i < reader.ProjectNodeCount(); i++) {
+                        casa::csa::Reader::NodeRef node = reader.ProjectNode(i);
+                        Properties props;
+                        reader.ReadProperties(node, props);
+                        char line[96];
+                        snprintf(line, sizeof(line), "%llu %g %g ", (unsigned long long)node.id,
+                            node.entry->position[0] + node.offset[0], node.entry->position[1] + node.offset[1]);
+                        built[dedupe].push_back(line + props.pstring["label"]);
+                    }
+                    std::sort(built[dedupe].begin(), built[dedupe].end());
+                }
+            }
+            double mb = (double)std::filesystem::file_size(path) / (1024.0 * 1024.0);
+            printf("%10zu %7s %8.1fx %9.2f %9.1f %9.2f %9.1f %9llu %9llu\n", nodes[dedupe], dedupe ? "yes" : "no", stats.Ratio(), mb,
+                save_ms, open_ms, build_ms, (unsigned long long)stats.templates, (unsigned long long)stats.instances);
+        }
+        ok = ok && nodes[0] == nodes[1] && built[0] == built[1];
+    }
+    std::filesystem::remove(path);
+    printf("both files load the same project: %s\n", ok ? "yes" : "NO");
+    return ok ? 0 : 1;
+}
+
+// Two forks of a 500k node project: ours changes 1% of the values and removes 0.1% of the nodes,
+// theirs changes 1% of the labels and a tenth of ours' values, and both add a thousand nodes
+// under the same ids.
+static int bench_csa_merge(void)
+{
+    const uint32_t n = 500000;
+    const uint32_t added = 1000;
+    const int runs = 3;
+    std::filesystem::path dir = std::filesystem::temp_directory_path();
+    std::string base_path = (dir / "casa_bench_base.csa").string();
+    std::string our_path = (dir / "casa_bench_ours.csa").string();
+    std::string their_path = (dir / "casa_bench_theirs.csa").string();
+    std::string merged_path = (dir / "casa_bench_merged.csa").string();
+
+    std::vector<Properties> base;
+    make_bench_project(base, n);
+    std::vector<Properties> ours = base, theirs = base;
+    for (uint32_t i = 0; i < n; i += 100)
+        ours[i].pfloat["value"] = -(float)i;
+    for (uint32_t i = 50; i < n; i += 100)
+        theirs[i].pstring["label"] = "theirs " + std::to_string(i);
+    for (uint32_t i = 0; i < n; i += 1000)
+        theirs[i].pfloat["value"] = (float)i + 0.5f;
+    BenchFork our_fork, their_fork;
+    our_fork.remove_every = 1000;
+    our_fork.remove_at = 500;
+    our_fork.added = added;
+    our_fork.added_value = 1.0f;
+    their_fork.added = added;
+    their_fork.added_value = 2.0f;
+    casa::csa::Writer writer;
+    if (!writer.WriteFile(base_path.c_str(), [&](casa::csa::Writer& w) { return fill_bench_project(base, w); }) ||
+        !writer.WriteFile(our_path.c_str(), [&](casa::csa::Writer& w) { return fill_bench_project(ours, w, our_fork); }) ||
+        !writer.WriteFile(their_path.c_str(), [&](casa::csa::Writer& w) { return fill_bench_project(theirs, w, their_fork); })) {
+        printf("csa_merge: can't write the projects\n");
+        return 1;
+    }
+
+    printf("csa_merge: %u node project, two forks with 1%% of it edited and %u nodes added each, best of %d\n", n, added, runs);
+    double open_ms = 1e30, diff_ms = 1e30, merge_ms = 1e30;
+    casa::csa::ProjectDiff diff;
+    casa::csa::MergeResult result;
+    bool ok = true;
+    for (int r = 0; r < runs; r++) {
+        double start = now_ms();
+        casa::csa::ProjectSnapshot b, o, t;
+        ok = b.Open(base_path.c_str()) && o.Open(our_path.c_str()) && t.Open(their_path.c_str()) && ok;
+        open_ms = std::min(open_ms, now_ms() - start);
+        start = now_ms();
+        casa::csa::DiffProjects(b, o, diff);
+        diff_ms = std::min(diff_ms, now_ms() - start);
+        start = now_ms();
+        ok = casa::csa::MergeProjects(b, o, t, casa::csa::MergeOptions(), merged_path.c_str(), result) && ok;
+        merge_ms = std::min(merge_ms, now_ms() - start);
+    }
+    printf("%-36s %10.1f ms\n", "open base, ours and theirs", open_ms);
+    printf("%-36s %10.1f ms  %zu nodes and %zu links changed\n", "diff base against ours", diff_ms, diff.nodes.size(), diff.links.size());
+    printf("%-36s %10.1f ms  %zu nodes, %zu links, %zu conflicts\n", "merge and write", merge_ms, result.nodes, result.links,
+        result.conflicts.size());
+
+    // Ours' edits and removals, theirs' labels, both sides' additions, and a conflict for every
+    // value both changed.
+    size_t removed = n / 1000;
+    size_t property_conflicts = 0;
+    for (const auto& c : result.conflicts)
+        property_conflicts += c.kind == casa::csa::MergeConflict::Kind::Property ? 1 : 0;
+    ok = ok && diff.nodes.size() == n / 100 + added;
+    ok = ok && result.nodes == n - removed + 2 * added && property_conflicts == n / 1000 && result.conflicts.size() == n / 1000;
+    casa::csa::ProjectSnapshot merged;
+    ok = ok && merged.Open(merged_path.c_str());
+    if (ok) {
+        Properties p;
+        merged.ReadProperties(merged.Node(150), p);
+        ok = p.pstring["label"] == "theirs 150" && p.pfloat["value"] == 150.0f;
+        p = Properties();
+        merged.ReadProperties(merged.Node(100), p);
+        ok = ok && p.pfloat["value"] == -100.0f && p.pstring["label"] == "node 100";
+    }
+    for (const std::string& path : { base_path, our_path, their_path, merged_path })
+        std::filesystem::remove(path);
+    printf("merged project has both sides' edits: %s\n", ok ? "yes" : "NO");
+    return ok ? 0 : 1;
+}
+
+// Runs "work" in a child process and waits for it, so the memory it takes is gone afterwards.
+// Runs it in this process where there is no fork().
+static bool in_child(const std::function<bool(void)>& work)
+{
+#if !defined(_WIN32)
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0) {
+        bool ok = work();
+        fflush(stdout);
+        _exit(ok ? 0 : 1);
+    }
+    if (child > 0) {
+        int status = 0;
+        waitpid(child, &status, 0);
+        return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+#endif
+    return work();
+}
+
+// The runs of one way of saving or loading a project.
+struct IoRuns {
+    std::vector<double> ms;
+    double peak_mb = -1.0;
+    bool ok = true;
+
+    void Add(const SaveMeasure& m)
+    {
+        ms.push_back(m.ms);
+        peak_mb = std::max(peak_mb, m.peak_mb);
+        ok = ok && m.ok;
+    }
+    // Nearest rank, so with fewer than 100 runs p99 is the slowest.
+    double Percentile(double p) const
+    {
+        std::vector<double> sorted = ms;
+        std::sort(sorted.begin(), sorted.end());
+        size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+        return sorted[std::max<size_t>(rank, 1) - 1];
+    }
+};
+
+static void print_io(size_t nodes, size_t links, const char* operation, size_t bytes, const IoRuns& runs)
+{
+    double mb = bytes / (1024.0 * 1024.0);
+    double p50 = runs.Percentile(50.0);
+    printf("%9zu %9zu  %-28s %5zu %9.2f %9.1f %9.2f %9.2f ", nodes, links, operation, runs.ms.size(), mb,
+        p50 > 0.0 ? mb / (p50 / 1000.0) : 0.0, p50, runs.Percentile(99.0));
+    if (runs.peak_mb < 0.0)
+        printf("%9s%s\n", "n/a", runs.ok ? "" : "  FAILED");
+    else
+        printf("%9.1f%s\n", runs.peak_mb, runs.ok ? "" : "  FAILED");
+}
+
+// The project file entry points the app itself uses, on seeded projects of every registered node
+// type (see graph_generator.h).  Projects are built in a child process, which saves them, so that
+// the loads start from an empty process; every run is a process of its own for its peak RSS.
+static int bench_project_io(void)
+{
+    const size_t sizes[] = { 1000, 10000, 100000, 1000000 };
+    const uint64_t seed = 1;
+    std::string binary_path = (std::filesystem::temp_directory_path() / "casa_bench_io.csa").string();
+    std::string text_path = (std::filesystem::temp_directory_path() / "casa_bench_io.txt").string();
+    bool ok = true;
+
+    // plano needs ImGui's context, but nothing here draws.
+    ImGuiContext* imgui = ImGui::CreateContext();
+    ImGui::GetIO().DisplaySize = ImVec2(1920.0f, 1080.0f);
+    plano::types::ContextData* context = nullptr;
+    auto fresh_context = [&context]() {
+        if (context != nullptr)
+            plano::api::DestroyContext(context);
+        context = plano::api::CreateContext(plano::types::ContextCallbacks(), "../plano/data/");
+        plano::api::SetContext(context);
+        RegiserNodesToActiveContext();
+        return context != nullptr;
+    };
+    if (!fresh_context()) {
+        printf("project_io: can't create a plano context\n");
+        ImGui::DestroyContext(imgui);
+        return 1;
+    }
+
+    printf("project_io: seeded projects (seed %llu) of every registered node type, one process per run\n", (unsigned long long)seed);
+    printf("MB/s at p50, p99 by nearest rank (the slowest run below 100 runs), peak RSS above the process at the start of the run\n");
+    printf("%9s %9s  %-28s %5s %9s %9s %9s %9s %9s\n", "nodes", "links", "operation", "runs", "MB", "MB/s", "p50 ms",
+        "p99 ms", "peak +MB");
+    for (size_t n : sizes) {
+        int runs = n <= 1000 ? 100 : n <= 10000 ? 30 : n <= 100000 ? 5 : 3;
+
+        // Saving needs the project in memory, which this process shouldn't keep for the loads.
+        bool saved = in_child([&]() {
+            casa::gen::GraphOptions options;
+            options.seed = seed;
+            options.nodes = n;
+            casa::bridge::GraphView view;
+            if (!casa::gen::GenerateIntoActiveContext(options) || !casa::bridge::CaptureActiveContext(view))
+                return false;
+            size_t links = view.links.size();
+            view = GraphView();
+
+            IoRuns file;
+            for (int r = 0; r < runs; r++)
+                file.Add(measure_save([&]() { return save_project_file(binary_path.c_str()) == 0; }));
+            print_io(n, links, "save_project_file", (size_t)std::filesystem::file_size(binary_path), file);
+
+            // The buffer is plano's.
+            IoRuns buffer;
+            for (int r = 0; r < runs; r++)
+                buffer.Add(measure_save([]() {
+                    size_t size = 0;
+                    return plano::api::SaveNodesAndLinksToBuffer(&size) != nullptr;
+                }));
+            size_t size = 0;
+            const char* text = plano::api::SaveNodesAndLinksToBuffer(&size);
+            std::ofstream out(text_path, std::ios::binary);
+            out.write(text ? text : "", (std::streamsize)(text ? size : 0));
+            out.close();
+            print_io(n, links, "SaveNodesAndLinksToBuffer", size, buffer);
+            return file.ok && buffer.ok && text != nullptr && (bool)out;
+        });
+        if (!saved) {
+            printf("project_io: can't generate and save %zu nodes\n", n);
+            ok = false;
+            continue;
+        }
+
+        size_t links = 0;
+        {
+            casa::csa::Reader reader;
+            if (reader.Open(binary_path.c_str()))
+                links = reader.ProjectLinkCount();
+        }
+        // Both files must read back as the whole project.
+        auto loads_whole = [&](const std::function<void(void)>& load) {
+            return in_child([&]() {
+                casa::bridge::GraphView view;
+                load();
+                return casa::bridge::CaptureActiveContext(view) && view.nodes.size() == n && view.links.size() == links;
+            });
+        };
+
+        IoRuns file;
+        for (int r = 0; r < runs; r++)
+            file.Add(measure_save([&]() { return load_project_file(binary_path.c_str()); }, fresh_context));
+        file.ok = file.ok && loads_whole([&]() { load_project_file(binary_path.c_str()); });
+        print_io(n, links, "load_project_file", (size_t)std::filesystem::file_size(binary_path), file);
+
+        // plano's parser wants a terminated string, read outside the clock.
+        std::string text;
+        auto read_text = [&]() {
+            std::ifstream in(text_path, std::ios::binary);
+            std::stringstream buffer;
+            buffer << in.rdbuf();
+            text = buffer.str();
+            return fresh_context();
+        };
+        IoRuns buffer;
+        for (int r = 0; r < runs; r++)
+            buffer.Add(measure_save([&]() { plano::api::LoadNodesAndLinksFromBuffer(text.size(), text.c_str()); return true; }, read_text));
+        buffer.ok = buffer.ok && loads_whole([&]() {
+            read_text();
+            plano::api::LoadNodesAndLinksFromBuffer(text.size(), text.c_str());
+        });
+        print_io(n, links, "LoadNodesAndLinksFromBuffer", (size_t)std::filesystem::file_size(text_path), buffer);
+        text = std::string();
+        ok = ok && file.ok && buffer.ok;
+    }
+    plano::api::DestroyContext(context);
+    ImGui::DestroyContext(imgui);
+    std::filesystem::remove(binary_path);
+    std::filesystem::remove(text_path);
+    printf("every save succeeded and read back whole: %s\n", ok ? "yes" : "NO");
+    return ok ? 0 : 1;
+}
+
+struct BenchmarkEntry {
+    const char* name;
+    int (*run)(void);
+    const char* description;
+};
+
+static const BenchmarkEntry benchmark_table[] = {
+    { "eval_scaling", bench_eval_scaling, "parallel graph evaluation with 1..32 workers" },
+    { "flow_vm", bench_flow_vm, "Flow bytecode dispatch loop, instructions per second" },
+    { "value_store", bench_value_store, "struct-of-arrays pin values against a hash map, 100k pins" },
+    { "batch_sweep", bench_batch_sweep, "256 property variants in SIMD lanes against 256 separate runs" },
+    { "frame_allocs", bench_frame_allocs, "heap allocations per frame for UI temporaries, heap against the frame arena" },
+    { "doc_snapshot", bench_doc_snapshot, "persistent document snapshots and edits from 1k to 1M nodes, against copying a flat map" },
+    { "csa_load", bench_csa_load, "opening a 500k node binary project through mmap, against reading it into a string" },
+    { "csa_save", bench_csa_save, "peak RSS and time of streaming a project into sinks, against building it in memory first" },
+    { "csa_parse", bench_csa_parse, "building plano's nodes from 100k to 1M node binary projects on 1..N threads" },
+    { "csa_compress", bench_csa_compress, "saving and loading through the compressed container on 1..N threads, against the plain format" },
+    { "journal_save", bench_journal_save, "saving one edit by appending to the journal, against rewriting the whole project" },
+    { "progressive_load", bench_progressive_load, "building the part of a 100k to 1M node project around its saved view, against all of it" },
+    { "csa_dedupe", bench_csa_dedupe, "file size and load time of 27k to 1M nodes of pasted subgraphs, stored in full against once" },
+    { "csa_merge", bench_csa_merge, "diff and three-way merge of two forks of a 500k node project" },
+    { "project_io", bench_project_io, "MB/s, p50/p99 and peak RSS of the project save and load entry points on seeded 1k to 1M node projects" },
+};
+
+int run_benchmark(const char* name)
+{
+    bool list = strcmp(name, "list") == 0;
+    for (const auto& entry : benchmark_table) {
+        if (list)
+            printf("%-20s %s\n", entry.name, entry.description);
+        else if (strcmp(name, entry.name) == 0)
+            return entry.run();
+    }
+    if (list)
+        return 0;
+    printf("unknown benchmark \"%s\", try: casa --benchmark list\n", name);
+    return 1;
+}
@@ -1,20 +1,62 @@
 #include "node_defs/blueprint_demo.h"
 #include "node_defs/import_animal.h"
+#include "node_defs/math_nodes.h"
 #include "node_defs/widget_demo.h"
 #include "node_defs/casa_nodes.h"
+#include "graph_eval.h"
+#include "batch_eval.h"
 
+// Registers the node with plano, and its (optional) Evaluate callbacks with the casa evaluator and the batch engine.
+static void RegisterNode(const plano::api::NodeDescription& node, casa::eval::EvaluateFn evaluate = nullptr,
+    casa::eval::BatchEvaluateFn batch = nullptr)
+{
+    if (evaluate != nullptr)
+        casa::eval::RegisterEvaluator(node.Type, evaluate);
+    if (batch != nullptr)
+        casa::eval::RegisterBatchEvaluator(node.Type, batch);
+    plano::api::RegisterNewNode(node);
+}
+
+struct RegisteredType {
+    plano::api::NodeDescription description;
+    casa::eval::EvaluateFn evaluate = nullptr;
+    casa::eval::BatchEvaluateFn batch = nullptr;
+};
+
+static std::vector<RegisteredType> RegisteredTypes(void)
+{
+    return {
+        { node_defs::blueprint_demo::InputActionFire::ConstructDefinition() },
+        { node_defs::blueprint_demo::OutputAction::ConstructDefinition(), node_defs::blueprint_demo::OutputAction::EvaluateIO },
+        { node_defs::blueprint_demo::Branch::ConstructDefinition() },
+        { node_defs::blueprint_demo::DoN::ConstructDefinition() },
+        { node_defs::blueprint_demo::SetTimer::ConstructDefinition() },
+        { node_defs::blueprint_demo::SingleLineTraceByChannel::ConstructDefinition() },
+        { node_defs::blueprint_demo::PrintString::ConstructDefinition() },
+        { node_defs::import_animal::Definition::ConstructDefinition(), node_defs::import_animal::Definition::EvaluateIO },
+        { node_defs::widget_demo::BasicWidgets::Definition::ConstructDefinition(), node_defs::widget_demo::BasicWidgets::Definition::EvaluateIO },
+        { node_defs::widget_demo::TreeDemo::ConstructDefinition() },
+        { node_defs::widget_demo::PlotDemo::ConstructDefinition() },
+        { node_defs::math_nodes::Constant::Definition::ConstructDefinition(), node_defs::math_nodes::Constant::Definition::EvaluateIO,
+          node_defs::math_nodes::Constant::Definition::EvaluateBatch },
+        { node_defs::math_nodes::ScaleOffset::Definition::ConstructDefinition(), node_defs::math_nodes::ScaleOffset::Definition::EvaluateIO,
+          node_defs::math_nodes::ScaleOffset::Definition::EvaluateBatch },
+        { node_defs::math_nodes::Add::Definition::ConstructDefinition(), node_defs::math_nodes::Add::Definition::EvaluateIO,
+          node_defs::math_nodes::Add::Definition::EvaluateBatch },
+        { node_defs::math_nodes::Multiply::Definition::ConstructDefinition(), node_defs::math_nodes::Multiply::Definition::EvaluateIO,
+          node_defs::math_nodes::Multiply::Definition::EvaluateBatch },
+    };
+}
 
 void RegiserNodesToActiveContext(void) {
 // Register node types to the context that is "active"
-plano::api::RegisterNewNode(node_defs::blueprint_demo::InputActionFire::ConstructDefinition());
-plano::api::RegisterNewNode(node_defs::blueprint_demo::OutputAction::ConstructDefinition());
-plano::api::RegisterNewNode(node_defs::blueprint_demo::Branch::ConstructDefinition());
-plano::api::RegisterNewNode(node_defs::blueprint_demo::DoN::ConstructDefinition());
-plano::api::RegisterNewNode(node_defs::blueprint_demo::SetTimer::ConstructDefinition());
-plano::api::RegisterNewNode(node_defs::blueprint_demo::SingleLineTraceByChannel::ConstructDefinition());
-plano::api::RegisterNewNode(node_defs::blueprint_demo::PrintString::ConstructDefinition());
-plano::api::RegisterNewNode(node_defs::import_animal::ConstructDefinition());
-plano::api::RegisterNewNode(node_defs::widget_demo::BasicWidgets::ConstructDefinition());
-plano::api::RegisterNewNode(node_defs::widget_demo::TreeDemo::ConstructDefinition());
-plano::api::RegisterNewNode(node_defs::widget_demo::PlotDemo::ConstructDefinition());
+for (const RegisteredType& type : RegisteredTypes())
+    RegisterNode(type.description, type.evaluate, type.batch);
+}
+
+std::vector<plano::api::NodeDescription> RegisteredNodeDescriptions(void) {
+std::vector<plano::api::NodeDescription> out;
+for (RegisteredType& type : RegisteredTypes())
+    out.push_back(std::move(type.description));
+return out;
 }
@@ -0,0 +1,277 @@
+#include "csa_compress.h"
+#include "casa_hash.h"
+#include "lz_block.h"
+#include "work_stealing_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <new>
+#include <thread>
+
+namespace casa {
+namespace csa {
+
+static unsigned thread_count(unsigned threads)
+{
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    return std::max(1u, threads);
+}
+
+static uint64_t align8(uint64_t n)
+{
+    return (n + 7) & ~(uint64_t)7;
+}
+
+bool IsCompressedProject(const char* data, size_t size)
+{
+    return size >= sizeof(kCompressedMagic) && memcmp(data, kCompressedMagic, sizeof(kCompressedMagic)) == 0;
+}
+
+// CompressingSink
+CompressingSink::CompressingSink(io::Sink& next, unsigned threads, uint32_t block_size)
+    : m_Next(next), m_BlockSize(std::max(block_size, 4096u))
+{
+    unsigned workers = thread_count(threads);
+    m_Pool = std::make_unique<WorkStealingPool>(workers);
+    m_Batch.resize(workers);
+}
+
+CompressingSink::~CompressingSink(void)
+{
+}
+
+bool CompressingSink::Write(const void* data, size_t size)
+{
+    if (m_Failed || m_Finished)
+        return false;
+    if (!m_Started) {
+        m_Started = true;
+        CompressedHeader header = {};
+        memcpy(header.magic, kCompressedMagic, sizeof(kCompressedMagic));
+        header.version = kCompressedVersion;
+        header.block_size = m_BlockSize;
+        header.codec = (uint32_t)Codec::LZ;
+        if (!m_Next.Write(&header, sizeof(header)))
+            m_Failed = true;
+        m_Offset = sizeof(header);
+    }
+    const char* from = (const char*)data;
+    while (size > 0 && !m_Failed) {
+        Block& block = m_Batch[m_Filled];
+        if (block.raw.size() != m_BlockSize)
+            block.raw.resize(m_BlockSize);
+        size_t n = std::min(size, (size_t)m_BlockSize - block.used);
+        memcpy(block.raw.data() + block.used, from, n);
+        block.used += n;
+        m_RawSize += n;
+        from += n;
+        size -= n;
+        if (block.used == m_BlockSize && ++m_Filled == m_Batch.size())
+            CompressBatch();
+    }
+    return !m_Failed;
+}
+
+void CompressingSink::CompressTask(void* user, uint32_t item, unsigned)
+{
+    Block& block = ((CompressingSink*)user)->m_Batch[item];
+    block.checksum = casa::hash::Words(casa::hash::kFnvOffset, block.raw.data(), block.used);
+    block.stored.resize(casa::lz::CompressBound(block.used));
+    size_t stored = casa::lz::Compress(block.raw.data(), block.used, block.stored.data(), block.stored.size());
+    // A block that doesn't shrink is kept as it is, stored_size == raw_size says so.
+    block.stored_size = stored == 0 || stored >= block.used ? block.used : stored;
+}
+
+// Compresses the full blocks of the batch on the pool, then passes them on in order.
+bool CompressingSink::CompressBatch(void)
+{
+    size_t count = m_Filled;
+    std::vector<uint32_t> items(count);
+    for (uint32_t i = 0; i < (uint32_t)count; i++)
+        items[i] = i;
+    m_Pool->Run(items.data(), count, &CompressingSink::CompressTask, this);
+
+    for (size_t i = 0; i < count && !m_Failed; i++) {
+        Block& block = m_Batch[i];
+        BlockEntry entry = {};
+        entry.offset = m_Offset;
+        entry.stored_size = (uint32_t)block.stored_size;
+        entry.raw_size = (uint32_t)block.used;
+        entry.checksum = block.checksum;
+        const char* bytes = block.stored_size == block.used ? block.raw.data() : block.stored.data();
+        if (!m_Next.Write(bytes, block.stored_size))
+            m_Failed = true;
+        m_Offset += block.stored_size;
+        m_Table.push_back(entry);
+        block.used = 0;
+    }
+    m_Filled = 0;
+    return !m_Failed;
+}
+
+bool CompressingSink::Finish(void)
+{
+    if (m_Finished)
+        return !m_Failed;
+    if (!m_Started)
+        Write(nullptr, 0);
+    m_Finished = true;
+    if (m_Failed)
+        return false;
+    if (m_Batch[m_Filled].used > 0)
+        m_Filled++;
+    if (!CompressBatch())
+        return false;
+
+    static const char zeros[8] = {};
+    uint64_t padding = align8(m_Offset) - m_Offset;
+    CompressedTrailer trailer = {};
+    trailer.raw_size = m_RawSize;
+    trailer.table_offset = m_Offset + padding;
+    trailer.block_count = (uint32_t)m_Table.size();
+    memcpy(trailer.magic, kCompressedMagic, sizeof(kCompressedMagic));
+    bool ok = m_Next.Write(zeros, (size_t)padding) &&
+        m_Next.Write(m_Table.data(), m_Table.size() * sizeof(BlockEntry)) &&
+        m_Next.Write(&trailer, sizeof(trailer)) && m_Next.Flush();
+    m_Offset += padding + m_Table.size() * sizeof(BlockEntry) + sizeof(trailer);
+    m_Failed = !ok;
+    return ok;
+}
+
+// Container checks shared by DecompressedProject and ReadProjectHeader.
+static bool read_container(const char* data, size_t size, CompressedHeader& header, CompressedTrailer& trailer,
+    std::vector<BlockEntry>& table, const char*& why)
+{
+    why = "not a compressed casa project";
+    if (size < sizeof(CompressedHeader) + sizeof(CompressedTrailer) || !IsCompressedProject(data, size))
+        return false;
+    memcpy(&header, data, sizeof(header));
+    memcpy(&trailer, data + size - sizeof(trailer), sizeof(trailer));
+    why = "the project was saved by a newer casa";
+    if (header.version > kCompressedVersion || header.codec != (uint32_t)Codec::LZ)
+        return false;
+    why = "the compressed project is truncated or damaged";
+    uint64_t table_end = size - sizeof(trailer);
+    if (memcmp(trailer.magic, kCompressedMagic, sizeof(kCompressedMagic)) != 0 ||
+        trailer.table_offset < sizeof(header) || trailer.table_offset > table_end ||
+        trailer.block_count != (table_end - trailer.table_offset) / sizeof(BlockEntry))
+        return false;
+    table.resize(trailer.block_count);
+    memcpy(table.data(), data + trailer.table_offset, table.size() * sizeof(BlockEntry));
+
+    uint64_t raw = 0;
+    for (const BlockEntry& e : table) {
+        if (e.offset < sizeof(header) || e.offset > trailer.table_offset || e.stored_size > trailer.table_offset - e.offset ||
+            e.raw_size > header.block_size || e.stored_size > e.raw_size ||
+            (uint64_t)e.stored_size * 255 + 64 < e.raw_size) // more than the codec can expand to
+            return false;
+        raw += e.raw_size;
+    }
+    return raw == trailer.raw_size;
+}
+
+static bool decompress_block(const char* data, const BlockEntry& entry, char* out)
+{
+    const char* stored = data + entry.offset;
+    if (entry.stored_size == entry.raw_size)
+        memcpy(out, stored, entry.raw_size);
+    else if (!casa::lz::Decompress(stored, entry.stored_size, out, entry.raw_size))
+        return false;
+    return casa::hash::Words(casa::hash::kFnvOffset, out, entry.raw_size) == entry.checksum;
+}
+
+// DecompressedProject
+namespace {
+struct DecompressJob {
+    const char* data;
+    const std::vector<BlockEntry>* table;
+    const std::vector<uint64_t>* raw_offsets;
+    char* out;
+    std::atomic<bool> failed{ false };
+};
+} // end anonymous namespace
+
+bool DecompressedProject::Open(const char* data, size_t size, std::string* error, unsigned threads)
+{
+    Close();
+    auto fail = [this, error](const char* why) {
+        if (error)
+            *error = why;
+        Close();
+        return false;
+    };
+    CompressedHeader header;
+    CompressedTrailer trailer;
+    std::vector<BlockEntry> table;
+    const char* why = nullptr;
+    if (!read_container(data, size, header, trailer, table, why))
+        return fail(why);
+
+    m_Words.reset(new (std::nothrow) uint64_t[align8(trailer.raw_size) / 8 + 1]);
+    if (!m_Words)
+        return fail("not enough memory to decompress the project");
+    m_Size = (size_t)trailer.raw_size;
+
+    std::vector<uint64_t> raw_offsets(table.size());
+    std::vector<uint32_t> items(table.size());
+    uint64_t at = 0;
+    for (size_t b = 0; b < table.size(); b++) {
+        raw_offsets[b] = at;
+        at += table[b].raw_size;
+        items[b] = (uint32_t)b;
+    }
+
+    DecompressJob job;
+    job.data = data;
+    job.table = &table;
+    job.raw_offsets = &raw_offsets;
+    job.out = (char*)m_Words.get();
+    WorkStealingPool pool(std::min(thread_count(threads), (unsigned)std::max<size_t>(table.size(), 1)));
+    pool.Run(items.data(), items.size(), [](void* user, uint32_t item, unsigned) {
+        DecompressJob& j = *(DecompressJob*)user;
+        if (!decompress_block(j.data, (*j.table)[item], j.out + (*j.raw_offsets)[item]))
+            j.failed = true;
+    }, &job);
+    if (job.failed)
+        return fail("the compressed project is damaged");
+    return true;
+}
+
+void DecompressedProject::Close(void)
+{
+    m_Words.reset();
+    m_Size = 0;
+}
+
+// Headers
+bool ReadProjectHeader(const char* data, size_t size, FileHeader& out)
+{
+    std::vector<char> first;
+    if (IsCompressedProject(data, size)) {
+        // The header is at the start of the first block.
+        CompressedHeader header;
+        CompressedTrailer trailer;
+        std::vector<BlockEntry> table;
+        const char* why = nullptr;
+        if (!read_container(data, size, header, trailer, table, why) || table.empty())
+            return false;
+        first.resize(table[0].raw_size);
+        if (!decompress_block(data, table[0], first.data()))
+            return false;
+        data = first.data();
+        size = first.size();
+    }
+    if (size < kHeaderSizeV1 || !IsBinaryProject(data, size))
+        return false;
+    uint32_t header_size;
+    memcpy(&header_size, data + offsetof(FileHeader, header_size), sizeof(header_size));
+    if (header_size < kHeaderSizeV1 || header_size > size)
+        return false;
+    out = FileHeader();
+    memcpy(&out, data, std::min<size_t>(header_size, sizeof(FileHeader)));
+    return true;
+}
+
+} // end namespace csa
+} // end namespace casa
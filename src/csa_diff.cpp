@@ -0,0 +1,791 @@
+#include "csa_diff.h"
+#include "casa_hash.h"
+#include "output_sink.h"
+#include "work_stealing_pool.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+
+namespace casa {
+namespace csa {
+
+// ProjectSnapshot
+bool ProjectSnapshot::Open(const char* path, std::string* error)
+{
+    m_Nodes.clear();
+    m_Links.clear();
+    m_Journal.Close();
+    m_Reader.Close();
+    m_Decompressed.Close();
+    m_File.Close();
+    m_NextId = 1;
+    m_ShiftFrom = UINT64_MAX;
+    m_ShiftBy = 0;
+
+    if (!m_File.Open(path)) {
+        if (error)
+            *error = "can't open the file";
+        return false;
+    }
+    const char* data = m_File.Data();
+    size_t size = m_File.Size();
+    if (IsCompressedProject(data, size)) {
+        if (!m_Decompressed.Open(data, size, error))
+            return false;
+        data = m_Decompressed.Data();
+        size = m_Decompressed.Size();
+        m_File.Close();
+    }
+    if (!IsBinaryProject(data, size)) {
+        if (error)
+            *error = "not a binary casa project, open and save it in casa first";
+        return false;
+    }
+    if (!m_Reader.Open(data, size, error))
+        return false;
+    uint64_t stamp = m_Reader.Header().journal_stamp;
+    bool journal = stamp != 0 && m_Journal.Open(JournalPath(path, stamp), stamp);
+
+    // The last record for an id is what replaying the journal leaves of it.  The file's nodes
+    // keep their place, whatever the journal added comes after them in the order it was added.
+    std::unordered_map<uint64_t, uint32_t> last_node, last_link;
+    if (journal) {
+        for (uint32_t r = 0; r < (uint32_t)m_Journal.RecordCount(); r++) {
+            const JournalRecord& record = m_Journal.Record(r);
+            bool node = record.kind == RecordKind::SetNode || record.kind == RecordKind::EraseNode;
+            (node ? last_node : last_link)[record.id] = r;
+        }
+    }
+    auto from_record = [this](const JournalRecord& record) {
+        NodeRef node;
+        node.entry = record.node;
+        node.pins = record.pins;
+        node.properties = record.properties;
+        node.id = record.id;
+        node.record = &record;
+        return node;
+    };
+
+    m_Nodes.reserve(m_Reader.ProjectNodeCount() + last_node.size());
+    for (size_t i = 0; i < m_Reader.ProjectNodeCount(); i++) {
+        Reader::NodeRef ref = m_Reader.ProjectNode(i);
+        auto it = last_node.find(ref.id);
+        if (it != last_node.end()) {
+            const JournalRecord& record = m_Journal.Record(it->second);
+            if (record.kind == RecordKind::SetNode)
+                m_Nodes.push_back(from_record(record));
+            last_node.erase(it);
+            continue;
+        }
+        NodeRef node;
+        node.entry = ref.entry;
+        node.pins = m_Reader.Pins(*ref.entry);
+        node.properties = m_Reader.Properties(*ref.entry);
+        node.id = ref.id;
+        node.id_shift = ref.id_shift;
+        node.offset[0] = ref.offset[0];
+        node.offset[1] = ref.offset[1];
+        if (ref.instance != nullptr) {
+            node.overrides = m_Reader.Overrides(*ref.instance);
+            node.override_count = ref.instance->override_count;
+            node.local = ref.local;
+        }
+        m_Nodes.push_back(node);
+    }
+    m_Links.reserve(m_Reader.ProjectLinkCount() + last_link.size());
+    for (size_t i = 0; i < m_Reader.ProjectLinkCount(); i++) {
+        LinkEntry link = m_Reader.ProjectLink(i);
+        auto it = last_link.find(link.id);
+        if (it != last_link.end()) {
+            const JournalRecord& record = m_Journal.Record(it->second);
+            if (record.kind == RecordKind::SetLink)
+                m_Links.push_back(*record.link);
+            last_link.erase(it);
+            continue;
+        }
+        m_Links.push_back(link);
+    }
+    for (uint32_t r = 0; r < (uint32_t)m_Journal.RecordCount(); r++) {
+        const JournalRecord& record = m_Journal.Record(r);
+        if (record.kind == RecordKind::SetNode) {
+            auto it = last_node.find(record.id);
+            if (it != last_node.end() && it->second == r)
+                m_Nodes.push_back(from_record(record));
+        } else if (record.kind == RecordKind::SetLink) {
+            auto it = last_link.find(record.id);
+            if (it != last_link.end() && it->second == r)
+                m_Links.push_back(*record.link);
+        }
+    }
+
+    // Files written by other tools may not keep next_id above every id, and the merge counts on it.
+    m_NextId = std::max<uint64_t>(m_Reader.Header().next_id, 1);
+    if (journal)
+        m_NextId = std::max(m_NextId, m_Journal.NextId());
+    for (const NodeRef& node : m_Nodes) {
+        m_NextId = std::max(m_NextId, node.id + 1);
+        for (uint32_t p = 0; p < node.entry->input_count + node.entry->output_count; p++)
+            m_NextId = std::max(m_NextId, node.pins[p].id + node.id_shift + 1);
+    }
+    for (const LinkEntry& link : m_Links)
+        m_NextId = std::max(m_NextId, link.id + 1);
+    return true;
+}
+
+std::string_view ProjectSnapshot::String(const NodeRef& node, StrRef s) const
+{
+    return node.record != nullptr ? m_Journal.String(*node.record, s) : m_Reader.String(s);
+}
+
+uint64_t ProjectSnapshot::PinId(const NodeRef& node, uint32_t pin) const
+{
+    return Shifted(node.pins[pin].id + node.id_shift);
+}
+
+void ProjectSnapshot::ReadProperties(const NodeRef& node, ::Properties& out) const
+{
+    ForEachProperty(node, [&out](std::string_view key, const PropertyEntry& e, std::string_view text) {
+        std::string k(key);
+        switch ((PropertyKind)e.kind) {
+        case PropertyKind::Bool: out.pbool[std::move(k)] = e.value.b != 0; break;
+        case PropertyKind::Int: out.pint[std::move(k)] = e.value.i; break;
+        case PropertyKind::Float: out.pfloat[std::move(k)] = e.value.f; break;
+        case PropertyKind::String: out.pstring[std::move(k)] = std::string(text); break;
+        default: break; // a kind from a later version
+        }
+    });
+}
+
+void ProjectSnapshot::ShiftIds(uint64_t from, uint64_t by)
+{
+    m_ShiftFrom = from;
+    m_ShiftBy = by;
+    for (NodeRef& node : m_Nodes)
+        node.id = Shifted(node.id);
+    for (LinkEntry& link : m_Links) {
+        link.id = Shifted(link.id);
+        link.start_pin = Shifted(link.start_pin);
+        link.end_pin = Shifted(link.end_pin);
+    }
+    m_NextId = Shifted(m_NextId);
+}
+
+// Hashing
+struct NodeHash {
+    uint64_t part[kNodeParts];
+
+    uint32_t Differs(const NodeHash& other) const
+    {
+        uint32_t parts = 0;
+        for (uint32_t k = 0; k < kNodeParts; k++) {
+            if (part[k] != other.part[k])
+                parts |= 1u << k;
+        }
+        return parts;
+    }
+};
+
+static uint64_t hash_text(uint64_t h, std::string_view s)
+{
+    h = casa::hash::Value(h, (uint64_t)s.size());
+    return casa::hash::Bytes(h, s.data(), s.size());
+}
+
+static void hash_node(const ProjectSnapshot& p, const ProjectSnapshot::NodeRef& node, NodeHash& out)
+{
+    const NodeEntry& e = *node.entry;
+    uint64_t h = hash_text(casa::hash::kFnvOffset, p.String(node, e.type));
+    h = casa::hash::Value(h, e.node_type);
+    h = casa::hash::Value(h, e.input_count);
+    h = casa::hash::Value(h, e.output_count);
+    for (uint32_t i = 0; i < e.input_count + e.output_count; i++) {
+        h = casa::hash::Value(h, p.PinId(node, i));
+        h = hash_text(h, p.String(node, node.pins[i].name));
+        h = casa::hash::Value(h, node.pins[i].type);
+        h = casa::hash::Value(h, node.pins[i].kind);
+    }
+    out.part[0] = h;
+
+    float position[2] = { p.X(node), p.Y(node) };
+    out.part[1] = casa::hash::Bytes(casa::hash::kFnvOffset, position, sizeof(position));
+
+    h = casa::hash::Bytes(casa::hash::kFnvOffset, e.color, sizeof(e.color));
+    out.part[2] = casa::hash::Bytes(h, e.size, sizeof(e.size));
+
+    h = hash_text(casa::hash::kFnvOffset, p.String(node, e.state));
+    out.part[3] = hash_text(h, p.String(node, e.saved_state));
+
+    // Summed, so the order the file lists them in doesn't count.
+    uint64_t sum = e.property_count;
+    p.ForEachProperty(node, [&sum](std::string_view key, const PropertyEntry& v, std::string_view text) {
+        uint64_t ph = hash_text(casa::hash::Value(casa::hash::kFnvOffset, v.kind), key);
+        switch ((PropertyKind)v.kind) {
+        case PropertyKind::Bool: ph = casa::hash::Value(ph, v.value.b != 0); break;
+        case PropertyKind::Int: ph = casa::hash::Value(ph, v.value.i); break;
+        case PropertyKind::Float: ph = casa::hash::Value(ph, v.value.f); break;
+        case PropertyKind::String: ph = hash_text(ph, text); break;
+        default: break;
+        }
+        sum += casa::hash::Mix(ph);
+    });
+    out.part[4] = sum;
+}
+
+static uint64_t hash_link(const LinkEntry& link)
+{
+    uint64_t h = casa::hash::Value(casa::hash::kFnvOffset, link.start_pin);
+    h = casa::hash::Value(h, link.end_pin);
+    return casa::hash::Bytes(h, link.color, sizeof(link.color));
+}
+
+// Work items of hash_nodes(), a run of nodes each.
+static const size_t kHashRun = 4096;
+
+struct HashJob {
+    const ProjectSnapshot* project;
+    NodeHash* out;
+};
+
+static void hash_nodes(const ProjectSnapshot& p, std::vector<NodeHash>& out, unsigned threads)
+{
+    out.resize(p.NodeCount());
+    std::vector<uint32_t> items((p.NodeCount() + kHashRun - 1) / kHashRun);
+    for (uint32_t i = 0; i < (uint32_t)items.size(); i++)
+        items[i] = i;
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    threads = std::max(1u, std::min(threads, (unsigned)std::max<size_t>(items.size(), 1)));
+    HashJob job = { &p, out.data() };
+    WorkStealingPool pool(threads);
+    pool.Run(items.data(), items.size(), [](void* user, uint32_t item, unsigned) {
+        const HashJob& j = *(const HashJob*)user;
+        size_t first = (size_t)item * kHashRun;
+        size_t last = std::min(first + kHashRun, j.project->NodeCount());
+        for (size_t n = first; n < last; n++)
+            hash_node(*j.project, j.project->Node(n), j.out[n]);
+    }, &job);
+}
+
+static std::unordered_map<uint64_t, uint32_t> index_nodes(const ProjectSnapshot& p)
+{
+    std::unordered_map<uint64_t, uint32_t> index;
+    index.reserve(p.NodeCount());
+    for (uint32_t i = 0; i < (uint32_t)p.NodeCount(); i++)
+        index.emplace(p.Node(i).id, i);
+    return index;
+}
+
+static std::unordered_map<uint64_t, uint32_t> index_links(const ProjectSnapshot& p)
+{
+    std::unordered_map<uint64_t, uint32_t> index;
+    index.reserve(p.LinkCount());
+    for (uint32_t i = 0; i < (uint32_t)p.LinkCount(); i++)
+        index.emplace(p.Link(i).id, i);
+    return index;
+}
+
+static const uint32_t kMissing = UINT32_MAX;
+
+static uint32_t find(const std::unordered_map<uint64_t, uint32_t>& index, uint64_t id)
+{
+    auto it = index.find(id);
+    return it == index.end() ? kMissing : it->second;
+}
+
+// Values compare the way they hash: bit for bit, so -0 differs from 0 and a NaN equals itself.
+template<typename T>
+static bool same_value(const T& a, const T& b)
+{
+    return a == b;
+}
+
+static bool same_value(float a, float b)
+{
+    return memcmp(&a, &b, sizeof(float)) == 0;
+}
+
+// Diff
+template<typename Map>
+static void changed_keys(const Map& a, const Map& b, std::vector<std::string>& out)
+{
+    for (const auto& kv : a) {
+        auto it = b.find(kv.first);
+        if (it == b.end() || !same_value(it->second, kv.second))
+            out.push_back(kv.first);
+    }
+    for (const auto& kv : b) {
+        if (a.find(kv.first) == a.end())
+            out.push_back(kv.first);
+    }
+}
+
+void DiffProjects(const ProjectSnapshot& base, const ProjectSnapshot& other, ProjectDiff& out, unsigned threads)
+{
+    out = ProjectDiff();
+    std::vector<NodeHash> base_hashes, other_hashes;
+    hash_nodes(base, base_hashes, threads);
+    hash_nodes(other, other_hashes, threads);
+
+    std::unordered_map<uint64_t, uint32_t> index = index_nodes(base);
+    std::vector<uint8_t> kept(base.NodeCount(), 0);
+    for (uint32_t i = 0; i < (uint32_t)other.NodeCount(); i++) {
+        NodeDiff diff;
+        diff.id = other.Node(i).id;
+        uint32_t b = find(index, diff.id);
+        if (b == kMissing) {
+            diff.change = Change::Added;
+            out.nodes.push_back(std::move(diff));
+            continue;
+        }
+        kept[b] = 1;
+        diff.parts = other_hashes[i].Differs(base_hashes[b]);
+        if (diff.parts == 0) {
+            out.same_nodes++;
+            continue;
+        }
+        if (diff.parts & kPartProperties) {
+            Properties from, to;
+            base.ReadProperties(base.Node(b), from);
+            other.ReadProperties(other.Node(i), to);
+            changed_keys(from.pbool, to.pbool, diff.properties);
+            changed_keys(from.pint, to.pint, diff.properties);
+            changed_keys(from.pfloat, to.pfloat, diff.properties);
+            changed_keys(from.pstring, to.pstring, diff.properties);
+            std::sort(diff.properties.begin(), diff.properties.end());
+        }
+        out.nodes.push_back(std::move(diff));
+    }
+    for (uint32_t b = 0; b < (uint32_t)base.NodeCount(); b++) {
+        if (!kept[b])
+            out.nodes.push_back(NodeDiff{ base.Node(b).id, Change::Removed, 0, {} });
+    }
+
+    index = index_links(base);
+    kept.assign(base.LinkCount(), 0);
+    for (uint32_t i = 0; i < (uint32_t)other.LinkCount(); i++) {
+        const LinkEntry& link = other.Link(i);
+        uint32_t b = find(index, link.id);
+        if (b == kMissing) {
+            out.links.push_back(LinkDiff{ link.id, Change::Added });
+            continue;
+        }
+        kept[b] = 1;
+        if (hash_link(link) == hash_link(base.Link(b)))
+            out.same_links++;
+        else
+            out.links.push_back(LinkDiff{ link.id, Change::Modified });
+    }
+    for (uint32_t b = 0; b < (uint32_t)base.LinkCount(); b++) {
+        if (!kept[b])
+            out.links.push_back(LinkDiff{ base.Link(b).id, Change::Removed });
+    }
+}
+
+// Merge
+// Where each part of a merged node comes from.  "properties" is set when both sides changed
+// them and they were merged key by key.
+struct MergedNode {
+    const ProjectSnapshot* project[kNodeParts];
+    const ProjectSnapshot::NodeRef* node[kNodeParts];
+    std::unique_ptr<Properties> properties;
+};
+
+static MergedNode whole(const ProjectSnapshot& p, uint32_t i)
+{
+    MergedNode m;
+    for (uint32_t k = 0; k < kNodeParts; k++) {
+        m.project[k] = &p;
+        m.node[k] = &p.Node(i);
+    }
+    return m;
+}
+
+// One key of one of Properties' maps, from all three sides.
+template<typename Map>
+static void merge_map(const Map& base, const Map& ours, const Map& theirs, bool prefer_theirs, uint64_t id,
+    Map& out, std::vector<MergeConflict>& conflicts)
+{
+    typedef typename Map::mapped_type Value;
+    auto merge_key = [&](const std::string& key) {
+        auto b = base.find(key), o = ours.find(key), t = theirs.find(key);
+        const Value* vb = b == base.end() ? nullptr : &b->second;
+        const Value* vo = o == ours.end() ? nullptr : &o->second;
+        const Value* vt = t == theirs.end() ? nullptr : &t->second;
+        auto same = [](const Value* x, const Value* y) { return x == nullptr ? y == nullptr : y != nullptr && same_value(*x, *y); };
+        const Value* v = vo;
+        if (same(vo, vt) || same(vt, vb)) {
+            v = vo;
+        } else if (same(vo, vb)) {
+            v = vt;
+        } else {
+            v = prefer_theirs ? vt : vo;
+            MergeConflict c;
+            c.kind = MergeConflict::Kind::Property;
+            c.id = id;
+            c.parts = kPartProperties;
+            c.property = key;
+            conflicts.push_back(std::move(c));
+        }
+        if (v != nullptr)
+            out[key] = *v;
+    };
+    for (const auto& kv : ours)
+        merge_key(kv.first);
+    for (const auto& kv : theirs) {
+        if (ours.find(kv.first) == ours.end())
+            merge_key(kv.first);
+    }
+    for (const auto& kv : base) {
+        if (ours.find(kv.first) == ours.end() && theirs.find(kv.first) == theirs.end())
+            merge_key(kv.first);
+    }
+}
+
+bool MergeProjects(const ProjectSnapshot& base, const ProjectSnapshot& ours, ProjectSnapshot& theirs,
+    const MergeOptions& options, const char* path, MergeResult& result, std::string* error)
+{
+    result = MergeResult();
+    if (ours.NextId() > base.NextId())
+        theirs.ShiftIds(base.NextId(), ours.NextId() - base.NextId());
+
+    std::vector<NodeHash> base_hashes, our_hashes, their_hashes;
+    hash_nodes(base, base_hashes, options.threads);
+    hash_nodes(ours, our_hashes, options.threads);
+    hash_nodes(theirs, their_hashes, options.threads);
+    std::unordered_map<uint64_t, uint32_t> base_index = index_nodes(base);
+    std::unordered_map<uint64_t, uint32_t> their_index = index_nodes(theirs);
+    const ProjectSnapshot& preferred = options.prefer_theirs ? (const ProjectSnapshot&)theirs : ours;
+
+    // Nodes: ours in their order, then what only theirs has.
+    std::vector<MergedNode> merged;
+    merged.reserve(ours.NodeCount());
+    std::vector<uint8_t> their_seen(theirs.NodeCount(), 0);
+    auto removed_changed = [&result](uint64_t id) {
+        MergeConflict c;
+        c.kind = MergeConflict::Kind::RemovedChanged;
+        c.id = id;
+        result.conflicts.push_back(std::move(c));
+    };
+    for (uint32_t o = 0; o < (uint32_t)ours.NodeCount(); o++) {
+        uint64_t id = ours.Node(o).id;
+        uint32_t b = find(base_index, id);
+        uint32_t t = find(their_index, id);
+        if (t != kMissing)
+            their_seen[t] = 1;
+        if (t == kMissing) {
+            if (b == kMissing) {
+                merged.push_back(whole(ours, o));           // Ours added it
+                result.from_ours++;
+            } else if (our_hashes[o].Differs(base_hashes[b]) != 0) {
+                removed_changed(id);                        // Theirs removed what ours changed
+                merged.push_back(whole(ours, o));
+                result.from_ours++;
+            }
+            continue;
+        }
+
+        MergedNode m = whole(ours, o);
+        uint32_t conflicted = 0;
+        bool took_ours = false, took_theirs = false;
+        for (uint32_t k = 0; k < kNodeParts; k++) {
+            uint64_t ho = our_hashes[o].part[k], ht = their_hashes[t].part[k];
+            bool has_base = b != kMissing;
+            uint64_t hb = has_base ? base_hashes[b].part[k] : 0;
+            if (ho == ht)
+                continue;
+            if (has_base && ho == hb) {
+                m.project[k] = &theirs;
+                m.node[k] = &theirs.Node(t);
+                took_theirs = true;
+            } else if (has_base && ht == hb) {
+                took_ours = true;
+            } else if ((1u << k) == kPartProperties && has_base) {
+                Properties pb, po, pt;
+                base.ReadProperties(base.Node(b), pb);
+                ours.ReadProperties(ours.Node(o), po);
+                theirs.ReadProperties(theirs.Node(t), pt);
+                m.properties = std::make_unique<Properties>();
+                merge_map(pb.pbool, po.pbool, pt.pbool, options.prefer_theirs, id, m.properties->pbool, result.conflicts);
+                merge_map(pb.pint, po.pint, pt.pint, options.prefer_theirs, id, m.properties->pint, result.conflicts);
+                merge_map(pb.pfloat, po.pfloat, pt.pfloat, options.prefer_theirs, id, m.properties->pfloat, result.conflicts);
+                merge_map(pb.pstring, po.pstring, pt.pstring, options.prefer_theirs, id, m.properties->pstring, result.conflicts);
+                took_ours = took_theirs = true;
+            } else {
+                conflicted |= 1u << k;
+                m.project[k] = &preferred;
+                m.node[k] = &preferred.Node(options.prefer_theirs ? t : o);
+            }
+        }
+        if (conflicted != 0) {
+            MergeConflict c;
+            c.kind = MergeConflict::Kind::Parts;
+            c.id = id;
+            c.parts = conflicted;
+            result.conflicts.push_back(std::move(c));
+        }
+        result.from_ours += took_ours ? 1 : 0;
+        result.from_theirs += took_theirs ? 1 : 0;
+        merged.push_back(std::move(m));
+    }
+    for (uint32_t t = 0; t < (uint32_t)theirs.NodeCount(); t++) {
+        if (their_seen[t])
+            continue;
+        uint32_t b = find(base_index, theirs.Node(t).id);
+        if (b != kMissing && their_hashes[t].Differs(base_hashes[b]) == 0)
+            continue;                                       // Ours removed it
+        if (b != kMissing)
+            removed_changed(theirs.Node(t).id);
+        merged.push_back(whole(theirs, t));
+        result.from_theirs++;
+    }
+    base_hashes = std::vector<NodeHash>();
+    our_hashes = std::vector<NodeHash>();
+    their_hashes = std::vector<NodeHash>();
+
+    // Links, the same way round, as a whole each.
+    std::vector<LinkEntry> links;
+    links.reserve(ours.LinkCount());
+    base_index = index_links(base);
+    their_index = index_links(theirs);
+    their_seen.assign(theirs.LinkCount(), 0);
+    for (uint32_t o = 0; o < (uint32_t)ours.LinkCount(); o++) {
+        const LinkEntry& link = ours.Link(o);
+        uint32_t b = find(base_index, link.id);
+        uint32_t t = find(their_index, link.id);
+        uint64_t ho = hash_link(link);
+        if (t == kMissing) {
+            if (b == kMissing) {
+                links.push_back(link);
+            } else if (ho != hash_link(base.Link(b))) {
+                removed_changed(link.id);
+                links.push_back(link);
+            }
+            continue;
+        }
+        their_seen[t] = 1;
+        uint64_t ht = hash_link(theirs.Link(t));
+        if (ho == ht || (b != kMissing && ht == hash_link(base.Link(b)))) {
+            links.push_back(link);
+        } else if (b != kMissing && ho == hash_link(base.Link(b))) {
+            links.push_back(theirs.Link(t));
+        } else {
+            MergeConflict c;
+            c.kind = MergeConflict::Kind::LinkChanged;
+            c.id = link.id;
+            result.conflicts.push_back(std::move(c));
+            links.push_back(options.prefer_theirs ? theirs.Link(t) : link);
+        }
+    }
+    for (uint32_t t = 0; t < (uint32_t)theirs.LinkCount(); t++) {
+        if (their_seen[t])
+            continue;
+        const LinkEntry& link = theirs.Link(t);
+        uint32_t b = find(base_index, link.id);
+        if (b != kMissing && hash_link(link) == hash_link(base.Link(b)))
+            continue;
+        if (b != kMissing)
+            removed_changed(link.id);
+        links.push_back(link);
+    }
+
+    // Every link must start at an output and end at an input of the merged nodes, and an input
+    // takes one link.  What comes first, ie. ours, wins.
+    enum : uint8_t { kOutput = 1, kInput = 2, kLinked = 4 };
+    std::unordered_map<uint64_t, uint8_t> pins;
+    for (const MergedNode& m : merged) {
+        const ProjectSnapshot& p = *m.project[0];
+        const ProjectSnapshot::NodeRef& node = *m.node[0];
+        for (uint32_t i = 0; i < node.entry->input_count + node.entry->output_count; i++)
+            pins[p.PinId(node, i)] = i < node.entry->input_count ? kInput : kOutput;
+    }
+    size_t kept = 0;
+    for (const LinkEntry& link : links) {
+        auto start = pins.find(link.start_pin);
+        auto end = pins.find(link.end_pin);
+        if (start == pins.end() || !(start->second & kOutput) || end == pins.end() || !(end->second & kInput) ||
+            (end->second & kLinked)) {
+            MergeConflict c;
+            c.kind = MergeConflict::Kind::DroppedLink;
+            c.id = link.id;
+            result.conflicts.push_back(std::move(c));
+            continue;
+        }
+        end->second |= kLinked;
+        links[kept++] = link;
+    }
+    links.resize(kept);
+    pins = std::unordered_map<uint64_t, uint8_t>();
+    result.nodes = merged.size();
+    result.links = links.size();
+
+    // Write it like save_project_file() does: to a temporary file that replaces "path" once it
+    // is all there, so "path" may be one of the projects being merged.
+    const FileHeader& view = ours.Header();
+    uint64_t next_id = std::max(ours.NextId(), theirs.NextId());
+    auto fill = [&](Writer& w) {
+        for (const MergedNode& m : merged) {
+            const ProjectSnapshot& kp = *m.project[0];
+            const ProjectSnapshot::NodeRef& kind = *m.node[0];
+            NodeEntry& entry = w.AddNode();
+            entry.id = kind.id;
+            entry.type = w.Intern(kp.String(kind, kind.entry->type));
+            entry.node_type = kind.entry->node_type;
+            entry.position[0] = m.project[1]->X(*m.node[1]);
+            entry.position[1] = m.project[1]->Y(*m.node[1]);
+            memcpy(entry.color, m.node[2]->entry->color, sizeof(entry.color));
+            memcpy(entry.size, m.node[2]->entry->size, sizeof(entry.size));
+            entry.state = w.Append(m.project[3]->String(*m.node[3], m.node[3]->entry->state));
+            entry.saved_state = w.Append(m.project[3]->String(*m.node[3], m.node[3]->entry->saved_state));
+            for (uint32_t i = 0; i < kind.entry->input_count + kind.entry->output_count; i++) {
+                const PinEntry& pin = kind.pins[i];
+                w.AddPin(kp.PinId(kind, i), kp.String(kind, pin.name), (plano::types::PinType)pin.type,
+                    (plano::types::PinKind)pin.kind);
+            }
+            if (m.properties) {
+                w.AddProperties(*m.properties);
+            } else {
+                m.project[4]->ForEachProperty(*m.node[4], [&w](std::string_view key, const PropertyEntry& e, std::string_view text) {
+                    w.AddProperty(key, e, text);
+                });
+            }
+        }
+        for (const LinkEntry& link : links)
+            w.AddLink(link);
+        w.SetNextId(next_id);
+        w.SetView(view.view[0], view.view[1], view.view[2], view.view[3]);
+        return true;
+    };
+
+    std::string temp = std::string(path) + ".tmp";
+    Writer writer;
+    writer.SetDedupe(options.dedupe);
+    bool written = false;
+    {
+        io::FileSink file;
+        if (file.Open(temp.c_str())) {
+            if (options.compress) {
+                CompressingSink blocks(file);
+                written = writer.Write(blocks, fill) && blocks.Finish();
+            } else {
+                written = writer.Write(file, fill);
+            }
+            written = file.Sync() && written;
+            written = file.Close() && written;
+        }
+    }
+    std::error_code ec;
+    if (written)
+        std::filesystem::rename(temp, path, ec);
+    if (!written || ec) {
+        std::filesystem::remove(temp, ec);
+        if (error)
+            *error = "can't write the merged project";
+        return false;
+    }
+    return true;
+}
+
+} // end namespace csa
+} // end namespace casa
+
+// Command line
+static const char* change_name(casa::csa::Change change)
+{
+    switch (change) {
+    case casa::csa::Change::Added: return "added";
+    case casa::csa::Change::Removed: return "removed";
+    default: return "modified";
+    }
+}
+
+static std::string part_names(uint32_t parts)
+{
+    static const char* names[casa::csa::kNodeParts] = { "kind", "position", "look", "state", "properties" };
+    std::string out;
+    for (uint32_t k = 0; k < casa::csa::kNodeParts; k++) {
+        if (parts & (1u << k))
+            out += (out.empty() ? "" : ",") + std::string(names[k]);
+    }
+    return out;
+}
+
+static bool open_project(casa::csa::ProjectSnapshot& project, const char* path)
+{
+    std::string error;
+    if (project.Open(path, &error))
+        return true;
+    printf("%s: %s\n", path, error.c_str());
+    return false;
+}
+
+int run_diff_command(const char* base_path, const char* other_path)
+{
+    casa::csa::ProjectSnapshot base, other;
+    if (!open_project(base, base_path) || !open_project(other, other_path))
+        return 2;
+    casa::csa::ProjectDiff diff;
+    casa::csa::DiffProjects(base, other, diff);
+    for (const auto& node : diff.nodes) {
+        printf("node %llu %s", (unsigned long long)node.id, change_name(node.change));
+        if (node.change == casa::csa::Change::Modified)
+            printf(" %s", part_names(node.parts).c_str());
+        for (const auto& key : node.properties)
+            printf(" \"%s\"", key.c_str());
+        printf("\n");
+    }
+    for (const auto& link : diff.links)
+        printf("link %llu %s\n", (unsigned long long)link.id, change_name(link.change));
+    printf("%zu nodes and %zu links changed, %zu nodes and %zu links the same\n", diff.nodes.size(), diff.links.size(),
+        diff.same_nodes, diff.same_links);
+    return diff.nodes.empty() && diff.links.empty() ? 0 : 1;
+}
+
+int run_merge_command(int argc, char** argv)
+{
+    // casa --merge <base> <ours> <theirs> <out> [options]
+    if (argc < 6) {
+        printf("usage: casa --merge <base> <ours> <theirs> <out> [--theirs] [--compress] [--dedupe]\n");
+        return 2;
+    }
+    casa::csa::MergeOptions options;
+    for (int a = 6; a < argc; a++) {
+        if (strcmp(argv[a], "--theirs") == 0) {
+            options.prefer_theirs = true;
+        } else if (strcmp(argv[a], "--compress") == 0) {
+            options.compress = true;
+        } else if (strcmp(argv[a], "--dedupe") == 0) {
+            options.dedupe = true;
+        } else {
+            printf("unknown merge option \"%s\"\n", argv[a]);
+            return 2;
+        }
+    }
+    casa::csa::ProjectSnapshot base, ours, theirs;
+    if (!open_project(base, argv[2]) || !open_project(ours, argv[3]) || !open_project(theirs, argv[4]))
+        return 2;
+    casa::csa::MergeResult result;
+    std::string error;
+    if (!casa::csa::MergeProjects(base, ours, theirs, options, argv[5], result, &error)) {
+        printf("%s: %s\n", argv[5], error.c_str());
+        return 2;
+    }
+    for (const auto& c : result.conflicts) {
+        unsigned long long id = (unsigned long long)c.id;
+        switch (c.kind) {
+        case casa::csa::MergeConflict::Kind::Parts: printf("conflict: node %llu %s\n", id, part_names(c.parts).c_str()); break;
+        case casa::csa::MergeConflict::Kind::Property: printf("conflict: node %llu property \"%s\"\n", id, c.property.c_str()); break;
+        case casa::csa::MergeConflict::Kind::LinkChanged: printf("conflict: link %llu\n", id); break;
+        case casa::csa::MergeConflict::Kind::RemovedChanged: printf("conflict: %llu removed on one side, changed on the other, kept\n", id); break;
+        case casa::csa::MergeConflict::Kind::DroppedLink: printf("dropped: link %llu, its input is taken or a pin is gone\n", id); break;
+        }
+    }
+    printf("merged %zu nodes and %zu links into %s: %zu nodes changed by ours, %zu by theirs, %zu conflicts, %s won them\n",
+        result.nodes, result.links, argv[5], result.from_ours, result.from_theirs, result.conflicts.size(),
+        options.prefer_theirs ? "theirs" : "ours");
+    return result.conflicts.empty() ? 0 : 1;
+}
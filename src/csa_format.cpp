@@ -0,0 +1,958 @@
+#include "csa_format.h"
+#include "casa_hash.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+namespace casa {
+namespace csa {
+
+bool IsBinaryProject(const char* data, size_t size)
+{
+    return size >= sizeof(kMagic) && memcmp(data, kMagic, sizeof(kMagic)) == 0;
+}
+
+static uint64_t align8(uint64_t n)
+{
+    return (n + 7) & ~(uint64_t)7;
+}
+
+static const uint32_t kMinRepeatNodes = 2;     // A lone node isn't worth an instance
+
+// Writer
+StrRef Writer::Intern(std::string_view s)
+{
+    if (m_Skipping && !m_InProperties)
+        return StrRef(); // an instance's, its template has it
+    RecordString(s);
+    auto it = m_Interned.find(s);
+    if (it == m_Interned.end()) {
+        if (m_Pass != Pass::Measure) { // every string was seen while measuring
+            m_Failed = true;
+            return StrRef();
+        }
+        StrRef ref = Append(s);
+        m_Interned.emplace(std::string(s), ref);
+        return ref;
+    }
+    // The string is stored where it first came up, which is wherever the table has got to.
+    if (it->second.offset == m_Counts.strings && it->second.size > 0)
+        Append(s);
+    return it->second;
+}
+
+StrRef Writer::Append(std::string_view s)
+{
+    StrRef ref = {};
+    if (m_Skipping && !m_InProperties)
+        return ref;
+    if (m_Counts.strings + s.size() > UINT32_MAX) {
+        m_Failed = true;
+        return ref;
+    }
+    ref.offset = (uint32_t)m_Counts.strings;
+    ref.size = (uint32_t)s.size();
+    m_Counts.strings += s.size();
+    if (m_Pass == Pass::Strings)
+        Put(s.data(), s.size());
+    return ref;
+}
+
+// Strings a node is made of go into its record, the values of its properties are kept apart.
+void Writer::RecordString(std::string_view s)
+{
+    if (m_Collect && m_HasNode && !m_InProperties)
+        RecordText(m_NodeBytes, s);
+}
+
+void Writer::Record(std::string& out, const void* data, size_t size)
+{
+    out.append((const char*)data, size);
+}
+
+void Writer::RecordText(std::string& out, std::string_view s)
+{
+    uint64_t size = s.size(); // length prefix so "ab"+"c" != "a"+"bc"
+    Record(out, &size, sizeof(size));
+    out.append(s.data(), s.size());
+}
+
+// Whether nodes "a" and "b" of the first walk are made of the same bytes: type, pins, property
+// keys and the rest their hashes stand for.
+bool Writer::SameNode(uint32_t a, uint32_t b) const
+{
+    uint64_t size = m_NodeRecords[a + 1] - m_NodeRecords[a];
+    return size == m_NodeRecords[b + 1] - m_NodeRecords[b] &&
+        memcmp(m_NodeBytes.data() + m_NodeRecords[a], m_NodeBytes.data() + m_NodeRecords[b], size) == 0;
+}
+
+bool Writer::SameValue(uint32_t a, uint32_t b) const
+{
+    uint64_t size = m_ValueRecords[a + 1] - m_ValueRecords[a];
+    return m_ValueHashes[a] == m_ValueHashes[b] && size == m_ValueRecords[b + 1] - m_ValueRecords[b] &&
+        memcmp(m_ValueBytes.data() + m_ValueRecords[a], m_ValueBytes.data() + m_ValueRecords[b], size) == 0;
+}
+
+NodeEntry& Writer::AddNode(void)
+{
+    FinishNode();
+    m_Node = {};
+    m_Node.first_pin = (uint32_t)m_Counts.pins;
+    m_Node.first_property = (uint32_t)m_Counts.properties;
+    m_HasNode = true;
+    if (m_Collect)
+        m_NodeRecords.push_back(m_NodeBytes.size());
+    if (!m_Order.empty()) {
+        if (m_AddedNodes >= m_Order.size()) {
+            m_Failed = true; // more nodes than the first walk had
+        } else if (m_Order[m_AddedNodes] >= m_DedupeStats.stored_nodes) {
+            uint32_t at = m_Order[m_AddedNodes];
+            auto it = std::upper_bound(m_Instances.begin(), m_Instances.end(), at,
+                [](uint32_t v, const InstanceEntry& i) { return v < i.first_node; });
+            m_Skipping = true;
+            m_SkipInstance = (uint32_t)(it - m_Instances.begin()) - 1;
+            m_SkipLocal = at - m_Instances[m_SkipInstance].first_node;
+        }
+    }
+    m_AddedNodes++;
+    if (!m_Skipping)
+        m_Counts.nodes++;
+    return m_Node;
+}
+
+void Writer::FinishNode(void)
+{
+    if (m_HasNode && m_Pass == Pass::Measure && m_Order.empty()) {
+        m_Positions.push_back(m_Node.position[0]);
+        m_Positions.push_back(m_Node.position[1]);
+    }
+    if (m_HasNode && m_Collect) {
+        Record(m_NodeBytes, m_Node.color, sizeof(m_Node.color));
+        Record(m_NodeBytes, m_Node.size, sizeof(m_Node.size));
+        Record(m_NodeBytes, &m_Node.node_type, sizeof(m_Node.node_type));
+        Record(m_NodeBytes, &m_Node.input_count, sizeof(m_Node.input_count));
+        Record(m_NodeBytes, &m_Node.output_count, sizeof(m_Node.output_count));
+        Record(m_NodeBytes, &m_Node.property_count, sizeof(m_Node.property_count));
+        uint64_t start = m_NodeRecords.back();
+        m_NodeIds.push_back(m_Node.id);
+        m_NodeHashes.push_back(casa::hash::Bytes(casa::hash::kFnvOffset, m_NodeBytes.data() + start, m_NodeBytes.size() - start));
+        m_NodeProperties.push_back(m_Node.first_property);
+    }
+    if (m_HasNode && m_Pass == Pass::Nodes && !m_Skipping)
+        Put(&m_Node, sizeof(m_Node));
+    m_HasNode = false;
+    m_Skipping = false;
+}
+
+void Writer::SetView(float min_x, float min_y, float max_x, float max_y)
+{
+    m_View[0] = min_x;
+    m_View[1] = min_y;
+    m_View[2] = max_x;
+    m_View[3] = max_y;
+}
+
+// Nodes far out, or at a NaN position, still land in some tile.
+static int32_t tile_coordinate(float v)
+{
+    float t = std::floor(v / kTileSize);
+    if (t != t)
+        return 0;
+    return (int32_t)std::clamp(t, -1.0e9f, 1.0e9f);
+}
+
+// Finds the connected subgraphs that are copies of one another, from what the first walk hashed,
+// and works out the instances, and which nodes, links and property values the tables keep.
+// Returns false if nothing repeats, and the tables stay as "fill" adds them.
+bool Writer::FindRepeats(void)
+{
+    using namespace casa::hash;
+    uint32_t count = (uint32_t)m_NodeIds.size();
+    uint32_t link_count = (uint32_t)m_LinkKeys.size();
+    m_NodeProperties.push_back((uint32_t)m_ValueHashes.size());
+    m_NodeRecords.push_back(m_NodeBytes.size());
+    m_ValueRecords.push_back(m_ValueBytes.size());
+    auto position = [this](uint32_t n, int axis) { return m_Positions[(size_t)n * 2 + axis]; };
+
+    // Connected components, every one named after its first node.  Links to pins nobody has
+    // belong to no component and stay in the table.
+    std::sort(m_PinNodes.begin(), m_PinNodes.end());
+    auto node_of = [this](uint64_t pin) {
+        auto it = std::lower_bound(m_PinNodes.begin(), m_PinNodes.end(), std::make_pair(pin, (uint32_t)0));
+        return it != m_PinNodes.end() && it->first == pin ? it->second : UINT32_MAX;
+    };
+    std::vector<uint32_t> parent(count);
+    std::iota(parent.begin(), parent.end(), 0u);
+    auto find = [&parent](uint32_t n) {
+        while (parent[n] != n) {
+            parent[n] = parent[parent[n]];
+            n = parent[n];
+        }
+        return n;
+    };
+    std::vector<uint32_t> link_node(link_count, UINT32_MAX);
+    for (uint32_t l = 0; l < link_count; l++) {
+        uint32_t a = node_of(m_LinkKeys[l].start_pin);
+        uint32_t b = node_of(m_LinkKeys[l].end_pin);
+        if (a == UINT32_MAX || b == UINT32_MAX)
+            continue;
+        link_node[l] = a;
+        a = find(a);
+        b = find(b);
+        if (a != b)
+            parent[std::max(a, b)] = std::min(a, b);
+    }
+    std::vector<uint32_t> component(count);
+    uint32_t components = 0;
+    for (uint32_t n = 0; n < count; n++) {
+        uint32_t root = find(n);
+        component[n] = root == n ? components++ : component[root];
+    }
+
+    // Every component's nodes by id, and its links by id.
+    std::vector<uint32_t> node_start(components + 1, 0);
+    std::vector<uint32_t> link_start(components + 1, 0);
+    for (uint32_t n = 0; n < count; n++)
+        node_start[component[n] + 1]++;
+    for (uint32_t l = 0; l < link_count; l++) {
+        if (link_node[l] != UINT32_MAX)
+            link_start[component[link_node[l]] + 1]++;
+    }
+    for (uint32_t c = 0; c < components; c++) {
+        node_start[c + 1] += node_start[c];
+        link_start[c + 1] += link_start[c];
+    }
+    std::vector<uint32_t> nodes(count);
+    std::vector<uint32_t> links(link_start[components]);
+    {
+        std::vector<uint32_t> cursor(node_start.begin(), node_start.end() - 1);
+        for (uint32_t n = 0; n < count; n++)
+            nodes[cursor[component[n]]++] = n;
+        cursor.assign(link_start.begin(), link_start.end() - 1);
+        for (uint32_t l = 0; l < link_count; l++) {
+            if (link_node[l] != UINT32_MAX)
+                links[cursor[component[link_node[l]]]++] = l;
+        }
+    }
+    for (uint32_t c = 0; c < components; c++) {
+        std::sort(nodes.begin() + node_start[c], nodes.begin() + node_start[c + 1],
+            [this](uint32_t a, uint32_t b) { return m_NodeIds[a] < m_NodeIds[b]; });
+        std::sort(links.begin() + link_start[c], links.begin() + link_start[c + 1],
+            [this](uint32_t a, uint32_t b) { return m_LinkKeys[a].id < m_LinkKeys[b].id; });
+    }
+
+    // The structural hash: what the nodes are and how they are linked, with every id taken
+    // relative to the component's first.  Only picks the candidates: a copy has to match its
+    // template byte for byte, so a collision can't put one subgraph's nodes in place of another's.
+    auto size = [&node_start](uint32_t c) { return node_start[c + 1] - node_start[c]; };
+    auto base = [&](uint32_t c) { return m_NodeIds[nodes[node_start[c]]]; };
+    auto same = [&](uint32_t a, uint32_t b) {
+        if (size(a) != size(b) || link_start[a + 1] - link_start[a] != link_start[b + 1] - link_start[b])
+            return false;
+        uint64_t base_a = base(a), base_b = base(b);
+        uint32_t first_a = nodes[node_start[a]], first_b = nodes[node_start[b]];
+        float dx = position(first_b, 0) - position(first_a, 0);
+        float dy = position(first_b, 1) - position(first_a, 1);
+        for (uint32_t k = 0; k < size(a); k++) {
+            uint32_t na = nodes[node_start[a] + k], nb = nodes[node_start[b] + k];
+            if (m_NodeIds[na] - base_a != m_NodeIds[nb] - base_b || m_NodeHashes[na] != m_NodeHashes[nb] ||
+                !SameNode(na, nb) || position(na, 0) + dx != position(nb, 0) || position(na, 1) + dy != position(nb, 1))
+                return false;
+        }
+        for (uint32_t k = 0; k < link_start[a + 1] - link_start[a]; k++) {
+            const LinkKey& la = m_LinkKeys[links[link_start[a] + k]];
+            const LinkKey& lb = m_LinkKeys[links[link_start[b] + k]];
+            if (la.id - base_a != lb.id - base_b || la.start_pin - base_a != lb.start_pin - base_b ||
+                la.end_pin - base_a != lb.end_pin - base_b || memcmp(la.color, lb.color, sizeof(la.color)) != 0)
+                return false;
+        }
+        return true;
+    };
+    std::unordered_map<uint64_t, std::vector<uint32_t>> seen;   // Hash, the first component of every shape
+    std::vector<uint32_t> copy_of(components, UINT32_MAX);
+    std::vector<uint32_t> copies(components, 0);
+    bool any = false;
+    for (uint32_t c = 0; c < components; c++) {
+        if (size(c) < kMinRepeatNodes)
+            continue;
+        uint64_t b = base(c);
+        uint64_t h = Value(kFnvOffset, size(c));
+        for (uint32_t k = node_start[c]; k < node_start[c + 1]; k++)
+            h = Combine(Combine(h, m_NodeHashes[nodes[k]]), m_NodeIds[nodes[k]] - b);
+        for (uint32_t k = link_start[c]; k < link_start[c + 1]; k++) {
+            const LinkKey& link = m_LinkKeys[links[k]];
+            h = Combine(Combine(Combine(Combine(h, link.hash), link.id - b), link.start_pin - b), link.end_pin - b);
+        }
+        std::vector<uint32_t>& shapes = seen[h];
+        for (uint32_t s : shapes) {
+            if (same(s, c)) {
+                copy_of[c] = s;
+                copies[s]++;
+                any = true;
+                break;
+            }
+        }
+        if (copy_of[c] == UINT32_MAX)
+            shapes.push_back(c);
+    }
+    if (!any) {
+        m_NodeProperties.pop_back();
+        m_NodeRecords.pop_back();
+        m_ValueRecords.pop_back();
+        return false;
+    }
+
+    // The tables keep every node but the copies', in the order "fill" adds them, and the copies
+    // follow, instance by instance.
+    std::vector<uint8_t> skip(count, 0);
+    for (uint32_t c = 0; c < components; c++) {
+        if (copy_of[c] != UINT32_MAX) {
+            for (uint32_t k = node_start[c]; k < node_start[c + 1]; k++)
+                skip[nodes[k]] = 1;
+        }
+    }
+    m_Order.assign(count, 0);
+    uint32_t stored = 0;
+    for (uint32_t n = 0; n < count; n++) {
+        if (!skip[n])
+            m_Order[n] = stored++;
+    }
+    m_SkipLink.assign(link_count, 0);
+    for (uint32_t l = 0; l < link_count; l++) {
+        if (link_node[l] != UINT32_MAX && copy_of[component[link_node[l]]] != UINT32_MAX)
+            m_SkipLink[l] = 1;
+    }
+    std::vector<uint32_t> link_order(link_count, 0);
+    uint32_t stored_links = 0;
+    for (uint32_t l = 0; l < link_count; l++) {
+        if (!m_SkipLink[l])
+            link_order[l] = stored_links++;
+    }
+
+    std::vector<uint32_t> template_of(components, UINT32_MAX);
+    for (uint32_t c = 0; c < components; c++) {
+        if (copies[c] == 0)
+            continue;
+        template_of[c] = (uint32_t)m_Templates.size();
+        TemplateEntry t = {};
+        t.first_node = (uint32_t)m_TemplateNodes.size();
+        t.node_count = size(c);
+        t.first_link = (uint32_t)m_TemplateLinks.size();
+        t.link_count = link_start[c + 1] - link_start[c];
+        for (uint32_t k = node_start[c]; k < node_start[c + 1]; k++)
+            m_TemplateNodes.push_back(m_Order[nodes[k]]);
+        for (uint32_t k = link_start[c]; k < link_start[c + 1]; k++)
+            m_TemplateLinks.push_back(link_order[links[k]]);
+        m_Templates.push_back(t);
+    }
+    m_Override.assign(m_ValueHashes.size(), 0);
+    uint32_t at = stored;
+    uint32_t at_link = stored_links;
+    for (uint32_t c = 0; c < components; c++) {
+        uint32_t s = copy_of[c];
+        if (s == UINT32_MAX)
+            continue;
+        uint32_t first = nodes[node_start[c]], first_s = nodes[node_start[s]];
+        InstanceEntry instance = {};
+        instance.id_shift = base(c) - base(s);
+        instance.offset[0] = position(first, 0) - position(first_s, 0);
+        instance.offset[1] = position(first, 1) - position(first_s, 1);
+        instance.template_index = template_of[s];
+        instance.first_node = at;
+        instance.first_link = at_link;
+        for (uint32_t k = 0; k < size(c); k++) {
+            uint32_t n = nodes[node_start[c] + k], m = nodes[node_start[s] + k];
+            m_Order[n] = at + k;
+            for (uint32_t j = 0; j < m_NodeProperties[n + 1] - m_NodeProperties[n]; j++) {
+                uint32_t p = m_NodeProperties[n] + j;
+                if (!SameValue(p, m_NodeProperties[m] + j)) {
+                    m_Override[p] = 1;
+                    m_DedupeStats.overrides++;
+                }
+            }
+        }
+        at += size(c);
+        at_link += link_start[c + 1] - link_start[c];
+        m_Instances.push_back(instance);
+    }
+    m_DedupeStats.templates = m_Templates.size();
+    m_DedupeStats.instances = m_Instances.size();
+    m_DedupeStats.stored_nodes = stored;
+    m_DedupeStats.stored_links = stored_links;
+
+    // The rest only served the search.
+    m_NodeIds = std::vector<uint64_t>();
+    m_NodeHashes = std::vector<uint64_t>();
+    m_NodeProperties = std::vector<uint32_t>();
+    m_ValueHashes = std::vector<uint64_t>();
+    m_NodeRecords = std::vector<uint64_t>();
+    m_NodeBytes = std::string();
+    m_ValueRecords = std::vector<uint64_t>();
+    m_ValueBytes = std::string();
+    m_PinNodes = std::vector<std::pair<uint64_t, uint32_t>>();
+    m_LinkKeys = std::vector<LinkKey>();
+    return true;
+}
+
+// Buckets the measured positions into tiles: a counting sort, with the tiles themselves sorted.
+void Writer::BuildSpatialIndex(void)
+{
+    m_Tiles.clear();
+    m_TileNodes.clear();
+    size_t count = m_Positions.size() / 2;
+    std::vector<uint32_t> tile_of(count);
+    std::unordered_map<uint64_t, uint32_t> slots;
+    uint64_t last_key = 0;
+    uint32_t last_slot = UINT32_MAX;
+    for (size_t n = 0; n < count; n++) {
+        int32_t x = tile_coordinate(m_Positions[n * 2]);
+        int32_t y = tile_coordinate(m_Positions[n * 2 + 1]);
+        uint64_t key = ((uint64_t)(uint32_t)y << 32) | (uint32_t)x;
+        if (key != last_key || last_slot == UINT32_MAX) { // neighbours in the file are often neighbours on the canvas
+            auto it = slots.try_emplace(key, (uint32_t)m_Tiles.size());
+            if (it.second)
+                m_Tiles.push_back(TileEntry{ x, y, 0, 0 });
+            last_key = key;
+            last_slot = it.first->second;
+        }
+        m_Tiles[last_slot].count++;
+        tile_of[m_Order.empty() ? n : m_Order[n]] = last_slot;
+    }
+    m_Positions.clear();
+    m_Positions.shrink_to_fit();
+
+    std::vector<uint32_t> order(m_Tiles.size());
+    std::iota(order.begin(), order.end(), 0u);
+    std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+        const TileEntry& ta = m_Tiles[a];
+        const TileEntry& tb = m_Tiles[b];
+        return ta.y != tb.y ? ta.y < tb.y : ta.x < tb.x;
+    });
+    std::vector<TileEntry> sorted(m_Tiles.size());
+    std::vector<uint32_t> rank(m_Tiles.size());
+    uint32_t first = 0;
+    for (uint32_t r = 0; r < (uint32_t)order.size(); r++) {
+        sorted[r] = m_Tiles[order[r]];
+        sorted[r].first = first;
+        first += sorted[r].count;
+        rank[order[r]] = r;
+    }
+    m_Tiles = std::move(sorted);
+
+    std::vector<uint32_t> cursor(m_Tiles.size());
+    for (size_t t = 0; t < m_Tiles.size(); t++)
+        cursor[t] = m_Tiles[t].first;
+    m_TileNodes.resize(count);
+    for (size_t n = 0; n < count; n++)
+        m_TileNodes[cursor[rank[tile_of[n]]]++] = (uint32_t)n;
+}
+
+void Writer::AddPin(uint64_t id, std::string_view name, plano::types::PinType type, plano::types::PinKind kind)
+{
+    if (!m_HasNode) {
+        m_Failed = true;
+        return;
+    }
+    if (m_Skipping)
+        return;
+    if (m_Collect) {
+        m_PinNodes.emplace_back(id, m_AddedNodes - 1);
+        uint64_t relative = id - m_Node.id;
+        uint64_t type_kind = ((uint64_t)type << 32) | (uint32_t)kind;
+        Record(m_NodeBytes, &relative, sizeof(relative));
+        Record(m_NodeBytes, &type_kind, sizeof(type_kind));
+    }
+    PinEntry pin = {};
+    pin.id = id;
+    pin.name = Intern(name);
+    pin.type = (uint32_t)type;
+    pin.kind = (uint32_t)kind;
+    if (kind == plano::types::PinKind::Input)
+        m_Node.input_count++;
+    else
+        m_Node.output_count++;
+    m_Counts.pins++;
+    if (m_Pass == Pass::Pins)
+        Put(&pin, sizeof(pin));
+}
+
+// "value" holds the kind's member of the union, "text" the value of a String.  An instance's node
+// only keeps the values that differ from its template's, as overrides.
+void Writer::PutProperty(std::string_view key, PropertyKind kind, const PropertyEntry& value, std::string_view text)
+{
+    uint32_t ordinal = m_AddedProperties++;
+    if (m_Collect) {
+        // The same bytes whether the value came from a Properties or from another file.
+        uint64_t start = m_ValueBytes.size();
+        bool b = value.value.b != 0;
+        switch (kind) {
+        case PropertyKind::Bool: Record(m_ValueBytes, &b, sizeof(b)); break;
+        case PropertyKind::Int: Record(m_ValueBytes, &value.value.i, sizeof(value.value.i)); break;
+        case PropertyKind::Float: Record(m_ValueBytes, &value.value.f, sizeof(value.value.f)); break;
+        case PropertyKind::String: RecordText(m_ValueBytes, text); break;
+        }
+        Record(m_NodeBytes, &kind, sizeof(kind));
+        RecordText(m_NodeBytes, key);
+        m_ValueRecords.push_back(start);
+        m_ValueHashes.push_back(casa::hash::Bytes(casa::hash::kFnvOffset, m_ValueBytes.data() + start, m_ValueBytes.size() - start));
+    }
+    if (m_Skipping && !(ordinal < m_Override.size() && m_Override[ordinal]))
+        return;
+    PropertyEntry entry;
+    memset(&entry, 0, sizeof(entry)); // all of the union, so files come out the same every time
+    entry.key = Intern(key);
+    entry.kind = (uint32_t)kind;
+    if (kind == PropertyKind::String)
+        entry.value.s = Append(text);
+    else
+        entry.value = value.value;
+    if (m_Skipping && m_Pass == Pass::Measure)
+        m_Found.push_back({ m_SkipInstance, OverrideEntry{ m_SkipLocal, (uint32_t)m_Counts.properties } });
+    if (!m_Skipping)
+        m_Node.property_count++;
+    m_Counts.properties++;
+    if (m_Pass == Pass::Properties)
+        Put(&entry, sizeof(entry));
+}
+
+void Writer::AddProperties(const Properties& p)
+{
+    if (!m_HasNode) {
+        m_Failed = true;
+        return;
+    }
+    m_InProperties = true;
+    PropertyEntry value;
+    memset(&value, 0, sizeof(value));
+    for (const auto& kv : p.pbool) {
+        value.value.b = kv.second ? 1 : 0;
+        PutProperty(kv.first, PropertyKind::Bool, value, std::string_view());
+    }
+    for (const auto& kv : p.pint) {
+        value.value.i = kv.second;
+        PutProperty(kv.first, PropertyKind::Int, value, std::string_view());
+    }
+    for (const auto& kv : p.pfloat) {
+        value.value.f = kv.second;
+        PutProperty(kv.first, PropertyKind::Float, value, std::string_view());
+    }
+    for (const auto& kv : p.pstring)
+        PutProperty(kv.first, PropertyKind::String, value, kv.second);
+    m_InProperties = false;
+}
+
+void Writer::AddProperty(std::string_view key, const PropertyEntry& value, std::string_view text)
+{
+    PropertyKind kind = (PropertyKind)value.kind;
+    if (!m_HasNode || kind < PropertyKind::Bool || kind > PropertyKind::String) {
+        m_Failed = true;
+        return;
+    }
+    m_InProperties = true;
+    PutProperty(key, kind, value, text);
+    m_InProperties = false;
+}
+
+void Writer::AddLink(const LinkEntry& link)
+{
+    uint32_t ordinal = m_AddedLinks++;
+    if (m_Collect) {
+        LinkKey key = { link.start_pin, link.end_pin, link.id, casa::hash::Bytes(casa::hash::kFnvOffset, link.color, sizeof(link.color)), {} };
+        memcpy(key.color, link.color, sizeof(key.color));
+        m_LinkKeys.push_back(key);
+    }
+    if (ordinal < m_SkipLink.size() && m_SkipLink[ordinal])
+        return;
+    m_Counts.links++;
+    if (m_Pass == Pass::Links)
+        Put(&link, sizeof(link));
+}
+
+void Writer::Put(const void* data, size_t size)
+{
+    if (m_Failed || m_Sink == nullptr)
+        return;
+    if (size > 0 && !m_Sink->Write(data, size))
+        m_Failed = true;
+    m_Written += size;
+}
+
+void Writer::Pad(void)
+{
+    static const char padding[8] = {};
+    Put(padding, (size_t)(align8(m_Written) - m_Written));
+}
+
+bool Writer::RunPass(Pass pass, const Fill& fill)
+{
+    m_Pass = pass;
+    m_Counts = Counts();
+    m_HasNode = false;
+    m_Skipping = false;
+    m_InProperties = false;
+    m_AddedNodes = 0;
+    m_AddedLinks = 0;
+    m_AddedProperties = 0;
+    if (!fill(*this))
+        return false;
+    FinishNode();
+    Pad();
+    return !m_Failed;
+}
+
+bool Writer::Write(io::Sink& sink, const Fill& fill)
+{
+    m_Interned.clear();
+    m_NextId = 1;
+    std::fill(std::begin(m_View), std::end(m_View), 0.0f);
+    m_Positions.clear();
+    m_Sink = nullptr;
+    m_Written = 0;
+    m_Failed = false;
+    m_Order.clear();
+    m_SkipLink.clear();
+    m_Override.clear();
+    m_Templates.clear();
+    m_TemplateNodes.clear();
+    m_TemplateLinks.clear();
+    m_Instances.clear();
+    m_Found.clear();
+    m_Overrides.clear();
+    m_DedupeStats = DedupeStats();
+    m_Collect = m_Dedupe;
+    bool measured_ok = RunPass(Pass::Measure, fill);
+    m_Collect = false;
+    if (!measured_ok)
+        return false;
+    m_DedupeStats.nodes = m_DedupeStats.stored_nodes = m_Counts.nodes;
+    m_DedupeStats.links = m_DedupeStats.stored_links = m_Counts.links;
+    if (m_Dedupe && FindRepeats()) {
+        // Measure again without the copies, they change where every string and entry lands.
+        m_Interned.clear();
+        if (!RunPass(Pass::Measure, fill) || m_AddedNodes != m_Order.size())
+            return false;
+        std::stable_sort(m_Found.begin(), m_Found.end(), [](const auto& a, const auto& b) {
+            return a.first != b.first ? a.first < b.first : a.second.node < b.second.node;
+        });
+        for (const auto& found : m_Found) {
+            InstanceEntry& instance = m_Instances[found.first];
+            if (instance.override_count++ == 0)
+                instance.first_override = (uint32_t)m_Overrides.size();
+            m_Overrides.push_back(found.second);
+        }
+        m_Found = std::vector<std::pair<uint32_t, OverrideEntry>>();
+    }
+    m_NodeIds.clear();
+    m_NodeHashes.clear();
+    m_NodeProperties.clear();
+    m_ValueHashes.clear();
+    m_NodeRecords.clear();
+    m_NodeBytes.clear();
+    m_ValueRecords.clear();
+    m_ValueBytes.clear();
+    m_PinNodes.clear();
+    m_LinkKeys.clear();
+    Counts measured = m_Counts;
+    BuildSpatialIndex();
+
+    FileHeader header = FileHeader();
+    memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.header_size = sizeof(FileHeader);
+    header.next_id = m_NextId;
+    header.journal_stamp = m_JournalStamp;
+    memcpy(header.view, m_View, sizeof(header.view));
+    header.tile_size = kTileSize;
+    uint64_t at = sizeof(FileHeader);
+    auto place = [&at](Section& section, uint64_t count, uint64_t entry_size) {
+        section.offset = at;
+        section.count = count;
+        at = align8(at + count * entry_size);
+    };
+    place(header.nodes, measured.nodes, sizeof(NodeEntry));
+    place(header.pins, measured.pins, sizeof(PinEntry));
+    place(header.properties, measured.properties, sizeof(PropertyEntry));
+    place(header.links, measured.links, sizeof(LinkEntry));
+    place(header.tiles, m_Tiles.size(), sizeof(TileEntry));
+    place(header.tile_nodes, m_TileNodes.size(), sizeof(uint32_t));
+    place(header.templates, m_Templates.size(), sizeof(TemplateEntry));
+    place(header.template_nodes, m_TemplateNodes.size(), sizeof(uint32_t));
+    place(header.template_links, m_TemplateLinks.size(), sizeof(uint32_t));
+    place(header.instances, m_Instances.size(), sizeof(InstanceEntry));
+    place(header.overrides, m_Overrides.size(), sizeof(OverrideEntry));
+    place(header.strings, measured.strings, 1);
+    header.instance_nodes = m_DedupeStats.nodes - m_DedupeStats.stored_nodes;
+    header.instance_links = m_DedupeStats.links - m_DedupeStats.stored_links;
+    header.file_size = at;
+
+    m_Sink = &sink;
+    Put(&header, sizeof(header));
+    const Pass tables[] = { Pass::Nodes, Pass::Pins, Pass::Properties, Pass::Links, Pass::Strings };
+    for (Pass pass : tables) {
+        if (pass == Pass::Strings) {
+            // The index and the instances were worked out while measuring, they go out from memory.
+            auto put = [this](const auto& table) {
+                Put(table.data(), table.size() * sizeof(table[0]));
+                Pad();
+            };
+            put(m_Tiles);
+            put(m_TileNodes);
+            put(m_Templates);
+            put(m_TemplateNodes);
+            put(m_TemplateLinks);
+            put(m_Instances);
+            put(m_Overrides);
+        }
+        if (!RunPass(pass, fill) || !(m_Counts == measured))
+            return false;
+    }
+    m_Sink = nullptr;
+    return m_Written == header.file_size && sink.Flush();
+}
+
+bool Writer::WriteFile(const char* path, const Fill& fill)
+{
+    io::FileSink file;
+    if (!file.Open(path))
+        return false;
+    bool ok = Write(file, fill);
+    return file.Close() && ok;
+}
+
+// Reader
+bool Reader::Open(const char* path, std::string* error)
+{
+    Close();
+    if (!m_File.Open(path)) {
+        if (error)
+            *error = "can't open the file";
+        return false;
+    }
+    m_Data = m_File.Data();
+    m_Size = m_File.Size();
+    if (!Validate(error)) {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+bool Reader::Open(const char* data, size_t size, std::string* error)
+{
+    Close();
+    m_Data = data;
+    m_Size = size;
+    if (!Validate(error)) {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void Reader::Close(void)
+{
+    m_File.Close();
+    m_Data = nullptr;
+    m_Size = 0;
+    m_Header = FileHeader();
+    m_Nodes = nullptr;
+    m_Pins = nullptr;
+    m_PropertyTable = nullptr;
+    m_Links = nullptr;
+    m_Tiles = nullptr;
+    m_TileNodes = nullptr;
+    m_Templates = nullptr;
+    m_TemplateNodes = nullptr;
+    m_TemplateLinks = nullptr;
+    m_Instances = nullptr;
+    m_Overrides = nullptr;
+    m_Strings = nullptr;
+}
+
+// Everything a lookup relies on is checked here once, so the accessors don't have to.
+bool Reader::Validate(std::string* error)
+{
+    auto fail = [error](const char* why) {
+        if (error)
+            *error = why;
+        return false;
+    };
+    if (m_Size < kHeaderSizeV1 || !IsBinaryProject(m_Data, m_Size))
+        return fail("not a binary casa project");
+    if (((uintptr_t)m_Data & 7) != 0)
+        return fail("project data is not 8 byte aligned");
+    const FileHeader* mapped = (const FileHeader*)m_Data;
+    if (mapped->version > kVersion)
+        return fail("the project was saved by a newer casa");
+    if (mapped->header_size < kHeaderSizeV1 || mapped->header_size > m_Size || mapped->file_size != m_Size)
+        return fail("the project file is truncated or damaged");
+    m_Header = FileHeader();
+    memcpy(&m_Header, mapped, std::min<size_t>(mapped->header_size, sizeof(FileHeader)));
+
+    auto section = [this](const Section& s, uint64_t entry_size) {
+        return (s.offset & 7) == 0 && s.offset >= m_Header.header_size && s.offset <= m_Size &&
+            s.count <= (m_Size - s.offset) / entry_size;
+    };
+    const FileHeader& h = m_Header;
+    if (!section(h.nodes, sizeof(NodeEntry)) || !section(h.pins, sizeof(PinEntry)) ||
+        !section(h.properties, sizeof(PropertyEntry)) || !section(h.links, sizeof(LinkEntry)) ||
+        !section(h.strings, 1) || h.strings.count > UINT32_MAX)
+        return fail("the project file is truncated or damaged");
+    // Older files have no index, their sections read as zero.
+    if ((h.tiles.count > 0 && !section(h.tiles, sizeof(TileEntry))) ||
+        (h.tile_nodes.count > 0 && !section(h.tile_nodes, sizeof(uint32_t))) ||
+        (h.tiles.count > 0 && !(h.tile_size > 0.0f && std::isfinite(h.tile_size))))
+        return fail("the project file is truncated or damaged");
+    if ((h.templates.count > 0 && !section(h.templates, sizeof(TemplateEntry))) ||
+        (h.template_nodes.count > 0 && !section(h.template_nodes, sizeof(uint32_t))) ||
+        (h.template_links.count > 0 && !section(h.template_links, sizeof(uint32_t))) ||
+        (h.instances.count > 0 && !section(h.instances, sizeof(InstanceEntry))) ||
+        (h.overrides.count > 0 && !section(h.overrides, sizeof(OverrideEntry))))
+        return fail("the project file is truncated or damaged");
+
+    m_Nodes = (const NodeEntry*)(m_Data + h.nodes.offset);
+    m_Pins = (const PinEntry*)(m_Data + h.pins.offset);
+    m_PropertyTable = (const PropertyEntry*)(m_Data + h.properties.offset);
+    m_Links = (const LinkEntry*)(m_Data + h.links.offset);
+    m_Tiles = (const TileEntry*)(m_Data + h.tiles.offset);
+    m_TileNodes = (const uint32_t*)(m_Data + h.tile_nodes.offset);
+    m_Templates = (const TemplateEntry*)(m_Data + h.templates.offset);
+    m_TemplateNodes = (const uint32_t*)(m_Data + h.template_nodes.offset);
+    m_TemplateLinks = (const uint32_t*)(m_Data + h.template_links.offset);
+    m_Instances = (const InstanceEntry*)(m_Data + h.instances.offset);
+    m_Overrides = (const OverrideEntry*)(m_Data + h.overrides.offset);
+    m_Strings = m_Data + h.strings.offset;
+
+    for (uint64_t n = 0; n < h.nodes.count; n++) {
+        const NodeEntry& node = m_Nodes[n];
+        if ((uint64_t)node.first_pin + node.input_count + node.output_count > h.pins.count ||
+            (uint64_t)node.first_property + node.property_count > h.properties.count)
+            return fail("a node refers past the end of the pin or property table");
+    }
+
+    // Instances follow one another in the project's order, ProjectNode() relies on it.
+    for (uint64_t t = 0; t < h.templates.count; t++) {
+        const TemplateEntry& entry = m_Templates[t];
+        if (entry.node_count == 0 || (uint64_t)entry.first_node + entry.node_count > h.template_nodes.count ||
+            (uint64_t)entry.first_link + entry.link_count > h.template_links.count)
+            return fail("a template refers past the end of its tables");
+    }
+    for (uint64_t i = 0; i < h.template_nodes.count; i++) {
+        if (m_TemplateNodes[i] >= h.nodes.count)
+            return fail("a template refers past the end of the node table");
+    }
+    for (uint64_t i = 0; i < h.template_links.count; i++) {
+        if (m_TemplateLinks[i] >= h.links.count)
+            return fail("a template refers past the end of the link table");
+    }
+    uint64_t node_at = h.nodes.count;
+    uint64_t link_at = h.links.count;
+    for (uint64_t i = 0; i < h.instances.count; i++) {
+        const InstanceEntry& instance = m_Instances[i];
+        if (instance.template_index >= h.templates.count || instance.first_node != node_at || instance.first_link != link_at ||
+            (uint64_t)instance.first_override + instance.override_count > h.overrides.count)
+            return fail("an instance is out of order or refers past the end of its tables");
+        const TemplateEntry& entry = m_Templates[instance.template_index];
+        for (uint32_t k = 0; k < instance.override_count; k++) {
+            const OverrideEntry& o = m_Overrides[instance.first_override + k];
+            if (o.node >= entry.node_count || o.property >= h.properties.count)
+                return fail("an override refers past the end of its template or the property table");
+        }
+        node_at += entry.node_count;
+        link_at += entry.link_count;
+        if (node_at > UINT32_MAX || link_at > UINT32_MAX)
+            return fail("an instance is out of order or refers past the end of its tables");
+    }
+    if (node_at - h.nodes.count != h.instance_nodes || link_at - h.links.count != h.instance_links)
+        return fail("the instances don't add up to the project's size");
+
+    for (uint64_t t = 0; t < h.tiles.count; t++) {
+        const TileEntry& tile = m_Tiles[t];
+        if ((uint64_t)tile.first + tile.count > h.tile_nodes.count)
+            return fail("a tile refers past the end of the node index");
+    }
+    for (uint64_t i = 0; i < h.tile_nodes.count; i++) {
+        if (m_TileNodes[i] >= node_at)
+            return fail("the node index refers past the end of the project's nodes");
+    }
+    return true;
+}
+
+Reader::NodeRef Reader::ProjectNode(size_t i) const
+{
+    NodeRef ref;
+    if (i < NodeCount()) {
+        ref.entry = &m_Nodes[i];
+        ref.id = ref.entry->id;
+        return ref;
+    }
+    const InstanceEntry* end = m_Instances + m_Header.instances.count;
+    const InstanceEntry* instance = std::upper_bound(m_Instances, end, (uint64_t)i,
+        [](uint64_t v, const InstanceEntry& e) { return v < e.first_node; }) - 1;
+    const TemplateEntry& t = m_Templates[instance->template_index];
+    ref.local = (uint32_t)(i - instance->first_node);
+    ref.entry = &m_Nodes[m_TemplateNodes[t.first_node + ref.local]];
+    ref.id_shift = instance->id_shift;
+    ref.id = ref.entry->id + instance->id_shift;
+    ref.offset[0] = instance->offset[0];
+    ref.offset[1] = instance->offset[1];
+    ref.instance = instance;
+    return ref;
+}
+
+LinkEntry Reader::ProjectLink(size_t i) const
+{
+    if (i < LinkCount())
+        return m_Links[i];
+    const InstanceEntry* end = m_Instances + m_Header.instances.count;
+    const InstanceEntry* instance = std::upper_bound(m_Instances, end, (uint64_t)i,
+        [](uint64_t v, const InstanceEntry& e) { return v < e.first_link; }) - 1;
+    const TemplateEntry& t = m_Templates[instance->template_index];
+    LinkEntry link = m_Links[m_TemplateLinks[t.first_link + (uint32_t)(i - instance->first_link)]];
+    link.id += instance->id_shift;
+    link.start_pin += instance->id_shift;
+    link.end_pin += instance->id_shift;
+    return link;
+}
+
+std::string_view Reader::String(StrRef s) const
+{
+    if ((uint64_t)s.offset + s.size > m_Header.strings.count)
+        return std::string_view();
+    return std::string_view(m_Strings + s.offset, s.size);
+}
+
+void Reader::ReadProperty(const PropertyEntry& e, ::Properties& out) const
+{
+    std::string key(String(e.key));
+    switch ((PropertyKind)e.kind) {
+    case PropertyKind::Bool: out.pbool[std::move(key)] = e.value.b != 0; break;
+    case PropertyKind::Int: out.pint[std::move(key)] = e.value.i; break;
+    case PropertyKind::Float: out.pfloat[std::move(key)] = e.value.f; break;
+    case PropertyKind::String: out.pstring[std::move(key)] = std::string(String(e.value.s)); break;
+    default: break; // a kind from a later version
+    }
+}
+
+void Reader::ReadProperties(const NodeEntry& node, ::Properties& out) const
+{
+    const PropertyEntry* entries = Properties(node);
+    for (uint32_t p = 0; p < node.property_count; p++)
+        ReadProperty(entries[p], out);
+}
+
+void Reader::ReadProperties(const NodeRef& node, ::Properties& out) const
+{
+    ReadProperties(*node.entry, out);
+    if (node.instance == nullptr)
+        return;
+    const OverrideEntry* overrides = Overrides(*node.instance);
+    for (uint32_t o = 0; o < node.instance->override_count; o++) {
+        if (overrides[o].node == node.local)
+            ReadProperty(m_PropertyTable[overrides[o].property], out);
+    }
+}
+
+} // end namespace csa
+} // end namespace casa
@@ -0,0 +1,358 @@
+#include "csa_journal.h"
+#include "casa_hash.h"
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <random>
+
+namespace casa {
+namespace csa {
+
+static uint64_t align8(uint64_t n)
+{
+    return (n + 7) & ~(uint64_t)7;
+}
+
+uint64_t NewJournalStamp(void)
+{
+    std::random_device device;
+    uint64_t stamp = ((uint64_t)device() << 32) ^ device();
+    stamp ^= (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count() * casa::hash::kFnvPrime;
+    return stamp == 0 ? 1 : stamp;
+}
+
+std::string JournalPath(const std::string& project_path, uint64_t stamp)
+{
+    char name[32];
+    snprintf(name, sizeof(name), ".%016" PRIx64 ".csaj", stamp);
+    return project_path + name;
+}
+
+// JournalBatch
+NodeEntry& JournalBatch::SetNode(uint64_t id)
+{
+    FinishNode();
+    m_HasNode = true;
+    m_NodeId = id;
+    m_Node = {};
+    m_Node.id = id;
+    return m_Node;
+}
+
+StrRef JournalBatch::String(std::string_view s)
+{
+    StrRef ref = {};
+    ref.offset = (uint32_t)m_Strings.size();
+    ref.size = (uint32_t)s.size();
+    m_Strings.append(s.data(), s.size());
+    return ref;
+}
+
+void JournalBatch::AddPin(uint64_t id, std::string_view name, plano::types::PinType type, plano::types::PinKind kind)
+{
+    PinEntry pin = {};
+    pin.id = id;
+    pin.name = String(name);
+    pin.type = (uint32_t)type;
+    pin.kind = (uint32_t)kind;
+    m_Pins.push_back(pin);
+    if (kind == plano::types::PinKind::Input)
+        m_Node.input_count++;
+    else
+        m_Node.output_count++;
+}
+
+void JournalBatch::AddProperties(const Properties& p)
+{
+    auto add = [this](std::string_view key, PropertyKind kind) -> PropertyEntry& {
+        PropertyEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.key = String(key);
+        entry.kind = (uint32_t)kind;
+        m_Properties.push_back(entry);
+        m_Node.property_count++;
+        return m_Properties.back();
+    };
+    for (const auto& kv : p.pbool)
+        add(kv.first, PropertyKind::Bool).value.b = kv.second ? 1 : 0;
+    for (const auto& kv : p.pint)
+        add(kv.first, PropertyKind::Int).value.i = kv.second;
+    for (const auto& kv : p.pfloat)
+        add(kv.first, PropertyKind::Float).value.f = kv.second;
+    for (const auto& kv : p.pstring) {
+        StrRef s = String(kv.second); // before add(), which hands out a reference into m_Properties
+        add(kv.first, PropertyKind::String).value.s = s;
+    }
+}
+
+void JournalBatch::EraseNode(uint64_t id)
+{
+    FinishNode();
+    PutRecord(RecordKind::EraseNode, id, nullptr, 0);
+}
+
+void JournalBatch::SetLink(const LinkEntry& link)
+{
+    FinishNode();
+    PutRecord(RecordKind::SetLink, link.id, &link, sizeof(link));
+}
+
+void JournalBatch::EraseLink(uint64_t id)
+{
+    FinishNode();
+    PutRecord(RecordKind::EraseLink, id, nullptr, 0);
+}
+
+void JournalBatch::Clear(void)
+{
+    m_Bytes.clear();
+    m_Records = 0;
+    m_NextId = 1;
+    m_HasNode = false;
+    m_Pins.clear();
+    m_Properties.clear();
+    m_Strings.clear();
+}
+
+void JournalBatch::FinishNode(void)
+{
+    if (!m_HasNode)
+        return;
+    m_HasNode = false;
+    size_t pins = m_Pins.size() * sizeof(PinEntry);
+    size_t properties = m_Properties.size() * sizeof(PropertyEntry);
+    std::vector<char> body(sizeof(NodeEntry) + pins + properties + m_Strings.size());
+    char* at = body.data();
+    memcpy(at, &m_Node, sizeof(NodeEntry));
+    at += sizeof(NodeEntry);
+    if (pins > 0)
+        memcpy(at, m_Pins.data(), pins);
+    at += pins;
+    if (properties > 0)
+        memcpy(at, m_Properties.data(), properties);
+    at += properties;
+    if (!m_Strings.empty())
+        memcpy(at, m_Strings.data(), m_Strings.size());
+    PutRecord(RecordKind::SetNode, m_NodeId, body.data(), body.size());
+    m_Pins.clear();
+    m_Properties.clear();
+    m_Strings.clear();
+}
+
+void JournalBatch::PutRecord(RecordKind kind, uint64_t id, const void* body, size_t size)
+{
+    RecordHeader header = {};
+    header.kind = (uint32_t)kind;
+    header.size = (uint32_t)align8(size);
+    header.id = id;
+    size_t at = m_Bytes.size();
+    m_Bytes.resize(at + sizeof(header) + header.size, 0);
+    memcpy(m_Bytes.data() + at, &header, sizeof(header));
+    if (size > 0)
+        memcpy(m_Bytes.data() + at + sizeof(header), body, size);
+    m_Records++;
+}
+
+// JournalWriter
+bool JournalWriter::Open(const std::string& path, uint64_t stamp)
+{
+    Close();
+    m_Path = path;
+    m_Stamp = stamp;
+    m_Seq = 0;
+    m_Size = 0;
+
+    JournalReader existing;
+    if (existing.Open(path, stamp)) {
+        uint64_t keep = existing.GoodSize();
+        m_Seq = existing.LastSeq();
+        existing.Close();
+        if (!m_File.Continue(path.c_str(), keep))
+            return false;
+        m_Size = keep;
+        return true;
+    }
+
+    JournalHeader header = {};
+    memcpy(header.magic, kJournalMagic, sizeof(kJournalMagic));
+    header.version = kJournalVersion;
+    header.stamp = stamp;
+    if (!m_File.Open(path.c_str()) || !m_File.Write(&header, sizeof(header)) || !m_File.Sync()) {
+        m_File.Close();
+        return false;
+    }
+    m_Size = sizeof(header);
+    return true;
+}
+
+void JournalWriter::Close(void)
+{
+    m_File.Close();
+}
+
+bool JournalWriter::Append(JournalBatch& batch)
+{
+    batch.FinishNode();
+    if (!m_File.IsOpen())
+        return false;
+    BatchHeader header = {};
+    header.seq = m_Seq + 1;
+    header.size = batch.m_Bytes.size();
+    header.next_id = batch.m_NextId;
+    header.checksum = casa::hash::Bytes(casa::hash::kFnvOffset, batch.m_Bytes.data(), batch.m_Bytes.size());
+    header.records = batch.m_Records;
+    bool ok = m_File.Write(&header, sizeof(header)) && m_File.Write(batch.m_Bytes.data(), batch.m_Bytes.size()) && m_File.Sync();
+    if (!ok) {
+        // Whatever made it to disk fails its checksum and is cut off the next time the journal is opened.
+        m_File.Close();
+        return false;
+    }
+    m_Seq++;
+    m_Size += sizeof(header) + batch.m_Bytes.size();
+    batch.Clear();
+    return true;
+}
+
+// JournalReader
+bool JournalReader::Open(const std::string& path, uint64_t stamp, std::string* error)
+{
+    Close();
+    auto fail = [this, error](const char* why) {
+        if (error)
+            *error = why;
+        Close();
+        return false;
+    };
+    if (!m_File.Open(path.c_str()))
+        return fail("no journal");
+    const char* data = m_File.Data();
+    uint64_t size = m_File.Size();
+    if (size < sizeof(JournalHeader) || memcmp(data, kJournalMagic, sizeof(kJournalMagic)) != 0)
+        return fail("not a casa journal");
+    if (((uintptr_t)data & 7) != 0)
+        return fail("journal data is not 8 byte aligned");
+    const JournalHeader* header = (const JournalHeader*)data;
+    if (header->version > kJournalVersion)
+        return fail("the journal was written by a newer casa");
+    if (header->stamp != stamp)
+        return fail("the journal belongs to another version of the project");
+
+    uint64_t at = sizeof(JournalHeader);
+    m_GoodSize = at;
+    uint64_t used = 0;
+    while (at < size && ReadBatch(data + at, size - at, used)) {
+        at += used;
+        m_GoodSize = at;
+    }
+    return true;
+}
+
+void JournalReader::Close(void)
+{
+    m_File.Close();
+    m_Records.clear();
+    m_Seq = 0;
+    m_NextId = 0;
+    m_GoodSize = 0;
+}
+
+// Adds the batch's records only if the whole batch checks out.
+bool JournalReader::ReadBatch(const char* at, uint64_t remaining, uint64_t& used)
+{
+    if (remaining < sizeof(BatchHeader))
+        return false;
+    const BatchHeader& batch = *(const BatchHeader*)at;
+    if (batch.seq != m_Seq + 1 || (batch.size & 7) != 0 || batch.size > remaining - sizeof(BatchHeader))
+        return false;
+    const char* records = at + sizeof(BatchHeader);
+    if (casa::hash::Bytes(casa::hash::kFnvOffset, records, (size_t)batch.size) != batch.checksum)
+        return false;
+
+    size_t first = m_Records.size();
+    uint64_t offset = 0;
+    for (uint32_t r = 0; r < batch.records; r++) {
+        if (batch.size - offset < sizeof(RecordHeader))
+            break;
+        const RecordHeader& rh = *(const RecordHeader*)(records + offset);
+        offset += sizeof(RecordHeader);
+        if ((rh.size & 7) != 0 || rh.size > batch.size - offset)
+            break;
+        const char* body = records + offset;
+        offset += rh.size;
+
+        JournalRecord record;
+        record.kind = (RecordKind)rh.kind;
+        record.id = rh.id;
+        bool good = true;
+        switch (record.kind) {
+        case RecordKind::SetNode: {
+            if (rh.size < sizeof(NodeEntry)) {
+                good = false;
+                break;
+            }
+            record.node = (const NodeEntry*)body;
+            uint64_t pins = (uint64_t)record.node->input_count + record.node->output_count;
+            uint64_t tables = sizeof(NodeEntry) + pins * sizeof(PinEntry) + (uint64_t)record.node->property_count * sizeof(PropertyEntry);
+            if (record.node->id != rh.id || tables > rh.size) {
+                good = false;
+                break;
+            }
+            record.pins = (const PinEntry*)(body + sizeof(NodeEntry));
+            record.properties = (const PropertyEntry*)(body + sizeof(NodeEntry) + pins * sizeof(PinEntry));
+            record.strings = body + tables;
+            record.strings_size = (uint32_t)(rh.size - tables);
+            break;
+        }
+        case RecordKind::SetLink:
+            good = rh.size >= sizeof(LinkEntry);
+            record.link = (const LinkEntry*)body;
+            break;
+        case RecordKind::EraseNode:
+        case RecordKind::EraseLink:
+            break;
+        default:
+            good = false;
+            break;
+        }
+        if (!good)
+            break;
+        m_Records.push_back(record);
+    }
+    if (m_Records.size() - first != batch.records || offset != batch.size) {
+        m_Records.resize(first);
+        return false;
+    }
+    m_Seq = batch.seq;
+    m_NextId = std::max(m_NextId, batch.next_id);
+    used = sizeof(BatchHeader) + batch.size;
+    return true;
+}
+
+std::string_view JournalReader::String(const JournalRecord& record, StrRef s) const
+{
+    if ((uint64_t)s.offset + s.size > record.strings_size)
+        return std::string_view();
+    return std::string_view(record.strings + s.offset, s.size);
+}
+
+void JournalReader::ReadProperties(const JournalRecord& record, ::Properties& out) const
+{
+    if (record.kind != RecordKind::SetNode)
+        return;
+    for (uint32_t p = 0; p < record.node->property_count; p++) {
+        const PropertyEntry& e = record.properties[p];
+        std::string key(String(record, e.key));
+        switch ((PropertyKind)e.kind) {
+        case PropertyKind::Bool: out.pbool[std::move(key)] = e.value.b != 0; break;
+        case PropertyKind::Int: out.pint[std::move(key)] = e.value.i; break;
+        case PropertyKind::Float: out.pfloat[std::move(key)] = e.value.f; break;
+        case PropertyKind::String: out.pstring[std::move(key)] = std::string(String(record, e.value.s)); break;
+        default: break; // a kind from a later version
+        }
+    }
+}
+
+} // end namespace csa
+} // end namespace casa
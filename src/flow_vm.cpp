@@ -0,0 +1,370 @@
+#include "flow_vm.h"
+#include <unordered_map>
+
+using plano::types::PinType;
+
+namespace casa {
+namespace flow {
+
+int Program::FindInputRegister(uintptr_t node_id, uint32_t input) const
+{
+    for (const auto& in : inputs)
+        if (in.node_id == node_id && in.input == input)
+            return (int)in.reg;
+    return -1;
+}
+
+// Compiler
+// Code is emitted one block per reachable (node, flow input) and per (node, flow output) fan-out.
+// Jump targets are label numbers while emitting, and get patched to pcs at the end.
+namespace {
+
+struct PinRef {
+    uint32_t node = 0;
+    uint32_t index = 0;
+    bool output = false;
+};
+
+class FlowCompiler {
+public:
+    FlowCompiler(const casa::bridge::GraphView& graph, Program& program) : g(graph), p(program) {}
+
+    void Compile(void)
+    {
+        p = Program();
+        IndexPins();
+
+        // Every event node's Flow outputs are entry points.
+        for (uint32_t n = 0; n < (uint32_t)g.nodes.size(); n++) {
+            if (g.nodes[n].type != "InputAction Fire")
+                continue;
+            for (uint32_t o = 0; o < g.nodes[n].output_count; o++) {
+                if (g.pins[g.nodes[n].first_output + o].type != PinType::Flow)
+                    continue;
+                Entry e;
+                e.node_id = g.nodes[n].id;
+                e.output = o;
+                e.pc = Label(n, o, true); // patched below
+                p.entries.push_back(e);
+            }
+        }
+
+        while (!worklist.empty()) {
+            uint64_t key = worklist.back();
+            worklist.pop_back();
+            uint32_t node = (uint32_t)(key >> 17);
+            uint32_t index = (uint32_t)(key & 0xffff);
+            bool output = (key >> 16) & 1;
+            label_pc[labels[key]] = (int32_t)p.code.size();
+            if (output)
+                EmitFanOut(node, index);
+            else
+                EmitInputBlock(node, index);
+        }
+
+        for (auto& in : p.code) {
+            if (in.op == Op::Jump || in.op == Op::Call)
+                in.a = label_pc[in.a];
+            else if (in.op == Op::Branch) {
+                in.b = label_pc[in.b];
+                in.c = label_pc[in.c];
+            }
+        }
+        for (auto& e : p.entries)
+            e.pc = (uint32_t)label_pc[e.pc];
+    }
+
+private:
+    void IndexPins(void)
+    {
+        for (uint32_t n = 0; n < (uint32_t)g.nodes.size(); n++) {
+            const auto& node = g.nodes[n];
+            for (uint32_t i = 0; i < node.input_count; i++)
+                pins[g.pins[node.first_input + i].id] = PinRef{ n, i, false };
+            for (uint32_t o = 0; o < node.output_count; o++)
+                pins[g.pins[node.first_output + o].id] = PinRef{ n, o, true };
+        }
+        for (const auto& link : g.links) {
+            auto from = pins.find(link.start_pin);
+            if (from == pins.end())
+                continue;
+            const auto& node = g.nodes[from->second.node];
+            if (g.pins[node.first_output + from->second.index].type == PinType::Flow)
+                flow_targets[link.start_pin].push_back(link.end_pin);
+            else
+                data_source[link.end_pin] = link.start_pin;
+        }
+    }
+
+    // Label of the block for a node's flow input (output == false) or output fan-out (output == true).
+    int32_t Label(uint32_t node, uint32_t index, bool output)
+    {
+        uint64_t key = ((uint64_t)node << 17) | ((uint64_t)output << 16) | index;
+        auto it = labels.find(key);
+        if (it != labels.end())
+            return (int32_t)it->second;
+        uint32_t label = (uint32_t)label_pc.size();
+        label_pc.push_back(-1);
+        labels[key] = label;
+        worklist.push_back(key);
+        return (int32_t)label;
+    }
+
+    void Emit(Op op, int32_t a = 0, int32_t b = 0, int32_t c = 0)
+    {
+        Instruction in;
+        in.op = op;
+        in.a = a;
+        in.b = b;
+        in.c = c;
+        p.code.push_back(in);
+    }
+
+    // Continue through one of a node's Flow outputs to everything linked to it.
+    void EmitFanOut(uint32_t node, uint32_t output)
+    {
+        uintptr_t pin = g.pins[g.nodes[node].first_output + output].id;
+        auto it = flow_targets.find(pin);
+        if (it == flow_targets.end() || it->second.empty()) {
+            Emit(Op::Halt);
+            return;
+        }
+        const auto& targets = it->second;
+        for (size_t t = 0; t < targets.size(); t++) {
+            const PinRef& target = pins[targets[t]];
+            int32_t label = Label(target.node, target.index, false);
+            Emit(t + 1 < targets.size() ? Op::Call : Op::Jump, label);
+        }
+    }
+
+    // Register for one of a node's data inputs, recording where its value comes from.
+    int32_t Register(uint32_t node, uint32_t input, Bank bank)
+    {
+        uint64_t key = ((uint64_t)node << 16) | input;
+        auto it = registers.find(key);
+        if (it != registers.end())
+            return (int32_t)it->second;
+
+        DataInput in;
+        in.node_id = g.nodes[node].id;
+        in.input = input;
+        in.bank = bank;
+        switch (bank) {
+        case Bank::Int: in.reg = p.int_registers++; break;
+        case Bank::Float: in.reg = p.float_registers++; break;
+        case Bank::String: in.reg = p.string_registers++; break;
+        }
+        uintptr_t pin = g.pins[g.nodes[node].first_input + input].id;
+        auto src = data_source.find(pin);
+        in.source_pin = src == data_source.end() ? 0 : src->second;
+        p.inputs.push_back(in);
+        registers[key] = in.reg;
+        return (int32_t)in.reg;
+    }
+
+    // Per node state that is not an input (DoN counters, timers) gets its own slot.
+    int32_t StateSlot(uint32_t node, uint32_t& bank_size)
+    {
+        auto it = state_slots.find(node);
+        if (it != state_slots.end())
+            return (int32_t)it->second;
+        uint32_t slot = bank_size++;
+        state_slots[node] = slot;
+        return (int32_t)slot;
+    }
+
+    void EmitInputBlock(uint32_t node, uint32_t input)
+    {
+        const std::string& type = g.nodes[node].type;
+        if (type == "Branch") {
+            // in: [Flow, Condition]  out: [True, False]
+            Emit(Op::Branch, Register(node, 1, Bank::Int), Label(node, 0, true), Label(node, 1, true));
+        } else if (type == "DoN") {
+            // in: [Enter, N, Reset]  out: [Exit, Counter]
+            int32_t counter = StateSlot(node, p.int_registers);
+            if (input == 2) {
+                Emit(Op::DoNReset, counter);
+                Emit(Op::Halt);
+                return;
+            }
+            Emit(Op::DoN, counter, Register(node, 1, Bank::Int));
+            EmitFanOut(node, 0);
+        } else if (type == "SetTimer") {
+            // in: [Flow, Object, Function Name, Time, Looping]  out: [Flow]
+            Emit(Op::SetTimer, StateSlot(node, p.timers), Register(node, 3, Bank::Float), Register(node, 4, Bank::Int));
+            EmitFanOut(node, 0);
+        } else if (type == "PrintString") {
+            // in: [Flow, In String]  out: [Flow]
+            Emit(Op::Print, Register(node, 1, Bank::String));
+            EmitFanOut(node, 0);
+        } else {
+            // Anything else just passes the flow through its first Flow output.
+            const auto& n = g.nodes[node];
+            for (uint32_t o = 0; o < n.output_count; o++) {
+                if (g.pins[n.first_output + o].type == PinType::Flow) {
+                    EmitFanOut(node, o);
+                    return;
+                }
+            }
+            Emit(Op::Halt);
+        }
+    }
+
+    const casa::bridge::GraphView& g;
+    Program& p;
+    std::unordered_map<uintptr_t, PinRef> pins;
+    std::unordered_map<uintptr_t, std::vector<uintptr_t>> flow_targets;  // Flow output pin -> input pins
+    std::unordered_map<uintptr_t, uintptr_t> data_source;                // data input pin -> output pin
+    std::unordered_map<uint64_t, uint32_t> labels;
+    std::unordered_map<uint64_t, uint32_t> registers;
+    std::unordered_map<uint32_t, uint32_t> state_slots;
+    std::vector<int32_t> label_pc;
+    std::vector<uint64_t> worklist;
+};
+
+} // end anonymous namespace
+
+void CompileFlow(const casa::bridge::GraphView& graph, Program& program)
+{
+    FlowCompiler compiler(graph, program);
+    compiler.Compile();
+}
+
+// Machine
+static const size_t kCallStackDepth = 256;
+
+void Machine::Load(const Program& program)
+{
+    m_Program = &program;
+    m_Ints.assign(program.int_registers, 0);
+    m_Floats.assign(program.float_registers, 0.0f);
+    m_Strings.assign(program.string_registers, std::string());
+    m_Timers.assign(program.timers, Timer());
+    m_CallStack.assign(kCallStackDepth, 0);
+    m_Bound.assign(program.inputs.size(), casa::eval::kNoSlot);
+    m_Executed = 0;
+}
+
+void Machine::Bind(const std::unordered_map<uintptr_t, casa::eval::Slot>& output_slot)
+{
+    for (size_t i = 0; i < m_Program->inputs.size(); i++) {
+        auto it = output_slot.find(m_Program->inputs[i].source_pin);
+        m_Bound[i] = it == output_slot.end() ? casa::eval::kNoSlot : it->second;
+    }
+}
+
+void Machine::RefreshInputs(const casa::eval::ValueStore& values)
+{
+    for (size_t i = 0; i < m_Bound.size(); i++) {
+        casa::eval::Slot slot = m_Bound[i];
+        if (slot == casa::eval::kNoSlot)
+            continue;
+        const DataInput& in = m_Program->inputs[i];
+        switch (in.bank) {
+        case Bank::Int: m_Ints[in.reg] = values.GetInt(slot); break; // Bool/Delegate pins read as 0/1
+        case Bank::Float: m_Floats[in.reg] = values.GetFloat(slot); break;
+        case Bank::String: m_Strings[in.reg] = values.GetString(slot); break;
+        }
+    }
+}
+
+bool Machine::Fire(uint32_t entry, uint64_t max_instructions)
+{
+    if (m_Program == nullptr || entry >= m_Program->entries.size())
+        return false;
+
+    // Locals, so the loop below runs out of registers and not through "this".
+    const Instruction* code = m_Program->code.data();
+    int32_t* ints = m_Ints.data();
+    float* floats = m_Floats.data();
+    uint32_t* stack = m_CallStack.data();
+    uint32_t sp = 0;
+    uint32_t pc = m_Program->entries[entry].pc;
+    uint64_t executed = 0;
+    bool ok = true;
+
+    for (;;) {
+        if (executed == max_instructions) {
+            ok = false;
+            break;
+        }
+        executed++;
+        const Instruction& in = code[pc];
+        switch (in.op) {
+        case Op::Halt:
+            if (sp == 0)
+                goto done;
+            pc = stack[--sp];
+            break;
+        case Op::Jump:
+            pc = (uint32_t)in.a;
+            break;
+        case Op::Call:
+            if (sp == kCallStackDepth) {
+                ok = false;
+                goto done;
+            }
+            stack[sp++] = pc + 1;
+            pc = (uint32_t)in.a;
+            break;
+        case Op::Branch:
+            pc = (uint32_t)(ints[in.a] ? in.b : in.c);
+            break;
+        case Op::DoN:
+            if (ints[in.a] < ints[in.b]) {
+                ints[in.a]++;
+                pc++;
+            } else if (sp == 0) {
+                goto done;
+            } else {
+                pc = stack[--sp];
+            }
+            break;
+        case Op::DoNReset:
+            ints[in.a] = 0;
+            pc++;
+            break;
+        case Op::SetTimer: {
+            Timer& t = m_Timers[in.a];
+            t.time = floats[in.b];
+            t.looping = ints[in.c] != 0;
+            t.armed++;
+            pc++;
+            break;
+        }
+        case Op::Print:
+            if (m_Print != nullptr)
+                m_Print(m_PrintUser, m_Strings[in.a]);
+            pc++;
+            break;
+        }
+    }
+done:
+    m_Executed += executed;
+    return ok;
+}
+
+void DrawFlowWindow(const Program& program, Machine& machine, const casa::eval::ValueStore& values, bool* open)
+{
+    if (!ImGui::Begin("Flow", open)) {
+        ImGui::End();
+        return;
+    }
+    ImGui::Text("%zu instructions, %u int / %u float / %u string registers, %u timers",
+        program.code.size(), program.int_registers, program.float_registers, program.string_registers, program.timers);
+    ImGui::Text("%llu instructions executed", (unsigned long long)machine.InstructionsExecuted());
+    for (uint32_t e = 0; e < (uint32_t)program.entries.size(); e++) {
+        ImGui::PushID((int)e);
+        if (ImGui::SmallButton("Fire")) {
+            machine.RefreshInputs(values);
+            machine.Fire(e);
+        }
+        ImGui::SameLine();
+        ImGui::Text("node %llu, %s", (unsigned long long)program.entries[e].node_id, program.entries[e].output == 0 ? "Pressed" : "Released");
+        ImGui::PopID();
+    }
+    ImGui::End();
+}
+
+} // end namespace flow
+} // end namespace casa
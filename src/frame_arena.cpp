@@ -0,0 +1,183 @@
+#include "frame_arena.h"
+#include "imgui.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#if defined(_MSC_VER)
+#include <malloc.h>
+#endif
+
+namespace casa {
+namespace mem {
+
+// Arena
+Arena::Arena(size_t chunk_size) : m_ChunkSize(chunk_size)
+{
+}
+
+void* Arena::Allocate(size_t bytes, size_t align)
+{
+    if (!m_Chunks.empty()) {
+        uintptr_t base = (uintptr_t)m_Chunks.back().get();
+        uintptr_t p = (base + m_Offset + align - 1) & ~(uintptr_t)(align - 1);
+        if (p - base + bytes <= m_ChunkSizes.back()) {
+            m_Offset = p - base + bytes;
+            return (void*)p;
+        }
+    }
+    Grow(bytes, align);
+    return Allocate(bytes, align);
+}
+
+void Arena::Grow(size_t bytes, size_t align)
+{
+    size_t size = std::max(m_ChunkSize, bytes + align);
+    m_Used += m_Offset;
+    m_Offset = 0;
+    m_Chunks.emplace_back(new char[size]);
+    m_ChunkSizes.push_back(size);
+    m_Capacity += size;
+}
+
+const char* Arena::Format(const char* fmt, ...)
+{
+    va_list args, copy;
+    va_start(args, fmt);
+
+    // Try to print straight into the rest of the chunk, only measure first when it doesn't fit.
+    size_t room = m_Chunks.empty() ? 0 : m_ChunkSizes.back() - m_Offset;
+    char* out = room ? m_Chunks.back().get() + m_Offset : nullptr;
+    va_copy(copy, args);
+    int length = vsnprintf(out, room, fmt, copy);
+    va_end(copy);
+    if (length < 0) {
+        va_end(args);
+        return "";
+    }
+    if ((size_t)length < room) {
+        m_Offset += (size_t)length + 1;
+    } else {
+        out = Allocate<char>((size_t)length + 1);
+        vsnprintf(out, (size_t)length + 1, fmt, args);
+    }
+    va_end(args);
+    return out;
+}
+
+void Arena::Reset(void)
+{
+    m_Peak = std::max(m_Peak, Used());
+    if (m_Chunks.size() > 1) {
+        // Next time it all fits in one chunk.
+        size_t size = m_Capacity;
+        m_Chunks.clear();
+        m_ChunkSizes.clear();
+        m_Chunks.emplace_back(new char[size]);
+        m_ChunkSizes.push_back(size);
+    }
+    m_Used = 0;
+    m_Offset = 0;
+}
+
+// Frame arena
+Arena& FrameArena(void)
+{
+    static Arena arena(256 * 1024);
+    return arena;
+}
+
+static std::atomic<uint64_t> heap_allocations{0};
+static std::atomic<uint64_t> heap_bytes{0};
+
+uint64_t HeapAllocations(void)
+{
+    return heap_allocations.load(std::memory_order_relaxed);
+}
+
+uint64_t HeapBytesAllocated(void)
+{
+    return heap_bytes.load(std::memory_order_relaxed);
+}
+
+static FrameMemoryStats frame_stats;
+static uint64_t frame_start_allocations = 0;
+
+void EndFrame(void)
+{
+    Arena& arena = FrameArena();
+    frame_stats.arena_used = arena.Used();
+    frame_stats.arena_capacity = arena.Capacity();
+    arena.Reset();
+
+    uint64_t now = HeapAllocations();
+    frame_stats.heap_allocations = now - frame_start_allocations;
+    if (frame_stats.frames > 0) // the first frame includes startup
+        frame_stats.peak_heap_allocations = std::max(frame_stats.peak_heap_allocations, frame_stats.heap_allocations);
+    frame_stats.frames++;
+    frame_start_allocations = now;
+}
+
+const FrameMemoryStats& FrameStats(void)
+{
+    return frame_stats;
+}
+
+void DrawMemoryWindow(bool* open)
+{
+    if (!ImGui::Begin("Memory", open)) {
+        ImGui::End();
+        return;
+    }
+    const FrameMemoryStats& st = frame_stats;
+    ImGui::Text("heap allocations last frame: %llu", (unsigned long long)st.heap_allocations);
+    ImGui::Text("peak per frame: %llu", (unsigned long long)st.peak_heap_allocations);
+    ImGui::Text("heap allocations total: %llu", (unsigned long long)HeapAllocations());
+    ImGui::Text("frame arena: %zu / %zu bytes", st.arena_used, st.arena_capacity);
+    ImGui::End();
+}
+
+} // end namespace mem
+} // end namespace casa
+
+// Global allocation counter.  Only the plain and aligned forms are replaced, the array and nothrow
+// forms all end up in these.  The sized deletes are replaced too, so they free what these allocated
+// however the compiler picks between them.
+static void* counted_alloc(size_t size)
+{
+    casa::mem::heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    casa::mem::heap_bytes.fetch_add(size, std::memory_order_relaxed);
+    void* p = malloc(size ? size : 1);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+static void* counted_aligned_alloc(size_t size, size_t align)
+{
+    casa::mem::heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    casa::mem::heap_bytes.fetch_add(size, std::memory_order_relaxed);
+#if defined(_MSC_VER)
+    void* p = _aligned_malloc(size ? size : 1, align);
+#else
+    void* p = nullptr;
+    if (posix_memalign(&p, std::max(align, sizeof(void*)), size ? size : 1) != 0)
+        p = nullptr;
+#endif
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new(size_t size) { return counted_alloc(size); }
+void operator delete(void* p) noexcept { free(p); }
+void* operator new(size_t size, std::align_val_t align) { return counted_aligned_alloc(size, (size_t)align); }
+#if defined(_MSC_VER)
+void operator delete(void* p, std::align_val_t) noexcept { _aligned_free(p); }
+#else
+void operator delete(void* p, std::align_val_t) noexcept { free(p); }
+#endif
+void operator delete(void* p, size_t) noexcept { operator delete(p); }
+void operator delete(void* p, size_t, std::align_val_t align) noexcept { operator delete(p, align); }
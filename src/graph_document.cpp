@@ -0,0 +1,284 @@
+#include "graph_document.h"
+#include "graph_eval.h"
+#include "csa_format.h"
+#include "csa_journal.h"
+#include <algorithm>
+
+namespace casa {
+namespace doc {
+
+NodeData MakeNodeData(const casa::bridge::GraphView& graph, const casa::bridge::NodeView& node)
+{
+    NodeData data;
+    data.id = node.id;
+    data.type = node.type;
+    data.inputs.reserve(node.input_count);
+    for (uint32_t i = 0; i < node.input_count; i++)
+        data.inputs.push_back(PinData{ graph.pins[node.first_input + i].id, graph.pins[node.first_input + i].type, std::string() });
+    data.outputs.reserve(node.output_count);
+    for (uint32_t o = 0; o < node.output_count; o++)
+        data.outputs.push_back(PinData{ graph.pins[node.first_output + o].id, graph.pins[node.first_output + o].type, std::string() });
+    if (node.properties)
+        data.properties = *node.properties;
+    return data;
+}
+
+void ApplyLayout(const casa::bridge::NodeLayout& layout, NodeData& node)
+{
+    node.position = layout.position;
+    node.size = layout.size;
+    node.color = layout.color;
+    node.node_type = layout.node_type;
+    node.state = layout.state;
+    node.saved_state = layout.saved_state;
+    if (layout.input_names.size() == node.inputs.size()) {
+        for (size_t i = 0; i < node.inputs.size(); i++)
+            node.inputs[i].name = layout.input_names[i];
+    }
+    if (layout.output_names.size() == node.outputs.size()) {
+        for (size_t o = 0; o < node.outputs.size(); o++)
+            node.outputs[o].name = layout.output_names[o];
+    }
+}
+
+static void set_color(float out[4], const ImVec4& color)
+{
+    out[0] = color.x;
+    out[1] = color.y;
+    out[2] = color.z;
+    out[3] = color.w;
+}
+
+// Everything but the strings, which the Writer and a JournalBatch store differently.
+static void set_entry(const NodeData& node, casa::csa::NodeEntry& entry)
+{
+    entry.id = node.id;
+    set_color(entry.color, node.color);
+    entry.position[0] = node.position.x;
+    entry.position[1] = node.position.y;
+    entry.size[0] = node.size.x;
+    entry.size[1] = node.size.y;
+    entry.node_type = node.node_type;
+}
+
+bool WriteSnapshot(const Snapshot& snapshot, casa::csa::Writer& out)
+{
+    uint64_t next_id = 1;
+    snapshot.nodes.ForEach([&](uint64_t, const NodeData& node) {
+        casa::csa::NodeEntry& entry = out.AddNode();
+        set_entry(node, entry);
+        entry.type = out.Intern(node.type);
+        entry.state = out.Append(node.state);
+        entry.saved_state = out.Append(node.saved_state);
+        next_id = std::max(next_id, (uint64_t)node.id + 1);
+        for (const auto& pin : node.inputs) {
+            out.AddPin(pin.id, pin.name, pin.type, plano::types::PinKind::Input);
+            next_id = std::max(next_id, (uint64_t)pin.id + 1);
+        }
+        for (const auto& pin : node.outputs) {
+            out.AddPin(pin.id, pin.name, pin.type, plano::types::PinKind::Output);
+            next_id = std::max(next_id, (uint64_t)pin.id + 1);
+        }
+        out.AddProperties(node.properties);
+    });
+    snapshot.links.ForEach([&](uint64_t, const LinkData& link) {
+        casa::csa::LinkEntry entry = {};
+        entry.id = link.id;
+        entry.start_pin = link.start_pin;
+        entry.end_pin = link.end_pin;
+        set_color(entry.color, link.color);
+        out.AddLink(entry);
+        next_id = std::max(next_id, (uint64_t)link.id + 1);
+    });
+    out.SetNextId(next_id);
+    return true;
+}
+
+void WriteChanges(const Snapshot& before, const Snapshot& after, casa::csa::JournalBatch& out)
+{
+    // The batch's next id only has to cover the ids it adds, the base file covers the rest.
+    uint64_t next_id = 1;
+    after.nodes.Diff(before.nodes, [&](uint64_t id, const NodeData*, const NodeData* node) {
+        next_id = std::max(next_id, id + 1);
+        if (node == nullptr) {
+            out.EraseNode(id);
+            return;
+        }
+        casa::csa::NodeEntry& entry = out.SetNode(id);
+        set_entry(*node, entry);
+        entry.type = out.String(node->type);
+        entry.state = out.String(node->state);
+        entry.saved_state = out.String(node->saved_state);
+        for (const auto& pin : node->inputs) {
+            out.AddPin(pin.id, pin.name, pin.type, plano::types::PinKind::Input);
+            next_id = std::max(next_id, (uint64_t)pin.id + 1);
+        }
+        for (const auto& pin : node->outputs) {
+            out.AddPin(pin.id, pin.name, pin.type, plano::types::PinKind::Output);
+            next_id = std::max(next_id, (uint64_t)pin.id + 1);
+        }
+        out.AddProperties(node->properties);
+    });
+    after.links.Diff(before.links, [&](uint64_t id, const LinkData*, const LinkData* link) {
+        next_id = std::max(next_id, id + 1);
+        if (link == nullptr) {
+            out.EraseLink(id);
+            return;
+        }
+        casa::csa::LinkEntry entry = {};
+        entry.id = link->id;
+        entry.start_pin = link->start_pin;
+        entry.end_pin = link->end_pin;
+        set_color(entry.color, link->color);
+        out.SetLink(entry);
+    });
+    out.SetNextId(next_id);
+}
+
+// Document
+Document::Document(void)
+{
+    casa::eval::AddEditListener(&Document::OnEdit, this);
+}
+
+Document::~Document(void)
+{
+    casa::eval::RemoveEditListener(&Document::OnEdit, this);
+}
+
+// Copy right away: by Update() the node may have moved in plano's storage, or be gone.
+void Document::OnEdit(void* user, const Properties* p)
+{
+    uintptr_t node = casa::bridge::NodeOfProperties(p);
+    if (node != 0)
+        ((Document*)user)->m_Pending[node] = *p;
+}
+
+void Document::SetNode(NodeData node)
+{
+    uintptr_t id = node.id;
+    m_Current.nodes.Set(id, std::move(node));
+    Edited();
+}
+
+bool Document::EraseNode(uintptr_t id)
+{
+    if (!m_Current.nodes.Erase(id))
+        return false;
+    Edited();
+    return true;
+}
+
+void Document::SetProperties(uintptr_t id, const Properties& p)
+{
+    const NodeData* old = m_Current.nodes.Find(id);
+    if (old == nullptr)
+        return;
+    NodeData node = *old;
+    node.properties = p;
+    casa::bridge::NodeLayout layout;
+    if (casa::bridge::CaptureNodeLayout(id, m_Index, layout))
+        ApplyLayout(layout, node); // an edit may have changed the node's state along with its properties
+    m_Current.nodes.Set(id, std::move(node));
+    Edited();
+}
+
+void Document::SetLink(const LinkData& link)
+{
+    m_Current.links.Set(link.id, link);
+    Edited();
+}
+
+bool Document::EraseLink(uintptr_t id)
+{
+    if (!m_Current.links.Erase(id))
+        return false;
+    Edited();
+    return true;
+}
+
+void Document::Update(void)
+{
+    for (const auto& kv : m_Pending)
+        SetProperties(kv.first, kv.second);
+    m_Pending.clear();
+}
+
+void Document::SyncTopology(const casa::bridge::GraphView& graph)
+{
+    casa::bridge::IndexActiveContext(m_Index);
+    std::unordered_set<uintptr_t> live;
+    live.reserve(graph.nodes.size());
+    casa::bridge::NodeLayout layout;
+    for (const auto& node : graph.nodes) {
+        live.insert(node.id);
+        if (m_Current.nodes.Find(node.id) == nullptr) {
+            NodeData data = MakeNodeData(graph, node);
+            if (casa::bridge::CaptureNodeLayout(node.id, m_Index, layout))
+                ApplyLayout(layout, data);
+            SetNode(std::move(data));
+        }
+    }
+    std::vector<uintptr_t> gone;
+    m_Current.nodes.ForEach([&](uint64_t id, const NodeData&) {
+        if (!live.count(id))
+            gone.push_back(id);
+    });
+    for (uintptr_t id : gone)
+        EraseNode(id);
+
+    live.clear();
+    gone.clear();
+    for (const auto& link : graph.links) {
+        live.insert(link.id);
+        if (m_Current.links.Find(link.id) == nullptr) {
+            LinkData data;
+            data.id = link.id;
+            data.start_pin = link.start_pin;
+            data.end_pin = link.end_pin;
+            casa::bridge::CaptureLinkColor(link.id, m_Index, data.color);
+            SetLink(data);
+        }
+    }
+    m_Current.links.ForEach([&](uint64_t id, const LinkData&) {
+        if (!live.count(id))
+            gone.push_back(id);
+    });
+    for (uintptr_t id : gone)
+        EraseLink(id);
+}
+
+void Document::SyncLayout(bool interacting)
+{
+    casa::bridge::SelectedNodes(m_Selected);
+    m_Watched.insert(m_Selected.begin(), m_Selected.end());
+    if (interacting)
+        return;
+    for (uintptr_t id : m_Watched) {
+        const NodeData* old = m_Current.nodes.Find(id);
+        ImVec2 position;
+        if (old == nullptr || !casa::bridge::NodePosition(id, position))
+            continue;
+        if (position.x == old->position.x && position.y == old->position.y)
+            continue;
+        NodeData node = *old;
+        node.position = position;
+        SetNode(std::move(node));
+    }
+    m_Watched.clear();
+    m_Watched.insert(m_Selected.begin(), m_Selected.end());
+}
+
+void Document::Clear(void)
+{
+    m_Current.nodes.Clear();
+    m_Current.links.Clear();
+    m_Pending.clear();
+    m_Index.nodes.clear();
+    m_Index.links.clear();
+    m_Watched.clear();
+    Edited();
+}
+
+} // end namespace doc
+} // end namespace casa
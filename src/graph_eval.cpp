@@ -0,0 +1,589 @@
+#include "graph_eval.h"
+#include "output_cache.h"
+#include "casa_hash.h"
+#include <algorithm>
+#include <chrono>
+
+namespace casa {
+namespace eval {
+
+// Evaluator registry
+static std::unordered_map<std::string, EvaluateFn>& evaluator_registry()
+{
+    static std::unordered_map<std::string, EvaluateFn> registry;
+    return registry;
+}
+
+void RegisterEvaluator(const std::string& type, EvaluateFn evaluate)
+{
+    evaluator_registry()[type] = evaluate;
+}
+
+EvaluateFn FindEvaluator(const std::string& type)
+{
+    auto& registry = evaluator_registry();
+    auto it = registry.find(type);
+    return it == registry.end() ? nullptr : it->second;
+}
+
+// Property edit tracking
+template<typename T>
+static uint64_t hash_property_value(uint64_t h, const T& v) { return casa::hash::Value(h, v); }
+static uint64_t hash_property_value(uint64_t h, const std::string& v) { return casa::hash::String(h, v); }
+
+template<typename Map>
+static uint64_t hash_map_entries(uint64_t kind, const Map& map)
+{
+    // Sum of mixed per-entry hashes: independent of the map's iteration order.
+    uint64_t sum = 0;
+    for (const auto& kv : map) {
+        uint64_t h = casa::hash::Value(casa::hash::kFnvOffset, kind);
+        h = casa::hash::String(h, kv.first);
+        h = hash_property_value(h, kv.second);
+        sum += casa::hash::Mix(h);
+    }
+    return sum;
+}
+
+uint64_t PropertiesHash(const Properties& p)
+{
+    uint64_t h = hash_map_entries(0, p.pint);
+    h += hash_map_entries(1, p.pfloat);
+    h += hash_map_entries(2, p.pbool);
+    h += hash_map_entries(3, p.pstring);
+    return casa::hash::Mix(h);
+}
+
+static std::vector<const Properties*> pending_edits;
+static std::vector<std::pair<EditListenerFn, void*>> edit_listeners;
+
+void MarkPropertiesDirty(const Properties* p)
+{
+    pending_edits.push_back(p);
+    for (const auto& listener : edit_listeners)
+        listener.first(listener.second, p);
+}
+
+void AddEditListener(EditListenerFn listener, void* user)
+{
+    edit_listeners.emplace_back(listener, user);
+}
+
+void RemoveEditListener(EditListenerFn listener, void* user)
+{
+    auto it = std::find(edit_listeners.begin(), edit_listeners.end(), std::make_pair(listener, user));
+    if (it != edit_listeners.end())
+        edit_listeners.erase(it);
+}
+
+void TakePendingEdits(std::vector<const Properties*>& out)
+{
+    out.insert(out.end(), pending_edits.begin(), pending_edits.end());
+    pending_edits.clear();
+}
+
+static double ms_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Compiler
+void CompilePlan(const casa::bridge::GraphView& graph, ExecutionPlan& plan)
+{
+    const uint32_t node_count = (uint32_t)graph.nodes.size();
+    plan.steps.clear();
+    plan.order.clear();
+    plan.input_slots.clear();
+    plan.output_slots.clear();
+    plan.output_slot.clear();
+    plan.node_of_properties.clear();
+    plan.downstream_offsets.assign(node_count + 1, 0);
+    plan.downstream.clear();
+    plan.step_of_node.assign(node_count, -1);
+    plan.node_count = node_count;
+    plan.cyclic_nodes = 0;
+    std::fill(plan.bank_size, plan.bank_size + kBankCount, 1); // entry 0 of each bank is the default
+
+    // Give every output pin a value slot, and remember which node owns every pin.
+    std::unordered_map<uintptr_t, uint32_t> node_of_pin;
+    std::unordered_map<uintptr_t, uint32_t> input_index; // input pin id -> index into input_slots
+    node_of_pin.reserve(graph.pins.size());
+    plan.output_slot.reserve(graph.pins.size());
+    for (uint32_t n = 0; n < node_count; n++) {
+        const auto& node = graph.nodes[n];
+        plan.node_of_properties[node.properties] = n;
+        for (uint32_t i = 0; i < node.input_count; i++) {
+            uintptr_t pin = graph.pins[node.first_input + i].id;
+            node_of_pin[pin] = n;
+            input_index[pin] = (uint32_t)plan.input_slots.size();
+            plan.input_slots.push_back(kNoSlot);
+        }
+        for (uint32_t o = 0; o < node.output_count; o++) {
+            const auto& pin = graph.pins[node.first_output + o];
+            Slot slot = AllocateSlot(plan.bank_size, pin.type);
+            node_of_pin[pin.id] = n;
+            plan.output_slot[pin.id] = slot;
+            plan.output_slots.push_back(slot);
+        }
+    }
+
+    // Wire inputs to the slots of the outputs they are linked to, and build the node level edges.
+    std::vector<uint32_t> indegree(node_count, 0);
+    std::vector<std::vector<uint32_t>> downstream(node_count);
+    for (const auto& link : graph.links) {
+        auto out = plan.output_slot.find(link.start_pin);
+        auto in = input_index.find(link.end_pin);
+        if (out == plan.output_slot.end() || in == input_index.end())
+            continue; // dangling link, plano should not produce these
+        plan.input_slots[in->second] = out->second;
+        uint32_t from = node_of_pin[link.start_pin];
+        uint32_t to = node_of_pin[link.end_pin];
+        downstream[from].push_back(to);
+        indegree[to]++;
+    }
+
+    // Kahn's algorithm.  Seeded in node order so the plan is deterministic for a given graph.
+    std::vector<uint32_t> order;
+    order.reserve(node_count);
+    for (uint32_t n = 0; n < node_count; n++)
+        if (indegree[n] == 0)
+            order.push_back(n);
+    for (size_t head = 0; head < order.size(); head++) {
+        for (uint32_t next : downstream[order[head]])
+            if (--indegree[next] == 0)
+                order.push_back(next);
+    }
+    plan.cyclic_nodes = node_count - (uint32_t)order.size();
+    plan.order = order;
+
+    // Keep the edges around in CSR form for dirty propagation.
+    for (uint32_t n = 0; n < node_count; n++)
+        plan.downstream_offsets[n + 1] = plan.downstream_offsets[n] + (uint32_t)downstream[n].size();
+    plan.downstream.reserve(plan.downstream_offsets[node_count]);
+    for (uint32_t n = 0; n < node_count; n++)
+        plan.downstream.insert(plan.downstream.end(), downstream[n].begin(), downstream[n].end());
+
+    // Flatten into steps.  Nodes without an evaluator still take part in the ordering,
+    // their outputs just keep the default value.
+    uint32_t input_base = 0, output_base = 0;
+    std::vector<uint32_t> first_input_of(node_count), first_output_of(node_count);
+    for (uint32_t n = 0; n < node_count; n++) {
+        first_input_of[n] = input_base;
+        first_output_of[n] = output_base;
+        input_base += graph.nodes[n].input_count;
+        output_base += graph.nodes[n].output_count;
+    }
+    for (uint32_t n : order) {
+        const auto& node = graph.nodes[n];
+        EvaluateFn evaluate = FindEvaluator(node.type);
+        if (evaluate == nullptr)
+            continue;
+        PlanStep step;
+        step.evaluate = evaluate;
+        step.properties = node.properties;
+        step.type_hash = casa::hash::String(casa::hash::kFnvOffset, node.type);
+        step.node = n;
+        step.first_input = first_input_of[n];
+        step.input_count = node.input_count;
+        step.first_output = first_output_of[n];
+        step.output_count = node.output_count;
+        plan.step_of_node[n] = (int32_t)plan.steps.size();
+        plan.steps.push_back(step);
+    }
+}
+
+// Engine
+// The engine with a sliced run in flight, for the progress bars drawn by TrackEdits.
+static const Engine* in_flight_engine = nullptr;
+static ProgressSourceFn progress_source = nullptr;
+static void* progress_source_user = nullptr;
+
+void SetProgressSource(ProgressSourceFn source, void* user)
+{
+    progress_source = source;
+    progress_source_user = user;
+}
+
+void DrawEvaluationProgress(const Properties* p)
+{
+    const Engine* engine = in_flight_engine;
+    float progress = 0.0f;
+    if (engine != nullptr) {
+        auto it = engine->Plan().node_of_properties.find(p);
+        if (it == engine->Plan().node_of_properties.end() || !engine->InFlight(it->second))
+            return;
+        progress = engine->Stats().progress;
+    } else if (progress_source == nullptr || !progress_source(progress_source_user, p, &progress)) {
+        return;
+    }
+    ImGui::ProgressBar(progress, ImVec2(120.0f, 0.0f), "evaluating");
+}
+
+Engine::~Engine(void)
+{
+    if (in_flight_engine == this)
+        in_flight_engine = nullptr;
+}
+
+void Engine::Update(void)
+{
+    Sync();
+    CollectEdits();
+    Run();
+}
+
+bool Engine::Sync(void)
+{
+    uint64_t stamp = casa::bridge::TopologyStamp();
+    if (stamp == m_Plan.topology)
+        return false;
+
+    if (stamp == 0) {
+        Reset();
+        return true;
+    }
+
+    casa::bridge::GraphView graph;
+    casa::bridge::CaptureActiveContext(graph);
+    Compile(std::move(graph), stamp);
+    return true;
+}
+
+void Engine::Compile(casa::bridge::GraphView graph, uint64_t topology)
+{
+    auto start = std::chrono::steady_clock::now();
+    m_Graph = std::move(graph);
+    CompilePlan(m_Graph, m_Plan);
+    m_Plan.topology = topology;
+    m_Values.Reset(m_Plan.bank_size);
+    for (uint32_t b = 0; b < kBankCount; b++)
+        m_SlotHash[b].assign(m_Plan.bank_size[b], casa::hash::kFnvOffset); // entry 0 keeps this as the "unconnected" hash
+    m_Dirty.assign(m_Plan.node_count, 0);
+    m_Pending.reset(new std::atomic<uint32_t>[m_Plan.node_count]);
+    m_InFlight = false; // the old run's cursor means nothing in the new plan
+    MarkAllDirty();
+
+    m_Stats.compiles++;
+    m_Stats.nodes = m_Plan.node_count;
+    m_Stats.steps = (uint32_t)m_Plan.steps.size();
+    m_Stats.cyclic_nodes = m_Plan.cyclic_nodes;
+    m_Stats.last_compile_ms = ms_since(start);
+}
+
+void Engine::SetWorkerCount(unsigned workers)
+{
+    if (workers <= 1)
+        m_Pool.reset();
+    else if (workers != WorkerCount())
+        m_Pool = std::make_unique<WorkStealingPool>(workers);
+    m_Arenas.resize(WorkerCount());
+    for (auto& arena : m_Arenas)
+        if (!arena)
+            arena = std::make_unique<casa::mem::Arena>();
+}
+
+void Engine::SetCache(OutputCache* cache)
+{
+    // Slot hashes are only kept up to date while a cache is attached, so start over.
+    m_Cache = cache;
+    MarkAllDirty();
+}
+
+void Engine::CollectEdits(void)
+{
+    m_Edits.clear();
+    TakePendingEdits(m_Edits);
+    for (const Properties* p : m_Edits) {
+        auto it = m_Plan.node_of_properties.find(p);
+        if (it != m_Plan.node_of_properties.end())
+            MarkDirty(it->second);
+    }
+}
+
+void Engine::MarkDirty(uint32_t node)
+{
+    // A dirty node always has a dirty cone, so we can stop at anything already marked.
+    if (node >= m_Dirty.size() || m_Dirty[node])
+        return;
+    m_Stack.clear();
+    m_Stack.push_back(node);
+    m_Dirty[node] = 1;
+    while (!m_Stack.empty()) {
+        uint32_t n = m_Stack.back();
+        m_Stack.pop_back();
+        for (uint32_t e = m_Plan.downstream_offsets[n]; e < m_Plan.downstream_offsets[n + 1]; e++) {
+            uint32_t next = m_Plan.downstream[e];
+            if (!m_Dirty[next]) {
+                m_Dirty[next] = 1;
+                m_Stack.push_back(next);
+            }
+        }
+    }
+    m_AnyDirty = true;
+
+    // The node may sit behind the cursor of a run in flight.  Skipping clean nodes is cheap,
+    // so just go back to the start.
+    if (m_InFlight) {
+        m_Cursor = 0;
+        m_Rewound = true;
+    }
+}
+
+void Engine::MarkAllDirty(void)
+{
+    std::fill(m_Dirty.begin(), m_Dirty.end(), 1);
+    m_AnyDirty = !m_Dirty.empty();
+    if (m_InFlight) {
+        m_Cursor = 0;
+        m_Rewound = true;
+    }
+}
+
+bool Engine::InFlight(uint32_t node) const
+{
+    return m_InFlight && node < m_Dirty.size() && m_Dirty[node] && m_Plan.step_of_node[node] >= 0;
+}
+
+void Engine::RunStep(const PlanStep& step, unsigned worker)
+{
+    NodeIO io;
+    io.m_Properties = step.properties;
+    io.m_Arena = m_Arenas[worker].get();
+    io.m_Store = &m_Values;
+    io.m_InputSlots = m_Plan.input_slots.data() + step.first_input;
+    io.m_OutputSlots = m_Plan.output_slots.data() + step.first_output;
+    io.m_InputCount = step.input_count;
+    io.m_OutputCount = step.output_count;
+
+    if (m_Cache == nullptr || step.output_count == 0) {
+        step.evaluate(io);
+        return;
+    }
+
+    // Cache key: type, properties, and the content hashes of everything we read.
+    uint64_t key = casa::hash::Combine(step.type_hash, PropertiesHash(*step.properties));
+    for (uint32_t i = 0; i < step.input_count; i++)
+        key = casa::hash::Combine(key, SlotHash(io.m_InputSlots[i]));
+    for (uint32_t o = 0; o < step.output_count; o++)
+        if (io.m_OutputSlots[o] != kNoSlot)
+            SlotHash(io.m_OutputSlots[o]) = casa::hash::Combine(key, o);
+
+    if (m_Cache->Lookup(key, m_Values, io.m_OutputSlots, step.output_count))
+        return;
+    step.evaluate(io);
+    m_Cache->Insert(key, m_Values, io.m_OutputSlots, step.output_count);
+}
+
+void Engine::Run(void)
+{
+    auto start = std::chrono::steady_clock::now();
+    if (!m_InFlight) {
+        StartRun();
+    } else if (m_Rewound) {
+        // Count what the edits added, so progress keeps making sense.
+        uint32_t dirty_steps = 0;
+        for (const auto& step : m_Plan.steps)
+            dirty_steps += m_Dirty[step.node];
+        m_RunSteps = m_RunDone + dirty_steps;
+        m_Rewound = false;
+    }
+
+    bool parallel = false;
+    if (m_AnyDirty) {
+        // A parallel run can't be stopped part way, so only unsliced runs use the pool.
+        parallel = m_TimeSliceMs <= 0.0 && m_Cursor == 0 && m_Pool && m_RunSteps - m_RunDone >= m_ParallelThreshold;
+        if (parallel) {
+            m_RunDone += RunParallel();
+            if (Interrupted()) {
+                // Whatever did not get to run is still marked, resume from the start.
+                m_Rewound = true;
+            } else {
+                m_Cursor = (uint32_t)m_Plan.order.size();
+            }
+        } else {
+            m_RunDone += RunSerial(start);
+        }
+    }
+    m_RunMs += ms_since(start);
+    m_RunFrames++;
+
+    if (!m_AnyDirty || m_Cursor >= m_Plan.order.size()) {
+        m_Stats.last_run_parallel = parallel;
+        FinishRun();
+    } else {
+        m_InFlight = true;
+        if (m_TimeSliceMs > 0.0)
+            in_flight_engine = this; // sliced runs are the ones on the UI thread, where TrackEdits draws
+        m_Stats.in_flight = true;
+        m_Stats.progress = m_RunSteps ? (float)m_RunDone / (float)m_RunSteps : 1.0f;
+    }
+}
+
+void Engine::StartRun(void)
+{
+    m_Cursor = 0;
+    m_Rewound = false;
+    m_RunSteps = 0;
+    m_RunDone = 0;
+    m_RunFrames = 0;
+    m_RunMs = 0.0;
+    if (m_AnyDirty)
+        for (const auto& step : m_Plan.steps)
+            m_RunSteps += m_Dirty[step.node];
+    if (m_Arenas.empty())
+        m_Arenas.push_back(std::make_unique<casa::mem::Arena>());
+    for (auto& arena : m_Arenas)
+        arena->Reset();
+}
+
+void Engine::FinishRun(void)
+{
+    // Nodes on cycles are never reached by the cursor, they are the only ones still marked.
+    std::fill(m_Dirty.begin(), m_Dirty.end(), 0);
+    m_AnyDirty = false;
+    m_InFlight = false;
+    if (in_flight_engine == this)
+        in_flight_engine = nullptr;
+
+    uint32_t skipped = (uint32_t)m_Plan.steps.size() - m_RunDone;
+    m_Stats.last_run_steps = m_RunDone;
+    m_Stats.last_skipped_steps = skipped;
+    m_Stats.last_run_frames = m_RunFrames;
+    m_Stats.total_run_steps += m_RunDone;
+    m_Stats.total_skipped_steps += skipped;
+    m_Stats.last_run_ms = m_RunMs;
+    m_Stats.in_flight = false;
+    m_Stats.progress = 1.0f;
+}
+
+uint32_t Engine::RunSerial(std::chrono::steady_clock::time_point start)
+{
+    // Walk every node, not just the steps, and clear each one as the cursor passes it.  Everything
+    // behind the cursor is then clean unless an edit marked it again, which keeps the dirty set
+    // closed downstream for MarkDirty().
+    uint32_t ran = 0;
+    const auto& order = m_Plan.order;
+    while (m_Cursor < order.size()) {
+        uint32_t node = order[m_Cursor++];
+        if (!m_Dirty[node])
+            continue;
+        m_Dirty[node] = 0;
+        int32_t step = m_Plan.step_of_node[node];
+        if (step < 0)
+            continue;
+        RunStep(m_Plan.steps[step], 0);
+        ran++;
+        if ((m_TimeSliceMs > 0.0 && ms_since(start) >= m_TimeSliceMs) || Interrupted())
+            break;
+    }
+    return ran;
+}
+
+uint32_t Engine::RunParallel(void)
+{
+    // Count, for every dirty node, how many dirty nodes feed it.  The dirty set is closed
+    // downstream, so clean nodes never wait on anything.
+    const uint32_t node_count = m_Plan.node_count;
+    for (uint32_t n = 0; n < node_count; n++)
+        m_Pending[n].store(0, std::memory_order_relaxed);
+    for (uint32_t n = 0; n < node_count; n++) {
+        if (!m_Dirty[n])
+            continue;
+        for (uint32_t e = m_Plan.downstream_offsets[n]; e < m_Plan.downstream_offsets[n + 1]; e++)
+            m_Pending[m_Plan.downstream[e]].fetch_add(1, std::memory_order_relaxed);
+    }
+    m_Ready.clear();
+    for (uint32_t n = 0; n < node_count; n++)
+        if (m_Dirty[n] && m_Pending[n].load(std::memory_order_relaxed) == 0)
+            m_Ready.push_back(n);
+
+    // Nodes on cycles never become ready, same as in the serial plan.
+    m_ParallelRan.store(0, std::memory_order_relaxed);
+    m_Pool->Run(m_Ready.data(), m_Ready.size(), RunNodeTask, this);
+    return m_ParallelRan.load(std::memory_order_relaxed);
+}
+
+void Engine::RunNodeTask(void* user, uint32_t node, unsigned worker)
+{
+    Engine& e = *(Engine*)user;
+    if (e.Interrupted())
+        return; // the node and everything downstream of it stay dirty
+    e.m_Dirty[node] = 0;
+    int32_t step = e.m_Plan.step_of_node[node];
+    if (step >= 0) {
+        e.RunStep(e.m_Plan.steps[step], worker);
+        e.m_ParallelRan.fetch_add(1, std::memory_order_relaxed);
+    }
+    // The acq_rel decrement is what orders our output writes before the downstream reads.
+    for (uint32_t i = e.m_Plan.downstream_offsets[node]; i < e.m_Plan.downstream_offsets[node + 1]; i++) {
+        uint32_t next = e.m_Plan.downstream[i];
+        if (e.m_Pending[next].fetch_sub(1, std::memory_order_acq_rel) == 1)
+            e.m_Pool->Push(worker, next);
+    }
+}
+
+void Engine::Reset(void)
+{
+    m_Graph = casa::bridge::GraphView();
+    m_Plan = ExecutionPlan();
+    m_Values.Clear();
+    for (auto& hashes : m_SlotHash)
+        hashes.clear();
+    m_Dirty.clear();
+    m_Pending.reset();
+    m_AnyDirty = false;
+    m_InFlight = false;
+    if (in_flight_engine == this)
+        in_flight_engine = nullptr;
+    uint64_t compiles = m_Stats.compiles;
+    m_Stats = EngineStats();
+    m_Stats.compiles = compiles;
+}
+
+Slot Engine::FindOutput(uintptr_t pin_id) const
+{
+    auto it = m_Plan.output_slot.find(pin_id);
+    return it == m_Plan.output_slot.end() ? kNoSlot : it->second;
+}
+
+void DrawEngineStats(const EngineStats& st, OutputCache* cache)
+{
+    ImGui::Text("nodes %u, steps %u, on cycles %u", st.nodes, st.steps, st.cyclic_nodes);
+    ImGui::Text("compiles %llu, last compile %.3f ms", (unsigned long long)st.compiles, st.last_compile_ms);
+    ImGui::Text("last run: evaluated %u, skipped %u (%.3f ms)", st.last_run_steps, st.last_skipped_steps, st.last_run_ms);
+    ImGui::Text("total: evaluated %llu, skipped %llu", (unsigned long long)st.total_run_steps, (unsigned long long)st.total_skipped_steps);
+    ImGui::Text("last run was %s, in %u slice(s)", st.last_run_parallel ? "parallel" : "serial", st.last_run_frames);
+    if (st.in_flight)
+        ImGui::ProgressBar(st.progress, ImVec2(-1.0f, 0.0f), "run in flight");
+
+    if (cache != nullptr) {
+        CacheStats cs = cache->Stats();
+        uint64_t lookups = cs.hits + cs.misses;
+        ImGui::Text("cache: %llu hits, %llu misses (%.1f%%)", (unsigned long long)cs.hits, (unsigned long long)cs.misses,
+            lookups ? 100.0 * (double)cs.hits / (double)lookups : 0.0);
+        ImGui::Text("cache: %zu entries, %.2f / %.2f MB, %llu evictions", cs.entries, cs.bytes / 1048576.0, cs.budget / 1048576.0,
+            (unsigned long long)cs.evictions);
+    }
+}
+
+void DrawStatsWindow(Engine& engine, bool* open)
+{
+    if (!ImGui::Begin("Evaluator", open)) {
+        ImGui::End();
+        return;
+    }
+    DrawEngineStats(engine.Stats(), engine.Cache());
+
+    int workers = (int)engine.WorkerCount();
+    ImGui::PushItemWidth(120);
+    if (ImGui::DragInt("workers", &workers, 0.1f, 1, 64))
+        engine.SetWorkerCount((unsigned)workers);
+    float slice = (float)engine.TimeSlice();
+    if (ImGui::DragFloat("time slice (ms, 0 = off)", &slice, 0.1f, 0.0f, 100.0f, "%.1f"))
+        engine.SetTimeSlice(slice);
+    ImGui::PopItemWidth();
+    ImGui::End();
+}
+
+} // end namespace eval
+} // end namespace casa
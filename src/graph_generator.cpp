@@ -0,0 +1,105 @@
+#include "graph_generator.h"
+#include "casa_hash.h"
+#include "property_block.h"
+#include "node_defs/casa_nodes.h"
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <map>
+
+namespace casa {
+namespace gen {
+
+// An output a later node may link to.
+struct OpenOutput {
+    uint32_t node;
+    uint32_t output;
+};
+
+void GenerateGraph(const std::vector<plano::api::NodeDescription>& types, const GraphOptions& options,
+    std::vector<casa::bridge::NewNode>& nodes, std::vector<casa::bridge::NewLink>& links)
+{
+    nodes.clear();
+    links.clear();
+    if (types.empty() || options.nodes == 0)
+        return;
+    Random random(options.seed);
+    uint32_t columns = options.columns;
+    if (columns == 0)
+        columns = (uint32_t)std::ceil(std::sqrt((double)options.nodes));
+
+    // The outputs of the last "reach" nodes, by pin type, oldest first.
+    std::map<int, std::deque<OpenOutput>> open;
+    nodes.reserve(options.nodes);
+    links.reserve(options.nodes * 3 / 2);
+    for (size_t n = 0; n < options.nodes; n++) {
+        uint32_t node = (uint32_t)n;
+        uint32_t type = n < types.size() ? node : random.Below((uint32_t)types.size());
+        const plano::api::NodeDescription& description = types[type];
+        casa::bridge::NewNode added;
+        added.description = &description;
+        added.position = ImVec2((float)(node % columns) * options.spacing[0], (float)(node / columns) * options.spacing[1]);
+        nodes.push_back(added);
+
+        for (uint32_t i = 0; i < (uint32_t)description.Inputs.size(); i++) {
+            auto candidates = open.find((int)description.Inputs[i].Type);
+            if (candidates == open.end())
+                continue;
+            std::deque<OpenOutput>& list = candidates->second;
+            while (!list.empty() && list.front().node + options.reach < node)
+                list.pop_front();
+            if (list.empty() || random.Unit() >= options.input_fill)
+                continue;
+            const OpenOutput& from = list[random.Below((uint32_t)list.size())];
+            links.push_back({ from.node, from.output, node, i });
+        }
+        for (uint32_t o = 0; o < (uint32_t)description.Outputs.size(); o++)
+            open[(int)description.Outputs[o].Type].push_back({ node, o });
+    }
+}
+
+// A value that depends on the seed, the node and the key, but not on the order the maps list
+// their keys in, which differs between standard libraries.
+static Random property_random(uint64_t seed, size_t node, const std::string& key)
+{
+    uint64_t h = casa::hash::Value(casa::hash::kFnvOffset, seed);
+    h = casa::hash::Value(h, (uint64_t)node);
+    return Random(casa::hash::String(h, key));
+}
+
+bool GenerateIntoActiveContext(const GraphOptions& options)
+{
+    std::vector<plano::api::NodeDescription> types = RegisteredNodeDescriptions();
+    std::vector<casa::bridge::NewNode> nodes;
+    std::vector<casa::bridge::NewLink> links;
+    GenerateGraph(types, options, nodes, links);
+
+    casa::bridge::LoadedGraph graph;
+    if (!casa::bridge::BuildGraph(nodes, links, graph) || !casa::bridge::InstallIntoActiveContext(graph))
+        return false;
+
+    casa::bridge::GraphView view;
+    if (!casa::bridge::CaptureActiveContext(view))
+        return false;
+    for (size_t n = 0; n < view.nodes.size(); n++) {
+        Properties& p = *view.nodes[n].properties;
+        for (auto& value : p.pfloat) {
+            Random random = property_random(options.seed, n, value.first);
+            value.second = value.second == 0.0f ? random.Unit() * 100.0f : value.second * (0.5f + random.Unit());
+        }
+        for (auto& value : p.pint) {
+            Random random = property_random(options.seed, n, value.first);
+            value.second += (int)random.Below(100);
+        }
+        for (auto& value : p.pbool) {
+            Random random = property_random(options.seed, n, value.first);
+            value.second = (random.Next() & 1) != 0;
+        }
+    }
+    // The maps were written behind the property blocks' back.
+    casa::props::ResetBlocks();
+    return true;
+}
+
+} // end namespace gen
+} // end namespace casa
@@ -0,0 +1,225 @@
+#include "incremental_save.h"
+#include "csa_format.h"
+#include "csa_compress.h"
+#include "output_sink.h"
+#include <chrono>
+#include <filesystem>
+#include <system_error>
+
+namespace casa {
+namespace doc {
+
+static void remove_quietly(const std::string& path)
+{
+    std::error_code ignored;
+    std::filesystem::remove(path, ignored);
+}
+
+IncrementalSaver::IncrementalSaver(void)
+{
+    m_Worker = std::async(std::launch::async, &IncrementalSaver::WorkerLoop, this);
+}
+
+// A compaction in progress is finished first, then thrown away: the project and its journal
+// are complete without it.
+IncrementalSaver::~IncrementalSaver(void)
+{
+    {
+        std::lock_guard<std::mutex> lk(m_Lock);
+        m_Stop = true;
+    }
+    m_Wake.notify_one();
+    m_Worker.wait();
+    if (m_Job)
+        remove_quietly(m_Job->temp);
+}
+
+// UI thread
+bool IncrementalSaver::Begin(const std::string& path, uint64_t stamp, const Snapshot& base)
+{
+    Reset();
+    auto journal = std::make_unique<casa::csa::JournalWriter>();
+    if (stamp == 0 || !journal->Open(casa::csa::JournalPath(path, stamp), stamp)) {
+        m_Status.error = "can't open the journal of " + path;
+        return false;
+    }
+    m_Path = path;
+    m_Journal = std::move(journal);
+    m_Saved = base;
+    m_CompactAt = m_Threshold;
+    m_Status.journal_bytes = m_Journal->Size();
+    return true;
+}
+
+void IncrementalSaver::Reset(void)
+{
+    m_Generation++;
+    m_Journal.reset();
+    m_Path.clear();
+    m_Saved = Snapshot();
+    m_Status = IncrementalSaveStatus();
+    {
+        // A finished compaction can go now; one still being written goes in Update() once it's done.
+        std::lock_guard<std::mutex> lk(m_Lock);
+        if (m_Job && m_Job->done) {
+            remove_quietly(m_Job->temp);
+            m_Job.reset();
+        }
+    }
+}
+
+bool IncrementalSaver::Save(const Document& document)
+{
+    if (!Ready())
+        return false;
+    Snapshot now = document.Take();
+    if (now.version == m_Saved.version)
+        return true;
+
+    auto started = std::chrono::steady_clock::now();
+    casa::csa::JournalBatch batch;
+    WriteChanges(m_Saved, now, batch);
+    uint64_t before = m_Journal->Size();
+    if (!m_Journal->Append(batch)) {
+        m_Status.error = "can't append to " + m_Journal->Path();
+        m_Journal.reset();
+        return false;
+    }
+    m_Saved = now;
+    m_Status.saves++;
+    m_Status.last_bytes = m_Journal->Size() - before;
+    m_Status.last_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+    m_Status.journal_bytes = m_Journal->Size();
+    m_Status.error.clear();
+
+    if (m_Journal->Size() >= m_CompactAt && !m_Status.compacting)
+        StartCompaction();
+    return true;
+}
+
+void IncrementalSaver::Update(void)
+{
+    std::unique_ptr<Compaction> job;
+    {
+        std::lock_guard<std::mutex> lk(m_Lock);
+        if (!m_Job || !m_Job->done)
+            return;
+        job = std::move(m_Job);
+    }
+    if (job->generation != m_Generation || !Ready()) {
+        remove_quietly(job->temp);
+        return;
+    }
+    FinishCompaction(std::move(job));
+}
+
+void IncrementalSaver::StartCompaction(void)
+{
+    auto job = std::make_unique<Compaction>();
+    job->generation = m_Generation;
+    job->snapshot = m_Saved;
+    job->stamp = casa::csa::NewJournalStamp();
+    job->temp = m_Path + ".compact.tmp";
+    job->compress = m_Compress;
+    job->dedupe = m_Dedupe;
+    {
+        std::lock_guard<std::mutex> lk(m_Lock);
+        if (m_Job)
+            return; // an abandoned one is still being written, try again on a later save
+        m_Job = std::move(job);
+    }
+    m_Status.compacting = true;
+    m_Wake.notify_one();
+}
+
+// The steps are ordered so that whichever one a crash interrupts, the project file on disk
+// names a journal that has every saved edit.
+void IncrementalSaver::FinishCompaction(std::unique_ptr<Compaction> job)
+{
+    m_Status.compacting = false;
+    // Whatever happens, don't try again before the journal has grown by another threshold.
+    m_CompactAt = m_Journal->Size() + m_Threshold;
+    if (!job->ok) {
+        m_Status.error = "can't compact: can't write " + job->temp;
+        remove_quietly(job->temp);
+        return;
+    }
+
+    // 1. The new journal, with what was saved since the worker took its snapshot.
+    std::string journal_path = casa::csa::JournalPath(m_Path, job->stamp);
+    auto journal = std::make_unique<casa::csa::JournalWriter>();
+    bool ok = journal->Open(journal_path, job->stamp);
+    if (ok && m_Saved.version != job->snapshot.version) {
+        casa::csa::JournalBatch batch;
+        WriteChanges(job->snapshot, m_Saved, batch);
+        ok = journal->Append(batch);
+    }
+    if (!ok) {
+        m_Status.error = "can't compact: can't write " + journal_path;
+        journal.reset();
+        remove_quietly(journal_path);
+        remove_quietly(job->temp);
+        return;
+    }
+
+    // 2. The new project file, which names the new journal.
+    std::error_code ec;
+    std::filesystem::rename(job->temp, m_Path, ec);
+    if (ec) {
+        m_Status.error = "can't compact: can't rename " + job->temp + ": " + ec.message();
+        journal.reset();
+        remove_quietly(journal_path);
+        remove_quietly(job->temp);
+        return;
+    }
+
+    // 3. The old journal, which nothing names anymore.
+    std::string old_path = m_Journal->Path();
+    m_Journal = std::move(journal);
+    remove_quietly(old_path);
+    m_CompactAt = m_Journal->Size() + m_Threshold;
+    m_Status.compactions++;
+    m_Status.journal_bytes = m_Journal->Size();
+    m_Status.error.clear();
+}
+
+// Worker thread
+void IncrementalSaver::WorkerLoop(void)
+{
+    for (;;) {
+        Compaction* job = nullptr;
+        {
+            std::unique_lock<std::mutex> lk(m_Lock);
+            m_Wake.wait(lk, [&] { return m_Stop || (m_Job && !m_Job->done); });
+            if (m_Stop)
+                return;
+            job = m_Job.get(); // stays put until it's done, only the UI thread takes it and only then
+        }
+
+        casa::csa::Writer writer;
+        writer.SetJournalStamp(job->stamp);
+        writer.SetDedupe(job->dedupe);
+        bool ok = false;
+        {
+            casa::io::FileSink file;
+            if (file.Open(job->temp.c_str())) {
+                auto fill = [job](casa::csa::Writer& out) { return WriteSnapshot(job->snapshot, out); };
+                if (job->compress) {
+                    casa::csa::CompressingSink blocks(file);
+                    ok = writer.Write(blocks, fill) && blocks.Finish();
+                } else {
+                    ok = writer.Write(file, fill);
+                }
+                ok = file.Sync() && ok;
+                ok = file.Close() && ok;
+            }
+        }
+
+        std::lock_guard<std::mutex> lk(m_Lock);
+        job->ok = ok;
+        job->done = true;
+    }
+}
+
+} // end namespace doc
+} // end namespace casa
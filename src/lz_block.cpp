@@ -0,0 +1,181 @@
+#include "lz_block.h"
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace casa {
+namespace lz {
+
+static const size_t kMinMatch = 4;
+static const size_t kMaxOffset = 65535;
+static const int kHashBits = 14;
+static const size_t kLastLiterals = 5;      // The end of a block is always literals...
+static const size_t kMatchLimit = 12;       // ...and no match starts this close to it.
+
+static inline uint32_t read32(const char* p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t hash4(uint32_t v)
+{
+    return (v * 2654435761u) >> (32 - kHashBits);
+}
+
+// Writes the part of a length that didn't fit its nibble.
+static inline char* put_length(char* op, size_t length)
+{
+    while (length >= 255) {
+        *op++ = (char)255;
+        length -= 255;
+    }
+    *op++ = (char)length;
+    return op;
+}
+
+size_t CompressBound(size_t size)
+{
+    return size + size / 255 + 16;
+}
+
+// Compression
+size_t Compress(const char* data, size_t size, char* out, size_t capacity)
+{
+    // Positions are kept relative to "data", 0 is a fine initial value: a candidate is always
+    // checked against the input before it is used.
+    thread_local std::vector<uint32_t> table;
+    table.assign((size_t)1 << kHashBits, 0);
+
+    char* op = out;
+    char* const op_end = out + capacity;
+    size_t anchor = 0;
+    size_t ip = 0;
+
+    auto emit = [&](size_t literals, size_t match_at, size_t offset, size_t match) -> bool {
+        // Worst case for this sequence, the token and offset included.
+        size_t need = 1 + literals + literals / 255 + 1 + 2 + match / 255 + 1;
+        if ((size_t)(op_end - op) < need)
+            return false;
+        char* token = op++;
+        uint8_t t = (uint8_t)((literals >= 15 ? 15 : literals) << 4);
+        if (literals >= 15)
+            op = put_length(op, literals - 15);
+        memcpy(op, data + match_at - literals, literals);
+        op += literals;
+        if (match > 0) {
+            *op++ = (char)(offset & 0xff);
+            *op++ = (char)(offset >> 8);
+            size_t m = match - kMinMatch;
+            t |= (uint8_t)(m >= 15 ? 15 : m);
+            if (m >= 15)
+                op = put_length(op, m - 15);
+        }
+        *token = (char)t;
+        return true;
+    };
+
+    if (size > kMatchLimit) {
+        size_t limit = size - kMatchLimit;
+        size_t match_end = size - kLastLiterals;
+        while (ip < limit) {
+            uint32_t v = read32(data + ip);
+            uint32_t h = hash4(v);
+            size_t ref = table[h];
+            table[h] = (uint32_t)ip;
+            if (ref >= ip || ip - ref > kMaxOffset || read32(data + ref) != v) {
+                // Step further the longer nothing matched, incompressible data goes by quickly.
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+            // Extend backwards into the pending literals, then forwards.
+            while (ip > anchor && ref > 0 && data[ip - 1] == data[ref - 1]) {
+                ip--;
+                ref--;
+            }
+            size_t length = kMinMatch;
+            while (ip + length < match_end && data[ip + length] == data[ref + length])
+                length++;
+            if (!emit(ip - anchor, ip, ip - ref, length))
+                return 0;
+            ip += length;
+            anchor = ip;
+            if (ip < limit)
+                table[hash4(read32(data + ip - 2))] = (uint32_t)(ip - 2);
+        }
+    }
+    if (!emit(size - anchor, size, 0, 0))
+        return 0;
+    return (size_t)(op - out);
+}
+
+// Decompression
+static inline bool get_length(const uint8_t*& ip, const uint8_t* end, size_t& length)
+{
+    uint8_t b;
+    do {
+        if (ip >= end)
+            return false;
+        b = *ip++;
+        length += b;
+    } while (b == 255);
+    return true;
+}
+
+bool Decompress(const char* data, size_t size, char* out, size_t raw_size)
+{
+    const uint8_t* ip = (const uint8_t*)data;
+    const uint8_t* const end = ip + size;
+    char* op = out;
+    char* const op_end = out + raw_size;
+
+    while (ip < end) {
+        uint8_t token = *ip++;
+        size_t literals = token >> 4;
+        if (literals == 15 && !get_length(ip, end, literals))
+            return false;
+        if (literals > (size_t)(end - ip) || literals > (size_t)(op_end - op))
+            return false;
+        if (literals <= 16 && end - ip >= 16 && op_end - op >= 16)
+            memcpy(op, ip, 16); // one fixed size copy for the common short run, the rest is overwritten
+        else
+            memcpy(op, ip, literals);
+        ip += literals;
+        op += literals;
+        if (ip == end)
+            break; // the last sequence has no match
+
+        if (end - ip < 2)
+            return false;
+        size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - out))
+            return false;
+        size_t match = token & 15;
+        if (match == 15 && !get_length(ip, end, match))
+            return false;
+        match += kMinMatch;
+        if (match > (size_t)(op_end - op))
+            return false;
+        const char* from = op - offset;
+        if (offset >= 8 && (size_t)(op_end - op) >= match + 8) {
+            // Eight bytes at a time, overshooting into room that later sequences overwrite.
+            for (size_t i = 0; i < match; i += 8)
+                memcpy(op + i, from + i, 8);
+            op += match;
+        } else if (offset >= match) {
+            memcpy(op, from, match);
+            op += match;
+        } else {
+            // Overlapping: the match repeats the last "offset" bytes.
+            for (size_t i = 0; i < match; i++)
+                op[i] = from[i];
+            op += match;
+        }
+    }
+    return op == op_end;
+}
+
+} // end namespace lz
+} // end namespace casa
@@ -43,39 +43,118 @@ std::unordered_map<GLuint, nodos_texture> texture_owner;
 // Node definitions
 #include "node_defs/casa_nodes.h"
 
+// Graph evaluation
+#include "background_eval.h"
+#include "graph_eval.h"
+#include "batch_eval.h"
+#include "output_cache.h"
+#include "flow_vm.h"
+#include "property_block.h"
+#include "frame_arena.h"
+#include "undo_history.h"
+#include "graph_document.h"
+#include "autosave.h"
+#include "incremental_save.h"
+#include "progressive_load.h"
+#include "benchmarks.h"
+#include "csa_diff.h"
+#include "texture_decode.h"
+#include <cstring>
+#include <memory>
+#include <thread>
+
 // Implement Callbacks
-ImTextureID NodosLoadTexture(const char* path)
-{   
-    // Texture metadata like height/width & layer count.
-    nodos_texture meta_tex; 
+// Textures are decoded on worker threads.  NodosLoadTexture() hands plano a texture showing a
+// placeholder right away, upload_decoded_textures() fills it in once the image is decoded.
+std::unique_ptr<casa::gfx::TextureDecoder> texture_decoder;
+const size_t texture_upload_budget = 16 * 1024 * 1024; // Bytes of pixels uploaded per frame
 
-    // Load pixel data into ram
-    unsigned char* pixels = stbi_load(path, &meta_tex.dim_x, &meta_tex.dim_y, &meta_tex.channel_count, 0);
+// Runs on the decoder's workers.  Always 4 channels, whatever the file has, so every upload is RGBA.
+static bool decode_with_stb(const char* path, casa::gfx::DecodedImage& out)
+{
+    int channel_count = 0;
+    unsigned char* pixels = stbi_load(path, &out.width, &out.height, &channel_count, 4);
     if (pixels == nullptr) {
-        exit(-1);
+        const char* reason = stbi_failure_reason();
+        out.error = std::string(path) + ": " + (reason != nullptr ? reason : "can't decode");
+        return false;
+    }
+    out.pixels.assign(pixels, pixels + (size_t)out.width * (size_t)out.height * 4);
+    stbi_image_free(pixels);
+    return true;
+}
+
+// Put RGBA8 pixels into texture "gid" and note its size for the other callbacks.
+static void upload_texture(GLuint gid, int width, int height, const unsigned char* pixels)
+{
+    glBindTexture(GL_TEXTURE_2D, gid);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    nodos_texture& meta_tex = texture_owner[gid];
+    meta_tex.dim_x = width;
+    meta_tex.dim_y = height;
+    meta_tex.channel_count = 4;
+}
+
+// What a texture shows until its image is decoded: one grey pixel.
+static void upload_placeholder_texture(GLuint gid)
+{
+    const unsigned char grey[4] = { 96, 96, 96, 255 };
+    upload_texture(gid, 1, 1, grey);
+}
+
+// What a texture shows when its image couldn't be loaded: a magenta and black checkerboard.
+static void upload_error_texture(GLuint gid)
+{
+    const int size = 16;
+    unsigned char pixels[size * size * 4];
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            unsigned char* p = &pixels[(y * size + x) * 4];
+            bool lit = ((x / 4) + (y / 4)) % 2 == 0;
+            p[0] = lit ? 255 : 0;
+            p[1] = 0;
+            p[2] = lit ? 255 : 0;
+            p[3] = 255;
+        }
+    }
+    upload_texture(gid, size, size, pixels);
+}
+
+// Once per frame, with the GL context current: upload what the workers decoded since the last
+// frame, up to "budget" bytes, the rest waits for the next frames.
+static void upload_decoded_textures(size_t budget)
+{
+    if (!texture_decoder)
+        return;
+    std::vector<casa::gfx::DecodedImage> decoded;
+    texture_decoder->TakeDecoded(budget, decoded);
+    for (const casa::gfx::DecodedImage& image : decoded) {
+        GLuint gid = (GLuint)image.handle;
+        if (image.Ok()) {
+            upload_texture(gid, image.width, image.height, image.pixels.data());
+        } else {
+            printf("Error: %s\n", image.error.c_str());
+            upload_error_texture(gid);
+        }
     }
+}
+
+ImTextureID NodosLoadTexture(const char* path)
+{   
+    if (!texture_decoder)
+        texture_decoder = std::make_unique<casa::gfx::TextureDecoder>(decode_with_stb);
 
     // Ask OpenGl to reserve a space in vram for a "texture object", and store that object's Id number into the 2nd argument.
     GLuint GlTextureId;    
     glGenTextures(1, &GlTextureId);
 
-    // Tell opengl to "plug in" the "texture object ID" into "the GL_TEXTURE_2D Slot of the state machine".
-    glBindTexture(GL_TEXTURE_2D, GlTextureId);
-    
-    // Upload pixels to GPU, construct texture object, store result in "whatever ID is plugged into the GL_TEXTURE_2D slot".  
-    int mip_map_level = 0;
-    auto channel_arrangement = GL_RGBA;
-    glTexImage2D(GL_TEXTURE_2D, 0, channel_arrangement, meta_tex.dim_x, meta_tex.dim_y, 0, channel_arrangement, GL_UNSIGNED_BYTE, pixels);
-
-    // Destroy the ram copy of pixel data, now that it is in vram.
-    stbi_image_free(pixels);
-
-    // Configure the texture properties
-    glGenerateMipmap(GL_TEXTURE_2D);
-    
-    // Store the texture metadata into a list accessed by an ID so we can service the other callbacks.
-    texture_owner[GlTextureId] = meta_tex;
-    return (ImTextureID)GlTextureId;
+    // Show the placeholder until the image is decoded, the workers take it from here.
+    upload_placeholder_texture(GlTextureId);
+    texture_decoder->Request(GlTextureId, path);
+    return (ImTextureID)(size_t)GlTextureId;
 }
 
 void NodosDestroyTexture(ImTextureID texture)
@@ -83,8 +162,12 @@ void NodosDestroyTexture(ImTextureID texture)
     //restore our GLuint from our void*
     GLuint gid = (GLuint)(size_t)texture;
 
+    // The image may still be decoding, GL hands the id out again.
+    if (texture_decoder)
+        texture_decoder->Cancel(gid);
+
     //delete the texture on the graphics card side.
-    glDeleteTextures(0, &gid);
+    glDeleteTextures(1, &gid);
 
     // destroy the nodos_texture and key-value-pair in the map
     texture_owner.erase(gid);
@@ -95,8 +178,9 @@ unsigned int NodosGetTextureWidth(ImTextureID texture)
     //restore our GLuint from our void*
     GLuint gid = (GLuint)(size_t)texture;
 
-    // use hash table to lookup the metadata
-    return texture_owner[gid].dim_x;
+    // use hash table to lookup the metadata.  find(), operator[] would insert unknown textures.
+    auto it = texture_owner.find(gid);
+    return it == texture_owner.end() ? 0 : it->second.dim_x;
 
 }
 
@@ -106,14 +190,24 @@ unsigned int NodosGetTextureHeight(ImTextureID texture)
     GLuint gid = (GLuint)(size_t)texture;
 
     // use hash table to lookup the metadata
-    return texture_owner[gid].dim_y;
+    auto it = texture_owner.find(gid);
+    return it == texture_owner.end() ? 0 : it->second.dim_y;
 }
 
 
 
 // Main 
-int main(int, char**)
+int main(int argc, char** argv)
 {
+    // Headless benchmarks:  casa --benchmark <name>
+    if (argc > 2 && strcmp(argv[1], "--benchmark") == 0)
+        return run_benchmark(argv[2]);
+    // Headless project diff and merge, see csa_diff.h
+    if (argc > 3 && strcmp(argv[1], "--diff") == 0)
+        return run_diff_command(argv[2], argv[3]);
+    if (argc > 1 && strcmp(argv[1], "--merge") == 0)
+        return run_merge_command(argc, argv);
+
     // Setup SDL
     // (Some versions of SDL before <2.0.10 appears to have performance/stalling issues on a minority of Windows systems,
     // depending on whether SDL_INIT_GAMECONTROLLER is enabled or disabled.. updating to latest version of SDL is recommended!)
@@ -208,9 +302,45 @@ int main(int, char**)
     // Variables to track sample window behaviors
     bool show_demo_window = true;
     bool show_another_window = false;
+    bool show_evaluator_stats = false;
+    bool show_memory = false;
+    bool show_flow = false;
+    bool show_sweep = false;
+    bool show_status_bar = true;
     ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
     
     plano_state_flags pstate;
+    // The output cache outlives contexts, so reloading a project reuses its old results.
+    casa::eval::OutputCache output_cache(256 * 1024 * 1024);
+    // Evaluation runs on its own thread, the frame only hands over snapshots and picks up results.
+    casa::eval::BackgroundEvaluator evaluator(std::thread::hardware_concurrency(), &output_cache);
+
+    // Flow links compile to bytecode whenever the graph is captured again.
+    casa::flow::Program flow_program;
+    casa::flow::Machine flow_machine;
+    uint64_t flow_captures = 0;
+    const void* flow_bound = nullptr;
+    flow_machine.SetPrint([](void*, const std::string& text) { printf("%s\n", text.c_str()); }, nullptr);
+    // The Sweep window keeps its last run.
+    casa::eval::SweepPanel sweep;
+
+    // Undo journal for the active graph, started over whenever a project is loaded or created.
+    casa::undo::History history;
+    uint64_t history_project = 0;
+    // casa's persistent copy of the graph, for anything that needs a snapshot to outlive the frame.
+    casa::doc::Document document;
+    // Writes snapshots of the document next to the project from a worker thread.
+    casa::doc::Autosaver autosaver;
+    std::string autosave_project = "?";
+    std::string autosave_path;
+    // Saves after the first one only append the changes to the project's journal.
+    casa::doc::IncrementalSaver incremental;
+    uint64_t incremental_stamp = 0;     // Journal the saver was started on
+    bool document_synced = false;       // The document has caught up with a freshly loaded project
+    // Large projects open around their saved view, the rest streams in over the next frames.
+    casa::doc::ProgressiveLoader progressive;
+    bool topology_streamed = false;     // Nodes streamed in since the last capture, the undo history adopts them
+    pstate.loader = &progressive;
 
     // Main draw loop
     while (!pstate.done)
@@ -232,6 +362,21 @@ int main(int, char**)
         }
         
         handle_load_save_dialogs(pstate, cbk);
+        upload_decoded_textures(texture_upload_budget);
+        if (progressive.Update() || progressive.Streaming())
+            topology_streamed = true;
+        // A full save or load names a new journal.  The document still holds the graph as it was
+        // saved, the frame hasn't edited it yet; after a load it needs a capture to catch up, and
+        // all of the project to have streamed in.
+        if (pstate.journal_stamp != incremental_stamp && pstate.project_generation == history_project && document_synced &&
+            !progressive.Streaming()) {
+            incremental_stamp = pstate.journal_stamp;
+            if (incremental_stamp != 0)
+                incremental.Begin(pstate.last_save_file_address, incremental_stamp, document.Take());
+            else
+                incremental.Reset();
+        }
+        incremental.Update();
          
         // Start the Dear ImGui frame
         ImGui_ImplOpenGL3_NewFrame();
@@ -271,8 +416,14 @@ int main(int, char**)
                 {
                     if (pstate.context_a != nullptr) {
                         if (pstate.last_save_file_address != "") {
-                            save_project_file(pstate.last_save_file_address.c_str());
-                            plano::api::ClearProjectDirtyFlag();
+                            progressive.Finish();
+                            bool appended = incremental.Ready() && incremental.Path() == pstate.last_save_file_address && incremental.Save(document);
+                            std::string error;
+                            if (appended || save_project_file(pstate.last_save_file_address.c_str(), &pstate.journal_stamp, pstate.compress_saves,
+                                    pstate.dedupe_saves, &error, &pstate.last_dedupe) == 0)
+                                plano::api::ClearProjectDirtyFlag();
+                            else
+                                pstate.file_error = "The project was not saved: " + error;
                         } else {
                             pstate.waiting_on_os_save_dialog = true;
                         }
@@ -282,6 +433,11 @@ int main(int, char**)
                     if (pstate.context_a != nullptr)
                         pstate.waiting_on_os_save_dialog = true;
                 }
+                if (ImGui::MenuItem("Compress Project Files", "", &pstate.compress_saves))
+                    incremental.SetCompress(pstate.compress_saves);
+                if (ImGui::MenuItem("Store Repeated Subgraphs Once", "", &pstate.dedupe_saves))
+                    incremental.SetDedupe(pstate.dedupe_saves);
+                ImGui::MenuItem("Progressive Loading", "", &pstate.progressive_load);
                 ImGui::Separator();
                 if (ImGui::MenuItem("Quit")) {
                     if (plano::api::IsProjectDirty())
@@ -293,10 +449,53 @@ int main(int, char**)
                 }
                 ImGui::EndMenu();
             }
+            if (ImGui::BeginMenu("Edit"))
+            {
+                if (ImGui::MenuItem("Undo", "Ctrl+Z", false, history.CanUndo()))
+                    history.Undo();
+                if (ImGui::MenuItem("Redo", "Ctrl+Y", false, history.CanRedo()))
+                    history.Redo();
+                ImGui::EndMenu();
+            }
+            if (ImGui::BeginMenu("View"))
+            {
+                ImGui::MenuItem("Evaluator Stats", "", &show_evaluator_stats);
+                ImGui::MenuItem("Memory", "", &show_memory);
+                ImGui::MenuItem("Flow", "", &show_flow);
+                ImGui::MenuItem("Sweep", "", &show_sweep);
+                ImGui::MenuItem("Status Bar", "", &show_status_bar);
+                ImGui::EndMenu();
+            }
+            if (progressive.Streaming()) {
+                const casa::doc::ProgressiveLoadStatus& loading = progressive.Status();
+                ImGui::TextDisabled("loading %zu of %zu nodes", loading.loaded_nodes, loading.node_count);
+            }
             ImGui::EndMainMenuBar();
         }
         
         handle_menu_state(pstate);
+        if (pstate.project_generation != history_project) {
+            history_project = pstate.project_generation;
+            history.Clear();
+            document.Clear();
+            autosaver.Reset();
+            incremental.Reset();
+            incremental_stamp = 0;
+            document_synced = false;
+            pstate.last_dedupe = casa::csa::DedupeStats();
+        }
+
+        // Undo shortcuts, unless a text field wants the keys for its own undo.
+        if (io.KeyCtrl && !io.WantTextInput) {
+            if (ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Z), false)) {
+                if (io.KeyShift)
+                    history.Redo();
+                else
+                    history.Undo();
+            } else if (ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Y), false)) {
+                history.Redo();
+            }
+        }
 
         // if we're in a dialog, don't let the user mess with stuff
         /*if(waiting_on_os_load_dialog || waiting_on_os_save_dialog) {
@@ -310,6 +509,73 @@ int main(int, char**)
         // 1. Show the active plano node graph window context, if it exists
         if (plano::api::GetContext() != nullptr)
             plano::api::Frame();
+        progressive.DrawStubs();
+
+        // 2. Evaluate the graph.  The plan is only recompiled when nodes or links changed,
+        // and only the nodes downstream of a property edit are re-run.
+        history.Update(ImGui::IsAnyItemActive());
+        document.Update();
+        document.SyncLayout(ImGui::IsAnyItemActive());
+        evaluator.Update();
+        const casa::eval::ResultSet& results = evaluator.Results();
+        if (show_evaluator_stats)
+            casa::eval::DrawStatsWindow(evaluator, &show_evaluator_stats);
+        if (evaluator.Captures() != flow_captures) {
+            // Nodes came or went: drop the property blocks, a new node may sit at a deleted one's address.
+            casa::props::ResetBlocks();
+            if (topology_streamed)
+                history.Adopt();
+            else
+                history.SyncTopology();
+            topology_streamed = false;
+            document.SyncTopology(evaluator.Graph());
+            document_synced = true;
+            flow_captures = evaluator.Captures();
+            casa::flow::CompileFlow(evaluator.Graph(), flow_program);
+            flow_machine.Load(flow_program);
+            flow_bound = nullptr;
+        }
+        if (results.output_slot && results.output_slot.get() != flow_bound) {
+            // Results of a new plan arrived, its value slots differ from the last one's.
+            flow_bound = results.output_slot.get();
+            flow_machine.Bind(*results.output_slot);
+        }
+        if (show_flow)
+            casa::flow::DrawFlowWindow(flow_program, flow_machine, results.values, &show_flow);
+        if (show_sweep)
+            casa::eval::DrawSweepWindow(sweep, evaluator.Graph(), &show_sweep);
+        if (show_memory)
+            casa::mem::DrawMemoryWindow(&show_memory);
+
+        // 3. Autosave.  The frame only takes a snapshot, the worker writes it.
+        if (pstate.last_save_file_address != autosave_project) {
+            autosave_project = pstate.last_save_file_address;
+            autosave_path = casa::doc::Autosaver::SidecarPath(autosave_project);
+        }
+        bool user_active = ImGui::IsAnyItemActive() || ImGui::IsMouseDown(0) || io.MouseDelta.x != 0.0f || io.MouseDelta.y != 0.0f;
+        if (plano::api::GetContext() != nullptr && !progressive.Streaming())
+            autosaver.Update(document, autosave_path, plano::api::IsProjectDirty(), user_active);
+        if (show_status_bar) {
+            // Built in the frame arena, it only has to last until the frame is presented.
+            casa::mem::Arena& arena = casa::mem::FrameArena();
+            const char* loaded_text = "";
+            const char* dedupe_text = "";
+            const casa::doc::ProgressiveLoadStatus& loaded = progressive.Status();
+            if (loaded.full_ms > 0.0) {
+                // A project that streamed in over a few frames was on screen before all of it was in.
+                if (loaded.first_frame_ms > 0.0 && loaded.first_frame_ms < loaded.full_ms)
+                    loaded_text = arena.Format("opened %zu nodes: first frame after %.0f ms, all after %.0f ms",
+                        loaded.loaded_nodes, loaded.first_frame_ms, loaded.full_ms);
+                else
+                    loaded_text = arena.Format("opened %zu nodes in %.0f ms", loaded.loaded_nodes, loaded.full_ms);
+            }
+            const casa::csa::DedupeStats& dedupe = pstate.last_dedupe;
+            if (dedupe.nodes != 0)
+                dedupe_text = arena.Format("last save stored %llu nodes as %llu (%.2fx)",
+                    (unsigned long long)dedupe.nodes, (unsigned long long)dedupe.stored_nodes, dedupe.Ratio());
+            const char* project_status = arena.Format("%s%s%s", loaded_text, loaded_text[0] && dedupe_text[0] ? "  |  " : "", dedupe_text);
+            casa::doc::DrawAutosaveStatusBar(autosaver, project_status);
+        }
         
         // Rendering 
         ImGui::Render();
@@ -318,6 +584,10 @@ int main(int, char**)
         glClear(GL_COLOR_BUFFER_BIT);
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
         SDL_GL_SwapWindow(window);
+        progressive.FrameDone();
+
+        // The frame is on screen, its temporaries can go.
+        casa::mem::EndFrame();
         
     } // End of draw loop.  Shutdown requested beyond here...
     if(pstate.context_a != nullptr)
@@ -325,6 +595,7 @@ int main(int, char**)
         plano::api::DestroyContext(pstate.context_a);
         pstate.context_a = nullptr;
     }
+    texture_decoder.reset();
         
     // Cleanup
     ImGui_ImplOpenGL3_Shutdown();
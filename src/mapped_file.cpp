@@ -0,0 +1,100 @@
+#include "mapped_file.h"
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace casa {
+namespace io {
+
+#if defined(_WIN32)
+
+bool MappedFile::Open(const char* path)
+{
+    Close();
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        return false;
+    }
+    m_File = file;
+    m_Size = (size_t)size.QuadPart;
+    m_Open = true;
+    if (m_Size == 0)
+        return true; // CreateFileMapping refuses empty files
+    m_Mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (m_Mapping != nullptr)
+        m_Data = (const char*)MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0);
+    if (m_Data == nullptr) {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void MappedFile::Close(void)
+{
+    if (m_Data != nullptr)
+        UnmapViewOfFile(m_Data);
+    if (m_Mapping != nullptr)
+        CloseHandle(m_Mapping);
+    if (m_File != nullptr)
+        CloseHandle(m_File);
+    m_Data = nullptr;
+    m_Mapping = nullptr;
+    m_File = nullptr;
+    m_Size = 0;
+    m_Open = false;
+}
+
+#else
+
+bool MappedFile::Open(const char* path)
+{
+    Close();
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+    m_Size = (size_t)st.st_size;
+    m_Open = true;
+    if (m_Size > 0) {
+        void* p = mmap(nullptr, m_Size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            close(fd);
+            m_Size = 0;
+            m_Open = false;
+            return false;
+        }
+        madvise(p, m_Size, MADV_SEQUENTIAL);
+        m_Data = (const char*)p;
+    }
+    close(fd); // the mapping keeps the file alive
+    return true;
+}
+
+void MappedFile::Close(void)
+{
+    if (m_Data != nullptr)
+        munmap((void*)m_Data, m_Size);
+    m_Data = nullptr;
+    m_Size = 0;
+    m_Open = false;
+}
+
+#endif
+
+} // end namespace io
+} // end namespace casa
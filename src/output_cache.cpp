@@ -0,0 +1,95 @@
+#include "output_cache.h"
+
+namespace casa {
+namespace eval {
+
+// Rough per-entry footprint: the values, their strings' heap buffers, the list node and the index slot.
+static size_t entry_bytes(const std::vector<PinValue>& outputs)
+{
+    size_t bytes = 64 + outputs.size() * sizeof(PinValue);
+    for (const auto& v : outputs)
+        if (v.s.capacity() > sizeof(std::string))
+            bytes += v.s.capacity();
+    return bytes;
+}
+
+OutputCache::OutputCache(size_t budget_bytes)
+{
+    m_Stats.budget = budget_bytes;
+}
+
+bool OutputCache::Lookup(uint64_t key, ValueStore& store, const Slot* slots, uint32_t output_count)
+{
+    std::lock_guard<std::mutex> lk(m_Lock);
+    auto it = m_Index.find(key);
+    if (it == m_Index.end() || it->second->outputs.size() != output_count) {
+        m_Stats.misses++;
+        return false;
+    }
+    m_Lru.splice(m_Lru.begin(), m_Lru, it->second);
+    const auto& cached = it->second->outputs;
+    for (uint32_t i = 0; i < output_count; i++)
+        store.Store(slots[i], cached[i]);
+    m_Stats.hits++;
+    return true;
+}
+
+void OutputCache::Insert(uint64_t key, const ValueStore& store, const Slot* slots, uint32_t output_count)
+{
+    std::vector<PinValue> outputs(output_count);
+    for (uint32_t i = 0; i < output_count; i++)
+        store.Load(slots[i], outputs[i]);
+    size_t bytes = entry_bytes(outputs);
+    std::lock_guard<std::mutex> lk(m_Lock);
+    if (bytes > m_Stats.budget)
+        return;
+
+    auto it = m_Index.find(key);
+    if (it != m_Index.end()) {
+        // Two workers raced on the same key, or the output count changed.  Keep the newest.
+        m_Stats.bytes -= it->second->bytes;
+        m_Lru.erase(it->second);
+        m_Index.erase(it);
+    }
+    m_Lru.push_front(Entry{ key, bytes, std::move(outputs) });
+    m_Index[key] = m_Lru.begin();
+    m_Stats.bytes += bytes;
+    EvictToBudget();
+}
+
+void OutputCache::SetBudget(size_t budget_bytes)
+{
+    std::lock_guard<std::mutex> lk(m_Lock);
+    m_Stats.budget = budget_bytes;
+    EvictToBudget();
+}
+
+void OutputCache::Clear(void)
+{
+    std::lock_guard<std::mutex> lk(m_Lock);
+    m_Lru.clear();
+    m_Index.clear();
+    m_Stats.bytes = 0;
+}
+
+CacheStats OutputCache::Stats(void) const
+{
+    std::lock_guard<std::mutex> lk(m_Lock);
+    CacheStats st = m_Stats;
+    st.entries = m_Index.size();
+    return st;
+}
+
+void OutputCache::EvictToBudget(void)
+{
+    while (m_Stats.bytes > m_Stats.budget && !m_Lru.empty()) {
+        const Entry& victim = m_Lru.back();
+        m_Stats.bytes -= victim.bytes;
+        m_Index.erase(victim.key);
+        m_Lru.pop_back();
+        m_Stats.evictions++;
+    }
+}
+
+} // end namespace eval
+} // end namespace casa
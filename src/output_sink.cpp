@@ -0,0 +1,183 @@
+#include "output_sink.h"
+#include <cstring>
+#include <fcntl.h>
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <cerrno>
+#include <unistd.h>
+#endif
+
+namespace casa {
+namespace io {
+
+// write() may take less than it was given, keep going until it took everything.
+static bool write_all(int fd, const void* data, size_t size)
+{
+    const char* at = (const char*)data;
+    while (size > 0) {
+#if defined(_WIN32)
+        unsigned int piece = size > (1u << 30) ? (1u << 30) : (unsigned int)size;
+        int written = _write(fd, at, piece);
+        if (written <= 0)
+            return false;
+#else
+        ssize_t written = write(fd, at, size);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+#endif
+        at += written;
+        size -= (size_t)written;
+    }
+    return true;
+}
+
+// FdSink
+bool FdSink::Write(const void* data, size_t size)
+{
+    if (!m_Failed && !write_all(m_Fd, data, size))
+        m_Failed = true;
+    return !m_Failed;
+}
+
+// MemorySink
+bool MemorySink::Write(const void* data, size_t size)
+{
+    if (m_Failed || size > m_Capacity - m_Size) {
+        m_Failed = true;
+        return false;
+    }
+    if (size > 0)
+        memcpy(m_Data + m_Size, data, size);
+    m_Size += size;
+    return true;
+}
+
+// BufferedSink
+BufferedSink::BufferedSink(Sink& next, size_t chunk_size)
+    : m_Next(next), m_Chunk(chunk_size > 0 ? chunk_size : 1)
+{
+}
+
+bool BufferedSink::Write(const void* data, size_t size)
+{
+    if (m_Failed)
+        return false;
+    if (m_Used + size <= m_Chunk.size()) {
+        memcpy(m_Chunk.data() + m_Used, data, size);
+        m_Used += size;
+        return true;
+    }
+    // Pieces at least a chunk long go straight through once the buffer is empty.
+    if (!Flush())
+        return false;
+    if (size >= m_Chunk.size()) {
+        m_Failed = !m_Next.Write(data, size);
+        return !m_Failed;
+    }
+    memcpy(m_Chunk.data(), data, size);
+    m_Used = size;
+    return true;
+}
+
+bool BufferedSink::Flush(void)
+{
+    if (!m_Failed && m_Used > 0)
+        m_Failed = !m_Next.Write(m_Chunk.data(), m_Used);
+    m_Used = 0;
+    if (!m_Failed)
+        m_Failed = !m_Next.Flush();
+    return !m_Failed;
+}
+
+// FileSink
+bool FileSink::Open(const char* path)
+{
+    Close();
+#if defined(_WIN32)
+    m_Fd = _open(path, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    m_Fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+    m_Used = 0;
+    m_Failed = false;
+    return m_Fd >= 0;
+}
+
+bool FileSink::Continue(const char* path, uint64_t size)
+{
+    Close();
+    m_Used = 0;
+    m_Failed = false;
+#if defined(_WIN32)
+    m_Fd = _open(path, _O_WRONLY | _O_BINARY);
+    if (m_Fd >= 0 && (_chsize_s(m_Fd, (__int64)size) != 0 || _lseeki64(m_Fd, (__int64)size, SEEK_SET) < 0))
+        Close();
+#else
+    m_Fd = open(path, O_WRONLY);
+    if (m_Fd >= 0 && (ftruncate(m_Fd, (off_t)size) != 0 || lseek(m_Fd, (off_t)size, SEEK_SET) < 0))
+        Close();
+#endif
+    return m_Fd >= 0;
+}
+
+bool FileSink::Write(const void* data, size_t size)
+{
+    if (m_Fd < 0 || m_Failed)
+        return false;
+    if (m_Used + size <= m_Chunk.size()) {
+        memcpy(m_Chunk.data() + m_Used, data, size);
+        m_Used += size;
+        return true;
+    }
+    if (!Flush())
+        return false;
+    if (size >= m_Chunk.size()) {
+        m_Failed = !write_all(m_Fd, data, size);
+        return !m_Failed;
+    }
+    memcpy(m_Chunk.data(), data, size);
+    m_Used = size;
+    return true;
+}
+
+bool FileSink::Flush(void)
+{
+    if (m_Fd < 0)
+        return false;
+    if (!m_Failed && m_Used > 0)
+        m_Failed = !write_all(m_Fd, m_Chunk.data(), m_Used);
+    m_Used = 0;
+    return !m_Failed;
+}
+
+bool FileSink::Sync(void)
+{
+    if (!Flush())
+        return false;
+#if defined(_WIN32)
+    m_Failed = _commit(m_Fd) != 0;
+#else
+    m_Failed = fsync(m_Fd) != 0;
+#endif
+    return !m_Failed;
+}
+
+bool FileSink::Close(void)
+{
+    if (m_Fd < 0)
+        return false;
+    bool ok = Flush();
+#if defined(_WIN32)
+    ok = _close(m_Fd) == 0 && ok;
+#else
+    ok = close(m_Fd) == 0 && ok;
+#endif
+    m_Fd = -1;
+    return ok;
+}
+
+} // end namespace io
+} // end namespace casa
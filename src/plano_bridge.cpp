@@ -0,0 +1,823 @@
+#include "plano_bridge.h"
+#include "casa_hash.h"
+#include "csa_format.h"
+#include "csa_journal.h"
+#include "work_stealing_pool.h"
+#include <algorithm>
+#include <cfloat>
+#include <thread>
+#include <unordered_set>
+#include "internal/internal.h" // plano's node and link storage
+
+namespace casa {
+namespace bridge {
+
+static void CapturePins(const std::vector<plano::types::Pin>& pins, GraphView& out)
+{
+    for (const auto& pin : pins) {
+        PinView pv;
+        pv.id = pin.ID.Get();
+        pv.type = pin.Type;
+        out.pins.push_back(pv);
+    }
+}
+
+bool CaptureActiveContext(GraphView& out)
+{
+    out.nodes.clear();
+    out.pins.clear();
+    out.links.clear();
+
+    plano::types::ContextData* ctx = plano::api::GetContext();
+    if (ctx == nullptr)
+        return false;
+
+    out.nodes.reserve(ctx->s_Nodes.size());
+    out.links.reserve(ctx->s_Links.size());
+    for (auto& node : ctx->s_Nodes) {
+        NodeView nv;
+        nv.id = node.ID.Get();
+        nv.type = node.Name;
+        nv.properties = &node.Properties;
+        nv.first_input = (uint32_t)out.pins.size();
+        nv.input_count = (uint32_t)node.Inputs.size();
+        CapturePins(node.Inputs, out);
+        nv.first_output = (uint32_t)out.pins.size();
+        nv.output_count = (uint32_t)node.Outputs.size();
+        CapturePins(node.Outputs, out);
+        out.nodes.push_back(nv);
+    }
+
+    for (const auto& link : ctx->s_Links) {
+        LinkView lv;
+        lv.start_pin = link.StartPinID.Get();
+        lv.end_pin = link.EndPinID.Get();
+        lv.id = link.ID.Get();
+        out.links.push_back(lv);
+    }
+    return true;
+}
+
+uint64_t TopologyStamp(void)
+{
+    plano::types::ContextData* ctx = plano::api::GetContext();
+    if (ctx == nullptr)
+        return 0;
+
+    // The context and node storage addresses are part of the stamp: the plan holds
+    // Properties pointers into s_Nodes, so a reallocation must look like a new topology.
+    uint64_t h = casa::hash::kFnvOffset;
+    h = casa::hash::Value(h, (uintptr_t)ctx);
+    h = casa::hash::Value(h, (uintptr_t)ctx->s_Nodes.data());
+    for (const auto& node : ctx->s_Nodes) {
+        h = casa::hash::Value(h, node.ID.Get());
+        for (const auto& pin : node.Inputs)
+            h = casa::hash::Value(h, pin.ID.Get());
+        for (const auto& pin : node.Outputs)
+            h = casa::hash::Value(h, pin.ID.Get());
+    }
+    for (const auto& link : ctx->s_Links) {
+        h = casa::hash::Value(h, link.StartPinID.Get());
+        h = casa::hash::Value(h, link.EndPinID.Get());
+    }
+    // Never hand out 0, that means "no context".
+    return h == 0 ? 1 : h;
+}
+
+// Storage edits
+void IndexActiveContext(ContextIndex& index)
+{
+    index.nodes.clear();
+    index.links.clear();
+    plano::types::ContextData* ctx = plano::api::GetContext();
+    if (ctx == nullptr)
+        return;
+    for (uint32_t n = 0; n < (uint32_t)ctx->s_Nodes.size(); n++)
+        index.nodes[ctx->s_Nodes[n].ID.Get()] = n;
+    for (uint32_t l = 0; l < (uint32_t)ctx->s_Links.size(); l++)
+        index.links[ctx->s_Links[l].ID.Get()] = l;
+}
+
+// Pins point back at the node that owns them, and nodes move when the vector does.
+static void FixPinOwners(plano::types::Node& node)
+{
+    for (auto& pin : node.Inputs)
+        pin.Node = &node;
+    for (auto& pin : node.Outputs)
+        pin.Node = &node;
+}
+
+bool CopyNode(uintptr_t id, const ContextIndex& index, NodeRecord& out)
+{
+    plano::types::ContextData* ctx = plano::api::GetContext();
+    auto it = index.nodes.find(id);
+    if (ctx == nullptr || it == index.nodes.end())
+        return false;
+    out.id = id;
+    out.node = std::make_shared<plano::types::Node>(ctx->s_Nodes[it->second]);
+    ax::NodeEditor::SetCurrentEditor(ctx->m_Editor);
+    out.position = ax::NodeEditor::GetNodePosition(id);
+    return true;
+}
+
+bool InsertNode(const NodeRecord& record, ContextIndex& index)
+{
+    plano::types::ContextData* ctx = plano::api::GetContext();
+    if (ctx == nullptr || !record.node || index.nodes.count(record.id))
+        return false;
+    const plano::types::Node* storage = ctx->s_Nodes.data();
+    ctx->s_Nodes.push_back(*record.node);
+    if (ctx->s_Nodes.data() != storage) {
+        for (auto& node : ctx->s_Nodes)
+            FixPinOwners(node);
+    } else {
+        FixPinOwners(ctx->s_Nodes.back());
+    }
+    index.nodes[record.id] = (uint32_t)ctx->s_Nodes.size() - 1;
+    ctx->s_Dirty = true;
+    ax::NodeEditor::SetCurrentEditor(ctx->m_Editor);
+    ax::NodeEditor::SetNodePosition(record.id, record.position);
+    return true;
+}
+
+bool RemoveNode(uintptr_t id, ContextIndex& index)
+{
+    plano::types::ContextData* ctx = plano::api::GetContext();
+    auto it = index.nodes.find(id);
+    if (ctx == nullptr || it == index.nodes.end())
+        return false;
+    uint32_t at = it->second;
+    uint32_t last = (uint32_t)ctx->s_Nodes.size() - 1;
+    index.nodes.erase(it);
+    if (at != last) {
+        ctx->s_Nodes[at] = std::move(ctx->s_Nodes[last]);
+        FixPinOwners(ctx->s_Nodes[at]);
+        index.nodes[ctx->s_Nodes[at].ID.Get()] = at;
+    }
+    ctx->s_Nodes.pop_back();
+    ctx->s_Dirty = true;
+    return true;
+}
+
+bool CopyLink(uintptr_t id, const ContextIndex& index, LinkRecord& out)
+{
+    plano::types::ContextData* ctx = plano::api::GetContext();
+    auto it = index.links.find(id);
+    if (ctx == nullptr || it == index.links.end())
+        return false;
+    out.id = id;
+    out.link = std::make_shared<plano::types::Link>(ctx->s_Links[it->second]);
+    return true;
+}
+
+bool InsertLink(const LinkRecord& record, ContextIndex& index)
+{
+    plano::types::ContextData* ctx = plano::api::GetContext();
+    if (ctx == nullptr || !record.link || index.links.count(record.id))
+        return false;
+    ctx->s_Links.push_back(*record.link);
+    index.links[record.id] = (uint32_t)ctx->s_Links.size() - 1;
+    ctx->s_Dirty = true;
+    return true;
+}
+
+bool RemoveLink(uintptr_t id, ContextIndex& index)
+{
+    plano::types::ContextData* ctx = plano::api::GetContext();
+    auto it = index.links.find(id);
+    if (ctx == nullptr || it == index.links.end())
+        return false;
+    uint32_t at = it->second;
+    uint32_t last = (uint32_t)ctx->s_Links.size() - 1;
+    index.links.erase(it);
+    if (at != last) {
+        ctx->s_Links[at] = ctx->s_Links[last];
+        index.links[ctx->s_Links[at].ID.Get()] = at;
+    }
+    ctx->s_Links.pop_back();
+    ctx->s_Dirty = true;
+    return true;
+}
+
+Properties* FindProperties(uintptr_t id, const ContextIndex& index)
+{
+    plano::types::ContextData* ctx = plano::api::GetContext();
+    auto it = index.nodes.find(id);
+    if (ctx == nullptr || it == index.nodes.end())
+        return nullptr;
+    if (it->second >= ctx->s_Nodes.size() || ctx->s_Nodes[it->second].ID.Get() != id)
+        return nullptr;
+    return &ctx->s_Nodes[it->second].Properties;
+}
+
+uintptr_t NodeOfProperties(const Properties* p)
+{
+    plano::types::ContextData* ctx = plano::api::GetContext();
+    if (ctx == nullptr || ctx->s_Nodes.empty())
+        return 0;
+    const char* first = (const char*)&ctx->s_Nodes.front().Properties;
+    const char* at = (const char*)p;
+    if (at < first)
+        return 0;
+    size_t n = (size_t)(at - first) / sizeof(plano::types::Node);
+    if (n >= ctx->s_Nodes.size() || &ctx->s_Nodes[n].Properties != p)
+        return 0;
+    return ctx->s_Nodes[n].ID.Get();
+}
+
+Properties& RecordProperties(NodeRecord& record)
+{
+    if (record.node.use_count() > 1)
+        record.node = std::make_shared<plano::types::Node>(*record.node);
+    return record.node->Properties;
+}
+
+const Properties& RecordProperties(const NodeRecord& record)
+{
+    return record.node->Properties;
+}
+
+template<typename Map>
+static size_t map_bytes(const Map& map)
+{
+    size_t bytes = 0;
+    for (const auto& kv : map)
+        bytes += sizeof(kv) + kv.first.capacity() + 16; // key, value and a hash node's overhead
+    return bytes;
+}
+
+size_t RecordBytes(const NodeRecord& record)
+{
+    if (!record.node)
+        return sizeof(record);
+    const plano::types::Node& node = *record.node;
+    size_t bytes = sizeof(record) + sizeof(node) + node.Name.capacity() + node.State.capacity() + node.SavedState.capacity();
+    for (const auto& pin : node.Inputs)
+        bytes += sizeof(pin) + pin.Name.capacity();
+    for (const auto& pin : node.Outputs)
+        bytes += sizeof(pin) + pin.Name.capacity();
+    const Properties& p = node.Properties;
+    bytes += map_bytes(p.pbool) + map_bytes(p.pint) + map_bytes(p.pfloat) + map_bytes(p.pstring);
+    for (const auto& kv : p.pstring)
+        bytes += kv.second.capacity();
+    return bytes;
+}
+
+size_t RecordBytes(const LinkRecord& record)
+{
+    return sizeof(record) + (record.link ? sizeof(plano::types::Link) : 0);
+}
+
+void MarkActiveContextDirty(void)
+{
+    plano::types::ContextData* ctx = plano::api::GetContext();
+    if (ctx != nullptr)
+        ctx->s_Dirty = true;
+}
+
+bool CaptureNodeLayout(uintptr_t id, const ContextIndex& index, NodeLayout& out)
+{
+    plano::types::ContextData* ctx = plano::api::GetContext();
+    auto it = index.nodes.find(id);
+    if (ctx == nullptr || it == index.nodes.end() || it->second >= ctx->s_Nodes.size())
+        return false;
+    const plano::types::Node& node = ctx->s_Nodes[it->second];
+    if (node.ID.Get() != id)
+        return false;
+    ax::NodeEditor::SetCurrentEditor(ctx->m_Editor);
+    out.position = ax::NodeEditor::GetNodePosition(node.ID);
+    out.size = node.Size;
+    out.color = node.Color.Value;
+    out.node_type = (uint32_t)node.Type;
+    out.state = node.State;
+    out.saved_state = node.SavedState;
+    out.input_names.clear();
+    for (const auto& pin : node.Inputs)
+        out.input_names.push_back(pin.Name);
+    out.output_names.clear();
+    for (const auto& pin : node.Outputs)
+        out.output_names.push_back(pin.Name);
+    return true;
+}
+
+bool CaptureLinkColor(uintptr_t id, const ContextIndex& index, ImVec4& out)
+{
+    plano::types::ContextData* ctx = plano::api::GetContext();
+    auto it = index.links.find(id);
+    if (ctx == nullptr || it == index.links.end() || it->second >= ctx->s_Links.size() ||
+        ctx->s_Links[it->second].ID.Get() != id)
+        return false;
+    out = ctx->s_Links[it->second].Color.Value;
+    return true;
+}
+
+bool NodePosition(uintptr_t id, ImVec2& out)
+{
+    plano::types::ContextData* ctx = plano::api::GetContext();
+    if (ctx == nullptr)
+        return false;
+    ax::NodeEditor::SetCurrentEditor(ctx->m_Editor);
+    out = ax::NodeEditor::GetNodePosition(id);
+    return true;
+}
+
+void SelectedNodes(std::vector<uintptr_t>& out)
+{
+    out.clear();
+    plano::types::ContextData* ctx = plano::api::GetContext();
+    if (ctx == nullptr)
+        return;
+    ax::NodeEditor::SetCurrentEditor(ctx->m_Editor);
+    int count = ax::NodeEditor::GetSelectedObjectCount();
+    if (count <= 0)
+        return;
+    std::vector<ax::NodeEditor::NodeId> ids((size_t)count);
+    ids.resize((size_t)std::max(ax::NodeEditor::GetSelectedNodes(ids.data(), count), 0));
+    out.reserve(ids.size());
+    for (const auto& id : ids)
+        out.push_back(id.Get());
+}
+
+// Project files
+bool WriteActiveContext(casa::csa::Writer& out)
+{
+    plano::types::ContextData* ctx = plano::api::GetContext();
+    if (ctx == nullptr)
+        return false;
+    ax::NodeEditor::SetCurrentEditor(ctx->m_Editor);
+
+    uint64_t next_id = (uint64_t)std::max(ctx->s_NextId, 1);
+    for (const auto& node : ctx->s_Nodes) {
+        casa::csa::NodeEntry& entry = out.AddNode();
+        entry.id = node.ID.Get();
+        entry.type = out.Intern(node.Name);
+        entry.state = out.Append(node.State);
+        entry.saved_state = out.Append(node.SavedState);
+        const ImVec4& color = node.Color.Value;
+        entry.color[0] = color.x;
+        entry.color[1] = color.y;
+        entry.color[2] = color.z;
+        entry.color[3] = color.w;
+        ImVec2 position = ax::NodeEditor::GetNodePosition(node.ID);
+        entry.position[0] = position.x;
+        entry.position[1] = position.y;
+        entry.size[0] = node.Size.x;
+        entry.size[1] = node.Size.y;
+        entry.node_type = (uint32_t)node.Type;
+        next_id = std::max(next_id, (uint64_t)entry.id + 1);
+        for (const auto& pin : node.Inputs)
+            out.AddPin(pin.ID.Get(), pin.Name, pin.Type, plano::types::PinKind::Input);
+        for (const auto& pin : node.Outputs)
+            out.AddPin(pin.ID.Get(), pin.Name, pin.Type, plano::types::PinKind::Output);
+        out.AddProperties(node.Properties);
+    }
+    for (const auto& link : ctx->s_Links) {
+        casa::csa::LinkEntry entry = {};
+        entry.id = link.ID.Get();
+        entry.start_pin = link.StartPinID.Get();
+        entry.end_pin = link.EndPinID.Get();
+        const ImVec4& color = link.Color.Value;
+        entry.color[0] = color.x;
+        entry.color[1] = color.y;
+        entry.color[2] = color.z;
+        entry.color[3] = color.w;
+        out.AddLink(entry);
+    }
+    out.SetNextId(next_id);
+    // The whole display, a little more than the editor's window, is what a progressive load
+    // brings in first.
+    ImVec2 view_min = ax::NodeEditor::ScreenToCanvas(ImVec2(0.0f, 0.0f));
+    ImVec2 view_max = ax::NodeEditor::ScreenToCanvas(ImGui::GetIO().DisplaySize);
+    out.SetView(view_min.x, view_min.y, view_max.x, view_max.y);
+    return true;
+}
+
+// Fill "node" from a table entry, "text" turns the entry's StrRefs into strings.
+template<typename Text>
+static void read_node(const casa::csa::NodeEntry& entry, const casa::csa::PinEntry* pins, const Text& text, plano::types::Node& node)
+{
+    node.ID = (uintptr_t)entry.id;
+    node.Name = std::string(text(entry.type));
+    node.State = std::string(text(entry.state));
+    node.SavedState = std::string(text(entry.saved_state));
+    node.Color = ImColor(entry.color[0], entry.color[1], entry.color[2], entry.color[3]);
+    node.Size = ImVec2(entry.size[0], entry.size[1]);
+    node.Type = (plano::types::NodeType)entry.node_type;
+    uint32_t count = entry.input_count + entry.output_count;
+    node.Inputs.reserve(entry.input_count);
+    node.Outputs.reserve(entry.output_count);
+    for (uint32_t p = 0; p < count; p++) {
+        plano::types::Pin pin;
+        pin.ID = (uintptr_t)pins[p].id;
+        pin.Node = nullptr;
+        pin.Name = std::string(text(pins[p].name));
+        pin.Type = (plano::types::PinType)pins[p].type;
+        pin.Kind = (plano::types::PinKind)pins[p].kind;
+        (p < entry.input_count ? node.Inputs : node.Outputs).push_back(std::move(pin));
+    }
+}
+
+// Build node "i" of the project "in" holds, which may be an instance's copy of a table node.
+static void read_project_node(const casa::csa::Reader& in, size_t i, plano::types::Node& node, ImVec2& position)
+{
+    casa::csa::Reader::NodeRef ref = in.ProjectNode(i);
+    read_node(*ref.entry, in.Pins(*ref.entry), [&in](casa::csa::StrRef s) { return in.String(s); }, node);
+    in.ReadProperties(ref, node.Properties);
+    if (ref.instance != nullptr) {
+        node.ID = (uintptr_t)ref.id;
+        for (auto& pin : node.Inputs)
+            pin.ID = (uintptr_t)(pin.ID.Get() + ref.id_shift);
+        for (auto& pin : node.Outputs)
+            pin.ID = (uintptr_t)(pin.ID.Get() + ref.id_shift);
+    }
+    FixPinOwners(node);
+    position = ImVec2(ref.entry->position[0] + ref.offset[0], ref.entry->position[1] + ref.offset[1]);
+}
+
+static plano::types::Link read_link(const casa::csa::LinkEntry& entry)
+{
+    plano::types::Link link;
+    link.ID = (uintptr_t)entry.id;
+    link.StartPinID = (uintptr_t)entry.start_pin;
+    link.EndPinID = (uintptr_t)entry.end_pin;
+    link.Color = ImColor(entry.color[0], entry.color[1], entry.color[2], entry.color[3]);
+    return link;
+}
+
+// LoadedGraph
+struct LoadedGraph::Storage {
+    std::vector<plano::types::Node> nodes;
+    std::vector<ImVec2> positions;
+    std::vector<plano::types::Link> links;
+    uint64_t next_id = 1;
+};
+
+LoadedGraph::LoadedGraph(void) : m_Storage(std::make_unique<Storage>())
+{
+}
+
+LoadedGraph::~LoadedGraph(void)
+{
+}
+
+size_t LoadedGraph::NodeCount(void) const
+{
+    return m_Storage->nodes.size();
+}
+
+size_t LoadedGraph::LinkCount(void) const
+{
+    return m_Storage->links.size();
+}
+
+uintptr_t LoadedGraph::NodeId(size_t i) const
+{
+    return m_Storage->nodes[i].ID.Get();
+}
+
+uintptr_t LoadedGraph::LinkId(size_t i) const
+{
+    return m_Storage->links[i].ID.Get();
+}
+
+// Work items of ReadGraph(): the first node_runs build a run of nodes each, the rest a run of links.
+static const size_t kReadRun = 2048;
+
+struct ReadGraphJob {
+    const casa::csa::Reader* in;
+    std::vector<plano::types::Node>* nodes;
+    std::vector<ImVec2>* positions;
+    std::vector<plano::types::Link>* links;
+    uint32_t node_runs;
+};
+
+bool ReadGraph(const casa::csa::Reader& in, LoadedGraph& out, unsigned threads)
+{
+    LoadedGraph::Storage& st = *out.m_Storage;
+    // Every slot exists before the workers start, so the pins can point at their nodes right away.
+    st.nodes.clear();
+    st.links.clear();
+    st.nodes.resize(in.ProjectNodeCount());
+    st.positions.resize(in.ProjectNodeCount());
+    st.links.resize(in.ProjectLinkCount());
+    st.next_id = in.Header().next_id;
+
+    uint32_t node_runs = (uint32_t)((in.ProjectNodeCount() + kReadRun - 1) / kReadRun);
+    uint32_t link_runs = (uint32_t)((in.ProjectLinkCount() + kReadRun - 1) / kReadRun);
+    std::vector<uint32_t> items(node_runs + link_runs);
+    for (uint32_t i = 0; i < (uint32_t)items.size(); i++)
+        items[i] = i;
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    threads = std::max(1u, std::min(threads, (unsigned)std::max<size_t>(items.size(), 1)));
+
+    ReadGraphJob job = { &in, &st.nodes, &st.positions, &st.links, node_runs };
+    WorkStealingPool pool(threads);
+    pool.Run(items.data(), items.size(), [](void* user, uint32_t item, unsigned) {
+        const ReadGraphJob& j = *(const ReadGraphJob*)user;
+        const casa::csa::Reader& in = *j.in;
+        if (item < j.node_runs) {
+            size_t first = (size_t)item * kReadRun;
+            size_t last = std::min(first + kReadRun, in.ProjectNodeCount());
+            for (size_t n = first; n < last; n++)
+                read_project_node(in, n, (*j.nodes)[n], (*j.positions)[n]);
+        } else {
+            size_t first = (size_t)(item - j.node_runs) * kReadRun;
+            size_t last = std::min(first + kReadRun, in.ProjectLinkCount());
+            for (size_t l = first; l < last; l++)
+                (*j.links)[l] = read_link(in.ProjectLink(l));
+        }
+    }, &job);
+    return true;
+}
+
+bool BuildGraph(const std::vector<NewNode>& nodes, const std::vector<NewLink>& links, LoadedGraph& out)
+{
+    LoadedGraph::Storage& st = *out.m_Storage;
+    st = LoadedGraph::Storage();
+    st.nodes.resize(nodes.size());
+    st.positions.resize(nodes.size());
+    uint64_t id = 1;
+    for (size_t n = 0; n < nodes.size(); n++) {
+        const plano::api::NodeDescription* description = nodes[n].description;
+        if (description == nullptr) {
+            st = LoadedGraph::Storage();
+            return false;
+        }
+        plano::types::Node& node = st.nodes[n];
+        node.ID = (uintptr_t)id++;
+        node.Name = description->Type;
+        node.Color = description->Color;
+        node.Type = plano::types::NodeType::Blueprint;
+        node.Size = ImVec2(0, 0);
+        auto add_pins = [&id](const std::vector<plano::api::PinDescription>& list, plano::types::PinKind kind,
+                std::vector<plano::types::Pin>& pins) {
+            pins.reserve(list.size());
+            for (const auto& desc : list) {
+                plano::types::Pin pin;
+                pin.ID = (uintptr_t)id++;
+                pin.Node = nullptr;
+                pin.Name = desc.Label;
+                pin.Type = desc.Type;
+                pin.Kind = kind;
+                pins.push_back(std::move(pin));
+            }
+        };
+        add_pins(description->Inputs, plano::types::PinKind::Input, node.Inputs);
+        add_pins(description->Outputs, plano::types::PinKind::Output, node.Outputs);
+        if (description->InitializeDefaultProperties != nullptr)
+            description->InitializeDefaultProperties(node.Properties);
+        FixPinOwners(node);
+        st.positions[n] = nodes[n].position;
+    }
+
+    st.links.reserve(links.size());
+    for (const NewLink& l : links) {
+        if (l.from >= st.nodes.size() || l.to >= st.nodes.size() ||
+            l.output >= st.nodes[l.from].Outputs.size() || l.input >= st.nodes[l.to].Inputs.size()) {
+            st = LoadedGraph::Storage();
+            return false;
+        }
+        plano::types::Link link;
+        link.ID = (uintptr_t)id++;
+        link.StartPinID = st.nodes[l.from].Outputs[l.output].ID;
+        link.EndPinID = st.nodes[l.to].Inputs[l.input].ID;
+        link.Color = ImColor(255, 255, 255);
+        st.links.push_back(std::move(link));
+    }
+    st.next_id = id;
+    return true;
+}
+
+bool InstallIntoActiveContext(LoadedGraph& graph)
+{
+    plano::types::ContextData* ctx = plano::api::GetContext();
+    if (ctx == nullptr)
+        return false;
+    LoadedGraph::Storage& st = *graph.m_Storage;
+    // Moving the vectors keeps every node where it is, the pins' owner pointers stay good.
+    ctx->s_Nodes = std::move(st.nodes);
+    ctx->s_Links = std::move(st.links);
+    ax::NodeEditor::SetCurrentEditor(ctx->m_Editor);
+    for (size_t n = 0; n < ctx->s_Nodes.size(); n++)
+        ax::NodeEditor::SetNodePosition(ctx->s_Nodes[n].ID, st.positions[n]);
+    ctx->s_NextId = (int)st.next_id;
+    ctx->s_Dirty = false;
+    st = LoadedGraph::Storage();
+    return true;
+}
+
+// Work items of ReadGraphPart(), the same way round as ReadGraph()'s.
+struct ReadPartJob {
+    const casa::csa::Reader* in;
+    const GraphPart* part;
+    std::vector<plano::types::Node>* nodes;
+    std::vector<ImVec2>* positions;
+    std::vector<plano::types::Link>* links;
+    uint32_t node_runs;
+};
+
+bool ReadGraphPart(const casa::csa::Reader& in, const casa::csa::JournalReader* journal, const GraphPart& part,
+    LoadedGraph& out, unsigned threads)
+{
+    if (journal == nullptr && (!part.journal_nodes.empty() || !part.journal_links.empty()))
+        return false;
+    LoadedGraph::Storage& st = *out.m_Storage;
+    size_t node_count = part.nodes.size() + part.journal_nodes.size();
+    st.nodes.clear();
+    st.links.clear();
+    st.nodes.resize(node_count);
+    st.positions.resize(node_count);
+    st.links.resize(part.links.size() + part.journal_links.size());
+    st.next_id = std::max(in.Header().next_id, journal ? journal->NextId() : 0);
+
+    uint32_t node_runs = (uint32_t)((part.nodes.size() + kReadRun - 1) / kReadRun);
+    uint32_t link_runs = (uint32_t)((part.links.size() + kReadRun - 1) / kReadRun);
+    std::vector<uint32_t> items(node_runs + link_runs);
+    for (uint32_t i = 0; i < (uint32_t)items.size(); i++)
+        items[i] = i;
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    threads = std::max(1u, std::min(threads, (unsigned)std::max<size_t>(items.size(), 1)));
+
+    ReadPartJob job = { &in, &part, &st.nodes, &st.positions, &st.links, node_runs };
+    WorkStealingPool pool(threads);
+    pool.Run(items.data(), items.size(), [](void* user, uint32_t item, unsigned) {
+        const ReadPartJob& j = *(const ReadPartJob*)user;
+        const casa::csa::Reader& in = *j.in;
+        if (item < j.node_runs) {
+            size_t first = (size_t)item * kReadRun;
+            size_t last = std::min(first + kReadRun, j.part->nodes.size());
+            for (size_t n = first; n < last; n++)
+                read_project_node(in, j.part->nodes[n], (*j.nodes)[n], (*j.positions)[n]);
+        } else {
+            size_t first = (size_t)(item - j.node_runs) * kReadRun;
+            size_t last = std::min(first + kReadRun, j.part->links.size());
+            for (size_t l = first; l < last; l++)
+                (*j.links)[l] = read_link(in.ProjectLink(j.part->links[l]));
+        }
+    }, &job);
+
+    // What was saved to the journal is a handful of records, not worth a pool.
+    for (size_t r = 0; r < part.journal_nodes.size(); r++) {
+        const casa::csa::JournalRecord& record = journal->Record(part.journal_nodes[r]);
+        size_t n = part.nodes.size() + r;
+        plano::types::Node& node = st.nodes[n];
+        read_node(*record.node, record.pins, [&](casa::csa::StrRef s) { return journal->String(record, s); }, node);
+        journal->ReadProperties(record, node.Properties);
+        FixPinOwners(node);
+        st.positions[n] = ImVec2(record.node->position[0], record.node->position[1]);
+    }
+    for (size_t r = 0; r < part.journal_links.size(); r++)
+        st.links[part.links.size() + r] = read_link(*journal->Record(part.journal_links[r]).link);
+    return true;
+}
+
+bool AppendToActiveContext(LoadedGraph& graph, size_t reserve)
+{
+    plano::types::ContextData* ctx = plano::api::GetContext();
+    if (ctx == nullptr)
+        return false;
+    LoadedGraph::Storage& st = *graph.m_Storage;
+
+    const plano::types::Node* storage = ctx->s_Nodes.data();
+    size_t first = ctx->s_Nodes.size();
+    ctx->s_Nodes.reserve(std::max(reserve, first + st.nodes.size()));
+    for (auto& node : st.nodes)
+        ctx->s_Nodes.push_back(std::move(node));
+    if (ctx->s_Nodes.data() != storage) {
+        for (auto& node : ctx->s_Nodes)
+            FixPinOwners(node);
+    } else {
+        for (size_t n = first; n < ctx->s_Nodes.size(); n++)
+            FixPinOwners(ctx->s_Nodes[n]);
+    }
+    ax::NodeEditor::SetCurrentEditor(ctx->m_Editor);
+    for (size_t n = first; n < ctx->s_Nodes.size(); n++)
+        ax::NodeEditor::SetNodePosition(ctx->s_Nodes[n].ID, st.positions[n - first]);
+
+    if (!st.links.empty()) {
+        // One walk over the context finds which of the pins the links need are still there, and
+        // which inputs already have a link.
+        std::unordered_map<uintptr_t, bool> pins; // pin -> already linked as an input
+        pins.reserve(st.links.size() * 2);
+        for (const auto& link : st.links) {
+            pins.emplace(link.StartPinID.Get(), false);
+            pins.emplace(link.EndPinID.Get(), false);
+        }
+        std::unordered_set<uintptr_t> present;
+        auto look = [&](const std::vector<plano::types::Pin>& list) {
+            for (const auto& pin : list) {
+                if (pins.count(pin.ID.Get()))
+                    present.insert(pin.ID.Get());
+            }
+        };
+        for (const auto& node : ctx->s_Nodes) {
+            look(node.Inputs);
+            look(node.Outputs);
+        }
+        for (const auto& link : ctx->s_Links) {
+            auto it = pins.find(link.EndPinID.Get());
+            if (it != pins.end())
+                it->second = true;
+        }
+        ctx->s_Links.reserve(ctx->s_Links.size() + st.links.size());
+        for (auto& link : st.links) {
+            auto end = pins.find(link.EndPinID.Get());
+            if (!present.count(link.StartPinID.Get()) || !present.count(link.EndPinID.Get()) || end->second)
+                continue;
+            end->second = true;
+            ctx->s_Links.push_back(std::move(link));
+        }
+    }
+    ctx->s_NextId = std::max(ctx->s_NextId, (int)st.next_id);
+    st = LoadedGraph::Storage();
+    return true;
+}
+
+void DrawLinkStubs(const std::vector<LinkStub>& stubs)
+{
+    plano::types::ContextData* ctx = plano::api::GetContext();
+    if (ctx == nullptr || stubs.empty())
+        return;
+    ax::NodeEditor::SetCurrentEditor(ctx->m_Editor);
+    const ImGuiViewport* viewport = ImGui::GetMainViewport();
+    ImVec2 clip_min = viewport->WorkPos;
+    ImVec2 clip_max = ImVec2(viewport->WorkPos.x + viewport->WorkSize.x, viewport->WorkPos.y + viewport->WorkSize.y);
+    ImDrawList* draw = ImGui::GetForegroundDrawList();
+    draw->PushClipRect(clip_min, clip_max);
+    const ImU32 color = IM_COL32(255, 255, 255, 110);
+    const float dash = 6.0f;
+    const float gap = 4.0f;
+    for (const LinkStub& stub : stubs) {
+        ImVec2 position = ax::NodeEditor::GetNodePosition(stub.node);
+        if (position.x == FLT_MAX)
+            continue; // deleted since
+        ImVec2 size = ax::NodeEditor::GetNodeSize(stub.node);
+        float y = position.y + size.y * (float)(stub.pin + 1) / (float)(stub.pin_count + 1);
+        ImVec2 from = ax::NodeEditor::CanvasToScreen(ImVec2(stub.output ? position.x + size.x : position.x, y));
+        if (from.y < clip_min.y || from.y > clip_max.y || from.x < clip_min.x - 64.0f || from.x > clip_max.x + 64.0f)
+            continue;
+        float dir = stub.output ? 1.0f : -1.0f;
+        for (int d = 0; d < 4; d++) {
+            float at = from.x + dir * d * (dash + gap);
+            draw->AddLine(ImVec2(at, from.y), ImVec2(at + dir * dash, from.y), color, 2.0f);
+        }
+        draw->AddCircle(ImVec2(from.x + dir * (4 * (dash + gap) + 3.0f), from.y), 3.0f, color);
+    }
+    draw->PopClipRect();
+}
+
+bool ReadIntoActiveContext(const casa::csa::Reader& in, unsigned threads)
+{
+    if (plano::api::GetContext() == nullptr)
+        return false;
+    LoadedGraph graph;
+    return ReadGraph(in, graph, threads) && InstallIntoActiveContext(graph);
+}
+
+bool ReplayIntoActiveContext(const casa::csa::JournalReader& in)
+{
+    plano::types::ContextData* ctx = plano::api::GetContext();
+    if (ctx == nullptr)
+        return false;
+
+    ContextIndex index;
+    IndexActiveContext(index);
+    for (size_t r = 0; r < in.RecordCount(); r++) {
+        const casa::csa::JournalRecord& record = in.Record(r);
+        switch (record.kind) {
+        case casa::csa::RecordKind::SetNode: {
+            NodeRecord node;
+            node.id = (uintptr_t)record.id;
+            node.node = std::make_shared<plano::types::Node>();
+            read_node(*record.node, record.pins, [&](casa::csa::StrRef s) { return in.String(record, s); }, *node.node);
+            in.ReadProperties(record, node.node->Properties);
+            node.position = ImVec2(record.node->position[0], record.node->position[1]);
+            RemoveNode(node.id, index);
+            InsertNode(node, index);
+            break;
+        }
+        case casa::csa::RecordKind::EraseNode:
+            RemoveNode((uintptr_t)record.id, index);
+            break;
+        case casa::csa::RecordKind::SetLink: {
+            LinkRecord link;
+            link.id = (uintptr_t)record.id;
+            link.link = std::make_shared<plano::types::Link>(read_link(*record.link));
+            RemoveLink(link.id, index);
+            InsertLink(link, index);
+            break;
+        }
+        case casa::csa::RecordKind::EraseLink:
+            RemoveLink((uintptr_t)record.id, index);
+            break;
+        }
+    }
+    ctx->s_NextId = std::max(ctx->s_NextId, (int)in.NextId());
+    ctx->s_Dirty = false;
+    return true;
+}
+
+} // end namespace bridge
+} // end namespace casa
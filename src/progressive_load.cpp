@@ -0,0 +1,352 @@
+#include "progressive_load.h"
+#include "plano_api.h"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+
+namespace casa {
+namespace doc {
+
+static const float kViewMargin = 0.5f;        // Half a view more on every side
+static const size_t kSliceNodes = 16384;      // Nodes the worker hands over at a time
+
+static double ms_since(std::chrono::steady_clock::time_point from)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - from).count();
+}
+
+// Planning
+namespace {
+struct PinEnd {
+    uint64_t node;
+    uint32_t pin;
+    uint32_t count;
+    bool output;
+};
+} // end anonymous namespace
+
+bool PlanLoad(const casa::csa::Reader& in, const casa::csa::JournalReader* journal, float margin, LoadPlan& out)
+{
+    out = LoadPlan();
+    if (in.TileCount() == 0)
+        return false;
+    const casa::csa::FileHeader& header = in.Header();
+
+    // The journal's last word on every id it mentions.
+    std::unordered_map<uint64_t, uint32_t> node_records;
+    std::unordered_map<uint64_t, uint32_t> link_records;
+    for (size_t r = 0; journal && r < journal->RecordCount(); r++) {
+        const casa::csa::JournalRecord& record = journal->Record(r);
+        bool node = record.kind == casa::csa::RecordKind::SetNode || record.kind == casa::csa::RecordKind::EraseNode;
+        (node ? node_records : link_records)[record.id] = (uint32_t)r;
+    }
+    auto replaced = [](const std::unordered_map<uint64_t, uint32_t>& records, uint64_t id) {
+        return !records.empty() && records.count(id) != 0;
+    };
+
+    // The region to build first.
+    float view[4] = { header.view[0], header.view[1], header.view[2], header.view[3] };
+    if (!(view[2] > view[0] && view[3] > view[1]) || !std::isfinite(view[2] - view[0]) || !std::isfinite(view[3] - view[1])) {
+        size_t fullest = 0;
+        for (size_t t = 1; t < in.TileCount(); t++) {
+            if (in.Tile(t).count > in.Tile(fullest).count)
+                fullest = t;
+        }
+        const casa::csa::TileEntry& tile = in.Tile(fullest);
+        view[0] = tile.x * header.tile_size;
+        view[1] = tile.y * header.tile_size;
+        view[2] = view[0] + header.tile_size;
+        view[3] = view[1] + header.tile_size;
+    }
+    float width = view[2] - view[0];
+    float height = view[3] - view[1];
+    float region[4] = { view[0] - width * margin, view[1] - height * margin, view[2] + width * margin, view[3] + height * margin };
+    double tile_min_x = std::floor((double)region[0] / header.tile_size);
+    double tile_min_y = std::floor((double)region[1] / header.tile_size);
+    double tile_max_x = std::floor((double)region[2] / header.tile_size);
+    double tile_max_y = std::floor((double)region[3] / header.tile_size);
+
+    // Nodes: the file's in the region's tiles first, in file order, then the journal's by position.
+    std::vector<uint8_t> in_first(in.ProjectNodeCount(), 0);
+    for (size_t t = 0; t < in.TileCount(); t++) {
+        const casa::csa::TileEntry& tile = in.Tile(t);
+        if (tile.x < tile_min_x || tile.x > tile_max_x || tile.y < tile_min_y || tile.y > tile_max_y)
+            continue;
+        const uint32_t* nodes = in.TileNodes(tile);
+        for (uint32_t k = 0; k < tile.count; k++) {
+            uint32_t n = nodes[k];
+            if (replaced(node_records, in.ProjectNode(n).id))
+                continue;
+            in_first[n] = 1;
+            out.first.nodes.push_back(n);
+        }
+    }
+    std::sort(out.first.nodes.begin(), out.first.nodes.end());
+    out.rest.nodes.reserve(in.ProjectNodeCount() - out.first.nodes.size());
+    for (uint32_t n = 0; n < (uint32_t)in.ProjectNodeCount(); n++) {
+        if (!in_first[n] && (node_records.empty() || !replaced(node_records, in.ProjectNode(n).id)))
+            out.rest.nodes.push_back(n);
+    }
+
+    std::vector<uint32_t> set_nodes;
+    std::vector<uint32_t> set_links;
+    for (const auto& kv : node_records) {
+        if (journal->Record(kv.second).kind == casa::csa::RecordKind::SetNode)
+            set_nodes.push_back(kv.second);
+    }
+    for (const auto& kv : link_records) {
+        if (journal->Record(kv.second).kind == casa::csa::RecordKind::SetLink)
+            set_links.push_back(kv.second);
+    }
+    std::sort(set_nodes.begin(), set_nodes.end());
+    std::sort(set_links.begin(), set_links.end());
+    for (uint32_t r : set_nodes) {
+        const float* p = journal->Record(r).node->position;
+        bool inside = p[0] >= region[0] && p[0] <= region[2] && p[1] >= region[1] && p[1] <= region[3];
+        (inside ? out.first : out.rest).journal_nodes.push_back(r);
+    }
+    out.node_count = out.first.nodes.size() + out.rest.nodes.size() + set_nodes.size();
+
+    // Links: between two nodes of the first part they go with it, the rest wait for the last
+    // slice, and those with one end in the first part leave a stub there until then.
+    std::unordered_map<uint64_t, PinEnd> pins;
+    auto add_pins = [&pins](const casa::csa::NodeEntry& node, const casa::csa::PinEntry* list, uint64_t id_shift) {
+        uint32_t count = node.input_count + node.output_count;
+        for (uint32_t p = 0; p < count; p++) {
+            bool output = p >= node.input_count;
+            PinEnd end = { node.id + id_shift, output ? p - node.input_count : p, output ? node.output_count : node.input_count, output };
+            pins.emplace(list[p].id + id_shift, end);
+        }
+    };
+    for (uint32_t n : out.first.nodes) {
+        casa::csa::Reader::NodeRef node = in.ProjectNode(n);
+        add_pins(*node.entry, in.Pins(*node.entry), node.id_shift);
+    }
+    for (uint32_t r : out.first.journal_nodes)
+        add_pins(*journal->Record(r).node, journal->Record(r).pins, 0);
+
+    auto sort_link = [&](uint64_t start_pin, uint64_t end_pin, uint32_t index, bool from_journal) {
+        auto start = pins.find(start_pin);
+        auto end = pins.find(end_pin);
+        bool has_start = start != pins.end();
+        bool has_end = end != pins.end();
+        casa::bridge::GraphPart& part = has_start && has_end ? out.first : out.rest;
+        (from_journal ? part.journal_links : part.links).push_back(index);
+        if (has_start != has_end) {
+            const PinEnd& loaded = has_start ? start->second : end->second;
+            casa::bridge::LinkStub stub;
+            stub.node = (uintptr_t)loaded.node;
+            stub.output = loaded.output;
+            stub.pin = loaded.pin;
+            stub.pin_count = loaded.count;
+            out.stubs.push_back(stub);
+        }
+    };
+    for (uint32_t l = 0; l < (uint32_t)in.ProjectLinkCount(); l++) {
+        casa::csa::LinkEntry link = in.ProjectLink(l);
+        if (!replaced(link_records, link.id))
+            sort_link(link.start_pin, link.end_pin, l, false);
+    }
+    for (uint32_t r : set_links) {
+        const casa::csa::LinkEntry& link = *journal->Record(r).link;
+        sort_link(link.start_pin, link.end_pin, r, true);
+    }
+    // An output feeding many far nodes needs its stub once.
+    auto key = [](const casa::bridge::LinkStub& s) { return std::make_tuple(s.node, s.output, s.pin); };
+    std::sort(out.stubs.begin(), out.stubs.end(), [&key](const auto& a, const auto& b) { return key(a) < key(b); });
+    out.stubs.erase(std::unique(out.stubs.begin(), out.stubs.end(), [&key](const auto& a, const auto& b) { return key(a) == key(b); }),
+        out.stubs.end());
+    return true;
+}
+
+// ProgressiveLoader
+ProgressiveLoader::ProgressiveLoader(void)
+{
+}
+
+ProgressiveLoader::~ProgressiveLoader(void)
+{
+    Cancel();
+}
+
+bool ProgressiveLoader::Begin(const std::string& path, uint64_t* journal_stamp)
+{
+    Cancel();
+    m_Status = ProgressiveLoadStatus();
+    m_Started = std::chrono::steady_clock::now();
+    if (plano::api::GetContext() == nullptr)
+        return false;
+
+    // The header alone says whether it's worth it, before anything is decompressed.
+    auto load = std::make_unique<Load>();
+    load->path = path;
+    load->context = plano::api::GetContext();
+    casa::csa::FileHeader header;
+    if (!load->file.Open(path.c_str()) || !casa::csa::ReadProjectHeader(load->file.Data(), load->file.Size(), header) ||
+        header.tiles.count == 0 || header.nodes.count + header.instance_nodes < m_MinNodes)
+        return false;
+    const char* data = load->file.Data();
+    size_t size = load->file.Size();
+    if (casa::csa::IsCompressedProject(data, size)) {
+        if (!load->decompressed.Open(data, size))
+            return false;
+        data = load->decompressed.Data();
+        size = load->decompressed.Size();
+        load->file.Close();
+    }
+    if (!load->source.Open(data, size))
+        return false;
+    uint64_t stamp = load->source.Header().journal_stamp;
+    load->has_journal = stamp != 0 && load->journal.Open(casa::csa::JournalPath(path, stamp), stamp);
+    const casa::csa::JournalReader* journal = load->has_journal ? &load->journal : nullptr;
+    if (!PlanLoad(load->source, journal, kViewMargin, load->plan))
+        return false;
+
+    // Room for every node up front, so the slices never move the ones the user is working on.
+    casa::bridge::LoadedGraph first;
+    if (!casa::bridge::ReadGraphPart(load->source, journal, load->plan.first, first) ||
+        !casa::bridge::AppendToActiveContext(first, load->plan.node_count))
+        return false;
+    plano::api::ClearProjectDirtyFlag();
+    if (journal_stamp)
+        *journal_stamp = stamp;
+
+    m_Status.streaming = true;
+    m_Status.loaded_nodes = load->plan.first.nodes.size() + load->plan.first.journal_nodes.size();
+    m_Status.node_count = load->plan.node_count;
+    m_Status.stubs = load->plan.stubs.size();
+    load->plan.first = casa::bridge::GraphPart();
+    m_FramePending = true;
+
+    // One core stays with the UI thread.
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency() - 1);
+    load->worker = std::async(std::launch::async, &ProgressiveLoader::Build, load.get(), threads);
+    m_Load = std::move(load);
+    return true;
+}
+
+bool ProgressiveLoader::Update(void)
+{
+    if (!m_Load)
+        return false;
+    if (plano::api::GetContext() != m_Load->context) {
+        Cancel(); // the context went away under it
+        return false;
+    }
+    return Install(false);
+}
+
+void ProgressiveLoader::FrameDone(void)
+{
+    if (m_FramePending) {
+        m_FramePending = false;
+        m_Status.first_frame_ms = ms_since(m_Started);
+    }
+}
+
+void ProgressiveLoader::DrawStubs(void) const
+{
+    if (m_Load)
+        casa::bridge::DrawLinkStubs(m_Load->plan.stubs);
+}
+
+void ProgressiveLoader::Finish(void)
+{
+    if (!m_Load)
+        return;
+    if (plano::api::GetContext() != m_Load->context) {
+        Cancel();
+        return;
+    }
+    m_Load->worker.wait();
+    Install(true);
+}
+
+void ProgressiveLoader::Cancel(void)
+{
+    // The last load's numbers go too, they were about a project that is going away.
+    m_Status = ProgressiveLoadStatus();
+    m_FramePending = false;
+    if (!m_Load)
+        return;
+    {
+        std::lock_guard<std::mutex> lk(m_Load->lock);
+        m_Load->cancel = true;
+    }
+    m_Load->worker.wait();
+    m_Load.reset();
+}
+
+// Appends what the worker has built, all of it or until the frame's budget is spent.
+bool ProgressiveLoader::Install(bool all)
+{
+    auto started = std::chrono::steady_clock::now();
+    bool changed = false;
+    for (;;) {
+        std::unique_ptr<casa::bridge::LoadedGraph> graph;
+        bool last = false;
+        {
+            std::lock_guard<std::mutex> lk(m_Load->lock);
+            if (!m_Load->ready.empty()) {
+                graph = std::move(m_Load->ready.front());
+                m_Load->ready.pop_front();
+            }
+            last = m_Load->done && m_Load->ready.empty();
+        }
+        if (graph) {
+            m_Status.loaded_nodes += graph->NodeCount();
+            casa::bridge::AppendToActiveContext(*graph, m_Status.node_count);
+            changed = true;
+        }
+        if (last) {
+            Complete();
+            return changed;
+        }
+        if (!graph || (!all && ms_since(started) >= m_BudgetMs))
+            return changed;
+    }
+}
+
+void ProgressiveLoader::Complete(void)
+{
+    m_Status.full_ms = ms_since(m_Started);
+    m_Status.streaming = false;
+    m_Status.stubs = 0;
+    m_Load.reset();
+}
+
+// Worker thread
+void ProgressiveLoader::Build(Load* load, unsigned threads)
+{
+    const casa::bridge::GraphPart& rest = load->plan.rest;
+    const casa::csa::JournalReader* journal = load->has_journal ? &load->journal : nullptr;
+    size_t slices = (rest.nodes.size() + kSliceNodes - 1) / kSliceNodes;
+    for (size_t s = 0; s <= slices; s++) {
+        {
+            std::lock_guard<std::mutex> lk(load->lock);
+            if (load->cancel)
+                return;
+        }
+        casa::bridge::GraphPart part;
+        if (s < slices) {
+            size_t first = s * kSliceNodes;
+            size_t last = std::min(first + kSliceNodes, rest.nodes.size());
+            part.nodes.assign(rest.nodes.begin() + first, rest.nodes.begin() + last);
+        } else {
+            // Every node is on its way now, so every link that's left can come.
+            part.journal_nodes = rest.journal_nodes;
+            part.links = rest.links;
+            part.journal_links = rest.journal_links;
+        }
+        auto graph = std::make_unique<casa::bridge::LoadedGraph>();
+        casa::bridge::ReadGraphPart(load->source, journal, part, *graph, threads);
+        std::lock_guard<std::mutex> lk(load->lock);
+        load->ready.push_back(std::move(graph));
+        load->done = s == slices;
+    }
+}
+
+} // end namespace doc
+} // end namespace casa
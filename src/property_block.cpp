@@ -0,0 +1,36 @@
+#include "property_block.h"
+#include <vector>
+
+namespace casa {
+namespace props {
+
+struct BlockTableHooks {
+    void (*clear)(void);
+    void (*forget)(const Properties*);
+};
+
+static std::vector<BlockTableHooks>& block_tables()
+{
+    static std::vector<BlockTableHooks> tables;
+    return tables;
+}
+
+void RegisterBlockTable(void (*clear)(void), void (*forget)(const Properties*))
+{
+    block_tables().push_back(BlockTableHooks{ clear, forget });
+}
+
+void ResetBlocks(void)
+{
+    for (const auto& table : block_tables())
+        table.clear();
+}
+
+void ForgetBlocks(const Properties* p)
+{
+    for (const auto& table : block_tables())
+        table.forget(p);
+}
+
+} // end namespace props
+} // end namespace casa
@@ -1,28 +1,127 @@
 #include "save_load_file.h"
 #include "tinyfiledialogs.h"
 #include "node_defs/casa_nodes.h"
+#include "property_block.h"
+#include "plano_bridge.h"
+#include "csa_format.h"
+#include "csa_compress.h"
+#include "mapped_file.h"
+#include "csa_journal.h"
+#include "output_sink.h"
+#include "progressive_load.h"
+#include <cstdio>
+#include <filesystem>
+#include <system_error>
 
-int save_project_file(const char* file_address)
+// The journal stamp in the header of the binary project at "file_address", 0 if there is none.
+static uint64_t journal_stamp_of(const char* file_address)
 {
-    size_t save_size;
-    char* cbuffer = plano::api::SaveNodesAndLinksToBuffer(&save_size);
-    auto ofs = std::ofstream(file_address);
-    ofs << std::string(cbuffer);
+    casa::io::MappedFile file;
+    casa::csa::FileHeader header;
+    if (!file.Open(file_address) || !casa::csa::ReadProjectHeader(file.Data(), file.Size(), header))
+        return 0;
+    return header.journal_stamp;
+}
+
+int save_project_file(const char* file_address, uint64_t* journal_stamp, bool compress, bool dedupe, std::string* error,
+    casa::csa::DedupeStats* dedupe_stats)
+{
+    // The writer streams the project into the file a chunk at a time, straight from plano's nodes.
+    // It goes to a temporary file first and replaces the project in one rename once it's all on
+    // disk, so the project and the journal its header names always belong together.
+    uint64_t old_stamp = journal_stamp_of(file_address);
+    uint64_t stamp = casa::csa::NewJournalStamp();
+    std::string temp = std::string(file_address) + ".tmp";
+    casa::csa::Writer writer;
+    writer.SetJournalStamp(stamp);
+    writer.SetDedupe(dedupe);
+    bool written = false;
+    std::string why;
+    {
+        casa::io::FileSink file;
+        if (!file.Open(temp.c_str())) {
+            why = "can't create " + temp;
+        } else {
+            if (compress) {
+                casa::csa::CompressingSink blocks(file);
+                written = writer.Write(blocks, casa::bridge::WriteActiveContext) && blocks.Finish();
+            } else {
+                written = writer.Write(file, casa::bridge::WriteActiveContext);
+            }
+            written = file.Sync() && written;
+            written = file.Close() && written;
+            if (!written)
+                why = "can't write " + temp;
+        }
+    }
+    std::error_code ec;
+    if (written) {
+        std::filesystem::rename(temp, file_address, ec);
+        if (ec)
+            why = "can't replace " + std::string(file_address) + ": " + ec.message();
+    }
+    if (!why.empty()) {
+        std::filesystem::remove(temp, ec);
+        if (error)
+            *error = why;
+        return -1;
+    }
+
+    // The old journal continued the file that was just replaced.
+    if (old_stamp != 0)
+        std::filesystem::remove(casa::csa::JournalPath(file_address, old_stamp), ec);
+    if (journal_stamp)
+        *journal_stamp = stamp;
+    if (dedupe_stats)
+        *dedupe_stats = dedupe ? writer.Dedupe() : casa::csa::DedupeStats();
     return 0;
 }
 
-void load_project_file(const char* file_address)
+bool load_project_file(const char* file_address, uint64_t* journal_stamp, std::string* error)
 {
     assert(plano::api::GetContext() != nullptr); // Context was not empty before a load. Set context to null or destroy the old context first.
+    if (journal_stamp)
+        *journal_stamp = 0;
 
-    // Load the project file
-    std::ifstream inf(file_address);
-    std::stringstream ssbuf;
-    ssbuf << inf.rdbuf();
-    std::string sbuf = ssbuf.str();
-    size_t load_size = sbuf.size();
-    plano::api::LoadNodesAndLinksFromBuffer(load_size, sbuf.c_str());
+    // Load the project file.  Binary projects are read straight out of the mapping, compressed
+    // ones out of memory they are decompressed into, then the edits saved to their journal
+    // since are replayed on top.  Older text projects are handed to plano's parser.
+    casa::io::MappedFile file;
+    if (!file.Open(file_address)) {
+        if (error)
+            *error = "can't open " + std::string(file_address);
+        return false;
+    }
+    const char* data = file.Data();
+    size_t size = file.Size();
+    casa::csa::DecompressedProject decompressed;
+    if (casa::csa::IsCompressedProject(data, size)) {
+        if (!decompressed.Open(data, size, error))
+            return false;
+        data = decompressed.Data();
+        size = decompressed.Size();
+        file.Close();
+    }
+    if (casa::csa::IsBinaryProject(data, size)) {
+        casa::csa::Reader reader;
+        if (!reader.Open(data, size, error))
+            return false;
+        casa::bridge::ReadIntoActiveContext(reader);
+        uint64_t stamp = reader.Header().journal_stamp;
+        casa::csa::JournalReader journal;
+        if (stamp != 0 && journal.Open(casa::csa::JournalPath(file_address, stamp), stamp))
+            casa::bridge::ReplayIntoActiveContext(journal);
+        if (journal_stamp)
+            *journal_stamp = stamp;
+    } else {
+        // plano's parser wants a terminated string, which the mapping doesn't promise.
+        std::string sbuf(data ? data : "", size);
+        plano::api::LoadNodesAndLinksFromBuffer(sbuf.size(), sbuf.c_str());
+    }
 
+    // Loading filled the Properties maps directly, re-read the property blocks from them.
+    casa::props::ResetBlocks();
+    return true;
 }
 
 // Thread stuff
@@ -57,9 +156,20 @@ void handle_load_save_dialogs(plano_state_flags& pstate, const plano::types::Con
         {
             const char* save_file = save_file_future.get();
             if (save_file) {
-                save_project_file(save_file);
-                plano::api::ClearProjectDirtyFlag();
-                pstate.last_save_file_address = std::string(save_file);
+                if (pstate.loader)
+                    pstate.loader->Finish(); // the whole project, not just what has streamed in so far
+                std::string error;
+                if (save_project_file(save_file, &pstate.journal_stamp, pstate.compress_saves, pstate.dedupe_saves, &error,
+                        &pstate.last_dedupe) == 0) {
+                    plano::api::ClearProjectDirtyFlag();
+                    pstate.last_save_file_address = std::string(save_file);
+                } else {
+                    // The project stays dirty, and whatever was to follow the save doesn't happen.
+                    pstate.file_error = "The project was not saved: " + error;
+                    pstate.waiting_on_quit = false;
+                    pstate.waiting_on_os_load_dialog = false;
+                    pstate.waiting_on_new = false;
+                }
             }
             else {
                 // Save was cancelled in the save dialog
@@ -94,6 +204,8 @@ void handle_load_save_dialogs(plano_state_flags& pstate, const plano::types::Con
         {
             const char* load_file = load_file_future.get();
             if (load_file) {
+                if (pstate.loader)
+                    pstate.loader->Cancel();
                 if (pstate.context_a != nullptr)
                 {
                     plano::api::DestroyContext(pstate.context_a);
@@ -101,7 +213,15 @@ void handle_load_save_dialogs(plano_state_flags& pstate, const plano::types::Con
                 pstate.context_a = plano::api::CreateContext(cbk, "../plano/data/");
                 plano::api::SetContext(pstate.context_a);
                 RegiserNodesToActiveContext();
-                load_project_file(load_file);
+                // A large project opens around its saved view and streams in the rest, anything else loads whole.
+                std::string error;
+                if (pstate.progressive_load && pstate.loader && pstate.loader->Begin(load_file, &pstate.journal_stamp))
+                    casa::props::ResetBlocks();
+                else if (!load_project_file(load_file, &pstate.journal_stamp, &error))
+                    pstate.file_error = "The project could not be loaded: " + error; // it is left empty
+                // A binary project saves back where it came from, the next save only appends to its journal.
+                pstate.last_save_file_address = pstate.journal_stamp != 0 ? std::string(load_file) : "";
+                pstate.project_generation++;
             }
             else {
                 ; // load cancelled in UI
@@ -114,9 +234,15 @@ void handle_load_save_dialogs(plano_state_flags& pstate, const plano::types::Con
     // New handling.  This creates a new project.
     if (pstate.waiting_on_new && !pstate.waiting_on_os_save_dialog)
     {
+        if (pstate.loader)
+            pstate.loader->Cancel();
         pstate.context_a = plano::api::CreateContext(cbk, "../plano/data/");
         plano::api::SetContext(pstate.context_a);
         RegiserNodesToActiveContext();
+        casa::props::ResetBlocks();
+        pstate.journal_stamp = 0;
+        pstate.last_save_file_address = "";
+        pstate.project_generation++;
 
         // Book keeping
         pstate.waiting_on_new = false;
@@ -133,6 +259,24 @@ void handle_load_save_dialogs(plano_state_flags& pstate, const plano::types::Con
 
 void handle_menu_state(plano_state_flags& pstate)
 {
+    // Draw modal window when a save or load failed.
+    if (!pstate.file_error.empty() && !ImGui::IsPopupOpen("file_error"))
+    {
+        ImGui::OpenPopup("file_error");
+        ImVec2 center = ImGui::GetMainViewport()->GetCenter();
+        ImGui::SetNextWindowPos(center, ImGuiCond_Appearing, ImVec2(0.5f, 0.5f));
+    }
+    if (ImGui::BeginPopupModal("file_error", NULL, ImGuiWindowFlags_AlwaysAutoResize))
+    {
+        ImGui::Text("%s", pstate.file_error.c_str());
+        if (ImGui::Button("OK"))
+        {
+            pstate.file_error.clear();
+            ImGui::CloseCurrentPopup();
+        }
+        ImGui::EndPopup();
+    }
+
     // Draw modal window when the user chooses "load", but has unsaved changes.
 // handle menu popups after menus are closed.
 // see https://github.com/ocornut/imgui/issues/331
@@ -0,0 +1,260 @@
+#include "simd_kernels.h"
+#include <atomic>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CASA_SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define CASA_TARGET_SSE
+#define CASA_TARGET_AVX2
+#else
+#define CASA_TARGET_SSE __attribute__((target("sse4.1")))
+#define CASA_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#else
+#define CASA_SIMD_X86 0
+#endif
+
+namespace casa {
+namespace simd {
+
+// Kernels
+// Each macro writes the scalar, SSE and AVX2 version of one kernel.  The vector loops leave the
+// tail to the scalar expression, so lane counts don't have to be a multiple of 8.
+#define CASA_SCALAR_BINARY(name, T, expr) \
+    static void name##_scalar(T* out, const T* a, const T* b, uint32_t n) \
+    { \
+        for (uint32_t i = 0; i < n; i++) { \
+            T x = a[i], y = b[i]; \
+            out[i] = expr; \
+        } \
+    }
+
+#define CASA_VECTOR_BINARY(name, T, expr, target, width, load, store, op) \
+    target static void name(T* out, const T* a, const T* b, uint32_t n) \
+    { \
+        uint32_t i = 0; \
+        for (; i + width <= n; i += width) \
+            store(out + i, op(load(a + i), load(b + i))); \
+        for (; i < n; i++) { \
+            T x = a[i], y = b[i]; \
+            out[i] = expr; \
+        } \
+    }
+
+#define CASA_LOAD_PS(p) _mm_loadu_ps(p)
+#define CASA_STORE_PS(p, v) _mm_storeu_ps(p, v)
+#define CASA_LOAD_PS256(p) _mm256_loadu_ps(p)
+#define CASA_STORE_PS256(p, v) _mm256_storeu_ps(p, v)
+#define CASA_LOAD_SI(p) _mm_loadu_si128((const __m128i*)(p))
+#define CASA_STORE_SI(p, v) _mm_storeu_si128((__m128i*)(p), v)
+#define CASA_LOAD_SI256(p) _mm256_loadu_si256((const __m256i*)(p))
+#define CASA_STORE_SI256(p, v) _mm256_storeu_si256((__m256i*)(p), v)
+
+#if CASA_SIMD_X86
+#define CASA_BINARY_F(name, expr, sse_op, avx_op) \
+    CASA_SCALAR_BINARY(name, float, expr) \
+    CASA_VECTOR_BINARY(name##_sse, float, expr, CASA_TARGET_SSE, 4, CASA_LOAD_PS, CASA_STORE_PS, sse_op) \
+    CASA_VECTOR_BINARY(name##_avx2, float, expr, CASA_TARGET_AVX2, 8, CASA_LOAD_PS256, CASA_STORE_PS256, avx_op)
+#define CASA_BINARY_I(name, expr, sse_op, avx_op) \
+    CASA_SCALAR_BINARY(name, int32_t, expr) \
+    CASA_VECTOR_BINARY(name##_sse, int32_t, expr, CASA_TARGET_SSE, 4, CASA_LOAD_SI, CASA_STORE_SI, sse_op) \
+    CASA_VECTOR_BINARY(name##_avx2, int32_t, expr, CASA_TARGET_AVX2, 8, CASA_LOAD_SI256, CASA_STORE_SI256, avx_op)
+#else
+#define CASA_BINARY_F(name, expr, sse_op, avx_op) CASA_SCALAR_BINARY(name, float, expr)
+#define CASA_BINARY_I(name, expr, sse_op, avx_op) CASA_SCALAR_BINARY(name, int32_t, expr)
+#endif
+
+// min/max are written the way minps/maxps behave, so NaNs come out the same at every level.
+CASA_BINARY_F(add_f, x + y, _mm_add_ps, _mm256_add_ps)
+CASA_BINARY_F(sub_f, x - y, _mm_sub_ps, _mm256_sub_ps)
+CASA_BINARY_F(mul_f, x * y, _mm_mul_ps, _mm256_mul_ps)
+CASA_BINARY_F(min_f, x < y ? x : y, _mm_min_ps, _mm256_min_ps)
+CASA_BINARY_F(max_f, x > y ? x : y, _mm_max_ps, _mm256_max_ps)
+// Integer overflow wraps in the vector versions, do the same in the scalar ones.
+CASA_BINARY_I(add_i, (int32_t)((uint32_t)x + (uint32_t)y), _mm_add_epi32, _mm256_add_epi32)
+CASA_BINARY_I(sub_i, (int32_t)((uint32_t)x - (uint32_t)y), _mm_sub_epi32, _mm256_sub_epi32)
+CASA_BINARY_I(mul_i, (int32_t)((uint32_t)x * (uint32_t)y), _mm_mullo_epi32, _mm256_mullo_epi32)
+
+static void mul_add_f_scalar(float* out, const float* a, const float* b, const float* c, uint32_t n)
+{
+    for (uint32_t i = 0; i < n; i++) {
+        float product = a[i] * b[i];
+        out[i] = product + c[i];
+    }
+}
+
+static void int_to_float_scalar(float* out, const int32_t* a, uint32_t n)
+{
+    for (uint32_t i = 0; i < n; i++)
+        out[i] = (float)a[i];
+}
+
+#if CASA_SIMD_X86
+CASA_TARGET_SSE static void mul_add_f_sse(float* out, const float* a, const float* b, const float* c, uint32_t n)
+{
+    uint32_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_ps(out + i, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)), _mm_loadu_ps(c + i)));
+    mul_add_f_scalar(out + i, a + i, b + i, c + i, n - i);
+}
+
+CASA_TARGET_AVX2 static void mul_add_f_avx2(float* out, const float* a, const float* b, const float* c, uint32_t n)
+{
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)), _mm256_loadu_ps(c + i)));
+    mul_add_f_scalar(out + i, a + i, b + i, c + i, n - i);
+}
+
+CASA_TARGET_SSE static void int_to_float_sse(float* out, const int32_t* a, uint32_t n)
+{
+    uint32_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_ps(out + i, _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(a + i))));
+    int_to_float_scalar(out + i, a + i, n - i);
+}
+
+CASA_TARGET_AVX2 static void int_to_float_avx2(float* out, const int32_t* a, uint32_t n)
+{
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(out + i, _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)(a + i))));
+    int_to_float_scalar(out + i, a + i, n - i);
+}
+#endif
+
+// Dispatch
+struct KernelTable {
+    void (*add_f)(float*, const float*, const float*, uint32_t);
+    void (*sub_f)(float*, const float*, const float*, uint32_t);
+    void (*mul_f)(float*, const float*, const float*, uint32_t);
+    void (*min_f)(float*, const float*, const float*, uint32_t);
+    void (*max_f)(float*, const float*, const float*, uint32_t);
+    void (*mul_add_f)(float*, const float*, const float*, const float*, uint32_t);
+    void (*add_i)(int32_t*, const int32_t*, const int32_t*, uint32_t);
+    void (*sub_i)(int32_t*, const int32_t*, const int32_t*, uint32_t);
+    void (*mul_i)(int32_t*, const int32_t*, const int32_t*, uint32_t);
+    void (*int_to_float)(float*, const int32_t*, uint32_t);
+};
+
+static const KernelTable scalar_kernels = {
+    add_f_scalar, sub_f_scalar, mul_f_scalar, min_f_scalar, max_f_scalar, mul_add_f_scalar,
+    add_i_scalar, sub_i_scalar, mul_i_scalar, int_to_float_scalar,
+};
+#if CASA_SIMD_X86
+static const KernelTable sse_kernels = {
+    add_f_sse, sub_f_sse, mul_f_sse, min_f_sse, max_f_sse, mul_add_f_sse,
+    add_i_sse, sub_i_sse, mul_i_sse, int_to_float_sse,
+};
+static const KernelTable avx2_kernels = {
+    add_f_avx2, sub_f_avx2, mul_f_avx2, min_f_avx2, max_f_avx2, mul_add_f_avx2,
+    add_i_avx2, sub_i_avx2, mul_i_avx2, int_to_float_avx2,
+};
+#endif
+
+static const KernelTable* table_for(Level level)
+{
+#if CASA_SIMD_X86
+    return level == Level::AVX2 ? &avx2_kernels : level == Level::SSE ? &sse_kernels : &scalar_kernels;
+#else
+    (void)level;
+    return &scalar_kernels;
+#endif
+}
+
+// Set by SetLevel(), nullptr until then.  Kernels run on the evaluator's threads, so the choice
+// is an atomic and the detected level a function-local static, which C++ initializes only once.
+static std::atomic<const KernelTable*> chosen_kernels{ nullptr };
+
+Level Detect(void)
+{
+#if CASA_SIMD_X86 && defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 1);
+    bool sse41 = (info[2] & (1 << 19)) != 0;
+    bool os_avx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+    __cpuidex(info, 7, 0);
+    bool avx2 = os_avx && (info[1] & (1 << 5)) != 0;
+    return avx2 ? Level::AVX2 : sse41 ? Level::SSE : Level::Scalar;
+#elif CASA_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return Level::AVX2;
+    if (__builtin_cpu_supports("sse4.1"))
+        return Level::SSE;
+    return Level::Scalar;
+#else
+    return Level::Scalar;
+#endif
+}
+
+void SetLevel(Level level)
+{
+    Level best = Detect();
+    if ((int)level > (int)best)
+        level = best;
+    chosen_kernels.store(table_for(level), std::memory_order_release);
+}
+
+static Level detected_level(void)
+{
+    static const Level level = Detect();
+    return level;
+}
+
+Level Active(void)
+{
+    const KernelTable* chosen = chosen_kernels.load(std::memory_order_acquire);
+    if (chosen == nullptr)
+        return detected_level();
+#if CASA_SIMD_X86
+    return chosen == &avx2_kernels ? Level::AVX2 : chosen == &sse_kernels ? Level::SSE : Level::Scalar;
+#else
+    return Level::Scalar;
+#endif
+}
+
+const char* LevelName(Level level)
+{
+    switch (level) {
+    case Level::AVX2: return "AVX2";
+    case Level::SSE: return "SSE4.1";
+    default: return "scalar";
+    }
+}
+
+static const KernelTable& kernels(void)
+{
+    const KernelTable* chosen = chosen_kernels.load(std::memory_order_acquire);
+    if (chosen != nullptr)
+        return *chosen;
+    return *table_for(detected_level());
+}
+
+void AddF(float* out, const float* a, const float* b, uint32_t n) { kernels().add_f(out, a, b, n); }
+void SubF(float* out, const float* a, const float* b, uint32_t n) { kernels().sub_f(out, a, b, n); }
+void MulF(float* out, const float* a, const float* b, uint32_t n) { kernels().mul_f(out, a, b, n); }
+void MinF(float* out, const float* a, const float* b, uint32_t n) { kernels().min_f(out, a, b, n); }
+void MaxF(float* out, const float* a, const float* b, uint32_t n) { kernels().max_f(out, a, b, n); }
+void MulAddF(float* out, const float* a, const float* b, const float* c, uint32_t n) { kernels().mul_add_f(out, a, b, c, n); }
+void AddI(int32_t* out, const int32_t* a, const int32_t* b, uint32_t n) { kernels().add_i(out, a, b, n); }
+void SubI(int32_t* out, const int32_t* a, const int32_t* b, uint32_t n) { kernels().sub_i(out, a, b, n); }
+void MulI(int32_t* out, const int32_t* a, const int32_t* b, uint32_t n) { kernels().mul_i(out, a, b, n); }
+void IntToFloat(float* out, const int32_t* a, uint32_t n) { kernels().int_to_float(out, a, n); }
+
+void FillF(float* out, float v, uint32_t n)
+{
+    for (uint32_t i = 0; i < n; i++)
+        out[i] = v;
+}
+
+void FillI(int32_t* out, int32_t v, uint32_t n)
+{
+    for (uint32_t i = 0; i < n; i++)
+        out[i] = v;
+}
+
+} // end namespace simd
+} // end namespace casa
@@ -0,0 +1,120 @@
+#include "texture_decode.h"
+#include <algorithm>
+#include <thread>
+
+namespace casa {
+namespace gfx {
+
+TextureDecoder::TextureDecoder(DecodeFn decode, unsigned threads)
+    : m_Decode(decode)
+{
+    if (threads == 0) {
+        unsigned cores = std::thread::hardware_concurrency();
+        threads = cores > 1 ? cores - 1 : 1;
+    }
+    for (unsigned t = 0; t < threads; t++)
+        m_Workers.push_back(std::async(std::launch::async, &TextureDecoder::WorkerLoop, this));
+}
+
+TextureDecoder::~TextureDecoder(void)
+{
+    {
+        std::lock_guard<std::mutex> lk(m_Lock);
+        m_Stop = true;
+    }
+    m_Wake.notify_all();
+    for (std::future<void>& worker : m_Workers)
+        worker.wait();
+}
+
+// UI thread
+void TextureDecoder::Request(uint64_t handle, const std::string& path)
+{
+    {
+        std::lock_guard<std::mutex> lk(m_Lock);
+        uint64_t ticket = m_NextTicket++;
+        m_Tickets[handle] = ticket;
+        m_Queue.push_back({ handle, ticket, path });
+    }
+    m_Wake.notify_one();
+}
+
+void TextureDecoder::Cancel(uint64_t handle)
+{
+    // Its job or image stays queued, and is dropped when it comes up.
+    std::lock_guard<std::mutex> lk(m_Lock);
+    m_Tickets.erase(handle);
+}
+
+size_t TextureDecoder::TakeDecoded(size_t budget, std::vector<DecodedImage>& out)
+{
+    std::lock_guard<std::mutex> lk(m_Lock);
+    size_t taken = 0;
+    size_t bytes = 0;
+    while (!m_Done.empty()) {
+        Finished& done = m_Done.front();
+        if (!Current(done.image.handle, done.ticket)) {
+            m_Done.pop_front();
+            continue;
+        }
+        if (taken > 0 && bytes + done.image.Bytes() > budget)
+            break;
+        bytes += done.image.Bytes();
+        m_Tickets.erase(done.image.handle);
+        out.push_back(std::move(done.image));
+        m_Done.pop_front();
+        taken++;
+    }
+    return taken;
+}
+
+size_t TextureDecoder::Pending(void) const
+{
+    std::lock_guard<std::mutex> lk(m_Lock);
+    return m_Tickets.size();
+}
+
+bool TextureDecoder::Current(uint64_t handle, uint64_t ticket) const
+{
+    auto it = m_Tickets.find(handle);
+    return it != m_Tickets.end() && it->second == ticket;
+}
+
+// Worker threads
+void TextureDecoder::WorkerLoop(void)
+{
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lk(m_Lock);
+            for (;;) {
+                m_Wake.wait(lk, [&] { return m_Stop || !m_Queue.empty(); });
+                if (m_Stop)
+                    return;
+                job = std::move(m_Queue.front());
+                m_Queue.pop_front();
+                if (Current(job.handle, job.ticket))
+                    break;
+            }
+        }
+
+        DecodedImage image;
+        if (!m_Decode(job.path.c_str(), image) || image.width <= 0 || image.height <= 0 ||
+            image.pixels.size() != (size_t)image.width * (size_t)image.height * 4) {
+            if (image.error.empty())
+                image.error = "can't decode " + job.path;
+            image.width = 0;
+            image.height = 0;
+            image.pixels.clear();
+            image.pixels.shrink_to_fit();
+        }
+        image.handle = job.handle;
+
+        std::lock_guard<std::mutex> lk(m_Lock);
+        if (Current(job.handle, job.ticket))
+            m_Done.push_back({ job.ticket, std::move(image) });
+    }
+}
+
+} // end namespace gfx
+} // end namespace casa
@@ -0,0 +1,376 @@
+#include "undo_history.h"
+#include "graph_eval.h"
+#include "property_block.h"
+#include <algorithm>
+#include <cfloat>
+#include <utility>
+
+namespace casa {
+namespace undo {
+
+using casa::eval::PinValue;
+using casa::eval::ValueBank;
+
+bool Entry::Empty(void) const
+{
+    return added_nodes.empty() && removed_nodes.empty() && added_links.empty() && removed_links.empty() && properties.empty();
+}
+
+static void box(PinValue& v, bool b) { v.b = b; }
+static void box(PinValue& v, int i) { v.i = i; }
+static void box(PinValue& v, float f) { v.f = f; }
+static void box(PinValue& v, const std::string& s) { v.s = s; }
+
+// Append a change for every key whose value differs between the two maps, or that only one has.
+template<typename Map>
+static void diff_map(uintptr_t node, ValueBank bank, const Map& before, const Map& after, std::vector<PropertyChange>& out)
+{
+    for (const auto& kv : after) {
+        auto it = before.find(kv.first);
+        if (it != before.end() && it->second == kv.second)
+            continue;
+        PropertyChange c;
+        c.node = node;
+        c.bank = bank;
+        c.key = kv.first;
+        c.had_after = true;
+        box(c.after, kv.second);
+        if (it != before.end()) {
+            c.had_before = true;
+            box(c.before, it->second);
+        }
+        out.push_back(std::move(c));
+    }
+    for (const auto& kv : before) {
+        if (after.count(kv.first))
+            continue;
+        PropertyChange c;
+        c.node = node;
+        c.bank = bank;
+        c.key = kv.first;
+        c.had_before = true;
+        box(c.before, kv.second);
+        out.push_back(std::move(c));
+    }
+}
+
+template<typename Map, typename T>
+static void put(Map& map, const std::string& key, bool present, const T& value)
+{
+    if (present)
+        map[key] = value;
+    else
+        map.erase(key);
+}
+
+static void apply_change(Properties& p, const PropertyChange& c, bool forward)
+{
+    bool present = forward ? c.had_after : c.had_before;
+    const PinValue& v = forward ? c.after : c.before;
+    switch (c.bank) {
+    case ValueBank::Bool: put(p.pbool, c.key, present, v.b); break;
+    case ValueBank::Int: put(p.pint, c.key, present, v.i); break;
+    case ValueBank::Float: put(p.pfloat, c.key, present, v.f); break;
+    case ValueBank::String: put(p.pstring, c.key, present, v.s); break;
+    default: break;
+    }
+}
+
+static size_t entry_bytes(const Entry& e)
+{
+    size_t bytes = sizeof(e);
+    for (const auto& r : e.added_nodes)
+        bytes += casa::bridge::RecordBytes(r);
+    for (const auto& r : e.removed_nodes)
+        bytes += casa::bridge::RecordBytes(r);
+    for (const auto& r : e.added_links)
+        bytes += casa::bridge::RecordBytes(r);
+    for (const auto& r : e.removed_links)
+        bytes += casa::bridge::RecordBytes(r);
+    for (const auto& c : e.properties)
+        bytes += sizeof(c) + c.key.capacity() + c.before.s.capacity() + c.after.s.capacity();
+    return bytes;
+}
+
+// True when "changes" edits exactly the keys the entry already holds, ie. the same widget again.
+static bool same_keys(const Entry& e, const std::vector<PropertyChange>& changes)
+{
+    if (e.properties.size() != changes.size())
+        return false;
+    for (const auto& c : changes) {
+        auto it = std::find_if(e.properties.begin(), e.properties.end(), [&c](const PropertyChange& o) {
+            return o.node == c.node && o.bank == c.bank && o.key == c.key;
+        });
+        if (it == e.properties.end())
+            return false;
+    }
+    return true;
+}
+
+// History
+History::History(size_t budget_bytes) : m_Budget(budget_bytes)
+{
+    casa::eval::AddEditListener(&History::OnEdit, this);
+}
+
+History::~History(void)
+{
+    casa::eval::RemoveEditListener(&History::OnEdit, this);
+}
+
+void History::OnEdit(void* user, const Properties* p)
+{
+    uintptr_t node = casa::bridge::NodeOfProperties(p);
+    if (node != 0)
+        ((History*)user)->m_Touched.push_back(node);
+}
+
+void History::Clear(void)
+{
+    m_Undo.clear();
+    m_Redo.clear();
+    m_Bytes = 0;
+    m_Touched.clear();
+    m_Nodes.clear();
+    m_Links.clear();
+    m_Context = plano::api::GetContext();
+    casa::bridge::IndexActiveContext(m_Index);
+    for (const auto& kv : m_Index.nodes) {
+        casa::bridge::NodeRecord record;
+        if (casa::bridge::CopyNode(kv.first, m_Index, record))
+            m_Nodes.emplace(kv.first, std::move(record));
+    }
+    for (const auto& kv : m_Index.links) {
+        casa::bridge::LinkRecord record;
+        if (casa::bridge::CopyLink(kv.first, m_Index, record))
+            m_Links.emplace(kv.first, std::move(record));
+    }
+}
+
+bool History::DiffProperties(uintptr_t node, std::vector<PropertyChange>& out)
+{
+    auto shadow = m_Nodes.find(node);
+    if (shadow == m_Nodes.end())
+        return true; // Added this frame, SyncTopology() records it whole
+    Properties* live = casa::bridge::FindProperties(node, m_Index);
+    if (live == nullptr)
+        return false;
+    const Properties& before = casa::bridge::RecordProperties(std::as_const(shadow->second));
+    size_t first = out.size();
+    diff_map(node, ValueBank::Bool, before.pbool, live->pbool, out);
+    diff_map(node, ValueBank::Int, before.pint, live->pint, out);
+    diff_map(node, ValueBank::Float, before.pfloat, live->pfloat, out);
+    diff_map(node, ValueBank::String, before.pstring, live->pstring, out);
+    if (out.size() != first)
+        casa::bridge::RecordProperties(shadow->second) = *live;
+    return true;
+}
+
+void History::SyncPositions(void)
+{
+    casa::bridge::SelectedNodes(m_Selected);
+    for (uintptr_t id : m_Selected) {
+        auto shadow = m_Nodes.find(id);
+        ImVec2 position;
+        // The editor answers FLT_MAX for a node it no longer has.
+        if (shadow != m_Nodes.end() && casa::bridge::NodePosition(id, position) && position.x != FLT_MAX)
+            shadow->second.position = position;
+    }
+}
+
+void History::Update(bool interacting)
+{
+    if (plano::api::GetContext() != m_Context) {
+        Clear();
+        return;
+    }
+    SyncPositions();
+
+    std::vector<PropertyChange> changes;
+    std::sort(m_Touched.begin(), m_Touched.end());
+    m_Touched.erase(std::unique(m_Touched.begin(), m_Touched.end()), m_Touched.end());
+    bool reindexed = false;
+    for (uintptr_t node : m_Touched) {
+        if (!DiffProperties(node, changes) && !reindexed) {
+            // Nodes moved in plano's storage since the last sync.
+            casa::bridge::IndexActiveContext(m_Index);
+            reindexed = true;
+            DiffProperties(node, changes);
+        }
+    }
+    m_Touched.clear();
+
+    if (!changes.empty()) {
+        Entry* top = m_Undo.empty() ? nullptr : &m_Undo.back();
+        if (top != nullptr && top->open && same_keys(*top, changes)) {
+            for (auto& c : changes) {
+                for (auto& o : top->properties) {
+                    if (o.node == c.node && o.bank == c.bank && o.key == c.key) {
+                        o.had_after = c.had_after;
+                        o.after = std::move(c.after);
+                    }
+                }
+            }
+        } else {
+            Entry entry;
+            entry.properties = std::move(changes);
+            entry.open = interacting;
+            Record(std::move(entry));
+        }
+    }
+    if (!interacting && !m_Undo.empty())
+        m_Undo.back().open = false;
+}
+
+void History::SyncTopology(void)
+{
+    Sync(true);
+}
+
+void History::Adopt(void)
+{
+    Sync(false);
+}
+
+void History::Sync(bool record)
+{
+    if (plano::api::GetContext() != m_Context) {
+        Clear();
+        return;
+    }
+    casa::bridge::IndexActiveContext(m_Index);
+
+    Entry entry;
+    for (const auto& kv : m_Index.nodes) {
+        if (m_Nodes.count(kv.first))
+            continue;
+        casa::bridge::NodeRecord copy;
+        if (casa::bridge::CopyNode(kv.first, m_Index, copy)) {
+            m_Nodes.emplace(kv.first, copy);
+            if (record)
+                entry.added_nodes.push_back(std::move(copy));
+        }
+    }
+    for (auto it = m_Nodes.begin(); it != m_Nodes.end();) {
+        if (m_Index.nodes.count(it->first)) {
+            ++it;
+            continue;
+        }
+        if (record)
+            entry.removed_nodes.push_back(std::move(it->second));
+        it = m_Nodes.erase(it);
+    }
+    for (const auto& kv : m_Index.links) {
+        if (m_Links.count(kv.first))
+            continue;
+        casa::bridge::LinkRecord copy;
+        if (casa::bridge::CopyLink(kv.first, m_Index, copy)) {
+            m_Links.emplace(kv.first, copy);
+            if (record)
+                entry.added_links.push_back(std::move(copy));
+        }
+    }
+    for (auto it = m_Links.begin(); it != m_Links.end();) {
+        if (m_Index.links.count(it->first)) {
+            ++it;
+            continue;
+        }
+        if (record)
+            entry.removed_links.push_back(std::move(it->second));
+        it = m_Links.erase(it);
+    }
+    if (!entry.Empty())
+        Record(std::move(entry));
+}
+
+void History::Record(Entry&& entry)
+{
+    for (const auto& e : m_Redo)
+        m_Bytes -= e.bytes;
+    m_Redo.clear();
+    if (!m_Undo.empty())
+        m_Undo.back().open = false;
+    entry.bytes = entry_bytes(entry);
+    m_Bytes += entry.bytes;
+    m_Undo.push_back(std::move(entry));
+    Trim();
+}
+
+// Drop the oldest entries until the journal fits, but always keep the newest one.
+void History::Trim(void)
+{
+    while (m_Bytes > m_Budget && m_Undo.size() > 1) {
+        m_Bytes -= m_Undo.front().bytes;
+        m_Undo.pop_front();
+    }
+}
+
+void History::SetBudget(size_t bytes)
+{
+    m_Budget = bytes;
+    Trim();
+}
+
+void History::Apply(const Entry& entry, bool forward)
+{
+    using namespace casa::bridge;
+    const auto& insert_nodes = forward ? entry.added_nodes : entry.removed_nodes;
+    const auto& erase_nodes = forward ? entry.removed_nodes : entry.added_nodes;
+    const auto& insert_links = forward ? entry.added_links : entry.removed_links;
+    const auto& erase_links = forward ? entry.removed_links : entry.added_links;
+
+    for (const auto& c : entry.properties) {
+        Properties* live = FindProperties(c.node, m_Index);
+        auto shadow = m_Nodes.find(c.node);
+        if (live == nullptr || shadow == m_Nodes.end())
+            continue;
+        apply_change(*live, c, forward);
+        apply_change(RecordProperties(shadow->second), c, forward);
+        casa::props::ForgetBlocks(live);
+        casa::eval::MarkPropertiesDirty(live);
+    }
+    if (!entry.properties.empty())
+        MarkActiveContextDirty();
+
+    // Links go before the nodes they hang off, and come back after them.
+    for (const auto& r : erase_links)
+        if (RemoveLink(r.id, m_Index))
+            m_Links.erase(r.id);
+    for (const auto& r : erase_nodes)
+        if (RemoveNode(r.id, m_Index))
+            m_Nodes.erase(r.id);
+    for (const auto& r : insert_nodes)
+        if (InsertNode(r, m_Index))
+            m_Nodes[r.id] = r;
+    for (const auto& r : insert_links)
+        if (InsertLink(r, m_Index))
+            m_Links[r.id] = r;
+
+    // Node storage moved, the property blocks are keyed by address.
+    if (!insert_nodes.empty() || !erase_nodes.empty())
+        casa::props::ResetBlocks();
+}
+
+bool History::Undo(void)
+{
+    if (m_Undo.empty() || plano::api::GetContext() != m_Context)
+        return false;
+    Apply(m_Undo.back(), false);
+    m_Undo.back().open = false;
+    m_Redo.push_back(std::move(m_Undo.back()));
+    m_Undo.pop_back();
+    return true;
+}
+
+bool History::Redo(void)
+{
+    if (m_Redo.empty() || plano::api::GetContext() != m_Context)
+        return false;
+    Apply(m_Redo.back(), true);
+    m_Undo.push_back(std::move(m_Redo.back()));
+    m_Redo.pop_back();
+    return true;
+}
+
+} // end namespace undo
+} // end namespace casa
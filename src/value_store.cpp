@@ -0,0 +1,171 @@
+#include "value_store.h"
+
+using plano::types::PinType;
+
+namespace casa {
+namespace eval {
+
+ValueBank BankOf(PinType type)
+{
+    switch (type) {
+    case PinType::Flow:
+    case PinType::Bool:
+    case PinType::Delegate:
+        return ValueBank::Bool;
+    case PinType::Int:
+        return ValueBank::Int;
+    case PinType::Float:
+        return ValueBank::Float;
+    case PinType::String:
+        return ValueBank::String;
+    default:
+        return ValueBank::None;
+    }
+}
+
+Slot AllocateSlot(uint32_t* bank_size, PinType type)
+{
+    ValueBank bank = BankOf(type);
+    if (bank == ValueBank::None)
+        return kNoSlot;
+    return MakeSlot(bank, bank_size[(uint32_t)bank]++);
+}
+
+void ValueStore::Reset(const uint32_t* bank_size)
+{
+    m_Bools.assign(bank_size[(uint32_t)ValueBank::Bool], 0);
+    m_Ints.assign(bank_size[(uint32_t)ValueBank::Int], 0);
+    m_Floats.assign(bank_size[(uint32_t)ValueBank::Float], 0.0f);
+    m_Strings.assign(bank_size[(uint32_t)ValueBank::String], std::string());
+}
+
+void ValueStore::Clear(void)
+{
+    m_Bools.clear();
+    m_Ints.clear();
+    m_Floats.clear();
+    m_Strings.clear();
+}
+
+static const std::string empty_string;
+
+bool ValueStore::GetBool(Slot slot) const
+{
+    uint32_t i = SlotIndex(slot);
+    switch (SlotBank(slot)) {
+    case ValueBank::Bool: return m_Bools[i] != 0;
+    case ValueBank::Int: return m_Ints[i] != 0;
+    case ValueBank::Float: return m_Floats[i] != 0.0f;
+    case ValueBank::String: return !m_Strings[i].empty();
+    default: return false;
+    }
+}
+
+int32_t ValueStore::GetInt(Slot slot) const
+{
+    uint32_t i = SlotIndex(slot);
+    switch (SlotBank(slot)) {
+    case ValueBank::Bool: return m_Bools[i];
+    case ValueBank::Int: return m_Ints[i];
+    case ValueBank::Float: return (int32_t)m_Floats[i];
+    default: return 0;
+    }
+}
+
+float ValueStore::GetFloat(Slot slot) const
+{
+    uint32_t i = SlotIndex(slot);
+    switch (SlotBank(slot)) {
+    case ValueBank::Bool: return m_Bools[i] ? 1.0f : 0.0f;
+    case ValueBank::Int: return (float)m_Ints[i];
+    case ValueBank::Float: return m_Floats[i];
+    default: return 0.0f;
+    }
+}
+
+const std::string& ValueStore::GetString(Slot slot) const
+{
+    if (SlotBank(slot) != ValueBank::String)
+        return empty_string;
+    return m_Strings[SlotIndex(slot)];
+}
+
+void ValueStore::SetBool(Slot slot, bool v)
+{
+    uint32_t i = SlotIndex(slot);
+    switch (SlotBank(slot)) {
+    case ValueBank::Bool: m_Bools[i] = v; break;
+    case ValueBank::Int: m_Ints[i] = v; break;
+    case ValueBank::Float: m_Floats[i] = v ? 1.0f : 0.0f; break;
+    case ValueBank::String: m_Strings[i] = v ? "true" : "false"; break;
+    default: break;
+    }
+}
+
+void ValueStore::SetInt(Slot slot, int32_t v)
+{
+    uint32_t i = SlotIndex(slot);
+    switch (SlotBank(slot)) {
+    case ValueBank::Bool: m_Bools[i] = v != 0; break;
+    case ValueBank::Int: m_Ints[i] = v; break;
+    case ValueBank::Float: m_Floats[i] = (float)v; break;
+    case ValueBank::String: m_Strings[i] = std::to_string(v); break;
+    default: break;
+    }
+}
+
+void ValueStore::SetFloat(Slot slot, float v)
+{
+    uint32_t i = SlotIndex(slot);
+    switch (SlotBank(slot)) {
+    case ValueBank::Bool: m_Bools[i] = v != 0.0f; break;
+    case ValueBank::Int: m_Ints[i] = (int32_t)v; break;
+    case ValueBank::Float: m_Floats[i] = v; break;
+    case ValueBank::String: m_Strings[i] = std::to_string(v); break;
+    default: break;
+    }
+}
+
+void ValueStore::SetString(Slot slot, const std::string& v)
+{
+    uint32_t i = SlotIndex(slot);
+    switch (SlotBank(slot)) {
+    case ValueBank::Bool: m_Bools[i] = !v.empty(); break;
+    case ValueBank::String: m_Strings[i] = v; break;
+    default: break; // no parsing numbers out of strings
+    }
+}
+
+void ValueStore::Load(Slot slot, PinValue& out) const
+{
+    out.b = GetBool(slot);
+    out.i = GetInt(slot);
+    out.f = GetFloat(slot);
+    out.s = GetString(slot);
+}
+
+void ValueStore::Store(Slot slot, const PinValue& v)
+{
+    uint32_t i = SlotIndex(slot);
+    switch (SlotBank(slot)) {
+    case ValueBank::Bool: m_Bools[i] = v.b; break;
+    case ValueBank::Int: m_Ints[i] = v.i; break;
+    case ValueBank::Float: m_Floats[i] = v.f; break;
+    case ValueBank::String: m_Strings[i] = v.s; break;
+    default: break;
+    }
+}
+
+uint32_t ValueStore::Count(ValueBank bank) const
+{
+    switch (bank) {
+    case ValueBank::Bool: return (uint32_t)m_Bools.size();
+    case ValueBank::Int: return (uint32_t)m_Ints.size();
+    case ValueBank::Float: return (uint32_t)m_Floats.size();
+    case ValueBank::String: return (uint32_t)m_Strings.size();
+    default: return 1;
+    }
+}
+
+} // end namespace eval
+} // end namespace casa
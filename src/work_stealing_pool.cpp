@@ -0,0 +1,124 @@
+#include "work_stealing_pool.h"
+
+namespace casa {
+
+WorkStealingPool::WorkStealingPool(unsigned worker_count)
+{
+    if (worker_count == 0)
+        worker_count = 1;
+    for (unsigned w = 0; w < worker_count; w++)
+        m_Queues.push_back(std::make_unique<WorkerQueue>());
+    // Worker 0 is whoever calls Run(), so only spawn the others.
+    for (unsigned w = 1; w < worker_count; w++)
+        m_Threads.emplace_back(&WorkStealingPool::ThreadMain, this, w);
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    {
+        std::lock_guard<std::mutex> lk(m_WakeLock);
+        m_Stop = true;
+    }
+    m_Wake.notify_all();
+    for (auto& t : m_Threads)
+        t.join();
+}
+
+void WorkStealingPool::Run(const uint32_t* items, size_t count, TaskFn task, void* user)
+{
+    if (count == 0)
+        return;
+
+    m_Task = task;
+    m_User = user;
+    m_Outstanding.store((int64_t)count, std::memory_order_relaxed);
+
+    // Deal the seeds out round robin so every worker starts with something local.
+    const unsigned workers = WorkerCount();
+    for (size_t i = 0; i < count; i++) {
+        WorkerQueue& q = *m_Queues[i % workers];
+        std::lock_guard<std::mutex> lk(q.lock);
+        q.items.push_back(items[i]);
+    }
+
+    if (!m_Threads.empty()) {
+        std::lock_guard<std::mutex> lk(m_WakeLock);
+        m_Active.store((unsigned)m_Threads.size(), std::memory_order_relaxed);
+        m_Generation++;
+    }
+    m_Wake.notify_all();
+
+    WorkLoop(0);
+
+    // Don't return (and let the caller free "user") while a background worker may still touch it.
+    while (m_Active.load(std::memory_order_acquire) != 0)
+        std::this_thread::yield();
+    m_Task = nullptr;
+    m_User = nullptr;
+}
+
+void WorkStealingPool::Push(unsigned worker, uint32_t item)
+{
+    // Count it before it becomes visible, so nobody can see Outstanding hit 0 early.
+    m_Outstanding.fetch_add(1, std::memory_order_relaxed);
+    WorkerQueue& q = *m_Queues[worker];
+    std::lock_guard<std::mutex> lk(q.lock);
+    q.items.push_back(item);
+}
+
+void WorkStealingPool::ThreadMain(unsigned worker)
+{
+    uint64_t seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lk(m_WakeLock);
+            m_Wake.wait(lk, [&] { return m_Stop || m_Generation != seen; });
+            if (m_Stop)
+                return;
+            seen = m_Generation;
+        }
+        WorkLoop(worker);
+        m_Active.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+void WorkStealingPool::WorkLoop(unsigned worker)
+{
+    uint32_t item;
+    while (m_Outstanding.load(std::memory_order_acquire) > 0) {
+        if (PopLocal(worker, item) || Steal(worker, item)) {
+            m_Task(m_User, item, worker);
+            m_Outstanding.fetch_sub(1, std::memory_order_acq_rel);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+bool WorkStealingPool::PopLocal(unsigned worker, uint32_t& item)
+{
+    WorkerQueue& q = *m_Queues[worker];
+    std::lock_guard<std::mutex> lk(q.lock);
+    if (q.items.empty())
+        return false;
+    item = q.items.back();
+    q.items.pop_back();
+    return true;
+}
+
+bool WorkStealingPool::Steal(unsigned worker, uint32_t& item)
+{
+    const unsigned workers = WorkerCount();
+    for (unsigned i = 1; i < workers; i++) {
+        WorkerQueue& q = *m_Queues[(worker + i) % workers];
+        std::lock_guard<std::mutex> lk(q.lock);
+        if (q.items.empty())
+            continue;
+        item = q.items.front();
+        q.items.pop_front();
+        return true;
+    }
+    return false;
+}
+
+} // end namespace casa